@@ -0,0 +1,122 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+
+#include <bassoon/array_encoder.hpp>
+#include <bassoon/array_writer.hpp>
+#include <bassoon/concrete_encoder.hpp>
+#include <bassoon/document_hash.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/encoder_stats.hpp>
+
+#include "../test/allocation_counter.hpp"
+
+// Heap allocations and bytes allocated per document, next to the time,
+// for each way of encoding a document. Anything but zero for the
+// encoder over an array_writer is a regression; see test_allocations.
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::allocation_scope;
+
+  using buffer_type = std::array<byte_t, 1024>;
+
+  template<typename Encoder_type>
+  void encode_record(Encoder_type& document) {
+    document.encode_int32("id", 1);
+    document.encode_utf8_string("name", "a name");
+    document.encode_floating_point("score", 2.5);
+    auto&& address = document.start_subdocument("address");
+    address.encode_utf8_string("city", "Springfield");
+    address.encode_int32("code", 12345);
+    address.finish();
+    auto&& tags = document.start_subarray("tags");
+    tags.encode_utf8_string("0", "a");
+    tags.encode_utf8_string("1", "b");
+    tags.finish();
+  }
+
+  template<typename Body>
+  void run_counted(benchmark::State& state, Body body) {
+    allocation_scope scope;
+    for (auto _ : state) {
+      body();
+      benchmark::ClobberMemory();
+    }
+    // Taken before setting the counters, which allocates.
+    auto const counts = scope.counts();
+    double const documents = static_cast<double>(state.iterations());
+    state.counters["allocations"] = counts.allocations / documents;
+    state.counters["allocated_bytes"] = counts.bytes / documents;
+  }
+
+  void BM_Encoder(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, [&] {
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer);
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(document.ok());
+      });
+  }
+  BENCHMARK(BM_Encoder);
+
+  void BM_EncoderWithStatistics(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, [&] {
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer, thread_encoder_stats());
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(document.ok());
+      });
+  }
+  BENCHMARK(BM_EncoderWithStatistics);
+
+  void BM_HashingWriter(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, [&] {
+        auto writer = make_array_writer(buffer);
+        auto hashing = make_hashing_writer(writer);
+        auto document = start_document(hashing);
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(hashing.digest());
+      });
+  }
+  BENCHMARK(BM_HashingWriter);
+
+  void BM_ArrayEncoder(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, [&] {
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer);
+        make_array_encoder(document.start_subarray("values"))
+          .encode_int32(1)
+          .encode_utf8_string("two")
+          .encode_floating_point(3.0)
+          .encode_boolean(true)
+          .finish();
+        document.finish();
+        benchmark::DoNotOptimize(document.ok());
+      });
+  }
+  BENCHMARK(BM_ArrayEncoder);
+
+  void BM_ConcreteEncoder(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, [&] {
+        auto writer = make_array_writer(buffer);
+        concrete_encoder<decltype(writer)> document(writer);
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(writer.ok());
+      });
+  }
+  BENCHMARK(BM_ConcreteEncoder);
+
+} // namespace
+
+BENCHMARK_MAIN();
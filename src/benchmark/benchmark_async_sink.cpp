@@ -0,0 +1,168 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bassoon/async_sink.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+// Writing a file of encoded batches through an async_sink, on each
+// backend, against encoding each batch and then blocking in write()
+// on it. The argument is the batch size.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  std::size_t const k_file_size = std::size_t(64) << 20;
+
+  std::string temporary_path() {
+    char const* directory = std::getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/bassoon-benchmark-output";
+  }
+
+  // A simple fixed size writer, for the synchronous baseline.
+  class batch_writer {
+  public:
+    using base_cursor_type = byte_t*;
+    using cursor = linear_cursor<batch_writer>;
+
+    explicit batch_writer(std::vector<byte_t>& buffer)
+      : base_(buffer.data())
+      , capacity_(buffer.size())
+      , used_(0) {}
+
+    bool reserve(std::size_t size) noexcept {
+      return capacity_ - used_ >= size;
+    }
+
+    cursor position() noexcept {
+      return cursor(*this, base_ + used_);
+    }
+
+    bool ok() const noexcept {
+      return true;
+    }
+
+    std::size_t distance(const cursor& a, const cursor& b) noexcept {
+      return std::distance(a.address(), b.address());
+    }
+
+    void write(void const* data, std::size_t size) noexcept {
+      std::memcpy(base_ + used_, data, size);
+      used_ += size;
+    }
+
+    void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+      std::memcpy(cursor.address(), data, size);
+    }
+
+    std::size_t valid() const noexcept {
+      return used_;
+    }
+
+  private:
+    byte_t* base_;
+    std::size_t capacity_;
+    std::size_t used_;
+  };
+
+  template<typename Writer_type>
+  bool encode_record(Writer_type& writer, std::int64_t i) {
+    auto document = start_document(writer);
+    document.encode_int64("_id", i);
+    document.encode_utf8_string("region", "region-7");
+    document.encode_utc_datetime("time", 1500000000000LL + i);
+    auto&& detail = document.start_subdocument("detail");
+    detail.encode_utf8_string("message", "something happened somewhere, and then something else");
+    detail.encode_floating_point("score", i * 0.25);
+    detail.finish();
+    document.finish();
+    return document.ok();
+  }
+
+  // Fills a batch with whole records, less than one record short of
+  // 'size'.
+  template<typename Writer_type>
+  void fill_batch(Writer_type& writer, std::size_t size, std::int64_t& i) {
+    while (writer.valid() + 256 <= size && encode_record(writer, i))
+      ++i;
+  }
+
+  void BM_SyncWrite(benchmark::State& state) {
+    std::size_t const batch = state.range(0);
+    std::string const path = temporary_path();
+    std::vector<byte_t> buffer(batch);
+    for (auto _ : state) {
+      int const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      std::int64_t i = 0;
+      for (std::size_t written = 0; written < k_file_size;) {
+        batch_writer writer(buffer);
+        fill_batch(writer, batch, i);
+        ssize_t const result = ::write(fd, buffer.data(), writer.valid());
+        if (result <= 0) {
+          state.SkipWithError("write failed");
+          break;
+        }
+        written += result;
+      }
+      ::close(fd);
+    }
+    ::unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * k_file_size);
+  }
+
+  void async_sink_benchmark(benchmark::State& state, async_sink_backend backend) {
+    async_sink_options options;
+    options.buffer_size = state.range(0);
+    options.backend = backend;
+
+    std::string const path = temporary_path();
+    for (auto _ : state) {
+      int const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      {
+        async_sink sink(fd, options);
+        if (sink.backend() != backend) {
+          state.SkipWithError("backend not available");
+          break;
+        }
+        std::int64_t i = 0;
+        for (std::size_t submitted = 0; submitted < k_file_size;) {
+          async_sink_buffer* const buffer = sink.acquire();
+          if (!buffer)
+            break;
+          fill_batch(*buffer, options.buffer_size, i);
+          submitted += buffer->valid();
+          sink.submit(buffer);
+        }
+        if (!sink.flush())
+          state.SkipWithError("write failed");
+      }
+      ::close(fd);
+    }
+    ::unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * k_file_size);
+  }
+
+  void BM_AsyncSinkIoUring(benchmark::State& state) {
+    async_sink_benchmark(state, async_sink_backend::io_uring);
+  }
+
+  void BM_AsyncSinkThreadPool(benchmark::State& state) {
+    async_sink_benchmark(state, async_sink_backend::thread_pool);
+  }
+
+  BENCHMARK(BM_SyncWrite)->RangeMultiplier(4)->Range(64 << 10, 4 << 20)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_AsyncSinkIoUring)->RangeMultiplier(4)->Range(64 << 10, 4 << 20)->Unit(benchmark::kMillisecond)->UseRealTime();
+  BENCHMARK(BM_AsyncSinkThreadPool)->RangeMultiplier(4)->Range(64 << 10, 4 << 20)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
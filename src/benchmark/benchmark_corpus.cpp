@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <bassoon/corpus_generator.hpp>
+#include <bassoon/decoder_handler.hpp>
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/streaming_decoder.hpp>
+
+// Decoding over the generated corpus presets, so that results can be
+// compared between versions on the same documents. Each corpus is
+// about 16MB, generated with seed 1.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  std::size_t const k_corpus_size = 16 << 20;
+
+  std::vector<byte_t> const& get_corpus(corpus_preset preset) {
+    static std::vector<byte_t> corpora[4];
+    std::vector<byte_t>& result = corpora[static_cast<std::size_t>(preset)];
+    if (result.empty()) {
+      corpus_generator generator(make_corpus_profile(preset), 1);
+      while (result.size() < k_corpus_size)
+        generator.append(result, 1000);
+    }
+    return result;
+  }
+
+  std::uint64_t walk(document_view const& document) {
+    std::uint64_t sum = 0;
+    for (auto const& element : document) {
+      if (element.type() == types::document || element.type() == types::array)
+        sum += walk(document_view(element.value()));
+      else
+        sum += element.value_size();
+    }
+    return sum;
+  }
+
+  void BM_WalkCorpus(benchmark::State& state) {
+    corpus_preset const preset = static_cast<corpus_preset>(state.range(0));
+    std::vector<byte_t> const& corpus = get_corpus(preset);
+    state.SetLabel(corpus_preset_name(preset));
+    for (auto _ : state) {
+      for (auto document : document_sequence(corpus.data(), corpus.size()))
+        benchmark::DoNotOptimize(walk(document_view(document.data)));
+    }
+    state.SetBytesProcessed(state.iterations() * corpus.size());
+  }
+  BENCHMARK(BM_WalkCorpus)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+  void BM_StreamingDecodeCorpus(benchmark::State& state) {
+    corpus_preset const preset = static_cast<corpus_preset>(state.range(0));
+    std::vector<byte_t> const& corpus = get_corpus(preset);
+    state.SetLabel(corpus_preset_name(preset));
+    null_decoder_handler handler;
+    for (auto _ : state) {
+      streaming_decoder<null_decoder_handler> decoder(handler);
+      benchmark::DoNotOptimize(decoder.feed(corpus.data(), corpus.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * corpus.size());
+  }
+  BENCHMARK(BM_StreamingDecodeCorpus)->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,313 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/concrete_encoder.hpp>
+#include <bassoon/decoder_handler.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/encoder_stats.hpp>
+#include <bassoon/streaming_decoder.hpp>
+
+#include "perf_counters.hpp"
+
+// The encode and decode hot paths under hardware counters, reported
+// per element: instructions, branches, branch misses and L1 data
+// read misses. Where the counters cannot be opened, only the time is
+// reported.
+//
+// Besides the usual flags, this takes:
+//
+//   --counters_write_baseline=<file>
+//       write the instructions per element of every benchmark run
+//   --counters_baseline=<file>
+//       fail, with exit status 1, if the instructions per element of
+//       any benchmark run grew past those in <file>, or if any
+//       benchmark in <file> was not run, or with exit status 2 if
+//       there are no counters to check them with
+//   --counters_tolerance=<fraction>
+//       how much growth to allow, 0.02 by default
+//
+// Instruction counts barely move from run to run, unlike time, so
+// even a small tolerance catches codegen getting worse.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 4096>;
+
+  // A record of 60 fields of mixed types and a subdocument of four.
+  std::size_t const k_fields = 60;
+  std::size_t const k_elements = k_fields + 1 + 4;
+
+  std::vector<std::string> const& field_names() {
+    static std::vector<std::string> result;
+    if (result.empty()) {
+      for (std::size_t i = 0; i != k_fields; ++i)
+        result.push_back("field_" + std::to_string(i));
+    }
+    return result;
+  }
+
+  template<typename Encoder_type>
+  void encode_record(Encoder_type& document) {
+    static byte_t const id[k_object_id_length] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    auto const& names = field_names();
+    for (std::size_t i = 0; i != k_fields; i += 6) {
+      document.encode_int32(names[i], static_cast<std::int32_t>(i));
+      document.encode_int64(names[i + 1], static_cast<std::int64_t>(i) << 33);
+      document.encode_floating_point(names[i + 2], i * 0.25);
+      document.encode_utf8_string(names[i + 3], "a short string");
+      document.encode_boolean(names[i + 4], i % 4 == 0);
+      document.encode_object_id(names[i + 5], object_id_cdata(&id[0]));
+    }
+    auto&& address = document.start_subdocument("address");
+    address.encode_utf8_string("street", "1 Main Street");
+    address.encode_utf8_string("city", "Springfield");
+    address.encode_int32("code", 12345);
+    address.encode_utc_datetime("since", 1500000000000LL);
+    address.finish();
+  }
+
+  // Kept out of line, so that every call through 'document' is virtual.
+  __attribute__((noinline)) void encode_abstract(abstract_encoder& document) {
+    encode_record(document);
+  }
+
+  buffer_type const& record() {
+    static buffer_type result;
+    static bool const encoded = [] {
+      auto writer = make_array_writer(result);
+      auto document = start_document(writer);
+      encode_record(document);
+      document.finish();
+      return document.ok();
+    }();
+    (void)encoded;
+    return result;
+  }
+
+  // Instructions per element of every benchmark run, by name, for the
+  // baseline.
+  std::map<std::string, double>& instructions_per_element() {
+    static std::map<std::string, double> result;
+    return result;
+  }
+
+  bassoon::perf::counters& counters() {
+    static bassoon::perf::counters result;
+    return result;
+  }
+
+  // Runs 'body' once per iteration with the counters around the loop,
+  // and reports them per element.
+  template<typename Body>
+  void run_counted(benchmark::State& state, char const* name, std::size_t elements, Body body) {
+    using bassoon::perf::counter;
+
+    counters().start();
+    for (auto _ : state)
+      body();
+    counters().stop();
+
+    double const count = static_cast<double>(state.iterations()) * elements;
+    state.SetItemsProcessed(state.iterations() * elements);
+    if (!counters().ok())
+      return;
+
+    bassoon::perf::counters::values_type const values = counters().read();
+    for (counter which : { counter::instructions, counter::branches, counter::branch_misses,
+                           counter::l1d_read_misses }) {
+      if (counters().has(which))
+        state.counters[bassoon::perf::counter_name(which)] = values[static_cast<std::size_t>(which)] / count;
+    }
+    instructions_per_element()[name] = values[static_cast<std::size_t>(counter::instructions)] / count;
+  }
+
+  void BM_EncodeDirect(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, "BM_EncodeDirect", k_elements, [&] {
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer);
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(document.ok());
+        benchmark::ClobberMemory();
+      });
+  }
+  BENCHMARK(BM_EncodeDirect);
+
+  // The same, counting with thread_encoder_stats. The difference from
+  // BM_EncodeDirect is what the statistics cost per element.
+  void BM_EncodeCounted(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, "BM_EncodeCounted", k_elements, [&] {
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer, thread_encoder_stats());
+        encode_record(document);
+        document.finish();
+        benchmark::DoNotOptimize(document.ok());
+        benchmark::ClobberMemory();
+      });
+  }
+  BENCHMARK(BM_EncodeCounted);
+
+  void BM_EncodeConcrete(benchmark::State& state) {
+    buffer_type buffer;
+    run_counted(state, "BM_EncodeConcrete", k_elements, [&] {
+        auto writer = make_array_writer(buffer);
+        concrete_encoder<decltype(writer)> document(writer);
+        encode_abstract(document);
+        document.finish();
+        benchmark::DoNotOptimize(writer.ok());
+        benchmark::ClobberMemory();
+      });
+  }
+  BENCHMARK(BM_EncodeConcrete);
+
+  // Reads every value in place, as a consumer of a view would.
+  std::uint64_t read_values(document_view const& document) {
+    std::uint64_t sum = 0;
+    for (auto const& element : document) {
+      switch (element.type()) {
+        case types::int32:
+          sum += element.as_int32();
+          break;
+        case types::int64:
+        case types::utc_datetime:
+          sum += element.as_int64();
+          break;
+        case types::floating_point:
+          sum += static_cast<std::uint64_t>(element.as_floating_point());
+          break;
+        case types::boolean:
+          sum += element.as_boolean();
+          break;
+        case types::utf8_string:
+          sum += element.as_string().size;
+          break;
+        case types::document:
+          sum += read_values(document_view(element.value()));
+          break;
+        default:
+          sum += element.value_size();
+          break;
+      }
+    }
+    return sum;
+  }
+
+  void BM_DecodeView(benchmark::State& state) {
+    document_view const document(record().data());
+    run_counted(state, "BM_DecodeView", k_elements, [&] {
+        benchmark::DoNotOptimize(read_values(document));
+      });
+  }
+  BENCHMARK(BM_DecodeView);
+
+  void BM_DecodeStreaming(benchmark::State& state) {
+    byte_t const* const data = record().data();
+    std::size_t const size = document_cdata(data).size;
+    null_decoder_handler handler;
+    streaming_decoder<null_decoder_handler> decoder(handler);
+    run_counted(state, "BM_DecodeStreaming", k_elements, [&] {
+        benchmark::DoNotOptimize(decoder.feed(data, size));
+      });
+  }
+  BENCHMARK(BM_DecodeStreaming);
+
+  bool write_baseline(char const* path) {
+    std::ofstream stream(path);
+    for (auto const& entry : instructions_per_element())
+      stream << entry.first << " " << entry.second << "\n";
+    return static_cast<bool>(stream);
+  }
+
+  // Returns false if any benchmark run grew past its baseline, or if
+  // any benchmark in the baseline was not run, so that one renamed,
+  // removed or filtered out is not taken for one that passed.
+  bool check_baseline(char const* path, double tolerance) {
+    std::ifstream stream(path);
+    if (!stream) {
+      std::fprintf(stderr, "cannot read baseline %s\n", path);
+      return false;
+    }
+
+    bool ok = true;
+    std::string name;
+    double baseline;
+    while (stream >> name >> baseline) {
+      auto const found = instructions_per_element().find(name);
+      if (found == instructions_per_element().end()) {
+        std::fprintf(stderr, "%-24s not run, baseline %10.2f  MISSING\n", name.c_str(), baseline);
+        ok = false;
+        continue;
+      }
+      double const limit = baseline * (1 + tolerance);
+      bool const regressed = found->second > limit;
+      std::fprintf(stderr, "%-24s %10.2f instructions per element, baseline %10.2f%s\n",
+                   name.c_str(), found->second, baseline, regressed ? "  REGRESSED" : "");
+      ok = ok && !regressed;
+    }
+    return ok;
+  }
+
+  // Takes the value of '--<flag>=' out of 'argument', if it is that flag.
+  bool take_flag(char const* argument, char const* flag, char const*& value) {
+    std::size_t const size = std::strlen(flag);
+    if (std::strncmp(argument, "--", 2) != 0 || std::strncmp(argument + 2, flag, size) != 0 ||
+        argument[2 + size] != '=')
+      return false;
+    value = argument + 2 + size + 1;
+    return true;
+  }
+
+} // namespace
+
+int main(int argc, char** argv) {
+  char const* baseline = nullptr;
+  char const* written_baseline = nullptr;
+  char const* tolerance = "0.02";
+
+  std::vector<char*> arguments;
+  for (int i = 0; i != argc; ++i) {
+    if (!take_flag(argv[i], "counters_baseline", baseline) &&
+        !take_flag(argv[i], "counters_write_baseline", written_baseline) &&
+        !take_flag(argv[i], "counters_tolerance", tolerance))
+      arguments.push_back(argv[i]);
+  }
+
+  int count = static_cast<int>(arguments.size());
+  benchmark::Initialize(&count, arguments.data());
+  if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+    return 1;
+
+  if (!counters().ok())
+    std::fprintf(stderr, "hardware counters unavailable: %s\n", std::strerror(counters().error()));
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  if ((written_baseline || baseline) && !counters().ok()) {
+    std::fprintf(stderr, "cannot write or check a baseline without counters\n");
+    return 2;
+  }
+
+  if (written_baseline && !write_baseline(written_baseline)) {
+    std::fprintf(stderr, "cannot write baseline %s\n", written_baseline);
+    return 1;
+  }
+
+  if (baseline && !check_baseline(baseline, std::atof(tolerance)))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_compare.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 128>;
+
+  enum keys {
+    k_int32,
+    k_int64,
+    k_double,
+    k_mixed_numbers,
+    k_string,
+    k_compound
+  };
+
+  std::size_t const k_key_count = 1 << 20;
+
+  // Index keys as they are usually stored, with empty names, packed
+  // one after the other.
+  struct key_set {
+    std::vector<byte_t> arena;
+    std::vector<byte_t const*> keys;
+  };
+
+  key_set make_keys(int kind) {
+    std::mt19937_64 random(kind);
+    key_set result;
+    std::vector<std::size_t> offsets;
+
+    for (std::size_t i = 0; i != k_key_count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      auto key = start_document(writer);
+      std::int64_t const value = static_cast<std::int64_t>(random());
+      switch (kind) {
+        case k_int32:
+          key.encode_int32("", static_cast<std::int32_t>(value));
+          break;
+        case k_int64:
+          key.encode_int64("", value);
+          break;
+        case k_double:
+          key.encode_floating_point("", value / 1e9);
+          break;
+        case k_mixed_numbers:
+          if (i % 3 == 0)
+            key.encode_int32("", static_cast<std::int32_t>(value));
+          else if (i % 3 == 1)
+            key.encode_int64("", value >> 20);
+          else
+            key.encode_floating_point("", value / 1e3);
+          break;
+        case k_string:
+          // Shared prefixes, as in e-mail addresses or paths.
+          key.encode_utf8_string("", "user" + std::to_string(value % 100000) + "@example.com");
+          break;
+        default:
+          key.encode_utf8_string("", "region-" + std::to_string(value % 16));
+          key.encode_int64("", value >> 8);
+          key.encode_floating_point("", (value & 0xff) / 4.0);
+          break;
+      }
+      key.finish();
+      offsets.push_back(result.arena.size());
+      result.arena.insert(result.arena.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+
+    for (std::size_t offset : offsets)
+      result.keys.push_back(result.arena.data() + offset);
+    return result;
+  }
+
+  template<typename Less>
+  void sort_keys(benchmark::State& state, Less less) {
+    key_set const keys = make_keys(state.range(0));
+    std::vector<byte_t const*> sorted;
+    for (auto _ : state) {
+      state.PauseTiming();
+      sorted = keys.keys;
+      state.ResumeTiming();
+      std::sort(sorted.begin(), sorted.end(), less);
+      benchmark::DoNotOptimize(sorted.data());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.keys.size());
+  }
+
+  void BM_SortDocuments(benchmark::State& state) {
+    sort_keys(state, document_less());
+  }
+  BENCHMARK(BM_SortDocuments)
+  ->Arg(k_int32)->Arg(k_int64)->Arg(k_double)->Arg(k_mixed_numbers)->Arg(k_string)->Arg(k_compound)
+  ->Unit(benchmark::kMillisecond);
+
+  // { region : 1, time : -1, score : 1 }.
+  void BM_SortCompoundDescending(benchmark::State& state) {
+    sort_keys(state, document_less(2));
+  }
+  BENCHMARK(BM_SortCompoundDescending)->Arg(k_compound)->Unit(benchmark::kMillisecond);
+
+  // Plain memcmp of the keys, which gets the order wrong, as a floor.
+  void BM_SortMemcmp(benchmark::State& state) {
+    sort_keys(state, [](byte_t const* a, byte_t const* b) {
+        std::size_t const a_size = document_view(a).size();
+        std::size_t const b_size = document_view(b).size();
+        int const result = std::memcmp(a, b, std::min(a_size, b_size));
+        return result < 0 || (result == 0 && a_size < b_size);
+      });
+  }
+  BENCHMARK(BM_SortMemcmp)->Arg(k_int64)->Arg(k_string)->Arg(k_compound)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
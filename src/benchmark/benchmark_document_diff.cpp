@@ -0,0 +1,189 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_diff.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 4096>;
+
+  // A monitoring record of the sort we replicate: a few identifying
+  // fields, a block of counters, a subdocument of gauges and an array
+  // of recent samples, 64 leaf values in all.
+  struct record {
+    std::int64_t id;
+    std::string host;
+    std::vector<std::int64_t> counters;
+    std::vector<double> gauges;
+    std::vector<std::int32_t> samples;
+    std::string status;
+  };
+
+  record make_record(std::mt19937& random) {
+    record result;
+    result.id = random();
+    result.host = "host-" + std::to_string(random() % 1000) + ".example.com";
+    for (int i = 0; i != 32; ++i)
+      result.counters.push_back(random());
+    for (int i = 0; i != 12; ++i)
+      result.gauges.push_back(random() / 1000.0);
+    for (int i = 0; i != 16; ++i)
+      result.samples.push_back(random() % 1000);
+    result.status = "ok";
+    return result;
+  }
+
+  // Changes each leaf with probability 'rate'. Most changes are to
+  // numbers; a changed status also changes size.
+  void mutate(record& target, double rate, std::mt19937& random) {
+    std::bernoulli_distribution change(rate);
+    for (auto& counter : target.counters)
+      if (change(random))
+        counter += 1 + random() % 100;
+    for (auto& gauge : target.gauges)
+      if (change(random))
+        gauge = random() / 1000.0;
+    for (auto& sample : target.samples)
+      if (change(random))
+        sample = random() % 1000;
+    if (change(random))
+      target.status = (target.status == "ok") ? "degraded: disk nearly full" : "ok";
+  }
+
+  std::size_t encode(record const& source, buffer_type& buffer) {
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer);
+    document.encode_int64("_id", source.id);
+    document.encode_utf8_string("host", source.host);
+    for (std::size_t i = 0; i != source.counters.size(); ++i)
+      document.encode_int64("counter_" + std::to_string(i), source.counters[i]);
+    auto gauges = document.start_subdocument("gauges");
+    for (std::size_t i = 0; i != source.gauges.size(); ++i)
+      gauges.encode_floating_point("g" + std::to_string(i), source.gauges[i]);
+    gauges.finish();
+    auto samples = document.start_subarray("samples");
+    for (std::size_t i = 0; i != source.samples.size(); ++i)
+      samples.encode_int32(std::to_string(i), source.samples[i]);
+    samples.finish();
+    document.encode_utf8_string("status", source.status);
+    document.finish();
+    return writer.valid();
+  }
+
+  // Pairs of old and new documents at a given mutation rate, with
+  // the patches between them.
+  struct corpus {
+    static const std::size_t k_pairs = 64;
+
+    explicit corpus(double rate)
+      : from(k_pairs)
+      , to(k_pairs)
+      , patches(k_pairs)
+      , document_bytes(0)
+      , patch_bytes(0) {
+      std::mt19937 random(1);
+      document_differ differ;
+      for (std::size_t i = 0; i != k_pairs; ++i) {
+        record value = make_record(random);
+        document_bytes += encode(value, from[i]);
+        mutate(value, rate, random);
+        encode(value, to[i]);
+        differ.diff(document_view(from[i].data()), document_view(to[i].data()));
+        auto writer = make_array_writer(patches[i]);
+        differ.encode(writer);
+        patch_bytes += writer.valid();
+      }
+    }
+
+    std::vector<buffer_type> from;
+    std::vector<buffer_type> to;
+    std::vector<buffer_type> patches;
+    std::size_t document_bytes;
+    std::size_t patch_bytes;
+  };
+
+  double rate_of(benchmark::State const& state) {
+    return state.range(0) / 1000.0;
+  }
+
+  void report(benchmark::State& state, corpus const& pairs) {
+    state.SetBytesProcessed(state.iterations() * (pairs.document_bytes / corpus::k_pairs));
+    state.counters["document_bytes"] = static_cast<double>(pairs.document_bytes) / corpus::k_pairs;
+    state.counters["patch_bytes"] = static_cast<double>(pairs.patch_bytes) / corpus::k_pairs;
+  }
+
+  void BM_Diff(benchmark::State& state) {
+    corpus const pairs(rate_of(state));
+    document_differ differ;
+    std::size_t i = 0;
+    for (auto _ : state) {
+      differ.diff(document_view(pairs.from[i].data()), document_view(pairs.to[i].data()));
+      benchmark::DoNotOptimize(differ.set_count());
+      i = (i + 1) % corpus::k_pairs;
+    }
+    report(state, pairs);
+  }
+
+  void BM_DiffAndEncode(benchmark::State& state) {
+    corpus const pairs(rate_of(state));
+    document_differ differ;
+    buffer_type patch;
+    std::size_t i = 0;
+    for (auto _ : state) {
+      differ.diff(document_view(pairs.from[i].data()), document_view(pairs.to[i].data()));
+      auto writer = make_array_writer(patch);
+      differ.encode(writer);
+      benchmark::DoNotOptimize(patch.data());
+      i = (i + 1) % corpus::k_pairs;
+    }
+    report(state, pairs);
+  }
+
+  void BM_Apply(benchmark::State& state) {
+    corpus const pairs(rate_of(state));
+    patch_applier applier;
+    buffer_type result;
+    std::size_t i = 0;
+    for (auto _ : state) {
+      applier.load(document_view(pairs.patches[i].data()));
+      auto writer = make_array_writer(result);
+      applier.apply(document_view(pairs.from[i].data()), writer);
+      benchmark::DoNotOptimize(result.data());
+      i = (i + 1) % corpus::k_pairs;
+    }
+    report(state, pairs);
+  }
+
+  // For reference: the cost of shipping the new document instead.
+  void BM_FullCopy(benchmark::State& state) {
+    corpus const pairs(rate_of(state));
+    buffer_type result;
+    std::size_t i = 0;
+    for (auto _ : state) {
+      document_view const source(pairs.to[i].data());
+      std::memcpy(result.data(), source.data(), source.size());
+      benchmark::DoNotOptimize(result.data());
+      i = (i + 1) % corpus::k_pairs;
+    }
+    report(state, pairs);
+  }
+
+  // Mutation rates are in thousandths of a leaf.
+  #define MUTATION_RATES Arg(0)->Arg(10)->Arg(50)->Arg(200)->Arg(1000)
+
+  BENCHMARK(BM_Diff)->MUTATION_RATES;
+  BENCHMARK(BM_DiffAndEncode)->MUTATION_RATES;
+  BENCHMARK(BM_Apply)->MUTATION_RATES;
+  BENCHMARK(BM_FullCopy)->MUTATION_RATES;
+
+} // namespace
+
+BENCHMARK_MAIN();
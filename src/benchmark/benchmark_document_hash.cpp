@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <random>
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_hash.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 4096>;
+
+  std::string make_bytes(std::size_t size) {
+    std::mt19937 random(size);
+    std::string result(size, '\0');
+    for (auto& c : result)
+      c = static_cast<char>(random());
+    return result;
+  }
+
+  void BM_ContentHasher(benchmark::State& state) {
+    std::string const data = make_bytes(state.range(0));
+    for (auto _ : state) {
+      content_hasher hasher;
+      hasher.update(data.data(), data.size());
+      benchmark::DoNotOptimize(hasher.digest());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+  }
+  BENCHMARK(BM_ContentHasher)->Arg(16)->Arg(256)->Arg(4096)->Arg(1 << 20);
+
+  // The library's string hash, for scale.
+  void BM_StdHash(benchmark::State& state) {
+    std::string const data = make_bytes(state.range(0));
+    std::hash<std::string> const hasher = std::hash<std::string>();
+    for (auto _ : state)
+      benchmark::DoNotOptimize(hasher(data));
+    state.SetBytesProcessed(state.iterations() * data.size());
+  }
+  BENCHMARK(BM_StdHash)->Arg(16)->Arg(256)->Arg(4096)->Arg(1 << 20);
+
+  template<typename Writer_type>
+  void encode_record(Writer_type& writer, std::mt19937& random) {
+    auto document = start_document(writer);
+    document.encode_int64("_id", random());
+    document.encode_utf8_string("host", "web-" + std::to_string(random() % 100) + ".example.com");
+    document.encode_utf8_string("msg", "GET /api/v1/items returned 200 after a cache miss");
+    auto timings = document.start_subdocument("timings");
+    timings.encode_floating_point("db", random() / 1e7);
+    timings.encode_floating_point("total", random() / 1e6);
+    timings.finish();
+    auto counters = document.start_subarray("counters");
+    for (int i = 0; i != 16; ++i)
+      counters.encode_int32(std::to_string(i), random());
+    counters.finish();
+    document.finish();
+  }
+
+  // Encoding with and without hashing on the way out, and encoding
+  // and then hashing the result.
+  void BM_Encode(benchmark::State& state) {
+    std::mt19937 random(1);
+    buffer_type buffer;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      encode_record(writer, random);
+      benchmark::DoNotOptimize(buffer.data());
+    }
+  }
+  BENCHMARK(BM_Encode);
+
+  void BM_EncodeThroughHashingWriter(benchmark::State& state) {
+    std::mt19937 random(1);
+    buffer_type buffer;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      auto hashing = make_hashing_writer(writer);
+      encode_record(hashing, random);
+      benchmark::DoNotOptimize(hashing.digest());
+    }
+  }
+  BENCHMARK(BM_EncodeThroughHashingWriter);
+
+  void BM_EncodeThenHash(benchmark::State& state, hash_mode mode, field_order order) {
+    std::mt19937 random(1);
+    buffer_type buffer;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      encode_record(writer, random);
+      hash_digest digest;
+      hash_document(document_view(buffer.data()), digest, mode, order);
+      benchmark::DoNotOptimize(digest);
+    }
+  }
+
+  void BM_EncodeThenHashBytewise(benchmark::State& state) {
+    BM_EncodeThenHash(state, hash_mode::bytewise, field_order::significant);
+  }
+  BENCHMARK(BM_EncodeThenHashBytewise);
+
+  void BM_EncodeThenHashCanonical(benchmark::State& state) {
+    BM_EncodeThenHash(state, hash_mode::canonical, field_order::significant);
+  }
+  BENCHMARK(BM_EncodeThenHashCanonical);
+
+  void BM_EncodeThenHashUnordered(benchmark::State& state) {
+    BM_EncodeThenHash(state, hash_mode::canonical, field_order::ignored);
+  }
+  BENCHMARK(BM_EncodeThenHashUnordered);
+
+} // namespace
+
+BENCHMARK_MAIN();
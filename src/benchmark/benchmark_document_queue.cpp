@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <thread>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_queue.hpp>
+#include <bassoon/encoder.hpp>
+
+// Throughput of a document_queue as producer threads are added, each
+// encoding log events into buffers of its own and pushing them, while
+// one consumer drains them into a document sequence, as a writer
+// thread would before writing it out. Reported as documents a second.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  const int k_documents_per_producer = 20000;
+
+  template<typename Writer_type>
+  bool encode_event(Writer_type& writer, int producer, int i) {
+    auto document = start_document(writer);
+    document.encode_int32("thread", producer);
+    document.encode_int64("sequence", i);
+    document.encode_utf8_string("level", "info");
+    document.encode_utf8_string("message", "request served from the cache in under a millisecond");
+    document.finish();
+    return document.ok();
+  }
+
+  void BM_DocumentQueue(benchmark::State& state) {
+    int const producers = static_cast<int>(state.range(0));
+
+    document_queue_options options;
+    options.capacity = 1024;
+    options.pool_size = 16;
+    options.buffer_size = 4096;
+
+    // Every event is the same size.
+    std::array<byte_t, 256> scratch;
+    auto writer = make_array_writer(scratch);
+    encode_event(writer, 0, 0);
+    std::size_t const event_size = writer.valid();
+
+    for (auto _ : state) {
+      document_queue queue(options);
+      std::vector<byte_t> sequence;
+      sequence.reserve(options.capacity * options.buffer_size);
+
+      std::thread consumer([&]() {
+        while (queue.wait()) {
+          queue.drain(sequence);
+          sequence.clear();
+        }
+      });
+
+      std::vector<std::thread> threads;
+      for (int p = 0; p != producers; ++p) {
+        threads.emplace_back([&, p]() {
+          document_queue_producer* const producer = queue.register_producer();
+          document_queue_buffer* buffer = producer->acquire();
+          for (int i = 0; i != k_documents_per_producer; ++i) {
+            if (buffer->valid() + event_size > options.buffer_size) {
+              producer->push(buffer);
+              buffer = producer->acquire();
+            }
+            encode_event(*buffer, p, i);
+          }
+          producer->push(buffer);
+          queue.release_producer(producer);
+        });
+      }
+      for (auto& thread : threads)
+        thread.join();
+      queue.close();
+      consumer.join();
+
+      if (queue.stats().drained != std::uint64_t(producers) * k_documents_per_producer)
+        state.SkipWithError("documents went missing");
+    }
+
+    state.SetItemsProcessed(state.iterations() * producers * k_documents_per_producer);
+  }
+  BENCHMARK(BM_DocumentQueue)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
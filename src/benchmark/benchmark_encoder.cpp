@@ -0,0 +1,562 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_encoder.hpp>
+#include <bassoon/array_writer.hpp>
+#include <bassoon/concrete_encoder.hpp>
+#include <bassoon/encoder.hpp>
+
+// Every encode_* method, through each way of driving the encoder, and
+// whole documents of a few shapes. Names read BM_Encode/<method>/<how>
+// and BM_Shape/<shape>/<how>, where <how> is one of:
+//
+//   direct    encoder<array_writer>, every call resolved statically
+//   checked   the same, with the caller checking 'ok' after each
+//             element
+//   concrete  concrete_encoder, called through abstract_encoder where
+//             the compiler cannot see the concrete type, so every
+//             call is a virtual call and a look at the encoder stack
+//   array     array_encoder, which names each element by its index
+//   floor     a copy of the finished document with one reserve,
+//             which is what the checks and the dispatch are paid on
+//             top of
+//
+// Each reports bytes per second, and the time per element.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 1 << 16>;
+
+  // Elements per document in BM_Encode.
+  std::size_t const k_elements = 64;
+
+  byte_t const k_object_id[k_object_id_length] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+  byte_t const k_binary[16] = { 0 };
+
+  // { x : 1 }, [ 1 ], and their elements.
+  byte_t const k_subdocument[] = { 12, 0, 0, 0, 0x10, 'x', 0, 1, 0, 0, 0, 0 };
+  byte_t const k_subarray[] = { 12, 0, 0, 0, 0x10, '0', 0, 1, 0, 0, 0, 0 };
+  byte_t const k_raw_elements[] = { 0x10, 'x', 0, 1, 0, 0, 0 };
+  byte_t const k_raw_int32[] = { 1, 0, 0, 0 };
+
+  // Element names, built once so that the benchmarks do not measure
+  // formatting them.
+  std::vector<std::string> const& names(std::size_t count) {
+    static std::vector<std::string> result;
+    while (result.size() < count)
+      result.push_back(std::to_string(result.size()));
+    return result;
+  }
+
+  // Each primitive encodes one element, given a name, or, through an
+  // array_encoder, without one.
+#define BASSOON_ENCODE_PRIMITIVE(method, ...)                           \
+  struct method {                                                       \
+    static char const* label() {                                        \
+      return #method;                                                   \
+    }                                                                   \
+                                                                        \
+    template<typename Encoder_type>                                     \
+    void named(Encoder_type& encoder, cstring_cdata name) const {       \
+      encoder.encode_##method(name, __VA_ARGS__);                       \
+    }                                                                   \
+                                                                        \
+    template<typename Encoder_type>                                     \
+    void indexed(Encoder_type& encoder) const {                         \
+      encoder.encode_##method(__VA_ARGS__);                             \
+    }                                                                   \
+  }
+
+#define BASSOON_ENCODE_NULLARY_PRIMITIVE(method)                        \
+  struct method {                                                       \
+    static char const* label() {                                        \
+      return #method;                                                   \
+    }                                                                   \
+                                                                        \
+    template<typename Encoder_type>                                     \
+    void named(Encoder_type& encoder, cstring_cdata name) const {       \
+      encoder.encode_##method(name);                                    \
+    }                                                                   \
+                                                                        \
+    template<typename Encoder_type>                                     \
+    void indexed(Encoder_type& encoder) const {                         \
+      encoder.encode_##method();                                        \
+    }                                                                   \
+  }
+
+  namespace primitives {
+
+    BASSOON_ENCODE_PRIMITIVE(floating_point, 3.25);
+    BASSOON_ENCODE_PRIMITIVE(utf8_string, "hello, world");
+    BASSOON_ENCODE_PRIMITIVE(subdocument, k_subdocument);
+    BASSOON_ENCODE_PRIMITIVE(as_subdocument, binary_cdata(k_raw_elements, sizeof(k_raw_elements)));
+    BASSOON_ENCODE_PRIMITIVE(subarray, k_subarray);
+    BASSOON_ENCODE_PRIMITIVE(as_subarray, binary_cdata(k_raw_elements, sizeof(k_raw_elements)));
+    BASSOON_ENCODE_PRIMITIVE(binary, binary_subtypes::generic, binary_cdata(k_binary, sizeof(k_binary)));
+    BASSOON_ENCODE_PRIMITIVE(object_id, object_id_cdata(&k_object_id[0]));
+    BASSOON_ENCODE_PRIMITIVE(boolean, true);
+    BASSOON_ENCODE_PRIMITIVE(utc_datetime, 1500000000000LL);
+    BASSOON_ENCODE_NULLARY_PRIMITIVE(null);
+    BASSOON_ENCODE_PRIMITIVE(regex, "^a.*z$", "i");
+    BASSOON_ENCODE_PRIMITIVE(javascript, "function() { return 1; }");
+    BASSOON_ENCODE_PRIMITIVE(symbol, "symbol");
+    BASSOON_ENCODE_PRIMITIVE(scoped_javascript, "function() { return x; }", k_subdocument);
+    BASSOON_ENCODE_PRIMITIVE(int32, 42);
+    BASSOON_ENCODE_PRIMITIVE(timestamp, 1500000000LL << 32);
+    BASSOON_ENCODE_PRIMITIVE(int64, 1LL << 40);
+    BASSOON_ENCODE_NULLARY_PRIMITIVE(min_key);
+    BASSOON_ENCODE_NULLARY_PRIMITIVE(max_key);
+
+    // The deprecated types are encoded all the same.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    BASSOON_ENCODE_NULLARY_PRIMITIVE(undefined);
+    BASSOON_ENCODE_PRIMITIVE(db_pointer, "db.collection", object_id_cdata(&k_object_id[0]));
+#pragma GCC diagnostic pop
+
+    // These have no array_encoder counterparts.
+    struct raw_elements {
+      static char const* label() {
+        return "raw_elements";
+      }
+
+      template<typename Encoder_type>
+      void named(Encoder_type& encoder, cstring_cdata) const {
+        encoder.encode_raw_elements(binary_cdata(k_raw_elements, sizeof(k_raw_elements)));
+      }
+    };
+
+    struct raw_value {
+      static char const* label() {
+        return "raw_value";
+      }
+
+      template<typename Encoder_type>
+      void named(Encoder_type& encoder, cstring_cdata name) const {
+        encoder.encode_raw_value(name, types::int32, binary_cdata(k_raw_int32, sizeof(k_raw_int32)));
+      }
+    };
+
+    // An empty subdocument or subarray, built with start and finish.
+    struct start_subdocument {
+      static char const* label() {
+        return "start_subdocument";
+      }
+
+      template<typename Encoder_type>
+      void named(Encoder_type& encoder, cstring_cdata name) const {
+        encoder.start_subdocument(name).finish();
+      }
+
+      template<typename Encoder_type>
+      void indexed(Encoder_type& encoder) const {
+        encoder.start_subdocument().finish();
+      }
+    };
+
+    struct start_subarray {
+      static char const* label() {
+        return "start_subarray";
+      }
+
+      template<typename Encoder_type>
+      void named(Encoder_type& encoder, cstring_cdata name) const {
+        encoder.start_subarray(name).finish();
+      }
+
+      template<typename Encoder_type>
+      void indexed(Encoder_type& encoder) const {
+        encoder.start_subarray().finish();
+      }
+    };
+
+  } // namespace primitives
+
+#undef BASSOON_ENCODE_PRIMITIVE
+#undef BASSOON_ENCODE_NULLARY_PRIMITIVE
+
+  // Kept out of line, so that every call through 'encoder' is virtual.
+  template<typename Primitive>
+  __attribute__((noinline)) void encode_elements(abstract_encoder& encoder, Primitive const& primitive) {
+    auto const& element_names = names(k_elements);
+    for (std::size_t i = 0; i != k_elements; ++i)
+      primitive.named(encoder, element_names[i]);
+  }
+
+  namespace flavors {
+
+    struct direct {
+      static char const* label() {
+        return "direct";
+      }
+
+      template<typename Writer_type, typename Primitive>
+      static void run(Writer_type& writer, Primitive const& primitive) {
+        auto const& element_names = names(k_elements);
+        auto document = start_document(writer);
+        for (std::size_t i = 0; i != k_elements; ++i)
+          primitive.named(document, element_names[i]);
+        document.finish();
+      }
+    };
+
+    struct checked {
+      static char const* label() {
+        return "checked";
+      }
+
+      template<typename Writer_type, typename Primitive>
+      static void run(Writer_type& writer, Primitive const& primitive) {
+        auto const& element_names = names(k_elements);
+        auto document = start_document(writer);
+        for (std::size_t i = 0; i != k_elements; ++i) {
+          primitive.named(document, element_names[i]);
+          if (!document.ok())
+            return;
+        }
+        document.finish();
+      }
+    };
+
+    struct concrete {
+      static char const* label() {
+        return "concrete";
+      }
+
+      template<typename Writer_type, typename Primitive>
+      static void run(Writer_type& writer, Primitive const& primitive) {
+        concrete_encoder<Writer_type> document(writer);
+        encode_elements(document, primitive);
+        document.finish();
+      }
+    };
+
+    struct array {
+      static char const* label() {
+        return "array";
+      }
+
+      template<typename Writer_type, typename Primitive>
+      static void run(Writer_type& writer, Primitive const& primitive) {
+        auto document = start_document(writer);
+        auto elements = make_array_encoder(document.start_subarray("a"));
+        for (std::size_t i = 0; i != k_elements; ++i)
+          primitive.indexed(elements);
+        elements.finish();
+        document.finish();
+      }
+    };
+
+    struct floor {
+      static char const* label() {
+        return "floor";
+      }
+
+      template<typename Writer_type, typename Primitive>
+      static void run(Writer_type& writer, Primitive const& primitive) {
+        static std::vector<byte_t> const bytes = encoded(primitive);
+        if (writer.reserve(bytes.size()))
+          writer.write(bytes.data(), bytes.size());
+      }
+
+    private:
+      template<typename Primitive>
+      static std::vector<byte_t> encoded(Primitive const& primitive) {
+        buffer_type buffer;
+        auto writer = make_array_writer(buffer);
+        direct::run(writer, primitive);
+        return std::vector<byte_t>(buffer.begin(), buffer.begin() + writer.valid());
+      }
+    };
+
+  } // namespace flavors
+
+  void report(benchmark::State& state, std::size_t size, std::size_t elements) {
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetItemsProcessed(state.iterations() * elements);
+    state.counters["time_per_element"] = benchmark::Counter(
+      elements, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+  }
+
+  template<typename Flavor, typename Primitive>
+  void BM_Encode(benchmark::State& state) {
+    buffer_type buffer;
+    Primitive const primitive = Primitive();
+    std::size_t size = 0;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      Flavor::run(writer, primitive);
+      if (!writer.ok()) {
+        state.SkipWithError("encoding failed");
+        break;
+      }
+      size = writer.valid();
+      benchmark::DoNotOptimize(buffer.data());
+      benchmark::ClobberMemory();
+    }
+    report(state, size, k_elements);
+  }
+
+  // Adds the elements of the shapes below to documents, by name, or to
+  // arrays, by index. Subdocuments are always filled by name.
+  struct by_name {
+    template<typename Encoder_type, typename Primitive>
+    static void add(Encoder_type& encoder, cstring_cdata name, Primitive const& primitive) {
+      primitive.named(encoder, name);
+    }
+
+    template<typename Encoder_type>
+    static auto start(Encoder_type& encoder, cstring_cdata name) -> decltype(encoder.start_subdocument(name)) {
+      return encoder.start_subdocument(name);
+    }
+  };
+
+  struct by_index {
+    template<typename Encoder_type, typename Primitive>
+    static void add(Encoder_type& encoder, cstring_cdata, Primitive const& primitive) {
+      primitive.indexed(encoder);
+    }
+
+    template<typename Encoder_type>
+    static auto start(Encoder_type& encoder, cstring_cdata) -> decltype(encoder.start_subdocument()) {
+      return encoder.start_subdocument();
+    }
+  };
+
+  namespace shapes {
+
+    // A typical small record.
+    struct small {
+      static char const* label() {
+        return "small";
+      }
+
+      static std::size_t elements() {
+        return 5;
+      }
+
+      template<typename Names, typename Encoder_type>
+      static void build(Encoder_type& encoder) {
+        Names::add(encoder, "_id", primitives::int64());
+        Names::add(encoder, "name", primitives::utf8_string());
+        Names::add(encoder, "active", primitives::boolean());
+        Names::add(encoder, "score", primitives::floating_point());
+        Names::add(encoder, "created", primitives::utc_datetime());
+      }
+    };
+
+    // Forty fields of mixed types, then a subdocument of five more.
+    struct medium {
+      static char const* label() {
+        return "medium";
+      }
+
+      static std::size_t elements() {
+        return 46;
+      }
+
+      template<typename Names, typename Encoder_type>
+      static void build(Encoder_type& encoder) {
+        auto const& field_names = names(40);
+        for (std::size_t i = 0; i != 40; i += 8) {
+          Names::add(encoder, field_names[i], primitives::int32());
+          Names::add(encoder, field_names[i + 1], primitives::int64());
+          Names::add(encoder, field_names[i + 2], primitives::floating_point());
+          Names::add(encoder, field_names[i + 3], primitives::utf8_string());
+          Names::add(encoder, field_names[i + 4], primitives::boolean());
+          Names::add(encoder, field_names[i + 5], primitives::utc_datetime());
+          Names::add(encoder, field_names[i + 6], primitives::object_id());
+          Names::add(encoder, field_names[i + 7], primitives::null());
+        }
+        auto&& address = Names::start(encoder, "address");
+        by_name::add(address, "street", primitives::utf8_string());
+        by_name::add(address, "city", primitives::utf8_string());
+        by_name::add(address, "region", primitives::utf8_string());
+        by_name::add(address, "code", primitives::int32());
+        by_name::add(address, "country", primitives::utf8_string());
+        address.finish();
+      }
+    };
+
+    // Thirty two levels of subdocuments, each with one field.
+    struct deep {
+      static char const* label() {
+        return "deep";
+      }
+
+      static std::size_t elements() {
+        return 2 * 32;
+      }
+
+      template<typename Names, typename Encoder_type>
+      static void build(Encoder_type& encoder) {
+        build_level<Names>(encoder, 32);
+      }
+
+    private:
+      template<typename Names, typename Encoder_type>
+      static void build_level(Encoder_type& encoder, int depth) {
+        Names::add(encoder, "depth", primitives::int32());
+        auto&& child = Names::start(encoder, "child");
+        if (depth > 1)
+          build_level<by_name>(child, depth - 1);
+        child.finish();
+      }
+    };
+
+    // A thousand int32 fields.
+    struct wide {
+      static char const* label() {
+        return "wide";
+      }
+
+      static std::size_t elements() {
+        return 1000;
+      }
+
+      template<typename Names, typename Encoder_type>
+      static void build(Encoder_type& encoder) {
+        auto const& field_names = names(1000);
+        for (std::size_t i = 0; i != 1000; ++i)
+          Names::add(encoder, field_names[i], primitives::int32());
+      }
+    };
+
+  } // namespace shapes
+
+  template<typename Shape>
+  __attribute__((noinline)) void build_abstract(abstract_encoder& encoder) {
+    Shape::template build<by_name>(encoder);
+  }
+
+  namespace shape_flavors {
+
+    struct direct {
+      template<typename Shape, typename Writer_type>
+      static void run(Writer_type& writer) {
+        auto document = start_document(writer);
+        Shape::template build<by_name>(document);
+        document.finish();
+      }
+    };
+
+    struct concrete {
+      template<typename Shape, typename Writer_type>
+      static void run(Writer_type& writer) {
+        concrete_encoder<Writer_type> document(writer);
+        build_abstract<Shape>(document);
+        document.finish();
+      }
+    };
+
+    struct array {
+      template<typename Shape, typename Writer_type>
+      static void run(Writer_type& writer) {
+        auto document = start_document(writer);
+        auto elements = make_array_encoder(document.start_subarray("a"));
+        Shape::template build<by_index>(elements);
+        elements.finish();
+        document.finish();
+      }
+    };
+
+  } // namespace shape_flavors
+
+  template<typename Flavor, typename Shape>
+  void BM_Shape(benchmark::State& state) {
+    buffer_type buffer;
+    std::size_t size = 0;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      Flavor::template run<Shape>(writer);
+      if (!writer.ok()) {
+        state.SkipWithError("encoding failed");
+        break;
+      }
+      size = writer.valid();
+      benchmark::DoNotOptimize(buffer.data());
+      benchmark::ClobberMemory();
+    }
+    report(state, size, Shape::elements());
+  }
+
+  template<typename Flavor, typename Primitive>
+  void register_encode() {
+    std::string const name = std::string("BM_Encode/") + Primitive::label() + "/" + Flavor::label();
+    benchmark::RegisterBenchmark(name.c_str(), &BM_Encode<Flavor, Primitive>);
+  }
+
+  template<typename Primitive>
+  void register_named() {
+    register_encode<flavors::direct, Primitive>();
+    register_encode<flavors::checked, Primitive>();
+    register_encode<flavors::concrete, Primitive>();
+    register_encode<flavors::floor, Primitive>();
+  }
+
+  template<typename Primitive>
+  void register_indexed() {
+    register_named<Primitive>();
+    register_encode<flavors::array, Primitive>();
+  }
+
+  template<typename Shape>
+  void register_shape() {
+    std::string const name = std::string("BM_Shape/") + Shape::label();
+    benchmark::RegisterBenchmark((name + "/direct").c_str(), &BM_Shape<shape_flavors::direct, Shape>);
+    benchmark::RegisterBenchmark((name + "/concrete").c_str(), &BM_Shape<shape_flavors::concrete, Shape>);
+    benchmark::RegisterBenchmark((name + "/array").c_str(), &BM_Shape<shape_flavors::array, Shape>);
+  }
+
+  int register_benchmarks() {
+    using namespace primitives;
+
+    // All the names any benchmark needs, so that none are added, and
+    // none move, while benchmarks run.
+    names(1000);
+
+    register_indexed<floating_point>();
+    register_indexed<utf8_string>();
+    register_indexed<subdocument>();
+    register_indexed<as_subdocument>();
+    register_indexed<subarray>();
+    register_indexed<as_subarray>();
+    register_indexed<binary>();
+    register_indexed<undefined>();
+    register_indexed<object_id>();
+    register_indexed<boolean>();
+    register_indexed<utc_datetime>();
+    register_indexed<null>();
+    register_indexed<regex>();
+    register_indexed<db_pointer>();
+    register_indexed<javascript>();
+    register_indexed<symbol>();
+    register_indexed<scoped_javascript>();
+    register_indexed<int32>();
+    register_indexed<timestamp>();
+    register_indexed<int64>();
+    register_indexed<min_key>();
+    register_indexed<max_key>();
+    register_named<raw_elements>();
+    register_named<raw_value>();
+    register_indexed<start_subdocument>();
+    register_indexed<start_subarray>();
+
+    register_shape<shapes::small>();
+    register_shape<shapes::medium>();
+    register_shape<shapes::deep>();
+    register_shape<shapes::wide>();
+    return 0;
+  }
+
+  int const registered = register_benchmarks();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,164 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/external_sort.hpp>
+#include <bassoon/mapped_file.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 256>;
+
+  std::size_t const k_file_size = std::size_t(256) << 20;
+  std::size_t const k_memory_budget = std::size_t(32) << 20;
+
+  bool write_all(int fd, byte_t const* data, std::size_t size) {
+    while (size != 0) {
+      ssize_t const written = ::write(fd, data, size);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
+    return true;
+  }
+
+  // A file of documents keyed on { region : 1, time : -1 }, eight
+  // times the memory budget, written once per process. If that
+  // fails, 'failure' says what did.
+  struct corpus {
+    corpus()
+      : size(0)
+      , failure(nullptr) {
+      char path[] = "/tmp/bassoon-benchmark-XXXXXX";
+      int const fd = ::mkstemp(path);
+      if (fd == -1) {
+        failure = "mkstemp failed";
+        return;
+      }
+      name = path;
+
+      std::mt19937_64 random(1);
+      std::vector<byte_t> chunk;
+      std::size_t written = 0;
+      for (std::int64_t i = 0; written < k_file_size; ++i) {
+        buffer_type buffer;
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer);
+        document.encode_int64("_id", i);
+        document.encode_utf8_string("region", "region-" + std::to_string(random() % 64));
+        document.encode_utc_datetime("time", 1500000000000LL + random() % 100000000);
+        document.encode_utf8_string("message", "something happened somewhere");
+        document.encode_floating_point("score", (random() % 4000) / 4.0);
+        document.finish();
+        chunk.insert(chunk.end(), buffer.begin(), buffer.begin() + writer.valid());
+        if (chunk.size() >= (1 << 20)) {
+          if (!write_all(fd, chunk.data(), chunk.size())) {
+            failure = "write failed";
+            break;
+          }
+          written += chunk.size();
+          chunk.clear();
+        }
+      }
+      ::close(fd);
+      size = written;
+    }
+
+    ~corpus() {
+      if (!name.empty())
+        ::unlink(name.c_str());
+    }
+
+    std::string name;
+    std::size_t size;
+    char const* failure;
+  };
+
+  corpus const& get_corpus() {
+    static corpus result;
+    return result;
+  }
+
+  // Counts what it is given and drops it.
+  struct counting_writer {
+    bool reserve(std::size_t) noexcept {
+      return true;
+    }
+
+    void write(void const* data, std::size_t size) noexcept {
+      benchmark::DoNotOptimize(data);
+      written += size;
+    }
+
+    std::size_t written = 0;
+  };
+
+  void report(benchmark::State& state, std::size_t bytes) {
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["peak_rss_mb"] = usage.ru_maxrss / 1024.0;
+  }
+
+  external_sort_options make_options() {
+    external_sort_options options;
+    options.memory_budget = k_memory_budget;
+    return options;
+  }
+
+  void BM_SortFile(benchmark::State& state) {
+    corpus const& input = get_corpus();
+    if (input.failure) {
+      state.SkipWithError(input.failure);
+      return;
+    }
+    for (auto _ : state) {
+      external_sorter sorter({ "region", "time" }, 2, make_options());
+      counting_writer writer;
+      if (!sorter.add_file(input.name.c_str()) || !sorter.finish(writer))
+        state.SkipWithError("sort failed");
+      state.counters["runs"] = sorter.spilled_runs();
+    }
+    report(state, input.size);
+  }
+  BENCHMARK(BM_SortFile)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  // The same, reading the file through a mapping. Pages of the file
+  // that have been read count towards the peak RSS.
+  void BM_SortMappedFile(benchmark::State& state) {
+    corpus const& input = get_corpus();
+    if (input.failure) {
+      state.SkipWithError(input.failure);
+      return;
+    }
+    for (auto _ : state) {
+      mapped_file file(input.name.c_str());
+      external_sorter sorter({ "region", "time" }, 2, make_options());
+      counting_writer writer;
+      if (!file.ok() || !sorter.add(file.documents()) || !sorter.finish(writer))
+        state.SkipWithError("sort failed");
+      state.counters["runs"] = sorter.spilled_runs();
+    }
+    report(state, input.size);
+  }
+  BENCHMARK(BM_SortMappedFile)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,147 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_compare.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/index_key.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 256>;
+
+  std::size_t const k_document_count = 1 << 20;
+
+  // Documents with a compound key { region : 1, time : -1, score : 1 }
+  // in among other fields, packed one after the other.
+  struct corpus {
+    std::vector<byte_t> arena;
+    std::vector<byte_t const*> documents;
+  };
+
+  corpus const& make_corpus() {
+    static corpus result;
+    if (!result.documents.empty())
+      return result;
+
+    std::mt19937_64 random(1);
+    std::vector<std::size_t> offsets;
+    for (std::size_t i = 0; i != k_document_count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      auto document = start_document(writer);
+      document.encode_int64("_id", i);
+      document.encode_utf8_string("region", "region-" + std::to_string(random() % 16));
+      document.encode_utc_datetime("time", 1500000000000LL + random() % 100000000);
+      document.encode_utf8_string("message", "something happened");
+      if (i % 2)
+        document.encode_int32("score", random() % 1000);
+      else
+        document.encode_floating_point("score", (random() % 4000) / 4.0);
+      document.finish();
+      offsets.push_back(result.arena.size());
+      result.arena.insert(result.arena.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    for (std::size_t offset : offsets)
+      result.documents.push_back(result.arena.data() + offset);
+    return result;
+  }
+
+  std::uint32_t const k_descending = 2;
+
+  index_key_encoder make_encoder() {
+    return index_key_encoder({ "region", "time", "score" }, k_descending);
+  }
+
+  void BM_EncodeKeys(benchmark::State& state) {
+    corpus const& documents = make_corpus();
+    index_key_encoder encoder = make_encoder();
+    std::array<byte_t, 256> key;
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+      for (auto document : documents.documents) {
+        auto writer = make_array_writer(key);
+        encoder.encode(document_view(document), writer);
+        bytes += writer.valid();
+        benchmark::DoNotOptimize(key.data());
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * documents.documents.size());
+    state.SetBytesProcessed(bytes);
+  }
+  BENCHMARK(BM_EncodeKeys)->Unit(benchmark::kMillisecond);
+
+  // Build every key, then sort them with memcmp.
+  void BM_SortEncodedKeys(benchmark::State& state) {
+    corpus const& documents = make_corpus();
+    index_key_encoder encoder = make_encoder();
+    std::vector<byte_t> arena;
+    std::vector<std::pair<std::size_t, std::size_t>> keys;
+    std::array<byte_t, 256> key;
+
+    for (auto _ : state) {
+      arena.clear();
+      keys.clear();
+      for (auto document : documents.documents) {
+        auto writer = make_array_writer(key);
+        encoder.encode(document_view(document), writer);
+        keys.emplace_back(arena.size(), writer.valid());
+        arena.insert(arena.end(), key.begin(), key.begin() + writer.valid());
+      }
+      byte_t const* const base = arena.data();
+      std::sort(keys.begin(), keys.end(), [base](std::pair<std::size_t, std::size_t> const& a,
+                                                 std::pair<std::size_t, std::size_t> const& b) {
+          int const result = std::memcmp(base + a.first, base + b.first, std::min(a.second, b.second));
+          return result < 0 || (result == 0 && a.second < b.second);
+        });
+      benchmark::DoNotOptimize(keys.data());
+    }
+    state.SetItemsProcessed(state.iterations() * documents.documents.size());
+  }
+  BENCHMARK(BM_SortEncodedKeys)->Unit(benchmark::kMillisecond);
+
+  // The same, with the key fields copied into BSON documents that are
+  // sorted with 'compare_documents'.
+  void BM_SortKeyDocuments(benchmark::State& state) {
+    corpus const& documents = make_corpus();
+    std::vector<byte_t> arena;
+    std::vector<std::size_t> offsets;
+    std::vector<byte_t const*> keys;
+    buffer_type key;
+
+    for (auto _ : state) {
+      arena.clear();
+      offsets.clear();
+      keys.clear();
+      for (auto document : documents.documents) {
+        document_view const view(document);
+        auto writer = make_array_writer(key);
+        auto key_document = start_document(writer);
+        for (char const* path : { "region", "time", "score" }) {
+          element_view const element = view.find(path, std::strlen(path));
+          key_document.encode_raw_value("", element.type(), binary_cdata(element.value(), element.value_size()));
+        }
+        key_document.finish();
+        offsets.push_back(arena.size());
+        arena.insert(arena.end(), key.begin(), key.begin() + writer.valid());
+      }
+      for (std::size_t offset : offsets)
+        keys.push_back(arena.data() + offset);
+      std::sort(keys.begin(), keys.end(), document_less(k_descending));
+      benchmark::DoNotOptimize(keys.data());
+    }
+    state.SetItemsProcessed(state.iterations() * documents.documents.size());
+  }
+  BENCHMARK(BM_SortKeyDocuments)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/json_parser.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 1 << 16>;
+
+  // Request logs as our ingestion endpoints receive them.
+  std::string make_log_records(std::size_t count) {
+    std::mt19937 random(1);
+    std::string result;
+    for (std::size_t i = 0; i != count; ++i) {
+      result += "{\"ts\":" + std::to_string(1500000000000LL + random()) +
+        ",\"host\":\"web-" + std::to_string(random() % 100) + ".example.com\"" +
+        ",\"msg\":\"GET /api/v1/items?id=" + std::to_string(random()) + " returned \\\"200 OK\\\"\\n\"" +
+        ",\"status\":200,\"cached\":" + (random() % 2 ? "true" : "false") +
+        ",\"timings\":{\"db\":" + std::to_string(random() / 1e7) +
+        ",\"total\":" + std::to_string(random() / 1e6) + "}" +
+        ",\"tags\":[\"api\",\"production\"]}\n";
+    }
+    return result;
+  }
+
+  std::string make_numbers() {
+    std::mt19937 random(2);
+    std::string result = "{\"values\":[";
+    for (int i = 0; i != 2000; ++i) {
+      if (i)
+        result += ',';
+      result += (i % 2) ? std::to_string(static_cast<std::int32_t>(random())) : std::to_string(random() / 977.0);
+    }
+    return result + "]}";
+  }
+
+  // Newline delimited JSON, one document per line.
+  void BM_ParseLines(benchmark::State& state) {
+    std::string const input = make_log_records(256);
+    std::vector<std::pair<std::size_t, std::size_t>> lines;
+    for (std::size_t begin = 0, end; (end = input.find('\n', begin)) != std::string::npos; begin = end + 1)
+      lines.emplace_back(begin, end - begin);
+
+    json_parser parser;
+    static buffer_type buffer;
+    for (auto _ : state) {
+      for (auto const& line : lines) {
+        auto writer = make_array_writer(buffer);
+        benchmark::DoNotOptimize(parser.parse(input.data() + line.first, line.second, writer));
+      }
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+    state.SetItemsProcessed(state.iterations() * lines.size());
+  }
+  BENCHMARK(BM_ParseLines);
+
+  void BM_ParseNumbers(benchmark::State& state) {
+    std::string const input = make_numbers();
+    json_parser parser(static_cast<json_number_policy>(state.range(0)));
+    static buffer_type buffer;
+    for (auto _ : state) {
+      auto writer = make_array_writer(buffer);
+      benchmark::DoNotOptimize(parser.parse(input.data(), input.size(), writer));
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+  }
+  BENCHMARK(BM_ParseNumbers)
+    ->Arg(static_cast<int>(json_number_policy::narrowest))
+    ->Arg(static_cast<int>(json_number_policy::floating_point));
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,201 @@
+#include <benchmark/benchmark.h>
+
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/json_transcoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 4096>;
+  using json_buffer_type = std::array<char, 16384>;
+
+  enum corpus {
+    k_log_records,
+    k_numbers,
+    k_text
+  };
+
+  // A request log record: a few identifiers, a message, timings and
+  // counters, and some tags.
+  void encode_log_record(encoder<array_writer<byte_t, 4096>>& document, std::mt19937& random) {
+    byte_t id[k_object_id_length];
+    for (auto& byte : id)
+      byte = static_cast<byte_t>(random());
+    document.encode_object_id("_id", object_id_cdata(&id[0]));
+    document.encode_utc_datetime("ts", 1500000000000LL + random() % 100000000000LL);
+    document.encode_utf8_string("host", "web-" + std::to_string(random() % 100) + ".example.com");
+    document.encode_utf8_string("msg", "GET /api/v1/items?id=" + std::to_string(random()) +
+                                " returned \"200 OK\" after a cache miss\n");
+    document.encode_int32("status", 200);
+    document.encode_boolean("cached", random() % 2 == 0);
+    auto timings = document.start_subdocument("timings");
+    timings.encode_floating_point("db", random() / 1e7);
+    timings.encode_floating_point("render", random() / 1e8);
+    timings.encode_floating_point("total", random() / 1e6);
+    timings.finish();
+    auto counters = document.start_subarray("counters");
+    for (int i = 0; i != 8; ++i)
+      counters.encode_int64(std::to_string(i), random());
+    counters.finish();
+    auto tags = document.start_subarray("tags");
+    tags.encode_utf8_string("0", "api");
+    tags.encode_utf8_string("1", "production");
+    tags.finish();
+  }
+
+  void encode_numbers(encoder<array_writer<byte_t, 4096>>& document, std::mt19937& random) {
+    std::uniform_real_distribution<double_t> reading(-1000.0, 1000.0);
+    for (int i = 0; i != 64; ++i) {
+      std::string const name = "v" + std::to_string(i);
+      if (i % 2)
+        document.encode_floating_point(name, reading(random));
+      else
+        document.encode_int64(name, static_cast<std::int64_t>(random()) * random());
+    }
+  }
+
+  void encode_text(encoder<array_writer<byte_t, 4096>>& document, std::mt19937& random) {
+    for (int i = 0; i != 8; ++i) {
+      std::string line;
+      while (line.size() < 200)
+        line += "word" + std::to_string(random() % 1000) + (random() % 16 ? " " : "\t\"quoted\"\n");
+      document.encode_utf8_string("line" + std::to_string(i), line);
+    }
+  }
+
+  std::vector<buffer_type> make_corpus(int kind) {
+    std::mt19937 random(kind);
+    std::vector<buffer_type> result(64);
+    for (auto& buffer : result) {
+      auto writer = make_array_writer(buffer);
+      auto document = start_document(writer);
+      if (kind == k_log_records)
+        encode_log_record(document, random);
+      else if (kind == k_numbers)
+        encode_numbers(document, random);
+      else
+        encode_text(document, random);
+      document.finish();
+    }
+    return result;
+  }
+
+  // What one writes first: walk the document and stream each value
+  // out with operator<<, escaping a char at a time.
+  void naive_string(std::ostream& stream, char const* data, std::size_t size) {
+    stream << '"';
+    for (std::size_t i = 0; i != size; ++i) {
+      unsigned char const c = data[i];
+      if (c == '"' || c == '\\')
+        stream << '\\' << data[i];
+      else if (c < 0x20)
+        stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+      else
+        stream << data[i];
+    }
+    stream << '"';
+  }
+
+  void naive_document(std::ostream& stream, document_view const& document, bool is_array) {
+    stream << (is_array ? '[' : '{');
+    bool first = true;
+    for (auto const& element : document) {
+      if (!first)
+        stream << ',';
+      first = false;
+      if (!is_array) {
+        naive_string(stream, element.name().data, element.name().size - 1);
+        stream << ':';
+      }
+      switch (element.type()) {
+        case types::floating_point:
+          stream << std::setprecision(17) << element.as_floating_point();
+          break;
+        case types::utf8_string:
+          naive_string(stream, element.as_string().data, element.as_string().size - 1);
+          break;
+        case types::document:
+        case types::array:
+          naive_document(stream, document_view(element.as_document()), element.type() == types::array);
+          break;
+        case types::object_id:
+          stream << "{\"$oid\":\"";
+          for (std::size_t i = 0; i != k_object_id_length; ++i)
+            stream << std::hex << std::setw(2) << std::setfill('0') << int(element.value()[i]) << std::dec;
+          stream << "\"}";
+          break;
+        case types::boolean:
+          stream << (element.as_boolean() ? "true" : "false");
+          break;
+        case types::utc_datetime:
+          stream << "{\"$date\":{\"$numberLong\":\"" << element.as_int64() << "\"}}";
+          break;
+        case types::int32:
+          stream << element.as_int32();
+          break;
+        case types::int64:
+          stream << element.as_int64();
+          break;
+        default:
+          stream << "null";
+          break;
+      }
+    }
+    stream << (is_array ? ']' : '}');
+  }
+
+  void BM_Transcode(benchmark::State& state, json_mode mode) {
+    std::vector<buffer_type> const documents = make_corpus(state.range(0));
+    json_buffer_type json;
+    std::size_t bytes = 0;
+
+    for (auto _ : state) {
+      for (auto const& document : documents) {
+        auto writer = make_array_writer(json);
+        transcode_to_json(document_view(document.data()), writer, mode);
+        bytes += writer.valid();
+        benchmark::DoNotOptimize(json.data());
+      }
+    }
+    state.SetBytesProcessed(bytes);
+    state.SetItemsProcessed(state.iterations() * documents.size());
+  }
+
+  void BM_TranscodeRelaxed(benchmark::State& state) {
+    BM_Transcode(state, json_mode::relaxed);
+  }
+  BENCHMARK(BM_TranscodeRelaxed)->Arg(k_log_records)->Arg(k_numbers)->Arg(k_text);
+
+  void BM_TranscodeCanonical(benchmark::State& state) {
+    BM_Transcode(state, json_mode::canonical);
+  }
+  BENCHMARK(BM_TranscodeCanonical)->Arg(k_log_records)->Arg(k_numbers)->Arg(k_text);
+
+  void BM_NaiveIostream(benchmark::State& state) {
+    std::vector<buffer_type> const documents = make_corpus(state.range(0));
+    std::ostringstream stream;
+    std::size_t bytes = 0;
+
+    for (auto _ : state) {
+      for (auto const& document : documents) {
+        stream.str(std::string());
+        naive_document(stream, document_view(document.data()), false);
+        bytes += stream.tellp();
+        benchmark::DoNotOptimize(stream);
+      }
+    }
+    state.SetBytesProcessed(bytes);
+    state.SetItemsProcessed(state.iterations() * documents.size());
+  }
+  BENCHMARK(BM_NaiveIostream)->Arg(k_log_records)->Arg(k_numbers)->Arg(k_text);
+
+} // namespace
+
+BENCHMARK_MAIN();
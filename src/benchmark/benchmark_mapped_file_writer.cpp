@@ -0,0 +1,99 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file_writer.hpp>
+#include <bassoon/streaming_writer.hpp>
+
+// Encoding a file of documents straight into a mapping of it, or
+// through the bounded ring of a streaming_writer, against encoding
+// each into an array_writer buffer and fwrite-ing that.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  std::size_t const k_file_size = std::size_t(64) << 20;
+
+  std::string temporary_path() {
+    char const* directory = std::getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/bassoon-benchmark-output";
+  }
+
+  template<typename Writer_type>
+  void encode_record(Writer_type& writer, std::int64_t i) {
+    auto document = start_document(writer);
+    document.encode_int64("_id", i);
+    document.encode_utf8_string("region", "region-7");
+    document.encode_utc_datetime("time", 1500000000000LL + i);
+    auto&& detail = document.start_subdocument("detail");
+    detail.encode_utf8_string("message", "something happened somewhere, and then something else");
+    detail.encode_floating_point("score", i * 0.25);
+    detail.finish();
+    document.finish();
+  }
+
+  void BM_MappedFileWriter(benchmark::State& state) {
+    std::string const path = temporary_path();
+    for (auto _ : state) {
+      mapped_file_writer writer(path.c_str());
+      for (std::int64_t i = 0; writer.valid() < k_file_size; ++i)
+        encode_record(writer, i);
+      if (!writer.close())
+        state.SkipWithError("write failed");
+    }
+    ::unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * k_file_size);
+  }
+  BENCHMARK(BM_MappedFileWriter)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  void BM_StreamingWriter(benchmark::State& state) {
+    std::string const path = temporary_path();
+    for (auto _ : state) {
+      int const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      {
+        streaming_writer writer(fd);
+        for (std::int64_t i = 0; writer.written() < k_file_size; ++i)
+          encode_record(writer, i);
+        if (!writer.flush())
+          state.SkipWithError("write failed");
+      }
+      ::close(fd);
+    }
+    ::unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * k_file_size);
+  }
+  BENCHMARK(BM_StreamingWriter)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+  void BM_ArrayWriterFwrite(benchmark::State& state) {
+    using buffer_type = std::array<byte_t, 256>;
+    std::string const path = temporary_path();
+    for (auto _ : state) {
+      std::FILE* file = std::fopen(path.c_str(), "wb");
+      std::size_t written = 0;
+      for (std::int64_t i = 0; written < k_file_size; ++i) {
+        buffer_type buffer;
+        auto writer = make_array_writer(buffer);
+        encode_record(writer, i);
+        written += std::fwrite(buffer.data(), 1, writer.valid(), file);
+      }
+      if (std::fclose(file) != 0)
+        state.SkipWithError("write failed");
+    }
+    ::unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * k_file_size);
+  }
+  BENCHMARK(BM_ArrayWriterFwrite)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
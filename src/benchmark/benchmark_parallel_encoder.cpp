@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bassoon/arena_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/parallel_encoder.hpp>
+
+// Encoding a result set of records into a batch of documents, on one
+// thread into an arena, and on a parallel_encoder with from one
+// thread up to one per core.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  const int k_records = 200000;
+
+  struct record {
+    std::int64_t id;
+    std::string name;
+    std::string email;
+    double balance;
+    std::int32_t visits;
+    bool active;
+  };
+
+  std::vector<record> const& records() {
+    static std::vector<record> const result = [] {
+      std::vector<record> records;
+      for (int i = 0; i != k_records; ++i) {
+        std::string const name = "customer " + std::to_string(i);
+        records.push_back(record{ i, name, name + "@example.com", i * 1.25, i % 1000, i % 3 != 0 });
+      }
+      return records;
+    }();
+    return result;
+  }
+
+  void encode_record(arena_writer& writer, record const& record) {
+    auto document = start_document(writer);
+    document.encode_int64("_id", record.id);
+    document.encode_utf8_string("name", record.name);
+    document.encode_utf8_string("email", record.email);
+    document.encode_floating_point("balance", record.balance);
+    document.encode_int32("visits", record.visits);
+    document.encode_boolean("active", record.active);
+    document.finish();
+  }
+
+  void BM_SerialEncode(benchmark::State& state) {
+    arena_writer writer;
+    for (auto _ : state) {
+      writer.clear();
+      for (auto const& record : records())
+        encode_record(writer, record);
+    }
+    state.SetItemsProcessed(state.iterations() * k_records);
+    state.SetBytesProcessed(state.iterations() * writer.valid());
+  }
+  BENCHMARK(BM_SerialEncode)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+  void BM_ParallelEncode(benchmark::State& state) {
+    parallel_encoder_options options;
+    options.threads = state.range(0);
+    parallel_encoder encoder(options);
+    for (auto _ : state) {
+      if (!encoder.encode(records().begin(), records().end(),
+                          [](arena_writer& writer, record const& record) { encode_record(writer, record); }))
+        state.SkipWithError("encoding failed");
+    }
+    state.SetItemsProcessed(state.iterations() * k_records);
+    state.SetBytesProcessed(state.iterations() * encoder.size());
+  }
+
+  // Powers of two up to the cores here, and the cores.
+  void core_counts(benchmark::internal::Benchmark* benchmark) {
+    int const cores = std::max(1U, std::thread::hardware_concurrency());
+    for (int threads = 1; threads < cores; threads *= 2)
+      benchmark->Arg(threads);
+    benchmark->Arg(cores);
+  }
+  BENCHMARK(BM_ParallelEncode)->Apply(core_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,186 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/endian.hpp>
+#include <bassoon/shm_ring.hpp>
+
+// Publish to consume latency between two processes, through a
+// shm_ring against a socketpair. The producer sends a document
+// stamped with the time, and waits for an acknowledgement before it
+// sends the next, so that each is measured without queueing. The
+// consumer reports the 50th and 99th percentiles, in nanoseconds, of
+// the time from the stamp to when it had the document in hand.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  std::int64_t now() {
+    timespec time;
+    ::clock_gettime(CLOCK_MONOTONIC, &time);
+    return std::int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+  }
+
+  template<typename Writer_type>
+  bool encode_stamped(Writer_type& writer) {
+    auto document = start_document(writer);
+    document.encode_int64("sent", now());
+    document.encode_utf8_string("message", "something happened somewhere, and then something else");
+    document.finish();
+    return document.ok();
+  }
+
+  // The stamp is the first element: after the length, the type, and
+  // "sent\0".
+  std::int64_t stamp(void const* document) {
+    std::int64_t sent;
+    std::memcpy(&sent, static_cast<byte_t const*>(document) + 10, sizeof(sent));
+    return bassoon::endian::little_to_native(sent);
+  }
+
+  struct percentiles {
+    std::int64_t p50;
+    std::int64_t p99;
+  };
+
+  percentiles summarize(std::vector<std::int64_t>& latencies) {
+    if (latencies.empty())
+      return { 0, 0 };
+    std::sort(latencies.begin(), latencies.end());
+    return { latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100] };
+  }
+
+  // Runs 'consume' in a child process, which reports its percentiles
+  // back through a pipe, and 'produce' in this one.
+  template<typename Consume, typename Produce>
+  void run(benchmark::State& state, Consume consume, Produce produce) {
+    int results[2];
+    if (::pipe(results) == -1) {
+      state.SkipWithError("pipe failed");
+      return;
+    }
+
+    pid_t const child = ::fork();
+    if (child == 0) {
+      std::vector<std::int64_t> latencies;
+      latencies.reserve(1 << 20);
+      consume(latencies);
+      percentiles const result = summarize(latencies);
+      ::_exit(::write(results[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+    }
+
+    produce();
+
+    percentiles result = { 0, 0 };
+    if (::read(results[0], &result, sizeof(result)) != sizeof(result))
+      state.SkipWithError("consumer failed");
+    ::waitpid(child, nullptr, 0);
+    ::close(results[0]);
+    ::close(results[1]);
+
+    state.counters["p50_ns"] = result.p50;
+    state.counters["p99_ns"] = result.p99;
+  }
+
+  void BM_ShmRingLatency(benchmark::State& state) {
+    shm_ring_options options;
+    options.capacity = 1 << 20;
+
+    // Both rings and both readers are set up before the fork; each
+    // process then uses only its own ends.
+    shm_ring_writer requests(options);
+    shm_ring_writer acks(options);
+    shm_ring_reader request_reader(requests.fd());
+    shm_ring_reader ack_reader(acks.fd());
+
+    run(state,
+        [&](std::vector<std::int64_t>& latencies) {
+          for (;;) {
+            document_cdata const document = request_reader.next();
+            if (!document.data)
+              break;
+            latencies.push_back(now() - stamp(document.data));
+            auto ack = start_document(acks);
+            ack.finish();
+          }
+        },
+        [&]() {
+          for (auto _ : state) {
+            encode_stamped(requests);
+            ack_reader.next();
+          }
+          requests.close();
+        });
+  }
+  BENCHMARK(BM_ShmRingLatency)->UseRealTime();
+
+  bool read_fully(int fd, void* data, std::size_t size) {
+    byte_t* bytes = static_cast<byte_t*>(data);
+    while (size != 0) {
+      ssize_t const result = ::read(fd, bytes, size);
+      if (result <= 0)
+        return false;
+      bytes += result;
+      size -= result;
+    }
+    return true;
+  }
+
+  void BM_SocketpairLatency(benchmark::State& state) {
+    int sockets[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
+      state.SkipWithError("socketpair failed");
+      return;
+    }
+
+    run(state,
+        [&](std::vector<std::int64_t>& latencies) {
+          ::close(sockets[0]);
+          std::array<byte_t, 4096> document;
+          for (;;) {
+            length_t length;
+            if (!read_fully(sockets[1], document.data(), sizeof(length)))
+              break;
+            length = document_cdata(document.data()).size;
+            if (length > static_cast<length_t>(document.size()) ||
+                !read_fully(sockets[1], document.data() + sizeof(length), length - sizeof(length)))
+              break;
+            latencies.push_back(now() - stamp(document.data()));
+            char const ack = 0;
+            if (::write(sockets[1], &ack, 1) != 1)
+              break;
+          }
+        },
+        [&]() {
+          ::close(sockets[1]);
+          std::array<byte_t, 4096> buffer;
+          for (auto _ : state) {
+            auto writer = make_array_writer(buffer);
+            encode_stamped(writer);
+            char ack;
+            if (::write(sockets[0], buffer.data(), writer.valid()) != static_cast<ssize_t>(writer.valid()) ||
+                ::read(sockets[0], &ack, 1) != 1) {
+              state.SkipWithError("socket failed");
+              break;
+            }
+          }
+          ::close(sockets[0]);
+        });
+  }
+  BENCHMARK(BM_SocketpairLatency)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,165 @@
+#ifndef included_0de0efc5_a54d_465a_bf0c_8072d4a5a41d
+#define included_0de0efc5_a54d_465a_bf0c_8072d4a5a41d
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace perf {
+
+    enum class counter {
+      instructions,
+      branches,
+      branch_misses,
+      l1d_read_misses
+    };
+
+    std::size_t const k_counter_count = 4;
+
+    inline char const* counter_name(counter which) noexcept {
+      switch (which) {
+        case counter::instructions:    return "instructions";
+        case counter::branches:        return "branches";
+        case counter::branch_misses:   return "branch_misses";
+        case counter::l1d_read_misses: return "l1d_read_misses";
+      }
+      return "unknown";
+    }
+
+    ///
+    /// The hardware counters of the calling thread, in user space
+    /// only, read as one group with perf_event_open so that they all
+    /// cover exactly the same stretch of code.
+    ///
+    /// Not every machine has every counter, and containers and
+    /// virtual machines often have none. Counters that cannot be
+    /// opened are left out: 'has' says which are there, and 'ok'
+    /// returns false, with 'error' the errno value, if instructions
+    /// cannot be counted at all.
+    ///
+    /// If the kernel has to multiplex the counters, the values are
+    /// scaled up by the fraction of the time that they were counting.
+    ///
+    class counters {
+    public:
+      using values_type = std::array<double, k_counter_count>;
+
+      counters() noexcept
+        : leader_(-1)
+        , opened_(0)
+        , error_(0) {
+        fds_.fill(-1);
+        open(counter::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        if (leader_ == -1)
+          return;
+        open(counter::branches, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+        open(counter::branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        open(counter::l1d_read_misses, PERF_TYPE_HW_CACHE,
+             PERF_COUNT_HW_CACHE_L1D |
+             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+      }
+
+      ~counters() {
+        for (int fd : fds_) {
+          if (fd != -1)
+            ::close(fd);
+        }
+      }
+
+      counters(const counters&) = delete;
+      counters& operator=(const counters&) = delete;
+
+      bool ok() const noexcept {
+        return leader_ != -1;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      bool has(counter which) const noexcept {
+        return fds_[static_cast<std::size_t>(which)] != -1;
+      }
+
+      ///
+      /// Zeroes the counters and starts them.
+      ///
+      void start() noexcept {
+        if (!ok())
+          return;
+        ::ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      }
+
+      void stop() noexcept {
+        if (ok())
+          ::ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      }
+
+      ///
+      /// The counts since 'start', zero for counters that are not
+      /// there.
+      ///
+      values_type read() const noexcept {
+        values_type result;
+        result.fill(0);
+
+        // The number of counters, the times enabled and running, then
+        // the counts in the order the counters were opened.
+        std::uint64_t data[3 + k_counter_count];
+        if (!ok() || ::read(leader_, data, sizeof(data)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t)))
+          return result;
+
+        double const scale = data[2] != 0 ? static_cast<double>(data[1]) / data[2] : 1.0;
+        for (std::size_t i = 0; i != data[0] && i != opened_; ++i)
+          result[static_cast<std::size_t>(order_[i])] = data[3 + i] * scale;
+        return result;
+      }
+
+    private:
+      void open(counter which, std::uint32_t type, std::uint64_t config) noexcept {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = leader_ == -1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format =
+          PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int const fd = static_cast<int>(::syscall(__NR_perf_event_open, &attributes, 0, -1, leader_,
+                                                  PERF_FLAG_FD_CLOEXEC));
+        if (fd == -1) {
+          if (leader_ == -1)
+            error_ = errno;
+          return;
+        }
+
+        if (leader_ == -1)
+          leader_ = fd;
+        fds_[static_cast<std::size_t>(which)] = fd;
+        order_[opened_++] = which;
+      }
+
+      std::array<int, k_counter_count> fds_;
+      std::array<counter, k_counter_count> order_;
+      int leader_;
+      std::size_t opened_;
+      int error_;
+    };
+
+  }  // namespace perf
+}  // namespace bassoon
+
+#endif // included_0de0efc5_a54d_465a_bf0c_8072d4a5a41d
@@ -0,0 +1,54 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <bassoon/corpus_generator.hpp>
+
+// Writes a corpus of generated BSON documents, back to back, for the
+// benchmarks and anything else that reads files of documents:
+//
+//   corpus_generator <preset> <documents> <seed> <path>
+//
+// The same arguments write the same file, so that results taken with
+// it can be compared between versions.
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  int usage(char const* program) {
+    std::cerr << "usage: " << program << " <preset> <documents> <seed> <path>\n"
+              << "presets:";
+    for (auto preset : { corpus_preset::telemetry, corpus_preset::user_profile,
+                         corpus_preset::log_event, corpus_preset::wide_sparse })
+      std::cerr << " " << corpus_preset_name(preset);
+    std::cerr << "\n";
+    return EXIT_FAILURE;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 5)
+    return usage(argv[0]);
+
+  corpus_preset preset;
+  if (!find_corpus_preset(argv[1], preset))
+    return usage(argv[0]);
+
+  char* end;
+  unsigned long long const documents = std::strtoull(argv[2], &end, 10);
+  if (*end != '\0')
+    return usage(argv[0]);
+  unsigned long long const seed = std::strtoull(argv[3], &end, 10);
+  if (*end != '\0')
+    return usage(argv[0]);
+
+  corpus_generator generator(make_corpus_profile(preset), seed);
+  if (!generator.write(argv[4], documents)) {
+    std::cerr << argv[4] << ": " << std::strerror(errno) << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
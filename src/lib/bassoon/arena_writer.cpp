@@ -0,0 +1,68 @@
+#include <bassoon/arena_writer.hpp>
+
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      std::size_t round_up(std::size_t size, std::size_t multiple) {
+        return (size + multiple - 1) / multiple * multiple;
+      }
+
+    }  // namespace
+
+    arena_writer::arena_writer(arena_writer_options options) noexcept
+      : options_(options)
+      , base_(nullptr)
+      , committed_(0)
+      , used_(0)
+      , error_(0) {
+
+      std::size_t const page = ::sysconf(_SC_PAGESIZE);
+      options_.extent = round_up(options_.extent == 0 ? 1 : options_.extent, page);
+      options_.reservation = round_up(options_.reservation == 0 ? 1 : options_.reservation, page);
+
+      // Address space only: nothing is committed until an extent of
+      // it is made writable.
+      void* const reserved = ::mmap(nullptr, options_.reservation, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (reserved == MAP_FAILED) {
+        fail(errno);
+        return;
+      }
+      base_ = static_cast<byte_t*>(reserved);
+    }
+
+    arena_writer::~arena_writer() {
+      if (base_)
+        ::munmap(base_, options_.reservation);
+    }
+
+    void arena_writer::clear() noexcept {
+      used_ = 0;
+      if (base_)
+        error_ = 0;
+    }
+
+    bool arena_writer::grow(std::size_t size) noexcept {
+      if (!ok())
+        return false;
+
+      std::size_t const wanted = round_up(used_ + size, options_.extent);
+      if (wanted > options_.reservation || wanted < used_)
+        return fail(ENOMEM);
+
+      if (::mprotect(base_ + committed_, wanted - committed_, PROT_READ | PROT_WRITE) == -1)
+        return fail(errno);
+
+      committed_ = wanted;
+      return true;
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,124 @@
+#ifndef included_ae0929f0_f741_4889_a0cd_014830244289
+#define included_ae0929f0_f741_4889_a0cd_014830244289
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct arena_writer_options {
+      // Memory is committed this many bytes at a time, rounded up to
+      // whole pages.
+      std::size_t extent = std::size_t(1) << 20;
+
+      // The address space set aside for the arena, which is the most
+      // that it can hold. It costs no memory until used.
+      std::size_t reservation = std::size_t(1) << 36;
+    };
+
+    ///
+    /// A writer into memory that grows without moving, for encoding
+    /// any number of documents back to back without knowing their
+    /// size up front.
+    ///
+    /// As with mapped_file_writer, the arena sets aside address space
+    /// for everything it may hold, and commits it an extent at a time,
+    /// so the cursors that the encoder holds stay valid as it grows.
+    /// 'clear' starts again from the beginning, keeping the memory
+    /// committed so far, so that an arena reused for one batch after
+    /// another stops growing once it has held the largest.
+    ///
+    /// Failure is not fatal: 'reserve' fails, 'ok' returns false until
+    /// 'clear', and 'error' returns the errno value of what failed.
+    ///
+    class LIBBASSOON_EXPORT arena_writer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<arena_writer>;
+
+      explicit arena_writer(arena_writer_options options = arena_writer_options()) noexcept;
+      ~arena_writer();
+
+      arena_writer(const arena_writer&) = delete;
+      arena_writer& operator=(const arena_writer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        if (committed_ - used_ >= size)
+          return ok();
+        return grow(size);
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, base_ + used_);
+      }
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(size <= committed_ - used_);
+        std::memcpy(base_ + used_, data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        // After a failure, the encoder may still patch the length of a
+        // document that it could not start, past what is committed.
+        if (!ok())
+          return;
+        std::memcpy(cursor.address(), data, size);
+      }
+
+      ///
+      /// The bytes written so far, which start at 'data'.
+      ///
+      std::size_t valid() const noexcept {
+        return used_;
+      }
+
+      byte_t const* data() const noexcept {
+        return base_;
+      }
+
+      ///
+      /// Forgets what was written, and any failure, but for a failure
+      /// to set aside the address space in the first place.
+      ///
+      void clear() noexcept;
+
+    private:
+      bool grow(std::size_t size) noexcept;
+
+      bool fail(int error) noexcept {
+        if (error_ == 0)
+          error_ = error;
+        return false;
+      }
+
+      arena_writer_options options_;
+      byte_t* base_;
+      std::size_t committed_;
+      std::size_t used_;
+      int error_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_ae0929f0_f741_4889_a0cd_014830244289
@@ -12,9 +12,9 @@ namespace bassoon {
         typedef encoder_type& type;
       };
 
-      template<typename writer_type>
-      struct encoder_storage<encoder<writer_type>> {
-        typedef encoder<writer_type> type;
+      template<typename writer_type, typename stats_type>
+      struct encoder_storage<encoder<writer_type, stats_type>> {
+        typedef encoder<writer_type, stats_type> type;
       };
     } // namespace details
 
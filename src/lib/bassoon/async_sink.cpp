@@ -0,0 +1,402 @@
+#include <bassoon/async_sink.hpp>
+
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// io_uring is driven through its system calls directly, from the
+// kernel's own header, so that there is nothing more to link.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define BASSOON_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#if !defined(BASSOON_HAVE_IO_URING)
+#define BASSOON_HAVE_IO_URING 0
+#endif
+
+namespace bassoon {
+  namespace bson {
+
+#if BASSOON_HAVE_IO_URING
+
+    struct async_sink::ring {
+      ~ring() {
+        if (sqes != MAP_FAILED)
+          ::munmap(sqes, sqes_size);
+        if (completion != MAP_FAILED)
+          ::munmap(completion, completion_size);
+        if (submission != MAP_FAILED)
+          ::munmap(submission, submission_size);
+        if (fd != -1)
+          ::close(fd);
+      }
+
+      void* map(std::size_t size, off_t offset) {
+        return ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+      }
+
+      int enter(unsigned submit, unsigned complete, unsigned flags) {
+        return ::syscall(__NR_io_uring_enter, fd, submit, complete, flags, nullptr, 0);
+      }
+
+      int fd = -1;
+
+      void* submission = MAP_FAILED;
+      std::size_t submission_size = 0;
+      unsigned* sq_tail = nullptr;
+      unsigned* sq_mask = nullptr;
+      unsigned* sq_array = nullptr;
+
+      io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+      std::size_t sqes_size = 0;
+
+      void* completion = MAP_FAILED;
+      std::size_t completion_size = 0;
+      unsigned* cq_head = nullptr;
+      unsigned* cq_tail = nullptr;
+      unsigned* cq_mask = nullptr;
+      io_uring_cqe* cqes = nullptr;
+    };
+
+#else
+
+    struct async_sink::ring {};
+
+#endif
+
+    async_sink::async_sink(int fd, async_sink_options options)
+      : fd_(fd)
+      , options_(options)
+      , backend_(async_sink_backend::thread_pool)
+      , offset_(0)
+      , memory_(nullptr)
+      , memory_size_(0)
+      , in_flight_(0)
+      , stopping_(false)
+      , error_(0)
+      , written_(0) {
+
+      std::size_t const page = ::sysconf(_SC_PAGESIZE);
+      options_.queue_depth = std::max<std::size_t>(options_.queue_depth, 1);
+      options_.buffer_size = (std::max<std::size_t>(options_.buffer_size, 1) + page - 1) / page * page;
+      options_.threads = std::max<std::size_t>(options_.threads, 1);
+
+      off_t const position = ::lseek(fd_, 0, SEEK_CUR);
+      if (position == -1) {
+        fail(errno);
+        return;
+      }
+      offset_ = position;
+
+      // One page aligned block for all of the buffers.
+      memory_size_ = options_.queue_depth * options_.buffer_size;
+      void* const memory = ::mmap(nullptr, memory_size_, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) {
+        fail(errno);
+        return;
+      }
+      memory_ = static_cast<byte_t*>(memory);
+
+      buffers_.reserve(options_.queue_depth);
+      free_buffers_.reserve(options_.queue_depth);
+      queue_.reserve(options_.queue_depth);
+      for (unsigned i = 0; i != options_.queue_depth; ++i) {
+        buffers_.emplace_back(new async_sink_buffer(memory_ + i * options_.buffer_size, options_.buffer_size, i));
+        free_buffers_.push_back(buffers_.back().get());
+      }
+
+      if (options_.backend != async_sink_backend::thread_pool) {
+        int const error = start_ring();
+        if (error == 0) {
+          backend_ = async_sink_backend::io_uring;
+          return;
+        }
+        ring_.reset();
+        if (options_.backend == async_sink_backend::io_uring) {
+          fail(error);
+          return;
+        }
+      }
+      start_threads();
+    }
+
+    async_sink::~async_sink() {
+      flush();
+      stop_threads();
+      ring_.reset();
+      if (memory_)
+        ::munmap(memory_, memory_size_);
+    }
+
+    async_sink_buffer* async_sink::acquire() noexcept {
+      async_sink_buffer* buffer = nullptr;
+      if (ring_) {
+        while (ok() && free_buffers_.empty()) {
+          if (!reap(true))
+            break;
+        }
+        if (ok() && !free_buffers_.empty()) {
+          buffer = free_buffers_.back();
+          free_buffers_.pop_back();
+        }
+      } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this]() { return !free_buffers_.empty() || !ok(); });
+        if (ok()) {
+          buffer = free_buffers_.back();
+          free_buffers_.pop_back();
+        }
+      }
+      return buffer;
+    }
+
+    bool async_sink::submit(async_sink_buffer* buffer) noexcept {
+      if (!ok() || buffer->valid() == 0) {
+        recycle(buffer, false);
+        return ok();
+      }
+
+      buffer->offset_ = offset_;
+      buffer->size_ = buffer->valid();
+      buffer->done_ = 0;
+      offset_ += buffer->size_;
+
+      if (ring_) {
+        ++in_flight_;
+        if (submit_write(buffer))
+          return true;
+        recycle(buffer, true);
+        return false;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++in_flight_;
+        queue_.push_back(buffer);
+      }
+      queued_.notify_one();
+      return ok();
+    }
+
+    bool async_sink::flush() noexcept {
+      if (ring_) {
+        while (in_flight_ != 0) {
+          if (!reap(true))
+            break;
+        }
+      } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [this]() { return in_flight_ == 0; });
+      }
+
+      if (ok() && ::lseek(fd_, offset_, SEEK_SET) == -1)
+        fail(errno);
+      return ok();
+    }
+
+    int async_sink::start_ring() {
+#if BASSOON_HAVE_IO_URING
+      ring_.reset(new ring);
+      ring& r = *ring_;
+
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+      r.fd = ::syscall(__NR_io_uring_setup, static_cast<unsigned>(options_.queue_depth), &params);
+      if (r.fd == -1)
+        return errno;
+
+      r.submission_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      r.submission = r.map(r.submission_size, IORING_OFF_SQ_RING);
+      if (r.submission == MAP_FAILED)
+        return errno;
+      byte_t* const submission = static_cast<byte_t*>(r.submission);
+      r.sq_tail = reinterpret_cast<unsigned*>(submission + params.sq_off.tail);
+      r.sq_mask = reinterpret_cast<unsigned*>(submission + params.sq_off.ring_mask);
+      r.sq_array = reinterpret_cast<unsigned*>(submission + params.sq_off.array);
+
+      r.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      r.sqes = static_cast<io_uring_sqe*>(r.map(r.sqes_size, IORING_OFF_SQES));
+      if (r.sqes == MAP_FAILED)
+        return errno;
+
+      r.completion_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      r.completion = r.map(r.completion_size, IORING_OFF_CQ_RING);
+      if (r.completion == MAP_FAILED)
+        return errno;
+      byte_t* const completion = static_cast<byte_t*>(r.completion);
+      r.cq_head = reinterpret_cast<unsigned*>(completion + params.cq_off.head);
+      r.cq_tail = reinterpret_cast<unsigned*>(completion + params.cq_off.tail);
+      r.cq_mask = reinterpret_cast<unsigned*>(completion + params.cq_off.ring_mask);
+      r.cqes = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+
+      // Registered once, so that no write pins the pages of its buffer
+      // or looks up the file again.
+      std::vector<iovec> buffers(buffers_.size());
+      for (std::size_t i = 0; i != buffers_.size(); ++i) {
+        buffers[i].iov_base = buffers_[i]->base_;
+        buffers[i].iov_len = buffers_[i]->capacity_;
+      }
+      if (::syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == -1)
+        return errno;
+      if (::syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_FILES, &fd_, 1) == -1)
+        return errno;
+      return 0;
+#else
+      return ENOSYS;
+#endif
+    }
+
+    void async_sink::start_threads() {
+      threads_.reserve(options_.threads);
+      for (std::size_t i = 0; i != options_.threads; ++i)
+        threads_.emplace_back([this]() { work(); });
+    }
+
+    void async_sink::stop_threads() noexcept {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      queued_.notify_all();
+      for (auto& thread : threads_)
+        thread.join();
+      threads_.clear();
+    }
+
+    void async_sink::work() noexcept {
+      for (;;) {
+        async_sink_buffer* buffer;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          queued_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+          if (queue_.empty())
+            return;
+          buffer = queue_.front();
+          queue_.erase(queue_.begin());
+        }
+
+        // After a failure, what is queued is dropped.
+        while (ok() && buffer->done_ != buffer->size_) {
+          ssize_t const result = ::pwrite(fd_, buffer->base_ + buffer->done_, buffer->size_ - buffer->done_,
+                                          buffer->offset_ + buffer->done_);
+          if (result == -1 && errno == EINTR)
+            continue;
+          if (result <= 0)
+            fail(result == 0 ? EIO : errno);
+          else
+            buffer->done_ += result;
+        }
+        recycle(buffer, true);
+      }
+    }
+
+    bool async_sink::submit_write(async_sink_buffer* buffer) noexcept {
+#if BASSOON_HAVE_IO_URING
+      ring& r = *ring_;
+
+      // At most one write per buffer is in flight, and the ring has an
+      // entry for each, so there is always room.
+      unsigned const tail = *r.sq_tail;
+      unsigned const index = tail & *r.sq_mask;
+      io_uring_sqe* const sqe = &r.sqes[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_WRITE_FIXED;
+      sqe->flags = IOSQE_FIXED_FILE;
+      sqe->fd = 0;
+      sqe->addr = reinterpret_cast<std::uintptr_t>(buffer->base_ + buffer->done_);
+      sqe->len = buffer->size_ - buffer->done_;
+      sqe->off = buffer->offset_ + buffer->done_;
+      sqe->buf_index = buffer->index_;
+      sqe->user_data = buffer->index_;
+      r.sq_array[index] = index;
+      __atomic_store_n(r.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+      while (r.enter(1, 0, 0) == -1) {
+        if (errno != EINTR) {
+          fail(errno);
+          return false;
+        }
+      }
+      return true;
+#else
+      (void)buffer;
+      fail(ENOSYS);
+      return false;
+#endif
+    }
+
+    bool async_sink::reap(bool wait) noexcept {
+#if BASSOON_HAVE_IO_URING
+      ring& r = *ring_;
+
+      unsigned head = *r.cq_head;
+      if (wait && head == __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+        while (r.enter(0, 1, IORING_ENTER_GETEVENTS) == -1) {
+          if (errno != EINTR) {
+            fail(errno);
+            return false;
+          }
+        }
+      }
+
+      for (; head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE); ++head) {
+        io_uring_cqe const& cqe = r.cqes[head & *r.cq_mask];
+        async_sink_buffer* const buffer = buffers_[cqe.user_data].get();
+        if (cqe.res <= 0)
+          fail(cqe.res == 0 ? EIO : -cqe.res);
+        else
+          buffer->done_ += cqe.res;
+
+        // A short write goes again, for the rest.
+        if (!ok() || buffer->done_ == buffer->size_ || !submit_write(buffer))
+          recycle(buffer, true);
+      }
+      __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+      return true;
+#else
+      (void)wait;
+      return false;
+#endif
+    }
+
+    void async_sink::recycle(async_sink_buffer* buffer, bool written) noexcept {
+      if (written)
+        written_.fetch_add(buffer->done_, std::memory_order_relaxed);
+      buffer->clear();
+
+      if (ring_) {
+        in_flight_ -= written;
+        free_buffers_.push_back(buffer);
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_ -= written;
+        free_buffers_.push_back(buffer);
+      }
+      released_.notify_all();
+    }
+
+    void async_sink::fail(int error) noexcept {
+      int expected = 0;
+      if (error_.compare_exchange_strong(expected, error, std::memory_order_relaxed)) {
+        // Wake 'acquire' in case it waits for a buffer that a failed
+        // write will not hand back soon.
+        std::lock_guard<std::mutex> lock(mutex_);
+        released_.notify_all();
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
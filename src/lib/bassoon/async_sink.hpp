@@ -0,0 +1,260 @@
+#ifndef included_6dce0c2e_3906_4d4d_b0af_1777d5e8eca3
+#define included_6dce0c2e_3906_4d4d_b0af_1777d5e8eca3
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    enum class async_sink_backend {
+      // io_uring where the kernel offers it, else the thread pool.
+      automatic,
+      io_uring,
+      thread_pool,
+    };
+
+    struct async_sink_options {
+      // The number of batch buffers, which is also the most writes
+      // that can be in flight at once.
+      std::size_t queue_depth = 8;
+
+      // The size of each batch buffer, rounded up to whole pages.
+      std::size_t buffer_size = std::size_t(1) << 20;
+
+      async_sink_backend backend = async_sink_backend::automatic;
+
+      // The threads that the thread pool backend writes on.
+      std::size_t threads = 2;
+    };
+
+    class async_sink;
+
+    ///
+    /// A batch buffer of an async_sink, and a writer that encodes
+    /// documents into it.
+    ///
+    /// The buffer keeps track of where the last top level document
+    /// that was finished in it ends. A document that does not fit
+    /// fails 'reserve' as usual, but the documents before it are
+    /// still whole: 'submit' writes those, and leaves out the one
+    /// that failed, to be encoded again into the next buffer.
+    ///
+    class LIBBASSOON_EXPORT async_sink_buffer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<async_sink_buffer>;
+
+      async_sink_buffer(const async_sink_buffer&) = delete;
+      async_sink_buffer& operator=(const async_sink_buffer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        ok_ = ok_ && capacity_ - used_ >= size;
+        return ok_;
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, base_ + used_);
+      }
+
+      bool ok() const noexcept {
+        return ok_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(size <= capacity_ - used_);
+        std::memcpy(base_ + used_, data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        std::memcpy(cursor.address(), data, size);
+        // The length of a top level document is written last.
+        if (ok_ && cursor.address() == base_ + finished_)
+          finished_ = used_;
+      }
+
+      ///
+      /// The bytes of the finished documents, which 'submit' writes.
+      ///
+      std::size_t valid() const noexcept {
+        return finished_;
+      }
+
+      std::size_t capacity() const noexcept {
+        return capacity_;
+      }
+
+    private:
+      friend class async_sink;
+
+      async_sink_buffer(byte_t* base, std::size_t capacity, unsigned index) noexcept
+        : base_(base)
+        , capacity_(capacity)
+        , index_(index) {
+        clear();
+      }
+
+      void clear() noexcept {
+        used_ = 0;
+        finished_ = 0;
+        ok_ = true;
+      }
+
+      byte_t* const base_;
+      std::size_t const capacity_;
+      unsigned const index_;
+      std::size_t used_;
+      std::size_t finished_;
+      bool ok_;
+
+      // Where the write of the buffer goes in the file, and how much
+      // of it is done, while it is in flight.
+      std::uint64_t offset_;
+      std::size_t size_;
+      std::size_t done_;
+    };
+
+    ///
+    /// An output sink that writes batches of encoded documents to a
+    /// file without blocking the thread that encodes them.
+    ///
+    /// The sink owns a fixed pool of batch buffers. 'acquire' hands
+    /// one out, the caller encodes documents into it, and 'submit'
+    /// queues the write of its finished documents and returns at
+    /// once. Once the write completes, the buffer goes back to the
+    /// pool, so that steady state encoding neither allocates nor
+    /// copies. 'acquire' waits for a buffer only when all of them are
+    /// in flight, which bounds both the memory and the writes queued.
+    ///
+    /// With io_uring, the buffers and the file are registered with
+    /// the ring once, up front, and each batch is a single fixed
+    /// buffer write. Where io_uring is not available, and the backend
+    /// is 'automatic', a pool of threads calls pwrite instead.
+    ///
+    /// Batches are written back to back from the file position at
+    /// construction, each at an offset fixed at 'submit', so the file
+    /// holds them in submission order however the writes complete.
+    /// The file descriptor must be seekable, and is not closed.
+    ///
+    /// The sink is used from one thread. Failure is sticky: 'ok'
+    /// returns false from then on, 'error' returns the errno value of
+    /// what failed, and 'acquire' returns null.
+    ///
+    class LIBBASSOON_EXPORT async_sink {
+    public:
+      explicit async_sink(int fd, async_sink_options options = async_sink_options());
+
+      ///
+      /// Waits for the writes in flight, as 'flush' does.
+      ///
+      ~async_sink();
+
+      async_sink(const async_sink&) = delete;
+      async_sink& operator=(const async_sink&) = delete;
+
+      ///
+      /// A cleared buffer from the pool, waiting for a write to
+      /// complete if none is free. Null once the sink has failed.
+      ///
+      async_sink_buffer* acquire() noexcept;
+
+      ///
+      /// Queues the write of the finished documents in 'buffer', which
+      /// goes back to the pool once it is written. Returns 'ok'.
+      ///
+      bool submit(async_sink_buffer* buffer) noexcept;
+
+      ///
+      /// Waits until everything submitted has been written, and moves
+      /// the file position past it. Returns 'ok'.
+      ///
+      bool flush() noexcept;
+
+      bool ok() const noexcept {
+        return error() == 0;
+      }
+
+      int error() const noexcept {
+        return error_.load(std::memory_order_relaxed);
+      }
+
+      ///
+      /// The backend in use, never 'automatic'.
+      ///
+      async_sink_backend backend() const noexcept {
+        return backend_;
+      }
+
+      ///
+      /// The bytes whose writes have completed.
+      ///
+      std::uint64_t written() const noexcept {
+        return written_.load(std::memory_order_relaxed);
+      }
+
+    private:
+      struct ring;
+
+      // Returns zero, or the errno value of what failed.
+      int start_ring();
+      void start_threads();
+      void stop_threads() noexcept;
+      void work() noexcept;
+
+      bool submit_write(async_sink_buffer* buffer) noexcept;
+      bool reap(bool wait) noexcept;
+
+      // Returns a buffer to the pool, after its write completed or in
+      // place of one.
+      void recycle(async_sink_buffer* buffer, bool written) noexcept;
+      void fail(int error) noexcept;
+
+      int fd_;
+      async_sink_options options_;
+      async_sink_backend backend_;
+      std::uint64_t offset_;
+
+      byte_t* memory_;
+      std::size_t memory_size_;
+      std::vector<std::unique_ptr<async_sink_buffer>> buffers_;
+
+      // The io_uring backend, used only by the calling thread.
+      std::unique_ptr<ring> ring_;
+      std::vector<async_sink_buffer*> free_buffers_;
+      std::size_t in_flight_;
+
+      // The thread pool backend. The mutex guards the queue and the
+      // free buffers, which the workers hand back.
+      std::mutex mutex_;
+      std::condition_variable queued_;
+      std::condition_variable released_;
+      std::vector<async_sink_buffer*> queue_;
+      std::vector<std::thread> threads_;
+      bool stopping_;
+
+      std::atomic<int> error_;
+      std::atomic<std::uint64_t> written_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_6dce0c2e_3906_4d4d_b0af_1777d5e8eca3
@@ -0,0 +1,272 @@
+#include <bassoon/columnar_extractor.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      std::size_t value_width(column_type type) noexcept {
+        switch (type) {
+          case column_type::int32:
+          case column_type::dictionary_string:
+            return sizeof(std::int32_t);
+          case column_type::int64:
+          case column_type::utc_datetime:
+            return sizeof(std::int64_t);
+          case column_type::floating_point:
+            return sizeof(double_t);
+          case column_type::boolean:
+            return sizeof(std::uint8_t);
+        }
+        return 0;
+      }
+
+      // The schema tree before we flatten it.
+      struct build_node {
+        std::string name;
+        std::int32_t column;
+        std::vector<build_node> children;
+      };
+
+    } // namespace
+
+    string_dictionary::string_dictionary()
+      : offsets_(1, 0) {}
+
+    std::int32_t string_dictionary::intern(char const* data, std::size_t size) {
+      if ((count() + 1) * 2 > slots_.size())
+        grow();
+
+      std::uint64_t const hash = element_details::hash_bytes(data, size);
+      std::size_t const mask = slots_.size() - 1;
+      std::size_t slot = hash & mask;
+
+      for (std::int32_t code; (code = slots_[slot]) >= 0; slot = (slot + 1) & mask) {
+        if (hashes_[code] == hash &&
+            offsets_[code + 1] - offsets_[code] == size &&
+            std::memcmp(&bytes_[offsets_[code]], data, size) == 0)
+          return code;
+      }
+
+      std::int32_t const code = count();
+      bytes_.insert(bytes_.end(), data, data + size);
+      offsets_.push_back(bytes_.size());
+      hashes_.push_back(hash);
+      slots_[slot] = code;
+      return code;
+    }
+
+    void string_dictionary::clear() {
+      bytes_.clear();
+      offsets_.assign(1, 0);
+      hashes_.clear();
+      std::fill(slots_.begin(), slots_.end(), -1);
+    }
+
+    void string_dictionary::grow() {
+      slots_.assign(std::max<std::size_t>(16, slots_.size() * 2), -1);
+      std::size_t const mask = slots_.size() - 1;
+      for (std::size_t code = 0; code != hashes_.size(); ++code) {
+        std::size_t slot = hashes_[code] & mask;
+        while (slots_[slot] >= 0)
+          slot = (slot + 1) & mask;
+        slots_[slot] = code;
+      }
+    }
+
+    columnar_extractor::columnar_extractor(column_spec const* columns, std::size_t count, std::size_t capacity)
+      : columns_(columns, columns + count)
+      , next_column_(count, -1)
+      , capacity_(capacity)
+      , row_(0)
+      , stamp_(0)
+      , column_stamps_(count, 0) {
+
+      build_node root = { std::string(), -1, {} };
+
+      for (std::size_t column = 0; column != count; ++column) {
+        build_node* current = &root;
+        char const* component = columns[column].path;
+        while (true) {
+          char const* const dot = std::strchr(component, '.');
+          std::string const name = dot ? std::string(component, dot) : std::string(component);
+
+          auto const found = std::find_if(current->children.begin(), current->children.end(),
+                                          [&](build_node const& child) { return child.name == name; });
+          if (found != current->children.end()) {
+            current = &*found;
+          } else {
+            current->children.push_back(build_node{ name, -1, {} });
+            current = &current->children.back();
+          }
+
+          if (!dot)
+            break;
+          component = dot + 1;
+        }
+
+        // Several columns may share a path, for instance to read one
+        // field both as int64 and as double.
+        std::int32_t* last = &current->column;
+        while (*last >= 0)
+          last = &next_column_[*last];
+        *last = column;
+      }
+
+      // Flatten the tree breadth first so that the children of each
+      // node are contiguous.
+      std::vector<build_node const*> pending(1, &root);
+      nodes_.push_back(node{ 0, 0, -1, 0, 0 });
+      for (std::size_t i = 0; i != pending.size(); ++i) {
+        build_node const& source = *pending[i];
+        nodes_[i].first_child = nodes_.size();
+        nodes_[i].child_count = source.children.size();
+        for (build_node const& child : source.children) {
+          nodes_.push_back(node{
+              static_cast<std::uint32_t>(names_.size()),
+              static_cast<std::uint32_t>(child.name.size()),
+              child.column,
+              0,
+              0 });
+          names_.insert(names_.end(), child.name.begin(), child.name.end());
+          pending.push_back(&child);
+        }
+      }
+
+      node_stamps_.assign(nodes_.size(), 0);
+    }
+
+    std::size_t columnar_extractor::extract(document_sequence const& documents) {
+      std::size_t row = 0;
+      for (auto current = documents.begin(); current != documents.end() && row != capacity_; ++current)
+        extract_row((*current).data, row++);
+      return row;
+    }
+
+    std::size_t columnar_extractor::extract(void const* const* documents, std::size_t count) {
+      std::size_t const rows = std::min(count, capacity_);
+      for (std::size_t row = 0; row != rows; ++row)
+        extract_row(documents[row], row);
+      return rows;
+    }
+
+    bool columnar_extractor::extract_row(void const* document, std::size_t row) {
+      row_ = row;
+      if (++stamp_ == 0) {
+        std::fill(node_stamps_.begin(), node_stamps_.end(), 0);
+        std::fill(column_stamps_.begin(), column_stamps_.end(), 0);
+        stamp_ = 1;
+      }
+
+      bool const ok = walk(document_view(document), nodes_[0]);
+
+      for (std::size_t column = 0; column != columns_.size(); ++column)
+        if (column_stamps_[column] != stamp_)
+          store_missing(column);
+
+      return ok;
+    }
+
+    bool columnar_extractor::walk(document_view const& document, node const& parent) {
+      std::uint32_t remaining = parent.child_count;
+
+      auto current = document.begin();
+      auto const end = document.end();
+      for (; current != end; ++current) {
+        element_view const& element = *current;
+
+        for (std::uint32_t i = 0; i != parent.child_count; ++i) {
+          std::uint32_t const index = parent.first_child + i;
+          node const& child = nodes_[index];
+          if (!element.has_name(names_.data() + child.name_offset, child.name_size))
+            continue;
+
+          if (node_stamps_[index] == stamp_)
+            break;
+          node_stamps_[index] = stamp_;
+
+          for (std::int32_t column = child.column; column >= 0; column = next_column_[column])
+            store(column, element);
+
+          if (child.child_count &&
+              (element.type() == types::document || element.type() == types::array) &&
+              !walk(document_view(element.as_document()), child))
+            return false;
+
+          if (--remaining == 0)
+            return true;
+          break;
+        }
+      }
+
+      return current.ok();
+    }
+
+    void columnar_extractor::store(std::size_t column, element_view const& element) {
+      column_spec const& spec = columns_[column];
+      types const type = element.type();
+
+      switch (spec.type) {
+        case column_type::int32:
+          if (type != types::int32)
+            return;
+          static_cast<std::int32_t*>(spec.values)[row_] = element.as_int32();
+          break;
+
+        case column_type::int64:
+          if (type == types::int64)
+            static_cast<std::int64_t*>(spec.values)[row_] = element.as_int64();
+          else if (type == types::int32)
+            static_cast<std::int64_t*>(spec.values)[row_] = element.as_int32();
+          else
+            return;
+          break;
+
+        case column_type::floating_point:
+          if (type == types::floating_point)
+            static_cast<double_t*>(spec.values)[row_] = element.as_floating_point();
+          else if (type == types::int32)
+            static_cast<double_t*>(spec.values)[row_] = element.as_int32();
+          else if (type == types::int64)
+            static_cast<double_t*>(spec.values)[row_] = element.as_int64();
+          else
+            return;
+          break;
+
+        case column_type::boolean:
+          if (type != types::boolean)
+            return;
+          static_cast<std::uint8_t*>(spec.values)[row_] = element.as_boolean();
+          break;
+
+        case column_type::utc_datetime:
+          if (type != types::utc_datetime)
+            return;
+          static_cast<std::int64_t*>(spec.values)[row_] = element.as_int64();
+          break;
+
+        case column_type::dictionary_string: {
+          if (type != types::utf8_string && type != types::symbol)
+            return;
+          string_cdata const value = element.as_string();
+          static_cast<std::int32_t*>(spec.values)[row_] = spec.dictionary->intern(value.data, value.size - 1);
+          break;
+        }
+      }
+
+      column_stamps_[column] = stamp_;
+      spec.validity[row_ / 8] |= static_cast<std::uint8_t>(1U << (row_ % 8));
+    }
+
+    void columnar_extractor::store_missing(std::size_t column) {
+      column_spec const& spec = columns_[column];
+      std::size_t const width = value_width(spec.type);
+      std::memset(static_cast<char*>(spec.values) + row_ * width, 0, width);
+      spec.validity[row_ / 8] &= static_cast<std::uint8_t>(~(1U << (row_ % 8)));
+    }
+
+  } // namespace bson
+} // namespace bassoon
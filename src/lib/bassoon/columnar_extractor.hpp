@@ -0,0 +1,188 @@
+#ifndef included_02dbe248_b71a_491f_be56_af2f7f3d74d0
+#define included_02dbe248_b71a_491f_be56_af2f7f3d74d0
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Maps distinct strings to dense int32 codes, in order of first
+    /// appearance. The strings are stored back to back in 'bytes',
+    /// with the string for code 'i' running from offsets()[i] to
+    /// offsets()[i + 1], which is the layout columnar engines expect
+    /// for a dictionary.
+    ///
+    class LIBBASSOON_EXPORT string_dictionary {
+    public:
+      string_dictionary();
+
+      ///
+      /// Returns the code for the 'size' bytes at 'data', adding them
+      /// to the dictionary if they are new.
+      ///
+      std::int32_t intern(char const* data, std::size_t size);
+
+      ///
+      /// The number of distinct strings.
+      ///
+      std::size_t count() const noexcept {
+        return offsets_.size() - 1;
+      }
+
+      std::string value(std::int32_t code) const {
+        return std::string(&bytes_[offsets_[code]], offsets_[code + 1] - offsets_[code]);
+      }
+
+      std::vector<char> const& bytes() const noexcept {
+        return bytes_;
+      }
+
+      std::vector<std::uint32_t> const& offsets() const noexcept {
+        return offsets_;
+      }
+
+      void clear();
+
+    private:
+      void grow();
+
+      std::vector<char> bytes_;
+      std::vector<std::uint32_t> offsets_;
+      std::vector<std::uint64_t> hashes_;
+
+      // Open addressing table of codes, or -1 for an empty slot. The
+      // size is a power of two that we keep at least twice 'count'.
+      std::vector<std::int32_t> slots_;
+    };
+
+    ///
+    /// The target type of a column, and which BSON types it accepts.
+    /// An element of any other type is treated as missing.
+    ///
+    enum class column_type {
+      // std::int32_t values, from int32 elements.
+      int32,
+
+      // std::int64_t values, from int32 and int64 elements.
+      int64,
+
+      // double_t values, from double, int32 and int64 elements.
+      floating_point,
+
+      // std::uint8_t values of 0 or 1, from boolean elements.
+      boolean,
+
+      // std::int64_t milliseconds since the epoch, from utc_datetime elements.
+      utc_datetime,
+
+      // std::int32_t codes into a string_dictionary, from string and symbol elements.
+      dictionary_string
+    };
+
+    ///
+    /// Describes one column to extract, and the caller's buffers that
+    /// receive it.
+    ///
+    struct column_spec {
+      // Dotted path to the field, such as "ts" or "tags.host".
+      char const* path;
+
+      column_type type;
+
+      // Room for 'capacity' values of the column's value type.
+      void* values;
+
+      // Room for (capacity + 7) / 8 bytes. Bit 'row % 8' of byte
+      // 'row / 8' is set if the row has a value.
+      std::uint8_t* validity;
+
+      // Receives the strings of a dictionary_string column. Unused
+      // for other column types.
+      string_dictionary* dictionary;
+    };
+
+    ///
+    /// Extracts typed columns from a batch of BSON documents into
+    /// caller provided struct-of-arrays buffers.
+    ///
+    /// The paths of the schema are compiled into a small tree keyed by
+    /// name, so each document is walked once, in place, comparing
+    /// each element's name length before its bytes and descending
+    /// only into subdocuments that hold wanted fields. The walk of a
+    /// document ends as soon as every wanted field has been seen. If
+    /// a field occurs more than once, the first occurrence wins.
+    ///
+    /// Every row of every column is written, so the buffers need not
+    /// be cleared first: missing values are stored as zero with their
+    /// validity bit cleared.
+    ///
+    class LIBBASSOON_EXPORT columnar_extractor {
+    public:
+      columnar_extractor(column_spec const* columns, std::size_t count, std::size_t capacity);
+
+      columnar_extractor(const columnar_extractor&) = delete;
+      columnar_extractor& operator=(const columnar_extractor&) = delete;
+
+      ///
+      /// Extracts one row per document, starting at row zero, until
+      /// the documents or the capacity run out. Returns the number of
+      /// rows written.
+      ///
+      std::size_t extract(document_sequence const& documents);
+
+      std::size_t extract(void const* const* documents, std::size_t count);
+
+      ///
+      /// Extracts 'document' into 'row'. Returns false if the
+      /// document turned out to be malformed, in which case the
+      /// fields before the malformed element are still extracted.
+      ///
+      bool extract_row(void const* document, std::size_t row);
+
+    private:
+      struct node {
+        // Name of this path component, in 'names_'.
+        std::uint32_t name_offset;
+        std::uint32_t name_size;
+
+        // The column for the path ending here, or -1.
+        std::int32_t column;
+
+        // Children are contiguous in 'nodes_'.
+        std::uint32_t first_child;
+        std::uint32_t child_count;
+      };
+
+      bool walk(document_view const& document, node const& parent);
+      void store(std::size_t column, element_view const& element);
+      void store_missing(std::size_t column);
+
+      std::vector<column_spec> columns_;
+
+      // Links columns that share a path, ending in -1.
+      std::vector<std::int32_t> next_column_;
+
+      std::size_t capacity_;
+
+      std::vector<node> nodes_;
+      std::vector<char> names_;
+
+      // The row currently being extracted, and a stamp that marks
+      // nodes and columns seen in this row without clearing them.
+      std::size_t row_;
+      std::uint32_t stamp_;
+      std::vector<std::uint32_t> node_stamps_;
+      std::vector<std::uint32_t> column_stamps_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_02dbe248_b71a_491f_be56_af2f7f3d74d0
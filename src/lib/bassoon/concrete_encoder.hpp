@@ -5,6 +5,7 @@
 #include <vector>
 
 #include <bassoon/abstract_encoder.hpp>
+#include <bassoon/encoder.hpp>
 
 namespace bassoon {
   namespace bson {
@@ -140,6 +141,16 @@ namespace bassoon {
         return *this;
       }
 
+      virtual concrete_encoder& encode_raw_elements(binary_cdata elements) final override {
+        current().encode_raw_elements(elements);
+        return *this;
+      }
+
+      virtual concrete_encoder& encode_raw_value(cstring_cdata name, types type, binary_cdata value) final override {
+        current().encode_raw_value(name, type, value);
+        return *this;
+      }
+
       virtual concrete_encoder& start_subdocument(cstring_cdata name) final override {
         encoders_.push(current().start_subdocument(name));
         return *this;
@@ -0,0 +1,289 @@
+#include <bassoon/corpus_generator.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      struct preset_entry {
+        corpus_preset preset;
+        char const* name;
+      };
+
+      preset_entry const k_presets[] = {
+        { corpus_preset::telemetry, "telemetry" },
+        { corpus_preset::user_profile, "user_profile" },
+        { corpus_preset::log_event, "log_event" },
+        { corpus_preset::wide_sparse, "wide_sparse" },
+      };
+
+      // Field names are made of these, joined by underscores.
+      char const* const k_syllables[] = {
+        "id", "name", "value", "count", "time", "host", "user", "status",
+        "level", "code", "type", "source", "target", "bytes", "rate", "region",
+        "created", "updated", "tags", "score", "email", "city", "zip", "total",
+      };
+
+      std::size_t const k_syllable_count = sizeof(k_syllables) / sizeof(k_syllables[0]);
+
+      // Big enough for the largest document that BSON allows.
+      using document_buffer = std::array<byte_t, 16 << 20>;
+
+      // Files are written in chunks of about this many bytes.
+      std::size_t const k_write_chunk = 1 << 20;
+
+      void append_documents(corpus_generator& generator, document_buffer& buffer,
+                            std::vector<byte_t>& corpus, std::size_t count) {
+        for (std::size_t i = 0; i != count; ++i) {
+          auto writer = make_array_writer(buffer);
+          if (generator.generate(writer))
+            corpus.insert(corpus.end(), buffer.begin(), buffer.begin() + writer.valid());
+        }
+      }
+
+      bool write_fully(int fd, byte_t const* data, std::size_t size) {
+        while (size != 0) {
+          ssize_t const written = ::write(fd, data, size);
+          if (written == -1) {
+            if (errno == EINTR)
+              continue;
+            return false;
+          }
+          data += written;
+          size -= written;
+        }
+        return true;
+      }
+
+    }  // namespace
+
+    corpus_profile make_corpus_profile(corpus_preset preset) noexcept {
+      corpus_profile profile;
+      corpus_type_weights& weights = profile.weights;
+      switch (preset) {
+        case corpus_preset::telemetry:
+          profile.min_fields = 24;
+          profile.max_fields = 32;
+          profile.max_depth = 0;
+          weights.floating_point = 8;
+          weights.int64 = 3;
+          weights.int32 = 2;
+          weights.utc_datetime = 1;
+          weights.utf8_string = 1;
+          weights.boolean = 1;
+          profile.min_string_length = 4;
+          profile.max_string_length = 16;
+          profile.string_lengths = corpus_length_distribution::uniform;
+          profile.key_vocabulary = 32;
+          break;
+
+        case corpus_preset::user_profile:
+          profile.min_fields = 6;
+          profile.max_fields = 14;
+          profile.max_depth = 2;
+          weights.utf8_string = 6;
+          weights.int32 = 2;
+          weights.boolean = 2;
+          weights.document = 2;
+          weights.array = 2;
+          weights.utc_datetime = 1;
+          weights.object_id = 1;
+          weights.floating_point = 1;
+          weights.null = 1;
+          profile.min_string_length = 3;
+          profile.max_string_length = 48;
+          profile.min_array_length = 0;
+          profile.max_array_length = 6;
+          profile.key_vocabulary = 14;
+          break;
+
+        case corpus_preset::log_event:
+          profile.min_fields = 5;
+          profile.max_fields = 9;
+          profile.max_depth = 1;
+          weights.utf8_string = 4;
+          weights.int32 = 2;
+          weights.utc_datetime = 1;
+          weights.int64 = 1;
+          weights.document = 1;
+          profile.min_string_length = 8;
+          profile.max_string_length = 1024;
+          profile.key_vocabulary = 9;
+          break;
+
+        case corpus_preset::wide_sparse:
+          profile.min_fields = 20;
+          profile.max_fields = 60;
+          profile.max_depth = 1;
+          weights.utf8_string = 3;
+          weights.int32 = 3;
+          weights.floating_point = 2;
+          weights.boolean = 2;
+          weights.int64 = 1;
+          weights.null = 1;
+          weights.document = 1;
+          weights.array = 1;
+          profile.min_string_length = 0;
+          profile.max_string_length = 24;
+          profile.max_array_length = 4;
+          profile.key_vocabulary = 4000;
+          profile.unique_keys_per_mille = 5;
+          break;
+      }
+      return profile;
+    }
+
+    char const* corpus_preset_name(corpus_preset preset) noexcept {
+      for (auto const& entry : k_presets) {
+        if (entry.preset == preset)
+          return entry.name;
+      }
+      return "unknown";
+    }
+
+    bool find_corpus_preset(char const* name, corpus_preset& preset) noexcept {
+      for (auto const& entry : k_presets) {
+        if (std::strcmp(entry.name, name) == 0) {
+          preset = entry.preset;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    corpus_generator::corpus_generator(corpus_profile const& profile, std::uint64_t seed)
+      : profile_(profile)
+      , random_(seed)
+      , unique_names_(0)
+      , object_ids_(0) {
+
+      // Name 'i' spells out 'i' in base k_syllable_count, so that no
+      // two names are the same.
+      std::size_t const names = profile_.key_vocabulary == 0 ? 1 : profile_.key_vocabulary;
+      vocabulary_.reserve(names);
+      for (std::size_t i = 0; i != names; ++i) {
+        std::string name = k_syllables[i % k_syllable_count];
+        for (std::size_t rest = i / k_syllable_count; rest != 0; rest /= k_syllable_count) {
+          name += '_';
+          name += k_syllables[rest % k_syllable_count];
+        }
+        vocabulary_.push_back(name);
+      }
+    }
+
+    void corpus_generator::append(std::vector<byte_t>& corpus, std::size_t count) {
+      std::unique_ptr<document_buffer> buffer(new document_buffer);
+      append_documents(*this, *buffer, corpus, count);
+    }
+
+    bool corpus_generator::write(char const* path, std::size_t count) {
+      int const fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd == -1)
+        return false;
+
+      std::unique_ptr<document_buffer> buffer(new document_buffer);
+      std::vector<byte_t> chunk;
+      chunk.reserve(k_write_chunk);
+      bool ok = true;
+      for (std::size_t generated = 0; ok && generated != count; ++generated) {
+        append_documents(*this, *buffer, chunk, 1);
+        if (chunk.size() >= k_write_chunk || generated + 1 == count) {
+          ok = write_fully(fd, chunk.data(), chunk.size());
+          chunk.clear();
+        }
+      }
+
+      int const error = errno;
+      if (::close(fd) == -1 && ok)
+        return false;
+      errno = error;
+      return ok;
+    }
+
+    types corpus_generator::pick_type(bool nest) {
+      corpus_type_weights const& weights = profile_.weights;
+      struct {
+        types type;
+        unsigned weight;
+      } const choices[] = {
+        { types::floating_point, weights.floating_point },
+        { types::utf8_string, weights.utf8_string },
+        { types::document, nest ? weights.document : 0 },
+        { types::array, nest ? weights.array : 0 },
+        { types::binary, weights.binary },
+        { types::object_id, weights.object_id },
+        { types::boolean, weights.boolean },
+        { types::utc_datetime, weights.utc_datetime },
+        { types::null, weights.null },
+        { types::int32, weights.int32 },
+        { types::timestamp, weights.timestamp },
+        { types::int64, weights.int64 },
+      };
+
+      std::uint64_t total = 0;
+      for (auto const& choice : choices)
+        total += choice.weight;
+      if (total == 0)
+        return types::int32;
+
+      std::uint64_t pick = below(total);
+      for (auto const& choice : choices) {
+        if (pick < choice.weight)
+          return choice.type;
+        pick -= choice.weight;
+      }
+      return types::int32;
+    }
+
+    cstring_cdata corpus_generator::pick_name(std::size_t field, std::size_t first_name, std::size_t stride) {
+      if (profile_.unique_keys_per_mille != 0 && below(1000) < profile_.unique_keys_per_mille) {
+        int const size = std::snprintf(unique_name_.data(), unique_name_.size(), "unique_%llu",
+                                       static_cast<unsigned long long>(++unique_names_));
+        return cstring_cdata(unique_name_.data(), size);
+      }
+      return vocabulary_[(first_name + field * stride) % vocabulary_.size()];
+    }
+
+    std::size_t corpus_generator::fill_value() {
+      std::size_t size = between(profile_.min_string_length, profile_.max_string_length);
+      if (profile_.string_lengths == corpus_length_distribution::skewed_short)
+        size = std::min(size, between(profile_.min_string_length, profile_.max_string_length));
+
+      // Lower case letters and spaces, five bits at a time.
+      static char const k_alphabet[] = "abcdefghijklmnopqrstuvwxyz      ";
+      value_.resize(size + 1);
+      std::uint64_t bits = 0;
+      for (std::size_t i = 0; i != size; ++i) {
+        if (i % 12 == 0)
+          bits = next();
+        value_[i] = k_alphabet[bits & 31];
+        bits >>= 5;
+      }
+      value_[size] = '\0';
+      return size;
+    }
+
+    void corpus_generator::fill_object_id(byte_t* id) {
+      // A random head and an ascending count, as ids made by one
+      // process are, written byte by byte so that they do not depend
+      // on the byte order of the platform.
+      std::uint64_t const head = next();
+      std::uint64_t const count = ++object_ids_;
+      for (std::size_t i = 0; i != 4; ++i)
+        id[i] = static_cast<byte_t>(head >> (8 * i));
+      for (std::size_t i = 0; i != 8; ++i)
+        id[4 + i] = static_cast<byte_t>(count >> (8 * (7 - i)));
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,296 @@
+#ifndef included_046adff2_a615_4c23_9db7_f0e9476f4a7d
+#define included_046adff2_a615_4c23_9db7_f0e9476f4a7d
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/encoder.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// The relative weights of the types that a generated value can
+    /// have. Subdocuments and subarrays are not generated past the
+    /// deepest level of a profile, whatever their weight.
+    ///
+    struct corpus_type_weights {
+      unsigned floating_point = 0;
+      unsigned utf8_string = 0;
+      unsigned document = 0;
+      unsigned array = 0;
+      unsigned binary = 0;
+      unsigned object_id = 0;
+      unsigned boolean = 0;
+      unsigned utc_datetime = 0;
+      unsigned null = 0;
+      unsigned int32 = 0;
+      unsigned timestamp = 0;
+      unsigned int64 = 0;
+    };
+
+    enum class corpus_length_distribution {
+      // Every length from the least to the most equally likely.
+      uniform,
+
+      // Short lengths likelier than long ones, as with most strings
+      // in real data: the lesser of two uniform lengths.
+      skewed_short
+    };
+
+    ///
+    /// The shape of the documents in a corpus.
+    ///
+    struct corpus_profile {
+      // Fields in every document and subdocument.
+      std::size_t min_fields = 4;
+      std::size_t max_fields = 16;
+
+      // How many levels of subdocuments and subarrays there can be
+      // under a top level document.
+      std::size_t max_depth = 2;
+
+      corpus_type_weights weights;
+
+      // The bytes in strings and binary values, not counting the
+      // null byte of strings.
+      std::size_t min_string_length = 0;
+      std::size_t max_string_length = 32;
+      corpus_length_distribution string_lengths = corpus_length_distribution::skewed_short;
+
+      // The values in arrays.
+      std::size_t min_array_length = 0;
+      std::size_t max_array_length = 8;
+
+      // Field names are drawn from a vocabulary of this many names,
+      // so that documents share names as documents in a collection
+      // do. If there are no more names than 'max_fields', every
+      // document names its fields in the same order, as records of
+      // one schema do, repeating names if it runs out; otherwise each
+      // document draws a different selection.
+      std::size_t key_vocabulary = 64;
+
+      // In how many fields in 1000 the name is instead one that no
+      // other document uses.
+      unsigned unique_keys_per_mille = 0;
+    };
+
+    ///
+    /// Named profiles, so that results taken with the same one can be
+    /// compared between versions.
+    ///
+    enum class corpus_preset {
+      // Flat records of a few dozen numeric metrics and a timestamp.
+      telemetry,
+
+      // Nested records of names, addresses, preferences and lists.
+      user_profile,
+
+      // A timestamp, a level, a few labels and a long message.
+      log_event,
+
+      // A few dozen fields out of thousands of possible names.
+      wide_sparse
+    };
+
+    LIBBASSOON_EXPORT corpus_profile make_corpus_profile(corpus_preset preset) noexcept;
+
+    LIBBASSOON_EXPORT char const* corpus_preset_name(corpus_preset preset) noexcept;
+
+    ///
+    /// Looks up a preset by the name that 'corpus_preset_name' gives
+    /// it. Returns false if there is none.
+    ///
+    LIBBASSOON_EXPORT bool find_corpus_preset(char const* name, corpus_preset& preset) noexcept;
+
+    ///
+    /// Generates BSON documents to a profile with the encoder. The
+    /// same profile and seed generate the same documents, byte for
+    /// byte, on every platform: the generator draws from
+    /// std::mt19937_64, which the standard defines exactly, and not
+    /// from the standard distributions, which it does not.
+    ///
+    class LIBBASSOON_EXPORT corpus_generator {
+    public:
+      corpus_generator(corpus_profile const& profile, std::uint64_t seed);
+
+      ///
+      /// Writes the next document into 'writer'. Returns false if the
+      /// writer ran out of room, in which case the generator has
+      /// still moved on to the document after.
+      ///
+      template<typename Writer_type>
+      bool generate(Writer_type& writer);
+
+      ///
+      /// Appends the next 'count' documents to 'corpus'.
+      ///
+      void append(std::vector<byte_t>& corpus, std::size_t count);
+
+      ///
+      /// Writes the next 'count' documents to the file at 'path',
+      /// replacing it. Returns false, with errno set, on failure.
+      ///
+      bool write(char const* path, std::size_t count);
+
+    private:
+      std::uint64_t next() {
+        return random_();
+      }
+
+      // A number from zero up to, but not including, 'bound'.
+      std::uint64_t below(std::uint64_t bound) {
+        return bound == 0 ? 0 : next() % bound;
+      }
+
+      std::size_t between(std::size_t least, std::size_t most) {
+        return least + below(most < least ? 1 : most - least + 1);
+      }
+
+      // The type of the next value, which may only nest if 'nest'.
+      types pick_type(bool nest);
+
+      cstring_cdata pick_name(std::size_t field, std::size_t first_name, std::size_t stride);
+
+      // The next string or binary value, in 'value_'.
+      std::size_t fill_value();
+
+      void fill_object_id(byte_t* id);
+
+      template<typename Encoder_type>
+      void generate_fields(Encoder_type& encoder, std::size_t depth);
+
+      template<typename Encoder_type>
+      void generate_elements(Encoder_type& encoder, std::size_t depth);
+
+      template<typename Encoder_type>
+      void generate_value(Encoder_type& encoder, cstring_cdata name, std::size_t depth);
+
+      corpus_profile profile_;
+      std::mt19937_64 random_;
+
+      std::vector<std::string> vocabulary_;
+      std::uint64_t unique_names_;
+      std::array<char, 32> unique_name_;
+      std::vector<char> value_;
+      std::uint64_t object_ids_;
+    };
+
+    template<typename Writer_type>
+    bool corpus_generator::generate(Writer_type& writer) {
+      auto document = start_document(writer);
+      generate_fields(document, 0);
+      document.finish();
+      return document.ok();
+    }
+
+    template<typename Encoder_type>
+    void corpus_generator::generate_fields(Encoder_type& encoder, std::size_t depth) {
+      std::size_t const fields = between(profile_.min_fields, profile_.max_fields);
+
+      // From a large vocabulary, names are taken from a random place,
+      // a random stride apart, so that they do not repeat within a
+      // document.
+      std::size_t first_name = 0;
+      std::size_t stride = 1;
+      if (vocabulary_.size() > profile_.max_fields) {
+        first_name = below(vocabulary_.size());
+        stride = between(1, vocabulary_.size() / (fields == 0 ? 1 : fields));
+      }
+
+      for (std::size_t field = 0; field != fields; ++field)
+        generate_value(encoder, pick_name(field, first_name, stride), depth);
+    }
+
+    template<typename Encoder_type>
+    void corpus_generator::generate_elements(Encoder_type& encoder, std::size_t depth) {
+      std::size_t const elements = between(profile_.min_array_length, profile_.max_array_length);
+      char name[24];
+      for (std::size_t index = 0; index != elements; ++index) {
+        int const size = std::snprintf(name, sizeof(name), "%zu", index);
+        generate_value(encoder, cstring_cdata(name, size), depth);
+      }
+    }
+
+    template<typename Encoder_type>
+    void corpus_generator::generate_value(Encoder_type& encoder, cstring_cdata name, std::size_t depth) {
+      switch (pick_type(depth < profile_.max_depth)) {
+        case types::document: {
+          auto nested = encoder.start_subdocument(name);
+          generate_fields(nested, depth + 1);
+          nested.finish();
+          break;
+        }
+
+        case types::array: {
+          auto nested = encoder.start_subarray(name);
+          generate_elements(nested, depth + 1);
+          nested.finish();
+          break;
+        }
+
+        case types::utf8_string: {
+          std::size_t const size = fill_value();
+          encoder.encode_utf8_string(name, string_cdata(value_.data(), size));
+          break;
+        }
+
+        case types::binary: {
+          std::size_t const size = fill_value();
+          encoder.encode_binary(name, binary_subtypes::generic, binary_cdata(value_.data(), size));
+          break;
+        }
+
+        case types::object_id: {
+          byte_t id[k_object_id_length];
+          fill_object_id(id);
+          encoder.encode_object_id(name, object_id_cdata(id));
+          break;
+        }
+
+        case types::boolean:
+          encoder.encode_boolean(name, next() & 1);
+          break;
+
+        case types::utc_datetime:
+          encoder.encode_utc_datetime(name, 1500000000000LL + static_cast<std::int64_t>(below(1000000000000ULL)));
+          break;
+
+        case types::null:
+          encoder.encode_null(name);
+          break;
+
+        case types::int32:
+          encoder.encode_int32(name, static_cast<std::int32_t>(below(100000)));
+          break;
+
+        case types::timestamp: {
+          // Drawn one at a time, so that the corpus does not depend
+          // on the order in which the compiler evaluates operands.
+          std::uint64_t const seconds = 1500000000ULL + below(100000000);
+          std::uint64_t const increment = below(1000);
+          encoder.encode_timestamp(name, static_cast<std::int64_t>(seconds << 32 | increment));
+          break;
+        }
+
+        case types::int64:
+          encoder.encode_int64(name, static_cast<std::int64_t>(next() >> 1));
+          break;
+
+        default:
+          // The 53 random bits of a double in [0, 1), scaled.
+          encoder.encode_floating_point(name, (next() >> 11) * (1.0 / (std::uint64_t(1) << 53)) * 1000.0);
+          break;
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_046adff2_a615_4c23_9db7_f0e9476f4a7d
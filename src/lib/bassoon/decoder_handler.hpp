@@ -0,0 +1,145 @@
+#ifndef included_f1ce2248_b8aa_49a3_9362_085e4d21f750
+#define included_f1ce2248_b8aa_49a3_9362_085e4d21f750
+
+#include <bassoon/bson.hpp>
+#include <bassoon/binary_data.hpp>
+#include <bassoon/string_data.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Every decoder event returns a handler_result. Returning 'stop'
+    /// ends decoding: the decoder delivers no further events and
+    /// reports that it was stopped.
+    ///
+    enum class handler_result {
+      proceed,
+      stop
+    };
+
+    ///
+    /// The set of events a decoder delivers to its handler. The
+    /// events mirror the encoder entry points, so a handler that
+    /// forwards each event to an encoder re-encodes its input.
+    ///
+    /// Handlers are resolved statically: decoders take the handler
+    /// type as a template parameter and call these members by
+    /// name. This class implements every event as a no-op, so you
+    /// can derive from it and hide only the events you care about.
+    ///
+    /// Any data passed to an event is only valid for the duration of
+    /// that event. Copy it if you need it later.
+    ///
+    struct null_decoder_handler {
+
+      ///
+      /// A new top level document has started.
+      ///
+      handler_result on_start_document() {
+        return handler_result::proceed;
+      }
+
+      ///
+      /// A subdocument named 'name' has started.
+      ///
+      handler_result on_start_subdocument(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+
+      ///
+      /// A subarray named 'name' has started.
+      ///
+      handler_result on_start_subarray(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+
+      ///
+      /// The innermost open document or array has ended. Delivered
+      /// once for every start event, including the top level one.
+      ///
+      handler_result on_finish() {
+        return handler_result::proceed;
+      }
+
+      handler_result on_floating_point(cstring_cdata name, double_t value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_utf8_string(cstring_cdata name, string_cdata value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_binary(cstring_cdata name, binary_subtypes subtype, binary_cdata data) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_undefined(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_object_id(cstring_cdata name, object_id_cdata id) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_boolean(cstring_cdata name, bool value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_utc_datetime(cstring_cdata name, std::int64_t value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_null(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_regex(cstring_cdata name, cstring_cdata regex, cstring_cdata options) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_db_pointer(cstring_cdata name, string_cdata dbname, object_id_cdata id) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_javascript(cstring_cdata name, string_cdata code) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_symbol(cstring_cdata name, string_cdata symbol) {
+        return handler_result::proceed;
+      }
+
+      ///
+      /// 'scope' points to a complete BSON document (leading length,
+      /// trailing null byte).
+      ///
+      handler_result on_scoped_javascript(cstring_cdata name, string_cdata code, void const* scope) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_int32(cstring_cdata name, std::int32_t value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_timestamp(cstring_cdata name, std::int64_t value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_int64(cstring_cdata name, std::int64_t value) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_min_key(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+
+      handler_result on_max_key(cstring_cdata name) {
+        return handler_result::proceed;
+      }
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_f1ce2248_b8aa_49a3_9362_085e4d21f750
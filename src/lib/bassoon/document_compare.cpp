@@ -0,0 +1,238 @@
+#include <bassoon/document_compare.hpp>
+
+#include <cmath>
+#include <cstring>
+
+namespace bassoon {
+  namespace bson {
+    namespace compare_details {
+
+      namespace {
+
+        template<typename T>
+        int compare_scalars(T a, T b) noexcept {
+          return (a < b) ? -1 : (b < a) ? 1 : 0;
+        }
+
+        int compare_doubles(double_t a, double_t b) noexcept {
+          if (a < b)
+            return -1;
+          if (b < a)
+            return 1;
+          if (a == b)
+            return 0;
+          // At least one is NaN.
+          return std::isnan(a) ? (std::isnan(b) ? 0 : -1) : 1;
+        }
+
+        int compare_bytes(byte_t const* a, std::size_t a_size, byte_t const* b, std::size_t b_size) noexcept {
+          int const result = std::memcmp(a, b, (a_size < b_size) ? a_size : b_size);
+          if (result != 0)
+            return (result < 0) ? -1 : 1;
+          return compare_scalars(a_size, b_size);
+        }
+
+        // Compares the length prefixed strings at 'a' and 'b', whose
+        // lengths include their null bytes.
+        int compare_strings(byte_t const* a, byte_t const* b) noexcept {
+          std::size_t const a_size = element_details::read_little_endian<length_t>(a);
+          std::size_t const b_size = element_details::read_little_endian<length_t>(b);
+          return compare_bytes(a + sizeof(length_t), a_size, b + sizeof(length_t), b_size);
+        }
+
+        int compare_numbers(element_view const& a, element_view const& b) noexcept {
+          types const a_type = a.type();
+          types const b_type = b.type();
+
+          if (a_type == b_type) {
+            if (a_type == types::int32)
+              return compare_scalars(a.as_int32(), b.as_int32());
+            if (a_type == types::int64)
+              return compare_scalars(a.as_int64(), b.as_int64());
+            return compare_doubles(a.as_floating_point(), b.as_floating_point());
+          }
+
+          // Every int32 is exactly a double.
+          if (a_type == types::floating_point)
+            return -((b_type == types::int32) ?
+                     compare_doubles(b.as_int32(), a.as_floating_point()) :
+                     compare_int64_double(b.as_int64(), a.as_floating_point()));
+          if (b_type == types::floating_point)
+            return (a_type == types::int32) ?
+              compare_doubles(a.as_int32(), b.as_floating_point()) :
+              compare_int64_double(a.as_int64(), b.as_floating_point());
+
+          std::int64_t const a_value = (a_type == types::int32) ? a.as_int32() : a.as_int64();
+          std::int64_t const b_value = (b_type == types::int32) ? b.as_int32() : b.as_int64();
+          return compare_scalars(a_value, b_value);
+        }
+
+        // Scoped JavaScript is a total length, the code as a string,
+        // and the scope as a document. Falls back to comparing the
+        // bytes if either value is not framed that way.
+        int compare_scoped_javascript(element_view const& a, element_view const& b) noexcept {
+          std::size_t const header = 2 * sizeof(length_t);
+          if (a.value_size() >= header && b.value_size() >= header) {
+            byte_t const* const a_code = a.value() + sizeof(length_t);
+            byte_t const* const b_code = b.value() + sizeof(length_t);
+            std::size_t const a_code_size = sizeof(length_t) + element_details::read_little_endian<length_t>(a_code);
+            std::size_t const b_code_size = sizeof(length_t) + element_details::read_little_endian<length_t>(b_code);
+            std::size_t const a_rest = a.value_size() - sizeof(length_t);
+            std::size_t const b_rest = b.value_size() - sizeof(length_t);
+
+            if (a_code_size <= a_rest && b_code_size <= b_rest) {
+              int const result = compare_strings(a_code, b_code);
+              if (result != 0)
+                return result;
+              return compare_documents(document_view(document_cdata(a_code + a_code_size, a_rest - a_code_size)),
+                                       document_view(document_cdata(b_code + b_code_size, b_rest - b_code_size)));
+            }
+          }
+          return compare_bytes(a.value(), a.value_size(), b.value(), b.value_size());
+        }
+
+        // Compares values whose types have the same place in the order.
+        int compare_same_kind(element_view const& a, element_view const& b) noexcept {
+          switch (a.type()) {
+            case types::floating_point:
+            case types::int32:
+            case types::int64:
+              return compare_numbers(a, b);
+
+            case types::utf8_string:
+            case types::symbol:
+            case types::javascript:
+              return compare_strings(a.value(), b.value());
+
+            case types::document:
+            case types::array:
+              return compare_documents(document_view(a.as_document()), document_view(b.as_document()));
+
+            case types::binary: {
+              // Size first, then the subtype and bytes together.
+              int const result = compare_scalars(a.value_size(), b.value_size());
+              if (result != 0)
+                return result;
+              return compare_bytes(a.value() + sizeof(length_t), a.value_size() - sizeof(length_t),
+                                   b.value() + sizeof(length_t), b.value_size() - sizeof(length_t));
+            }
+
+            case types::object_id:
+            case types::boolean:
+              return compare_bytes(a.value(), a.value_size(), b.value(), b.value_size());
+
+            case types::utc_datetime:
+              return compare_scalars(a.as_int64(), b.as_int64());
+
+            case types::timestamp:
+              return compare_scalars(static_cast<std::uint64_t>(a.as_int64()),
+                                     static_cast<std::uint64_t>(b.as_int64()));
+
+            case types::regex: {
+              // The pattern, then the options. Both are null terminated,
+              // and the null sorts below every other byte.
+              std::size_t const a_pattern = std::strlen(reinterpret_cast<char const*>(a.value())) + 1;
+              std::size_t const b_pattern = std::strlen(reinterpret_cast<char const*>(b.value())) + 1;
+              int const result = compare_bytes(a.value(), a_pattern, b.value(), b_pattern);
+              if (result != 0)
+                return result;
+              return compare_bytes(a.value() + a_pattern, a.value_size() - a_pattern,
+                                   b.value() + b_pattern, b.value_size() - b_pattern);
+            }
+
+            case types::db_pointer_no_deprecated: {
+              // The length of the namespace, then the namespace and the
+              // ObjectId together.
+              int const result = compare_scalars(a.value_size(), b.value_size());
+              if (result != 0)
+                return result;
+              return compare_bytes(a.value(), a.value_size(), b.value(), b.value_size());
+            }
+
+            case types::scoped_javascript:
+              return compare_scoped_javascript(a, b);
+
+            default:
+              // MinKey, MaxKey, null and undefined have no value.
+              return 0;
+          }
+        }
+
+      } // namespace
+
+      int compare_int64_double(std::int64_t a, double_t b) noexcept {
+        if (std::isnan(b))
+          return 1;
+        // 2^63 is the first double past the int64 range.
+        if (b >= 9223372036854775808.0)
+          return -1;
+        if (b < -9223372036854775808.0)
+          return 1;
+
+        // 'b' is within range, so its integral part is exact as an
+        // int64, and what is left is exact as a double.
+        std::int64_t const integral = static_cast<std::int64_t>(b);
+        if (a != integral)
+          return (a < integral) ? -1 : 1;
+        double_t const fraction = b - static_cast<double_t>(integral);
+        return (fraction > 0) ? -1 : (fraction < 0) ? 1 : 0;
+      }
+
+    } // namespace compare_details
+
+    int compare_values(element_view const& a, element_view const& b) noexcept {
+      using namespace compare_details;
+
+      // The same type: go straight to the value.
+      if (a.type() != b.type()) {
+        int const a_place = canonical_type(a.type());
+        int const b_place = canonical_type(b.type());
+        if (a_place != b_place)
+          return (a_place < b_place) ? -1 : 1;
+      }
+      return compare_same_kind(a, b);
+    }
+
+    int compare_elements(element_view const& a, element_view const& b) noexcept {
+      using namespace compare_details;
+
+      if (a.type() != b.type()) {
+        int const a_place = canonical_type(a.type());
+        int const b_place = canonical_type(b.type());
+        if (a_place != b_place)
+          return (a_place < b_place) ? -1 : 1;
+      }
+
+      // Names are null terminated, and most are short enough that a
+      // loop beats a call to strcmp.
+      byte_t const* a_name = a.data() + 1;
+      byte_t const* b_name = b.data() + 1;
+      for (; *a_name == *b_name; ++a_name, ++b_name)
+        if (*a_name == 0)
+          return compare_same_kind(a, b);
+      return (*a_name < *b_name) ? -1 : 1;
+    }
+
+    int compare_documents(document_view const& a, document_view const& b, std::uint32_t descending) noexcept {
+      if (a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0)
+        return 0;
+
+      auto a_current = a.begin();
+      auto b_current = b.begin();
+      auto const a_end = a.end();
+      auto const b_end = b.end();
+
+      for (std::size_t index = 0;; ++index, ++a_current, ++b_current) {
+        if (a_current == a_end)
+          return (b_current == b_end) ? 0 : -1;
+        if (b_current == b_end)
+          return 1;
+
+        int const result = compare_elements(*a_current, *b_current);
+        if (result != 0)
+          return (index < 32 && (descending >> index) & 1) ? -result : result;
+      }
+    }
+
+  } // namespace bson
+} // namespace bassoon
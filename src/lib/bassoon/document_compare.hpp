@@ -0,0 +1,122 @@
+#ifndef included_4a6a8d62_09bc_4d0b_a58e_69a106be2555
+#define included_4a6a8d62_09bc_4d0b_a58e_69a106be2555
+
+#include <cstdint>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace compare_details {
+
+      // The place of each type in MongoDB's sort order. Types that
+      // compare by value with one another share a place: all the
+      // numbers, and strings with symbols.
+      inline int canonical_type(types type) noexcept {
+        switch (type) {
+          case types::min:                      return 0;
+          case types::undefined_no_deprecated:  return 1;
+          case types::null:                     return 2;
+          case types::floating_point:
+          case types::int32:
+          case types::int64:                    return 3;
+          case types::utf8_string:
+          case types::symbol:                   return 4;
+          case types::document:                 return 5;
+          case types::array:                    return 6;
+          case types::binary:                   return 7;
+          case types::object_id:                return 8;
+          case types::boolean:                  return 9;
+          case types::utc_datetime:             return 10;
+          case types::timestamp:                return 11;
+          case types::regex:                    return 12;
+          case types::db_pointer_no_deprecated: return 13;
+          case types::javascript:               return 14;
+          case types::scoped_javascript:        return 15;
+          case types::max:                      return 16;
+        }
+        return 16;
+      }
+
+      // Compares exactly, without rounding 'a' to a double. NaN is
+      // less than every number.
+      LIBBASSOON_EXPORT int compare_int64_double(std::int64_t a, double_t b) noexcept;
+
+    } // namespace compare_details
+
+    ///
+    /// Compares the values of two elements in MongoDB's order, as
+    /// used for sorting and by indexes, ignoring their names. Returns
+    /// a negative number, zero, or a positive number, like memcmp.
+    ///
+    /// Values of different types compare by the place of their type
+    /// in the order: MinKey, undefined, null, numbers, strings and
+    /// symbols, documents, arrays, binary, ObjectId, booleans, dates,
+    /// timestamps, regular expressions, DBPointer, JavaScript, scoped
+    /// JavaScript, MaxKey.
+    ///
+    /// Numbers compare by value whatever their types, exactly, with
+    /// NaN below every other number, and -0.0 equal to 0.0. Strings
+    /// compare by their bytes, with no collation; binary compares by
+    /// size first; documents and arrays compare as below.
+    ///
+    /// The work is done on the bytes in place, with no decoding:
+    /// ObjectIds, strings and binary are compared with memcmp, and
+    /// the doubles and integers of values of the same type are read
+    /// as they are, with the exact mixed comparison only when the
+    /// types of two numbers differ.
+    ///
+    LIBBASSOON_EXPORT int compare_values(element_view const& a, element_view const& b) noexcept;
+
+    ///
+    /// As above, but two elements whose types differ in place compare
+    /// by type, then by name, then by value, as MongoDB compares the
+    /// elements of documents.
+    ///
+    LIBBASSOON_EXPORT int compare_elements(element_view const& a, element_view const& b) noexcept;
+
+    ///
+    /// Compares two documents element by element with
+    /// 'compare_elements'; a document that runs out first is the
+    /// lesser. Documents whose bytes are identical, at any depth,
+    /// compare equal with a single memcmp.
+    ///
+    /// Bit 'i' of 'descending' reverses the comparison of the 'i'th
+    /// element, counting from zero, for compound index keys such as
+    /// { a : 1, b : -1 }. It applies only to the first 32 elements
+    /// and only at the top level.
+    ///
+    /// Both documents should be well formed. If either is not, it
+    /// compares as though it ended at the first malformed element.
+    ///
+    LIBBASSOON_EXPORT int compare_documents(document_view const& a, document_view const& b,
+                                            std::uint32_t descending = 0) noexcept;
+
+    ///
+    /// A strict weak ordering of documents, for std::sort and the
+    /// ordered containers.
+    ///
+    class document_less {
+    public:
+      explicit document_less(std::uint32_t descending = 0) noexcept
+        : descending_(descending) {}
+
+      bool operator()(document_view const& a, document_view const& b) const noexcept {
+        return compare_documents(a, b, descending_) < 0;
+      }
+
+      bool operator()(void const* a, void const* b) const noexcept {
+        return compare_documents(document_view(a), document_view(b), descending_) < 0;
+      }
+
+    private:
+      std::uint32_t descending_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_4a6a8d62_09bc_4d0b_a58e_69a106be2555
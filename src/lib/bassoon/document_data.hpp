@@ -1,24 +1,44 @@
 #ifndef included_6bf34bab_ade9_4622_9af8_c7e5c3345325
 #define included_6bf34bab_ade9_4622_9af8_c7e5c3345325
 
+#include <cstring>
+
+#include <bassoon/binary_data.hpp>
+#include <bassoon/endian.hpp>
+
 namespace bassoon {
   namespace bson {
 
+    ///
+    /// A complete BSON document in memory: its leading length, its
+    /// elements, and its trailing null byte. 'size' covers all of it.
+    ///
     template<typename T, typename S>
-    struct generic_document_data : generic_binary_data<T, S> {
+    struct generic_document_data : public generic_binary_data<T, S> {
 
       using base_type = generic_binary_data<T, S>;
       using value_type = typename base_type::value_type;
       using pointer_type = typename base_type::pointer_type;
       using size_type = typename base_type::size_type;
 
-      generic_document_data(pointer_type data)
-        : generic_binary_data(data, get_size(data)) {}
+      // Reads the size out of the document's leading length.
+      explicit generic_document_data(pointer_type data) noexcept
+        : base_type(data, get_size(data)) {}
+
+      // Use this if you already know the size of the document.
+      constexpr generic_document_data(pointer_type data, size_type size) noexcept
+        : base_type(data, size) {}
 
+    private:
+      static size_type get_size(pointer_type data) noexcept {
+        length_t length;
+        std::memcpy(&length, data, sizeof(length));
+        return endian::little_to_native(length);
+      }
     };
 
-    using document_data = generic_document_data<void, int32>;
-    using document_cdata = generic_document_data<void const, int32>;
+    using document_data = generic_document_data<void, length_t>;
+    using document_cdata = generic_document_data<void const, length_t>;
 
   }  // namespace bson
 }  // namespace bassoon
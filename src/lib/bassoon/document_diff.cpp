@@ -0,0 +1,235 @@
+#include <bassoon/document_diff.hpp>
+
+#include <cstring>
+
+namespace bassoon {
+  namespace bson {
+
+    document_differ::document_differ()
+      : unset_count_(0)
+      , replace_(false)
+      , to_(nullptr) {}
+
+    bool document_differ::diff(document_view const& from, document_view const& to) {
+      operations_.clear();
+      unset_count_ = 0;
+      paths_.clear();
+      prefix_.clear();
+      replace_ = false;
+      to_ = to.data();
+
+      if (from.size() == to.size() && std::memcmp(from.data(), to.data(), to.size()) == 0)
+        return true;
+
+      switch (diff_level(from, to)) {
+        case level_result::ok:
+          return true;
+        case level_result::reordered:
+          operations_.clear();
+          unset_count_ = 0;
+          paths_.clear();
+          replace_ = true;
+          return true;
+        case level_result::malformed:
+          break;
+      }
+      return false;
+    }
+
+    document_differ::level_result document_differ::diff_level(document_view const& from, document_view const& to) {
+      auto old = from.begin();
+      auto const old_end = from.end();
+      if (!old.ok())
+        return level_result::malformed;
+
+      // Once we see an element that is not in 'from', every element
+      // after it must be new as well.
+      bool appending = false;
+
+      auto current = to.begin();
+      for (; current != to.end(); ++current) {
+        element_view const& element = *current;
+        cstring_cdata const name = element.name();
+        std::size_t const name_size = name.size - 1;
+
+        if (name_size == 0 || std::memchr(name.data, '.', name_size))
+          return level_result::reordered;
+
+        // Usually the match is the next old element, so look ahead of
+        // the last match first. Old elements that we pass on the way
+        // are gone from the new document.
+        auto match = old;
+        while (match != old_end && !match->has_name(name.data, name_size))
+          ++match;
+        if (!match.ok())
+          return level_result::malformed;
+
+        if (match == old_end) {
+          if (from.find(name.data, name_size))
+            return level_result::reordered;
+          appending = true;
+          add(name, element);
+          continue;
+        }
+
+        if (appending)
+          return level_result::reordered;
+
+        for (; old != match; ++old)
+          add(old->name(), element_view());
+
+        element_view const previous = *match;
+        old = ++match;
+
+        if (previous.size() == element.size() &&
+            std::memcmp(previous.data(), element.data(), element.size()) == 0)
+          continue;
+
+        if (previous.type() == element.type() &&
+            (element.type() == types::document || element.type() == types::array)) {
+          std::size_t const operations = operations_.size();
+          std::size_t const unsets = unset_count_;
+          std::size_t const paths = paths_.size();
+          std::size_t const prefix = prefix_.size();
+
+          if (prefix)
+            prefix_ += '.';
+          prefix_.append(name.data, name_size);
+          level_result const result = diff_level(document_view(previous.as_document()),
+                                                 document_view(element.as_document()));
+          prefix_.resize(prefix);
+
+          if (result == level_result::ok)
+            continue;
+          if (result == level_result::malformed)
+            return result;
+
+          // We cannot describe the changes within it, so send all of it.
+          operations_.resize(operations);
+          unset_count_ = unsets;
+          paths_.resize(paths);
+        }
+
+        add(name, element);
+      }
+
+      if (!current.ok())
+        return level_result::malformed;
+
+      for (; old != old_end; ++old)
+        add(old->name(), element_view());
+
+      return old.ok() ? level_result::ok : level_result::malformed;
+    }
+
+    void document_differ::add(cstring_cdata name, element_view const& value) {
+      std::size_t const offset = paths_.size();
+      paths_.insert(paths_.end(), prefix_.begin(), prefix_.end());
+      if (!prefix_.empty())
+        paths_.push_back('.');
+      paths_.insert(paths_.end(), name.data, name.data + name.size);
+
+      operations_.push_back(operation{ offset, paths_.size() - offset - 1, value });
+      if (!value)
+        ++unset_count_;
+    }
+
+    patch_applier::patch_applier()
+      : current_(nullptr)
+      , replace_(false)
+      , replacement_(nullptr) {}
+
+    bool patch_applier::load(document_view const& patch) {
+      operations_.clear();
+      replace_ = false;
+
+      auto current = patch.begin();
+      for (; current != patch.end(); ++current) {
+        element_view const& element = *current;
+
+        if (element.type() != types::document)
+          return false;
+
+        if (element.has_name("$replace", 8)) {
+          replace_ = true;
+          replacement_ = element.value();
+          continue;
+        }
+
+        bool const is_set = element.has_name("$set", 4);
+        if (!is_set && !element.has_name("$unset", 6))
+          return false;
+
+        document_view const operations(element.as_document());
+        auto operation = operations.begin();
+        for (; operation != operations.end(); ++operation) {
+          cstring_cdata const path = operation->name();
+          operations_.push_back(patch_applier::operation{
+              path.data, static_cast<std::size_t>(path.size - 1),
+              is_set ? *operation : element_view(), false });
+        }
+        if (!operation.ok())
+          return false;
+      }
+
+      return current.ok();
+    }
+
+    rewrite_action patch_applier::on_element(element_view const& element) {
+      cstring_cdata const name = element.name();
+      std::size_t const prefix = prefix_.size();
+      if (prefix)
+        prefix_ += '.';
+      prefix_.append(name.data, name.size - 1);
+
+      bool const is_nested = (element.type() == types::document || element.type() == types::array);
+      rewrite_action action = rewrite_action::keep;
+
+      for (auto& operation : operations_) {
+        if (operation.path_size < prefix_.size() ||
+            std::memcmp(operation.path, prefix_.data(), prefix_.size()) != 0)
+          continue;
+
+        if (operation.path_size == prefix_.size()) {
+          // Only the first element with a given path is changed.
+          if (operation.applied)
+            continue;
+          operation.applied = true;
+          current_ = &operation;
+          action = operation.value ? rewrite_action::replace : rewrite_action::drop;
+          break;
+        }
+
+        if (is_nested && operation.path[prefix_.size()] == '.')
+          action = rewrite_action::descend;
+      }
+
+      if (action == rewrite_action::descend)
+        prefix_sizes_.push_back(prefix);
+      else
+        prefix_.resize(prefix);
+      return action;
+    }
+
+    char const* patch_applier::leaf(operation const& operation) const noexcept {
+      std::size_t const prefix = prefix_.size() + (prefix_.empty() ? 0 : 1);
+      if (operation.path_size <= prefix ||
+          std::memcmp(operation.path, prefix_.data(), prefix_.size()) != 0 ||
+          (prefix != 0 && operation.path[prefix_.size()] != '.'))
+        return nullptr;
+
+      char const* const name = operation.path + prefix;
+      if (std::memchr(name, '.', operation.path_size - prefix))
+        return nullptr;
+      return name;
+    }
+
+    bool patch_applier::finish_apply() noexcept {
+      for (auto const& operation : operations_)
+        if (!operation.applied)
+          return false;
+      return true;
+    }
+
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,261 @@
+#ifndef included_a2e7b865_2545_4b59_b068_cfb09381a900
+#define included_a2e7b865_2545_4b59_b068_cfb09381a900
+
+#include <string>
+#include <vector>
+
+#include <bassoon/document_rewriter.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Works out the changes that turn one document into another, as
+    /// a patch that is itself a BSON document:
+    ///
+    ///   { "$set": { "a.b": <new value>, ... },
+    ///     "$unset": { "c": true, ... } }
+    ///
+    /// Either part is left out when it has no entries, so the patch
+    /// between identical documents is the empty document.
+    ///
+    /// Both documents are compared element by element, in place. An
+    /// element whose bytes are unchanged is skipped with a single
+    /// memcmp, however large it is, and a changed subdocument or
+    /// array is compared recursively so that only the changed values
+    /// within it are sent.
+    ///
+    /// Applying the patch reproduces the new document byte for byte.
+    /// That requires the elements kept from the old document to stay
+    /// in order, with any new elements after them. When a document
+    /// does not fit that shape, or holds a name that cannot be part
+    /// of a dotted path, the whole document is set instead, and for
+    /// the top level document the patch is { "$replace": <new document> }.
+    ///
+    class LIBBASSOON_EXPORT document_differ {
+    public:
+      document_differ();
+
+      ///
+      /// Computes the patch from 'from' to 'to'. Returns false if
+      /// either document turns out to be malformed, which byte for
+      /// byte identical documents are never checked for. Both must
+      /// outlive any call to 'encode'.
+      ///
+      bool diff(document_view const& from, document_view const& to);
+
+      ///
+      /// Encodes the patch computed by the last call to 'diff' as a
+      /// new document written by 'writer'.
+      ///
+      template<typename Writer_type>
+      bool encode(Writer_type& writer) const;
+
+      bool identical() const noexcept {
+        return !replace_ && operations_.empty();
+      }
+
+      std::size_t set_count() const noexcept {
+        return operations_.size() - unset_count_;
+      }
+
+      std::size_t unset_count() const noexcept {
+        return unset_count_;
+      }
+
+    private:
+      enum class level_result {
+        ok,
+        reordered,
+        malformed
+      };
+
+      struct operation {
+        // The dotted path, in 'paths_', followed by a null byte.
+        std::size_t path_offset;
+        std::size_t path_size;
+
+        // The new element, or an empty view to unset the path.
+        element_view value;
+      };
+
+      level_result diff_level(document_view const& from, document_view const& to);
+      void add(cstring_cdata name, element_view const& value);
+
+      cstring_cdata path(operation const& operation) const {
+        return cstring_cdata(&paths_[operation.path_offset], operation.path_size);
+      }
+
+      std::vector<operation> operations_;
+      std::size_t unset_count_;
+      std::vector<char> paths_;
+
+      // The path of the document being compared.
+      std::string prefix_;
+
+      bool replace_;
+      void const* to_;
+    };
+
+    ///
+    /// Builds the new document from an old one and a patch made by
+    /// document_differ, in a single pass over the old document. Runs
+    /// of unchanged elements are copied in bulk; see rewrite_document.
+    ///
+    class LIBBASSOON_EXPORT patch_applier {
+    public:
+      patch_applier();
+
+      ///
+      /// Prepares to apply 'patch', which must outlive any call to
+      /// 'apply'. Returns false if it is not a patch.
+      ///
+      bool load(document_view const& patch);
+
+      ///
+      /// Writes the result of applying the patch to 'from' as a new
+      /// document into 'writer'. Returns false if 'from' is
+      /// malformed, if the writer fails, or if the patch does not fit
+      /// 'from', for instance because it unsets an element that is
+      /// not there.
+      ///
+      template<typename Writer_type>
+      bool apply(document_view const& from, Writer_type& writer);
+
+    private:
+      struct operation {
+        // The dotted path, which is the name of the element in the
+        // patch and so is followed by a null byte.
+        char const* path;
+        std::size_t path_size;
+
+        // The new element, or an empty view to unset the path.
+        element_view value;
+
+        bool applied;
+      };
+
+      // Adapts the applier to the hooks that rewrite_document calls.
+      class rewriter {
+      public:
+        explicit rewriter(patch_applier& applier) noexcept
+          : applier_(applier) {}
+
+        rewrite_action on_element(element_view const& element, std::size_t) {
+          return applier_.on_element(element);
+        }
+
+        template<typename Encoder_type>
+        void on_replace(element_view const& element, std::size_t, Encoder_type& encoder) {
+          element_view const& value = applier_.current_->value;
+          encoder.encode_raw_value(element.name(), value.type(), binary_cdata(value.value(), value.value_size()));
+        }
+
+        template<typename Encoder_type>
+        void on_finish(std::size_t depth, Encoder_type& encoder) {
+          applier_.on_finish(depth, encoder);
+        }
+
+      private:
+        patch_applier& applier_;
+      };
+
+      rewrite_action on_element(element_view const& element);
+
+      template<typename Encoder_type>
+      void on_finish(std::size_t depth, Encoder_type& encoder);
+
+      // Returns the part of 'operation's path after the current
+      // prefix, if that is all that remains of it, or an empty
+      // pointer.
+      char const* leaf(operation const& operation) const noexcept;
+
+      bool finish_apply() noexcept;
+
+      std::vector<operation> operations_;
+
+      // The path of the document being rewritten, and the lengths it
+      // had at each enclosing document.
+      std::string prefix_;
+      std::vector<std::size_t> prefix_sizes_;
+
+      operation* current_;
+
+      bool replace_;
+      void const* replacement_;
+    };
+
+    template<typename Writer_type>
+    bool document_differ::encode(Writer_type& writer) const {
+      auto patch = start_document(writer);
+
+      if (replace_) {
+        patch.encode_subdocument("$replace", to_);
+      } else {
+        if (set_count()) {
+          auto set = patch.start_subdocument("$set");
+          for (auto const& operation : operations_)
+            if (operation.value)
+              set.encode_raw_value(path(operation), operation.value.type(),
+                                   binary_cdata(operation.value.value(), operation.value.value_size()));
+          set.finish();
+        }
+        if (unset_count()) {
+          auto unset = patch.start_subdocument("$unset");
+          for (auto const& operation : operations_)
+            if (!operation.value)
+              unset.encode_boolean(path(operation), true);
+          unset.finish();
+        }
+      }
+
+      patch.finish();
+      return patch.ok();
+    }
+
+    template<typename Writer_type>
+    bool patch_applier::apply(document_view const& from, Writer_type& writer) {
+      if (replace_) {
+        null_rewriter copy;
+        return rewrite_document(document_view(replacement_), writer, copy);
+      }
+
+      prefix_.clear();
+      prefix_sizes_.clear();
+      for (auto& operation : operations_)
+        operation.applied = false;
+
+      rewriter hooks(*this);
+      bool const ok = rewrite_document(from, writer, hooks);
+      return finish_apply() && ok;
+    }
+
+    template<typename Encoder_type>
+    void patch_applier::on_finish(std::size_t depth, Encoder_type& encoder) {
+      // Elements that the old document lacks go at the end, in the
+      // order of the patch.
+      for (auto& operation : operations_) {
+        if (operation.applied || !operation.value)
+          continue;
+        char const* const name = leaf(operation);
+        if (!name)
+          continue;
+        encoder.encode_raw_value(cstring_cdata(name, operation.path + operation.path_size - name),
+                                 operation.value.type(),
+                                 binary_cdata(operation.value.value(), operation.value.value_size()));
+        operation.applied = true;
+      }
+
+      if (depth != 0) {
+        prefix_.resize(prefix_sizes_.back());
+        prefix_sizes_.pop_back();
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_a2e7b865_2545_4b59_b068_cfb09381a900
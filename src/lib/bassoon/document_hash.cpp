@@ -0,0 +1,214 @@
+#include <bassoon/document_hash.hpp>
+
+#include <cmath>
+
+namespace bassoon {
+  namespace bson {
+    namespace hash_details {
+
+      namespace {
+
+        std::uint64_t mix(std::uint64_t value) noexcept {
+          value ^= value >> 33;
+          value *= 0xff51afd7ed558ccdULL;
+          value ^= value >> 33;
+          value *= 0xc4ceb9fe1a85ec53ULL;
+          value ^= value >> 33;
+          return value;
+        }
+
+        std::uint64_t rotate(std::uint64_t value, int bits) noexcept {
+          return (value << bits) | (value >> (64 - bits));
+        }
+
+      } // namespace
+
+      hash_digest finish(uint128_t sum, std::uint64_t size, std::uint64_t seed) noexcept {
+        // 'mix' is a bijection, so given 'high' and the size each step
+        // below maps one half of the sum one to one onto one half of
+        // the digest.
+        std::uint64_t const low = static_cast<std::uint64_t>(sum);
+        std::uint64_t const high = static_cast<std::uint64_t>(sum >> 64);
+        std::uint64_t const length = mix(size ^ 0x2d358dccaa6c78a5ULL);
+
+        hash_digest result;
+        result.low = mix(low ^ mix(high + seed + 0x8bb84b93962eacc9ULL) ^ rotate(length, 17));
+        result.high = mix(high ^ mix(result.low + 0x4b33a62ed433d4a3ULL) ^ length);
+        return result;
+      }
+
+    } // namespace hash_details
+
+    content_hasher::content_hasher(std::uint64_t seed) noexcept
+      : seed_(seed)
+      , sum_(0)
+      , size_(0) {}
+
+    void content_hasher::update(void const* data, std::size_t size) noexcept {
+      using namespace hash_details;
+
+      byte_t const* input = static_cast<byte_t const*>(data);
+      std::size_t used = size_ % k_block_size;
+      size_ += size;
+
+      if (used != 0) {
+        std::size_t const take = (size < k_block_size - used) ? size : k_block_size - used;
+        std::memcpy(tail_ + used, input, take);
+        input += take;
+        size -= take;
+        used += take;
+        if (used != k_block_size)
+          return;
+        sum_ += block_sum(tail_, (size_ - size) / k_block_size - 1, seed_);
+      }
+
+      std::uint64_t index = (size_ - size) / k_block_size;
+      for (; size >= k_block_size; input += k_block_size, size -= k_block_size)
+        sum_ += block_sum(input, index++, seed_);
+      std::memcpy(tail_, input, size);
+    }
+
+    hash_digest content_hasher::digest() const noexcept {
+      using namespace hash_details;
+
+      uint128_t sum = sum_;
+      std::size_t const rest = size_ % k_block_size;
+      if (rest != 0)
+        sum += tail_sum(tail_, rest, size_ / k_block_size, seed_);
+      return finish(sum, size_, seed_);
+    }
+
+    namespace {
+
+      // The canonical form is a stream of elements much like BSON, but
+      // with no lengths on documents and arrays, which end at their
+      // null byte as before. Every number is written as a double
+      // element whose value is a flag byte and eight bytes: zero and
+      // the int64, for integers and integral doubles that fit, and one
+      // and the bits of the double otherwise. Each value can still be
+      // told apart from what follows it, so equal streams mean equal
+      // documents.
+
+      bool update_canonical(content_hasher& hasher, document_view const& document) noexcept;
+
+      void update_number(content_hasher& hasher, element_view const& element) noexcept {
+        byte_t value[9];
+        std::int64_t integer = 0;
+        bool is_integer = true;
+
+        if (element.type() == types::int32) {
+          integer = element.as_int32();
+        } else if (element.type() == types::int64) {
+          integer = element.as_int64();
+        } else {
+          double_t const number = element.as_floating_point();
+          // 2^63 is the first double past the int64 range.
+          is_integer = (number >= -9223372036854775808.0 && number < 9223372036854775808.0 &&
+                        number == std::trunc(number));
+          if (is_integer) {
+            integer = static_cast<std::int64_t>(number);
+          } else {
+            std::uint64_t bits;
+            if (std::isnan(number)) {
+              bits = 0x7ff8000000000000ULL;
+            } else {
+              std::memcpy(&bits, &number, sizeof(bits));
+            }
+            element_details::write_little_endian(value + 1, bits);
+          }
+        }
+
+        value[0] = is_integer ? 0 : 1;
+        if (is_integer)
+          element_details::write_little_endian(value + 1, integer);
+
+        byte_t const type = static_cast<byte_t>(types::floating_point);
+        hasher.update(&type, 1);
+        hasher.update(element.data() + 1, element.name().size);
+        hasher.update(value, sizeof(value));
+      }
+
+      void update_element(content_hasher& hasher, element_view const& element, bool& ok) noexcept {
+        switch (element.type()) {
+          case types::floating_point:
+          case types::int32:
+          case types::int64:
+            update_number(hasher, element);
+            break;
+
+          case types::document:
+          case types::array:
+            hasher.update(element.data(), 1 + element.name().size);
+            ok = update_canonical(hasher, document_view(element.as_document()));
+            break;
+
+          default:
+            hasher.update(element.data(), element.size());
+            break;
+        }
+      }
+
+      bool update_canonical(content_hasher& hasher, document_view const& document) noexcept {
+        auto current = document.begin();
+        bool ok = true;
+        for (; ok && current != document.end(); ++current)
+          update_element(hasher, *current, ok);
+        if (!ok || !current.ok())
+          return false;
+
+        byte_t const end = 0;
+        hasher.update(&end, 1);
+        return true;
+      }
+
+      // Each element is hashed on its own and the digests are added
+      // up, along with the count, which the sum would otherwise lose.
+      bool hash_unordered(document_view const& document, hash_digest& result, std::uint64_t seed) noexcept {
+        hash_details::uint128_t sum = 0;
+        std::uint64_t count = 0;
+
+        auto current = document.begin();
+        bool ok = true;
+        for (; ok && current != document.end(); ++current, ++count) {
+          content_hasher element_hasher(seed);
+          update_element(element_hasher, *current, ok);
+          hash_digest const digest = element_hasher.digest();
+          sum += (static_cast<hash_details::uint128_t>(digest.high) << 64) | digest.low;
+        }
+        if (!ok || !current.ok())
+          return false;
+
+        byte_t summary[24];
+        element_details::write_little_endian(summary, static_cast<std::uint64_t>(sum));
+        element_details::write_little_endian(summary + 8, static_cast<std::uint64_t>(sum >> 64));
+        element_details::write_little_endian(summary + 16, count);
+
+        content_hasher hasher(seed);
+        hasher.update(summary, sizeof(summary));
+        result = hasher.digest();
+        return true;
+      }
+
+    } // namespace
+
+    bool hash_document(document_view const& document, hash_digest& result,
+                       hash_mode mode, field_order order, std::uint64_t seed) noexcept {
+      if (mode == hash_mode::bytewise) {
+        content_hasher hasher(seed);
+        hasher.update(document.data(), document.size());
+        result = hasher.digest();
+        return true;
+      }
+
+      if (order == field_order::ignored)
+        return hash_unordered(document, result, seed);
+
+      content_hasher hasher(seed);
+      if (!update_canonical(hasher, document))
+        return false;
+      result = hasher.digest();
+      return true;
+    }
+
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,255 @@
+#ifndef included_4f19c817_f2de_45ef_baf8_a8a56caeed68
+#define included_4f19c817_f2de_45ef_baf8_a8a56caeed68
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// A 128 bit content hash. Where 64 bits are enough, use 'low'
+    /// alone: it depends on every input bit.
+    ///
+    struct hash_digest {
+      std::uint64_t low;
+      std::uint64_t high;
+    };
+
+    inline bool operator==(hash_digest const& a, hash_digest const& b) noexcept {
+      return a.low == b.low && a.high == b.high;
+    }
+
+    inline bool operator!=(hash_digest const& a, hash_digest const& b) noexcept {
+      return !(a == b);
+    }
+
+    enum class hash_mode {
+      // The bytes of the document, as they are.
+      bytewise,
+
+      // What the document means: int32, int64 and double values that
+      // are numerically equal hash the same, as do 0.0 and -0.0, and
+      // every NaN. The rest hashes by type, name and value bytes.
+      canonical
+    };
+
+    enum class field_order {
+      significant,
+
+      // The top level elements hash as a multiset, so that
+      // { a : 1, b : 2 } and { b : 2, a : 1 } are equal. Order still
+      // matters within subdocuments and arrays.
+      ignored
+    };
+
+    namespace hash_details {
+
+      __extension__ typedef unsigned __int128 uint128_t;
+
+      // The input is hashed in blocks of this many bytes, each on its
+      // own, and the results are added up. See 'content_hasher'.
+      const std::size_t k_block_size = 64;
+
+      // Arbitrary odd constants, one for each word of a block.
+      const std::uint64_t k_keys[k_block_size / 8] = {
+        0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+        0x1d8e4e27c47d124fULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0x2545f4914f6cdd1dULL
+      };
+
+      // The NH sum of the block at 'index': the eight words, each
+      // offset by a key that depends on the position, are multiplied
+      // in pairs to 128 bits and the products added.
+      inline uint128_t block_sum(byte_t const* block, std::uint64_t index, std::uint64_t seed) noexcept {
+        std::uint64_t const tweak = (index * 0x9e3779b97f4a7c15ULL) ^ seed;
+        uint128_t sum = 0;
+        for (std::size_t i = 0; i != k_block_size / 8; i += 2) {
+          std::uint64_t const a = element_details::read_little_endian<std::uint64_t>(block + i * 8) + (k_keys[i] ^ tweak);
+          std::uint64_t const b = element_details::read_little_endian<std::uint64_t>(block + i * 8 + 8) + (k_keys[i + 1] ^ tweak);
+          sum += static_cast<uint128_t>(a) * b;
+        }
+        return sum;
+      }
+
+      // As above, for the last 'size' bytes of the input, padded with
+      // zeros. The total size goes into the digest, so the padding
+      // is never mistaken for data.
+      inline uint128_t tail_sum(byte_t const* data, std::size_t size, std::uint64_t index, std::uint64_t seed) noexcept {
+        byte_t block[k_block_size] = {};
+        std::memcpy(block, data, size);
+        return block_sum(block, index, seed);
+      }
+
+      // Mixes the sum of the blocks and the input size into the digest.
+      // For a given size the mapping is one to one.
+      LIBBASSOON_EXPORT hash_digest finish(uint128_t sum, std::uint64_t size, std::uint64_t seed) noexcept;
+
+    } // namespace hash_details
+
+    ///
+    /// A streaming hash over bytes, at a few tenths of a cycle per
+    /// byte. Feed it with 'update' and read 'digest' at any point.
+    ///
+    /// The input is cut into 64 byte blocks, each block is hashed with
+    /// keys that depend on its position, and the block hashes are
+    /// summed. Because the sum does not care about the order in which
+    /// blocks arrive, a block can be taken out and hashed again after
+    /// it changes; 'hashing_writer' relies on that.
+    ///
+    /// The hash is meant for deduplication and caching of documents we
+    /// produce ourselves. It is not keyed, and is not meant to stand
+    /// up to input chosen to collide.
+    ///
+    class LIBBASSOON_EXPORT content_hasher {
+    public:
+      explicit content_hasher(std::uint64_t seed = 0) noexcept;
+
+      void update(void const* data, std::size_t size) noexcept;
+
+      hash_digest digest() const noexcept;
+
+      std::uint64_t size() const noexcept {
+        return size_;
+      }
+
+    private:
+      std::uint64_t seed_;
+      hash_details::uint128_t sum_;
+      std::uint64_t size_;
+      byte_t tail_[hash_details::k_block_size];
+    };
+
+    ///
+    /// Hashes 'document' into 'result'.
+    ///
+    /// The bytewise hash is that of the document's bytes, and equals
+    /// the digest of a 'hashing_writer' that the document was encoded
+    /// through. It never fails.
+    ///
+    /// The canonical hash walks the elements, and returns false if the
+    /// document turns out to be malformed. Scoped JavaScript, whose
+    /// scope is a document, hashes by its bytes.
+    ///
+    LIBBASSOON_EXPORT bool hash_document(document_view const& document, hash_digest& result,
+                                         hash_mode mode = hash_mode::bytewise,
+                                         field_order order = field_order::significant,
+                                         std::uint64_t seed = 0) noexcept;
+
+    ///
+    /// A writer that passes everything through to 'Writer_type' and
+    /// hashes the bytes as they are written, so that the bytewise hash
+    /// of a document is ready as soon as the encoder finishes it,
+    /// without going over the output again.
+    ///
+    /// The encoder writes a placeholder for the length of each
+    /// document and array, and patches it with 'write_at' when the
+    /// document is finished. Each patch takes the one or two blocks it
+    /// lands in out of the sum, and adds them back once they hold the
+    /// real length, so the digest is that of the bytes as they end up.
+    /// That means reading those blocks back, so the wrapped writer
+    /// must keep its output in contiguous memory, as 'array_writer'
+    /// does.
+    ///
+    /// Only bytes written through this writer are hashed; anything
+    /// the wrapped writer held before is not.
+    ///
+    template<typename Writer_type>
+    class hashing_writer {
+    public:
+      using base_cursor_type = typename Writer_type::base_cursor_type;
+      using cursor = linear_cursor<hashing_writer>;
+
+      explicit hashing_writer(Writer_type& writer, std::uint64_t seed = 0) noexcept
+        : writer_(writer)
+        , start_(writer.position().address())
+        , seed_(seed)
+        , sum_(0)
+        , size_(0)
+        , blocks_(0) {}
+
+      bool reserve(std::size_t size) noexcept {
+        return writer_.reserve(size);
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, writer_.position().address());
+      }
+
+      bool ok() const noexcept {
+        return writer_.ok();
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        writer_.write(data, size);
+        size_ += size;
+        for (; (blocks_ + 1) * hash_details::k_block_size <= size_; ++blocks_)
+          sum_ += hash_details::block_sum(block(blocks_), blocks_, seed_);
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        // Blocks that are not complete yet are hashed when they are,
+        // and so is anything before 'start_', whose offset wraps.
+        std::size_t const offset = std::distance(start_, cursor.address());
+        std::size_t const first = offset / hash_details::k_block_size;
+        std::size_t const last = (offset + size - 1) / hash_details::k_block_size;
+        std::size_t const end = (last < blocks_) ? last + 1 : blocks_;
+
+        for (std::size_t i = first; i < end; ++i)
+          sum_ -= hash_details::block_sum(block(i), i, seed_);
+        writer_.write_at(typename Writer_type::cursor(writer_, cursor.address()), data, size);
+        for (std::size_t i = first; i < end; ++i)
+          sum_ += hash_details::block_sum(block(i), i, seed_);
+      }
+
+      ///
+      /// The hash of everything written so far, as it stands now.
+      ///
+      hash_digest digest() const noexcept {
+        hash_details::uint128_t sum = sum_;
+        std::size_t const rest = size_ - blocks_ * hash_details::k_block_size;
+        if (rest != 0)
+          sum += hash_details::tail_sum(block(blocks_), rest, blocks_, seed_);
+        return hash_details::finish(sum, size_, seed_);
+      }
+
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+      Writer_type& wrapped_writer() noexcept {
+        return writer_;
+      }
+
+    private:
+      byte_t const* block(std::size_t index) const noexcept {
+        return reinterpret_cast<byte_t const*>(&*start_) + index * hash_details::k_block_size;
+      }
+
+      Writer_type& writer_;
+      base_cursor_type start_;
+      std::uint64_t seed_;
+      hash_details::uint128_t sum_;
+      std::size_t size_;
+      std::size_t blocks_;
+    };
+
+    template<typename Writer_type>
+    hashing_writer<Writer_type> make_hashing_writer(Writer_type& writer, std::uint64_t seed = 0) {
+      return hashing_writer<Writer_type>(writer, seed);
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_4f19c817_f2de_45ef_baf8_a8a56caeed68
@@ -0,0 +1,118 @@
+#include <bassoon/document_merger.hpp>
+
+#include <algorithm>
+
+namespace bassoon {
+  namespace bson {
+
+    using element_details::hash_bytes;
+
+    namespace {
+
+      std::uint64_t hash_name(element_view const& element) noexcept {
+        cstring_cdata const name = element.name();
+        return hash_bytes(name.data, name.size - 1);
+      }
+
+    } // namespace
+
+    document_merger::document_merger(std::size_t depth)
+      : depth_(std::max<std::size_t>(depth, 1))
+      , current_(-1)
+      , ok_(true) {}
+
+    bool document_merger::push_level(document_view const& overlay) {
+      level const added = { entries_.size(), slots_.size(), 0 };
+
+      auto current = overlay.begin();
+      for (; current != overlay.end(); ++current)
+        entries_.push_back(entry{ *current, hash_name(*current), false });
+
+      if (!current.ok()) {
+        entries_.resize(added.first_entry);
+        return false;
+      }
+
+      // Keep the table at most half full.
+      std::size_t const count = entries_.size() - added.first_entry;
+      std::size_t slot_count = 4;
+      while (slot_count < count * 2)
+        slot_count *= 2;
+
+      levels_.push_back(added);
+      levels_.back().slot_count = slot_count;
+      slots_.resize(added.first_slot + slot_count, -1);
+
+      // If the overlay has a name more than once, its last value
+      // wins, and the earlier ones are marked as used so that they
+      // are never written.
+      std::int32_t* const slots = &slots_[added.first_slot];
+      std::size_t const mask = slot_count - 1;
+      for (std::size_t i = added.first_entry; i != entries_.size(); ++i) {
+        entry const& added_entry = entries_[i];
+        cstring_cdata const name = added_entry.element.name();
+        std::size_t slot = added_entry.hash & mask;
+        for (; slots[slot] >= 0; slot = (slot + 1) & mask) {
+          entry& existing = entries_[slots[slot]];
+          if (existing.hash == added_entry.hash && existing.element.has_name(name.data, name.size - 1)) {
+            existing.used = true;
+            break;
+          }
+        }
+        slots[slot] = static_cast<std::int32_t>(i);
+      }
+
+      return true;
+    }
+
+    void document_merger::pop_level() noexcept {
+      level const& top = levels_.back();
+      entries_.resize(top.first_entry);
+      slots_.resize(top.first_slot);
+      levels_.pop_back();
+    }
+
+    // Returns the index of the overlay entry with the name of
+    // 'element', in the innermost level, or -1.
+    std::ptrdiff_t document_merger::find(element_view const& element) const noexcept {
+      level const& top = levels_.back();
+      if (top.first_entry == entries_.size())
+        return -1;
+
+      cstring_cdata const name = element.name();
+      std::uint64_t const hash = hash_bytes(name.data, name.size - 1);
+      std::int32_t const* const slots = &slots_[top.first_slot];
+      std::size_t const mask = top.slot_count - 1;
+
+      for (std::size_t slot = hash & mask; slots[slot] >= 0; slot = (slot + 1) & mask) {
+        entry const& candidate = entries_[slots[slot]];
+        if (candidate.hash == hash && candidate.element.has_name(name.data, name.size - 1))
+          return slots[slot];
+      }
+      return -1;
+    }
+
+    rewrite_action document_merger::on_element(element_view const& element, std::size_t depth) {
+      std::ptrdiff_t const found = find(element);
+      if (found < 0)
+        return rewrite_action::keep;
+
+      if (entries_[found].used)
+        return rewrite_action::drop;
+      entries_[found].used = true;
+
+      element_view const value = entries_[found].element;
+      if (depth + 1 < depth_ &&
+          element.type() == types::document &&
+          value.type() == types::document) {
+        if (push_level(document_view(value.as_document())))
+          return rewrite_action::descend;
+        ok_ = false;
+      }
+
+      current_ = found;
+      return rewrite_action::replace;
+    }
+
+  } // namespace bson
+} // namespace bassoon
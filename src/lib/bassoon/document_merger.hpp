@@ -0,0 +1,154 @@
+#ifndef included_38d6cf04_ae51_4d5b_aee7_35b17fbce17a
+#define included_38d6cf04_ae51_4d5b_aee7_35b17fbce17a
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <bassoon/document_rewriter.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Merges an overlay document into a base document, the way an
+    /// upsert does, without decoding either of them.
+    ///
+    /// The result holds the elements of the base in their order,
+    /// except that an element that the overlay also has takes the
+    /// overlay's value (last writer wins). The overlay's other
+    /// elements follow, in their order. If the overlay has a name more
+    /// than once, only its last occurrence counts; if the base has one
+    /// that the overlay also has, only its first occurrence is kept,
+    /// with the overlay's value. Only the overlay is indexed, so any
+    /// other name that the base repeats is copied through repeated.
+    ///
+    /// With a 'depth' above one, a subdocument present in both is
+    /// itself merged, down to that many levels, instead of being
+    /// replaced. Arrays are always replaced.
+    ///
+    /// The names of the overlay are indexed in a small hash table,
+    /// and runs of base elements that the overlay does not touch are
+    /// copied with a single bulk copy, as are runs of overlay
+    /// elements. No tree is built, and once the merger's buffers have
+    /// grown to fit the documents at hand, merging allocates nothing.
+    ///
+    class LIBBASSOON_EXPORT document_merger {
+    public:
+      explicit document_merger(std::size_t depth = 1);
+
+      ///
+      /// Writes the merge of 'base' and 'overlay' as a new document
+      /// into 'writer'. Returns false if either document is malformed
+      /// or if the writer fails.
+      ///
+      template<typename Writer_type>
+      bool merge(document_view const& base, document_view const& overlay, Writer_type& writer);
+
+    private:
+      struct entry {
+        element_view element;
+        std::uint64_t hash;
+        bool used;
+      };
+
+      // The index of one overlay document. Its entries and hash slots
+      // are ranges of 'entries_' and 'slots_'.
+      struct level {
+        std::size_t first_entry;
+        std::size_t first_slot;
+        std::size_t slot_count;
+      };
+
+      // Adapts the merger to the hooks that rewrite_document calls.
+      class rewriter {
+      public:
+        explicit rewriter(document_merger& merger) noexcept
+          : merger_(merger) {}
+
+        rewrite_action on_element(element_view const& element, std::size_t depth) {
+          return merger_.on_element(element, depth);
+        }
+
+        template<typename Encoder_type>
+        void on_replace(element_view const& element, std::size_t, Encoder_type& encoder) {
+          element_view const& value = merger_.entries_[merger_.current_].element;
+          encoder.encode_raw_value(element.name(), value.type(), binary_cdata(value.value(), value.value_size()));
+        }
+
+        template<typename Encoder_type>
+        void on_finish(std::size_t depth, Encoder_type& encoder) {
+          merger_.on_finish(depth, encoder);
+        }
+
+      private:
+        document_merger& merger_;
+      };
+
+      bool push_level(document_view const& overlay);
+      void pop_level() noexcept;
+      std::ptrdiff_t find(element_view const& element) const noexcept;
+      rewrite_action on_element(element_view const& element, std::size_t depth);
+
+      template<typename Encoder_type>
+      void on_finish(std::size_t depth, Encoder_type& encoder);
+
+      std::size_t depth_;
+
+      std::vector<level> levels_;
+      std::vector<entry> entries_;
+
+      // Open addressing table of indexes into 'entries_', or -1.
+      std::vector<std::int32_t> slots_;
+
+      // The entry that is replacing an element.
+      std::ptrdiff_t current_;
+      bool ok_;
+    };
+
+    template<typename Writer_type>
+    bool document_merger::merge(document_view const& base, document_view const& overlay, Writer_type& writer) {
+      levels_.clear();
+      entries_.clear();
+      slots_.clear();
+      ok_ = push_level(overlay);
+      if (!ok_)
+        return false;
+
+      rewriter hooks(*this);
+      bool const ok = rewrite_document(base, writer, hooks);
+      return ok && ok_;
+    }
+
+    template<typename Encoder_type>
+    void document_merger::on_finish(std::size_t depth, Encoder_type& encoder) {
+      // Append what the base did not have, copying adjacent overlay
+      // elements together.
+      byte_t const* run = nullptr;
+      byte_t const* run_end = nullptr;
+
+      for (std::size_t i = levels_.back().first_entry; i != entries_.size(); ++i) {
+        entry const& current = entries_[i];
+        if (current.used)
+          continue;
+        if (run_end != current.element.data()) {
+          if (run != run_end)
+            encoder.encode_raw_elements(binary_cdata(run, run_end - run));
+          run = current.element.data();
+        }
+        run_end = current.element.data() + current.element.size();
+      }
+      if (run != run_end)
+        encoder.encode_raw_elements(binary_cdata(run, run_end - run));
+
+      if (depth != 0)
+        pop_level();
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_38d6cf04_ae51_4d5b_aee7_35b17fbce17a
@@ -0,0 +1,357 @@
+#include <bassoon/document_queue.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <new>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      int futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected) {
+        return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected,
+                         nullptr, nullptr, 0);
+      }
+
+      void futex_wake(std::atomic<std::uint32_t>& word, int count) {
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr,
+                  nullptr, 0);
+      }
+
+    }  // namespace
+
+    struct document_queue::cell {
+      // 'index' when the cell is free for the producer that claims
+      // position 'index', and 'index + 1' once it is full.
+      std::atomic<std::size_t> sequence;
+      document_queue_buffer* buffer;
+    };
+
+    struct document_queue::shared {
+      // Read only, once made.
+      std::unique_ptr<cell[]> cells;
+      std::size_t mask;
+
+      // Producers claim cells here.
+      alignas(64) std::atomic<std::size_t> tail;
+
+      // The consumer's own.
+      alignas(64) std::size_t head;
+      std::atomic<std::uint64_t> drained;
+
+      // Written only when someone sleeps or is woken: the futex that
+      // the consumer sleeps on, and whether it does, then the futex
+      // that blocked producers sleep on, and how many do.
+      alignas(64) std::atomic<std::uint32_t> pushed;
+      std::atomic<std::uint32_t> consumer_waiting;
+      std::atomic<std::uint32_t> progress;
+      std::atomic<std::uint32_t> blocked;
+      std::atomic<std::uint32_t> closed;
+    };
+
+    void document_queue::shared_deleter::operator()(shared* state) const noexcept {
+      state->~shared();
+      std::free(state);
+    }
+
+    template<typename Ready>
+    bool document_queue::block(Ready ready) noexcept {
+      shared& state = *shared_;
+      state.blocked.fetch_add(1, std::memory_order_seq_cst);
+      bool result;
+      for (;;) {
+        std::uint32_t const progress = state.progress.load(std::memory_order_seq_cst);
+        if (ready()) {
+          result = true;
+          break;
+        }
+        if (state.closed.load(std::memory_order_acquire)) {
+          result = false;
+          break;
+        }
+        futex_wait(state.progress, progress);
+      }
+      state.blocked.fetch_sub(1, std::memory_order_relaxed);
+      return result;
+    }
+
+    document_queue_producer::document_queue_producer(document_queue& queue, document_queue_options const& options)
+      : free_tail_(0)
+      , queue_(queue)
+      , memory_(new byte_t[(options.pool_size + 1) * options.buffer_size])
+      , free_(options.pool_size)
+      , free_head_(0)
+      , queued_(0)
+      , dropped_(0)
+      , spilled_(0) {
+
+      buffers_.reserve(options.pool_size);
+      for (std::size_t i = 0; i != options.pool_size; ++i) {
+        buffers_.emplace_back(new document_queue_buffer(this, memory_.get() + i * options.buffer_size,
+                                                        options.buffer_size));
+        free_[i] = buffers_.back().get();
+      }
+      free_tail_.store(options.pool_size, std::memory_order_release);
+
+      byte_t* const spare = memory_.get() + options.pool_size * options.buffer_size;
+      spare_.reset(new document_queue_buffer(this, spare, options.buffer_size));
+    }
+
+    document_queue_buffer* document_queue_producer::acquire() noexcept {
+      document_queue_buffer* buffer = take();
+      if (buffer)
+        return buffer;
+
+      if (queue_.options_.policy == document_queue_policy::block &&
+          queue_.block([&]() { return (buffer = take()) != nullptr; }))
+        return buffer;
+      return spare_.get();
+    }
+
+    document_queue_push document_queue_producer::push(document_queue_buffer* buffer) noexcept {
+      // Nothing to queue, so nothing is lost: take the buffer back.
+      std::size_t const documents = buffer->documents_;
+      if (documents == 0) {
+        give_back(buffer);
+        return document_queue_push::queued;
+      }
+
+      if (buffer == spare_.get())
+        return overflow(buffer);
+
+      if (queue_.enqueue(buffer) ||
+          (queue_.options_.policy == document_queue_policy::block &&
+           queue_.block([&]() { return queue_.enqueue(buffer); }))) {
+        queued_.fetch_add(documents, std::memory_order_relaxed);
+        return document_queue_push::queued;
+      }
+
+      document_queue_push const result = overflow(buffer);
+      give_back(buffer);
+      return result;
+    }
+
+    document_queue_buffer* document_queue_producer::take() noexcept {
+      if (free_head_ == free_tail_.load(std::memory_order_acquire))
+        return nullptr;
+      return free_[free_head_++ % free_.size()];
+    }
+
+    document_queue_push document_queue_producer::overflow(document_queue_buffer* buffer) noexcept {
+      document_queue_options const& options = queue_.options_;
+      std::size_t const documents = buffer->documents_;
+      bool spilled = false;
+
+      if (documents != 0 && options.policy == document_queue_policy::spill && options.spill_fd != -1) {
+        // One write, with O_APPEND, lands whole; a short one leaves
+        // the rest to a second, which another producer may precede.
+        byte_t const* data = buffer->base_;
+        std::size_t size = buffer->valid();
+        while (size != 0) {
+          ssize_t const written = ::write(options.spill_fd, data, size);
+          if (written == -1 && errno == EINTR)
+            continue;
+          if (written <= 0)
+            break;
+          data += written;
+          size -= written;
+        }
+        spilled = size == 0;
+      }
+
+      buffer->clear();
+      if (spilled) {
+        spilled_.fetch_add(documents, std::memory_order_relaxed);
+        return document_queue_push::spilled;
+      }
+      dropped_.fetch_add(documents, std::memory_order_relaxed);
+      return document_queue_push::dropped;
+    }
+
+    void document_queue_producer::give_back(document_queue_buffer* buffer) noexcept {
+      buffer->clear();
+      if (buffer == spare_.get())
+        return;
+
+      // From the producer, which holds 'buffer', so the slot before the
+      // head is its own to put it back in.
+      free_[--free_head_ % free_.size()] = buffer;
+    }
+
+    document_queue::document_queue(document_queue_options options)
+      : options_(options) {
+
+      options_.pool_size = std::max<std::size_t>(options_.pool_size, 1);
+      options_.buffer_size = std::max<std::size_t>(options_.buffer_size, 5);
+
+      std::size_t capacity = 2;
+      while (capacity < options_.capacity)
+        capacity *= 2;
+      options_.capacity = capacity;
+
+      void* memory;
+      if (::posix_memalign(&memory, 64, sizeof(shared)) != 0)
+        throw std::bad_alloc();
+      shared_.reset(new (memory) shared());
+
+      shared& state = *shared_;
+      state.cells.reset(new cell[capacity]);
+      state.mask = capacity - 1;
+      for (std::size_t i = 0; i != capacity; ++i)
+        state.cells[i].sequence.store(i, std::memory_order_relaxed);
+      state.tail.store(0, std::memory_order_relaxed);
+      state.head = 0;
+      state.drained.store(0, std::memory_order_relaxed);
+      state.pushed.store(0, std::memory_order_relaxed);
+      state.consumer_waiting.store(0, std::memory_order_relaxed);
+      state.progress.store(0, std::memory_order_relaxed);
+      state.blocked.store(0, std::memory_order_relaxed);
+      state.closed.store(0, std::memory_order_relaxed);
+    }
+
+    document_queue::~document_queue() = default;
+
+    document_queue_producer* document_queue::register_producer() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_producers_.empty()) {
+        document_queue_producer* const producer = free_producers_.back();
+        free_producers_.pop_back();
+        return producer;
+      }
+      producers_.emplace_back(new document_queue_producer(*this, options_));
+      return producers_.back().get();
+    }
+
+    void document_queue::release_producer(document_queue_producer* producer) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_producers_.push_back(producer);
+    }
+
+    std::size_t document_queue::drain(std::vector<byte_t>& sequence, std::size_t max_documents) {
+      return drain(
+        [&](document_cdata document) {
+          byte_t const* const data = static_cast<byte_t const*>(document.data);
+          sequence.insert(sequence.end(), data, data + document.size);
+        },
+        max_documents);
+    }
+
+    bool document_queue::wait() noexcept {
+      shared& state = *shared_;
+      auto const ready = [&]() {
+        return state.cells[state.head & state.mask].sequence.load(std::memory_order_seq_cst) == state.head + 1;
+      };
+
+      for (;;) {
+        if (ready())
+          return true;
+        if (state.closed.load(std::memory_order_acquire))
+          return ready();
+
+        // Say that we sleep before the last look, so that a producer
+        // that pushes after the look sees it, and wakes us.
+        state.consumer_waiting.store(1, std::memory_order_seq_cst);
+        std::uint32_t const pushed = state.pushed.load(std::memory_order_seq_cst);
+        if (!ready() && !state.closed.load(std::memory_order_seq_cst))
+          futex_wait(state.pushed, pushed);
+        state.consumer_waiting.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void document_queue::close() noexcept {
+      shared& state = *shared_;
+      state.closed.store(1, std::memory_order_seq_cst);
+      state.pushed.fetch_add(1, std::memory_order_seq_cst);
+      futex_wake(state.pushed, INT_MAX);
+      state.progress.fetch_add(1, std::memory_order_seq_cst);
+      futex_wake(state.progress, INT_MAX);
+    }
+
+    document_queue_stats document_queue::stats() {
+      document_queue_stats result = { 0, 0, 0, 0 };
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const& producer : producers_) {
+          result.queued += producer->queued_.load(std::memory_order_relaxed);
+          result.dropped += producer->dropped_.load(std::memory_order_relaxed);
+          result.spilled += producer->spilled_.load(std::memory_order_relaxed);
+        }
+      }
+      result.drained = shared_->drained.load(std::memory_order_relaxed);
+      return result;
+    }
+
+    bool document_queue::enqueue(document_queue_buffer* buffer) noexcept {
+      shared& state = *shared_;
+      std::size_t position = state.tail.load(std::memory_order_relaxed);
+      cell* target;
+      for (;;) {
+        target = &state.cells[position & state.mask];
+        std::size_t const sequence = target->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t const difference = static_cast<std::ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+          if (state.tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            break;
+        } else if (difference < 0) {
+          // The cell a lap behind is still full: the queue is.
+          return false;
+        } else {
+          position = state.tail.load(std::memory_order_relaxed);
+        }
+      }
+
+      target->buffer = buffer;
+      target->sequence.store(position + 1, std::memory_order_seq_cst);
+
+      // Ordered after the store above, against the consumer saying it
+      // sleeps and then looking at the cell.
+      if (state.consumer_waiting.load(std::memory_order_seq_cst)) {
+        state.pushed.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(state.pushed, 1);
+      }
+      return true;
+    }
+
+    document_queue_buffer* document_queue::dequeue() noexcept {
+      shared& state = *shared_;
+      cell& target = state.cells[state.head & state.mask];
+      if (target.sequence.load(std::memory_order_acquire) != state.head + 1)
+        return nullptr;
+
+      document_queue_buffer* const buffer = target.buffer;
+      target.sequence.store(state.head + state.mask + 1, std::memory_order_release);
+      ++state.head;
+      return buffer;
+    }
+
+    void document_queue::recycle(document_queue_buffer* buffer) noexcept {
+      document_queue_producer& owner = *buffer->owner_;
+      buffer->clear();
+      std::size_t const tail = owner.free_tail_.load(std::memory_order_relaxed);
+      owner.free_[tail % owner.free_.size()] = buffer;
+      owner.free_tail_.store(tail + 1, std::memory_order_release);
+    }
+
+    void document_queue::finish_drain(std::size_t documents) noexcept {
+      shared& state = *shared_;
+      state.drained.store(state.drained.load(std::memory_order_relaxed) + documents, std::memory_order_relaxed);
+
+      // Read 'blocked' with a read-modify-write, which orders it after
+      // the cells and buffers freed above: a blocked producer counts
+      // itself before it looks for them, so either it finds them, or
+      // we see it, and wake it.
+      if (state.blocked.fetch_add(0, std::memory_order_seq_cst) != 0) {
+        state.progress.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(state.progress, INT_MAX);
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,317 @@
+#ifndef included_bcb54802_05da_4695_b3aa_5dc9bf9d8285
+#define included_bcb54802_05da_4695_b3aa_5dc9bf9d8285
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    enum class document_queue_policy {
+      // Wait for the consumer to make room.
+      block,
+
+      // Throw the documents away.
+      drop,
+
+      // Write the documents to 'spill_fd' instead, straight from the
+      // producer thread.
+      spill,
+    };
+
+    enum class document_queue_push {
+      queued,
+      dropped,
+      spilled,
+    };
+
+    struct document_queue_options {
+      // The most buffers that can be queued at once, rounded up to a
+      // power of two.
+      std::size_t capacity = 4096;
+
+      // The buffers that each producer has, and their size. A producer
+      // can have this many buffers queued before the policy applies.
+      std::size_t pool_size = 64;
+      std::size_t buffer_size = 4096;
+
+      document_queue_policy policy = document_queue_policy::block;
+
+      // Where 'spill' writes documents. Open it with O_APPEND, so that
+      // the writes of different producers do not overlap.
+      int spill_fd = -1;
+    };
+
+    struct document_queue_stats {
+      // Documents, by what became of them.
+      std::uint64_t queued;
+      std::uint64_t drained;
+      std::uint64_t dropped;
+      std::uint64_t spilled;
+    };
+
+    class document_queue;
+    class document_queue_producer;
+
+    ///
+    /// A buffer from a producer's pool, and a writer that encodes
+    /// documents into it. As with async_sink_buffer, a document that
+    /// does not fit fails, and leaves the ones before it whole.
+    ///
+    class LIBBASSOON_EXPORT document_queue_buffer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<document_queue_buffer>;
+
+      document_queue_buffer(const document_queue_buffer&) = delete;
+      document_queue_buffer& operator=(const document_queue_buffer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        ok_ = ok_ && capacity_ - used_ >= size;
+        return ok_;
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, base_ + used_);
+      }
+
+      bool ok() const noexcept {
+        return ok_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(size <= capacity_ - used_);
+        std::memcpy(base_ + used_, data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        std::memcpy(cursor.address(), data, size);
+        // The length of a top level document is written last.
+        if (ok_ && cursor.address() == base_ + finished_) {
+          finished_ = used_;
+          ++documents_;
+        }
+      }
+
+      ///
+      /// The bytes of the finished documents, which are what is
+      /// pushed.
+      ///
+      std::size_t valid() const noexcept {
+        return finished_;
+      }
+
+    private:
+      friend class document_queue;
+      friend class document_queue_producer;
+
+      document_queue_buffer(document_queue_producer* owner, byte_t* base, std::size_t capacity) noexcept
+        : owner_(owner)
+        , base_(base)
+        , capacity_(capacity) {
+        clear();
+      }
+
+      void clear() noexcept {
+        used_ = 0;
+        finished_ = 0;
+        documents_ = 0;
+        ok_ = true;
+      }
+
+      document_queue_producer* const owner_;
+      byte_t* const base_;
+      std::size_t const capacity_;
+      std::size_t used_;
+      std::size_t finished_;
+      std::size_t documents_;
+      bool ok_;
+    };
+
+    ///
+    /// One thread's end of a document_queue. Neither 'acquire' nor
+    /// 'push' takes a lock or allocates: the buffers are the
+    /// producer's own, made when it was registered, and come back to
+    /// it from the consumer through a single producer, single consumer
+    /// ring. Use a producer from one thread at a time.
+    ///
+    class LIBBASSOON_EXPORT document_queue_producer {
+    public:
+      document_queue_producer(const document_queue_producer&) = delete;
+      document_queue_producer& operator=(const document_queue_producer&) = delete;
+
+      ///
+      /// A cleared buffer to encode into. When every buffer in the
+      /// pool is queued, this waits for one to come back under the
+      /// 'block' policy; under the others, it returns a spare buffer,
+      /// which is never queued: pushing it drops or spills it.
+      ///
+      document_queue_buffer* acquire() noexcept;
+
+      ///
+      /// Queues the finished documents in 'buffer', or, if the queue
+      /// is full, waits, drops or spills them as the policy says. The
+      /// buffer belongs to the queue afterwards. A buffer without
+      /// finished documents is just taken back, and counts as queued.
+      ///
+      document_queue_push push(document_queue_buffer* buffer) noexcept;
+
+    private:
+      friend class document_queue;
+
+      document_queue_producer(document_queue& queue, document_queue_options const& options);
+
+      document_queue_buffer* take() noexcept;
+      document_queue_push overflow(document_queue_buffer* buffer) noexcept;
+      void give_back(document_queue_buffer* buffer) noexcept;
+
+      // The consumer writes 'free_tail_', and the producer the
+      // counters, which are kept apart by the fields between.
+      std::atomic<std::size_t> free_tail_;
+      document_queue& queue_;
+      std::unique_ptr<byte_t[]> memory_;
+      std::vector<std::unique_ptr<document_queue_buffer>> buffers_;
+      std::unique_ptr<document_queue_buffer> spare_;
+
+      // The free buffers. The producer takes from the head, and the
+      // consumer gives back at the tail; there is always room.
+      std::vector<document_queue_buffer*> free_;
+      std::size_t free_head_;
+
+      std::atomic<std::uint64_t> queued_;
+      std::atomic<std::uint64_t> dropped_;
+      std::atomic<std::uint64_t> spilled_;
+    };
+
+    ///
+    /// A bounded queue of document buffers from many producer threads
+    /// to one consumer thread, which drains them in batches.
+    ///
+    /// The queue is a ring of cells, each with a sequence number that
+    /// says whether it is free or full, as in Dmitry Vyukov's bounded
+    /// queue. A producer claims a cell with a compare and swap on the
+    /// tail, and fills it in its own time: one that is preempted half
+    /// way holds up only the consumer, at that cell, and never other
+    /// producers. The consumer takes cells in order without any atomic
+    /// read-modify-write.
+    ///
+    /// Nobody spins. A consumer with nothing to do, and producers
+    /// blocked under the 'block' policy, sleep on futexes, and are
+    /// woken only if they are asleep, so that the common case makes no
+    /// system calls.
+    ///
+    /// Producers are registered, once per thread, with
+    /// 'register_producer', which allocates. A producer that is
+    /// released can be handed to another thread later; the queue owns
+    /// them all.
+    ///
+    class LIBBASSOON_EXPORT document_queue {
+    public:
+      explicit document_queue(document_queue_options options = document_queue_options());
+      ~document_queue();
+
+      document_queue(const document_queue&) = delete;
+      document_queue& operator=(const document_queue&) = delete;
+
+      document_queue_producer* register_producer();
+      void release_producer(document_queue_producer* producer);
+
+      ///
+      /// Calls 'function(document)', with a document_cdata, for each
+      /// document queued, in the order their buffers were queued, and
+      /// gives the buffers back to their producers. Stops taking
+      /// buffers once 'max_documents' documents have been drained.
+      /// Returns the number drained.
+      ///
+      template<typename Function>
+      std::size_t drain(Function function,
+                        std::size_t max_documents = std::numeric_limits<std::size_t>::max()) {
+        std::size_t documents = 0;
+        while (documents < max_documents) {
+          document_queue_buffer* const buffer = dequeue();
+          if (!buffer)
+            break;
+          for (auto document : document_sequence(buffer->base_, buffer->valid())) {
+            function(document);
+            ++documents;
+          }
+          recycle(buffer);
+        }
+        finish_drain(documents);
+        return documents;
+      }
+
+      ///
+      /// Drains documents onto the end of 'sequence', back to back, as
+      /// a document_sequence reads them.
+      ///
+      std::size_t drain(std::vector<byte_t>& sequence,
+                        std::size_t max_documents = std::numeric_limits<std::size_t>::max());
+
+      ///
+      /// Waits until there is something to drain. Returns false, at
+      /// once, if the queue is closed and empty.
+      ///
+      bool wait() noexcept;
+
+      ///
+      /// Tells the consumer that nothing more is coming, and releases
+      /// producers blocked on it, which drop what they were pushing.
+      ///
+      void close() noexcept;
+
+      document_queue_stats stats();
+
+    private:
+      friend class document_queue_producer;
+
+      // The ring, and the atomics that producers and the consumer
+      // share, each group on a cache line of its own. They are
+      // allocated apart, as 'new' does not align to cache lines
+      // before C++17.
+      struct cell;
+      struct shared;
+      struct shared_deleter {
+        void operator()(shared* state) const noexcept;
+      };
+
+      bool enqueue(document_queue_buffer* buffer) noexcept;
+      document_queue_buffer* dequeue() noexcept;
+      void recycle(document_queue_buffer* buffer) noexcept;
+      void finish_drain(std::size_t documents) noexcept;
+
+      // Waits, under the 'block' policy, until 'ready' returns true or
+      // the queue closes. Returns false if it closed.
+      template<typename Ready>
+      bool block(Ready ready) noexcept;
+
+      document_queue_options options_;
+      std::unique_ptr<shared, shared_deleter> shared_;
+
+      std::mutex mutex_;
+      std::vector<std::unique_ptr<document_queue_producer>> producers_;
+      std::vector<document_queue_producer*> free_producers_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_bcb54802_05da_4695_b3aa_5dc9bf9d8285
@@ -0,0 +1,144 @@
+#ifndef included_d45f587a_1f7a_4f15_9e58_12ebecb779c9
+#define included_d45f587a_1f7a_4f15_9e58_12ebecb779c9
+
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// What to do with an element of the source document.
+    ///
+    enum class rewrite_action {
+      // Copy the element as is.
+      keep,
+
+      // Leave the element out.
+      drop,
+
+      // Leave the element out, and let the rewriter encode whatever
+      // should take its place, such as the same value under a new
+      // name.
+      replace,
+
+      // The element is a document or array: copy it, rewriting its
+      // elements in turn. Treated as 'keep' for other types.
+      descend
+    };
+
+    ///
+    /// A rewriter that keeps every element. Derive from it and
+    /// override what you need; the hooks are resolved statically.
+    ///
+    /// 'depth' is zero for the elements of the top level document.
+    ///
+    class null_rewriter {
+    public:
+      rewrite_action on_element(element_view const&, std::size_t) {
+        return rewrite_action::keep;
+      }
+
+      ///
+      /// Called for elements that 'on_element' chose to replace.
+      ///
+      template<typename Encoder_type>
+      void on_replace(element_view const&, std::size_t, Encoder_type&) {}
+
+      ///
+      /// Called at the end of the top level document and of each
+      /// document or array we descended into, before it is finished.
+      /// Anything encoded here is appended to it.
+      ///
+      template<typename Encoder_type>
+      void on_finish(std::size_t, Encoder_type&) {}
+    };
+
+    ///
+    /// Rewrites the elements of 'source' into 'target', which must be
+    /// a started document, asking 'rewriter' about each element.
+    ///
+    /// Only what changes is encoded. Each run of consecutive kept
+    /// elements, including any subdocuments and arrays within them,
+    /// is copied into 'target' with a single bulk copy, so a rewrite
+    /// that touches few elements costs little more than a memcpy of
+    /// the document.
+    ///
+    /// Returns false if the source turned out to be malformed, in
+    /// which case 'target' is incomplete, or if 'target' is not ok.
+    /// 'target' may have any statistics policy, which its nested
+    /// documents share.
+    ///
+    template<typename Writer_type, typename Stats_type, typename Rewriter_type>
+    bool rewrite_elements(document_view const& source, encoder<Writer_type, Stats_type>& target,
+                          Rewriter_type& rewriter, std::size_t depth = 0) {
+
+      byte_t const* const elements = static_cast<byte_t const*>(source.data()) + sizeof(length_t);
+      byte_t const* const elements_end = static_cast<byte_t const*>(source.data()) + source.size() - 1;
+
+      // The start of the run of kept elements not yet copied.
+      byte_t const* run = elements;
+
+      auto current = source.begin();
+      auto const end = source.end();
+
+      for (; current != end; ++current) {
+        element_view const& element = *current;
+        rewrite_action const action = rewriter.on_element(element, depth);
+
+        if (action == rewrite_action::keep)
+          continue;
+
+        bool const is_nested = (element.type() == types::document || element.type() == types::array);
+        if (action == rewrite_action::descend && !is_nested)
+          continue;
+
+        if (run != element.data())
+          target.encode_raw_elements(binary_cdata(run, element.data() - run));
+        run = element.data() + element.size();
+
+        if (action == rewrite_action::replace) {
+          rewriter.on_replace(element, depth, target);
+        } else if (action == rewrite_action::descend) {
+          auto nested = (element.type() == types::array) ?
+            target.start_subarray(element.name()) :
+            target.start_subdocument(element.name());
+          bool const ok = rewrite_elements<Writer_type, Stats_type>(document_view(element.as_document()), nested,
+                                                                    rewriter, depth + 1);
+          rewriter.on_finish(depth + 1, nested);
+          nested.finish();
+          if (!ok)
+            return false;
+        }
+      }
+
+      if (!current.ok())
+        return false;
+
+      if (run != elements_end)
+        target.encode_raw_elements(binary_cdata(run, elements_end - run));
+
+      return target.ok();
+    }
+
+    ///
+    /// Rewrites 'source' into a new document written by 'writer',
+    /// encoded with the statistics policy 'Stats_type', as in
+    /// 'rewrite_document(source, writer, rewriter, thread_encoder_stats())'.
+    /// The new document is finished even if the source turns out to
+    /// be malformed.
+    ///
+    template<typename Writer_type, typename Rewriter_type, typename Stats_type = no_encoder_stats>
+    bool rewrite_document(document_view const& source, Writer_type& writer, Rewriter_type& rewriter,
+                          Stats_type stats = Stats_type()) {
+      auto target = start_document(writer, stats);
+      bool const ok = rewrite_elements(source, target, rewriter);
+      rewriter.on_finish(0, target);
+      target.finish();
+      return ok && target.ok();
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_d45f587a_1f7a_4f15_9e58_12ebecb779c9
@@ -0,0 +1,158 @@
+#ifndef included_e3dfa44a_8831_4e55_9d3e_b60d1f0e9f1a
+#define included_e3dfa44a_8831_4e55_9d3e_b60d1f0e9f1a
+
+#include <cstddef>
+#include <iterator>
+
+#include <bassoon/document_data.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// A view of back to back BSON documents in contiguous memory,
+    /// as found in a mongodump style .bson file. The sequence does
+    /// not own its memory.
+    ///
+    class document_sequence {
+    public:
+
+      ///
+      /// A forward iterator over the documents of a sequence. Each
+      /// step reads only the leading length of the next document
+      /// and checks that its trailing null byte is where the length
+      /// says it should be.
+      ///
+      /// If the next document is malformed (truncated, or with a
+      /// nonsense length) the iterator moves to the end of the
+      /// sequence and 'ok' returns false. 'offset' then reports where
+      /// the malformed data starts.
+      ///
+      class iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = document_cdata;
+        using difference_type = std::ptrdiff_t;
+        using pointer = document_cdata const*;
+        using reference = document_cdata;
+
+        iterator() noexcept
+          : begin_(nullptr)
+          , current_(nullptr)
+          , end_(nullptr)
+          , offset_(0)
+          , length_(0)
+          , ok_(true) {}
+
+        iterator(byte_t const* begin, byte_t const* current, byte_t const* end) noexcept
+          : begin_(begin)
+          , current_(current)
+          , end_(end)
+          , offset_(current - begin)
+          , length_(0)
+          , ok_(true) {
+          check();
+        }
+
+        document_cdata operator*() const noexcept {
+          return document_cdata(current_, length_);
+        }
+
+        iterator& operator++() noexcept {
+          current_ += length_;
+          offset_ += length_;
+          check();
+          return *this;
+        }
+
+        iterator operator++(int) noexcept {
+          iterator result(*this);
+          ++*this;
+          return result;
+        }
+
+        bool operator==(const iterator& other) const noexcept {
+          return current_ == other.current_;
+        }
+
+        bool operator!=(const iterator& other) const noexcept {
+          return current_ != other.current_;
+        }
+
+        ///
+        /// Returns false if iteration stopped at a malformed document.
+        ///
+        bool ok() const noexcept {
+          return ok_;
+        }
+
+        ///
+        /// The offset of the current document from the start of the
+        /// sequence, or of the malformed data that ended iteration.
+        ///
+        std::size_t offset() const noexcept {
+          return offset_;
+        }
+
+      private:
+        void check() noexcept {
+          length_ = 0;
+          if (current_ == end_)
+            return;
+
+          std::size_t const available = end_ - current_;
+          if (available > sizeof(length_t)) {
+            length_t const length = document_cdata(current_).size;
+            if (length > static_cast<length_t>(sizeof(length_t)) &&
+                static_cast<std::size_t>(length) <= available &&
+                current_[length - 1] == 0) {
+              length_ = length;
+              return;
+            }
+          }
+
+          ok_ = false;
+          current_ = end_;
+        }
+
+        byte_t const* begin_;
+        byte_t const* current_;
+        byte_t const* end_;
+        std::size_t offset_;
+        length_t length_;
+        bool ok_;
+      };
+
+      document_sequence() noexcept
+        : data_(nullptr)
+        , size_(0) {}
+
+      document_sequence(void const* data, std::size_t size) noexcept
+        : data_(static_cast<byte_t const*>(data))
+        , size_(size) {}
+
+      iterator begin() const noexcept {
+        return iterator(data_, data_, data_ + size_);
+      }
+
+      iterator end() const noexcept {
+        return iterator(data_, data_ + size_, data_ + size_);
+      }
+
+      void const* data() const noexcept {
+        return data_;
+      }
+
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+    private:
+      byte_t const* data_;
+      std::size_t size_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_e3dfa44a_8831_4e55_9d3e_b60d1f0e9f1a
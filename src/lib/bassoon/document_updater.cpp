@@ -0,0 +1,161 @@
+#include <bassoon/document_updater.hpp>
+
+#include <cstring>
+#include <limits>
+
+#include <bassoon/document_view.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    using element_details::read_little_endian;
+    using element_details::write_little_endian;
+
+    document_updater::document_updater(void* data, std::size_t capacity) noexcept
+      : data_(static_cast<byte_t*>(data))
+      , size_(0)
+      , capacity_(capacity) {
+      if (capacity_ >= sizeof(length_t)) {
+        length_t const length = read_little_endian<length_t>(data_);
+        if (length > 0)
+          size_ = length;
+      }
+    }
+
+    update_status document_updater::set_floating_point(cstring_cdata path, double_t value) noexcept {
+      // BSON stores the IEEE 754 bits little endian, as an int64 is.
+      std::uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      byte_t bytes[sizeof(bits)];
+      write_little_endian(bytes, bits);
+      return set_fixed(path, types::floating_point, bytes, sizeof(bytes));
+    }
+
+    update_status document_updater::set_int32(cstring_cdata path, std::int32_t value) noexcept {
+      byte_t bytes[sizeof(value)];
+      write_little_endian(bytes, value);
+      return set_fixed(path, types::int32, bytes, sizeof(bytes));
+    }
+
+    update_status document_updater::set_int64(cstring_cdata path, std::int64_t value) noexcept {
+      byte_t bytes[sizeof(value)];
+      write_little_endian(bytes, value);
+      return set_fixed(path, types::int64, bytes, sizeof(bytes));
+    }
+
+    update_status document_updater::set_utc_datetime(cstring_cdata path, std::int64_t value) noexcept {
+      byte_t bytes[sizeof(value)];
+      write_little_endian(bytes, value);
+      return set_fixed(path, types::utc_datetime, bytes, sizeof(bytes));
+    }
+
+    update_status document_updater::set_timestamp(cstring_cdata path, std::int64_t value) noexcept {
+      byte_t bytes[sizeof(value)];
+      write_little_endian(bytes, value);
+      return set_fixed(path, types::timestamp, bytes, sizeof(bytes));
+    }
+
+    update_status document_updater::set_boolean(cstring_cdata path, bool value) noexcept {
+      byte_t const byte = static_cast<byte_t>(value ? values::true_ : values::false_);
+      return set_fixed(path, types::boolean, &byte, sizeof(byte));
+    }
+
+    update_status document_updater::set_object_id(cstring_cdata path, object_id_cdata value) noexcept {
+      return set_fixed(path, types::object_id, value.data, k_object_id_length);
+    }
+
+    update_status document_updater::set_null(cstring_cdata path) noexcept {
+      return set_fixed(path, types::null, nullptr, 0);
+    }
+
+    update_status document_updater::set_utf8_string(cstring_cdata path, string_cdata value) noexcept {
+      byte_t length[sizeof(length_t)];
+      write_little_endian(length, value.size);
+      return set(path, replacement{ types::utf8_string, length, sizeof(length), value.data,
+                                    static_cast<std::size_t>(value.size) });
+    }
+
+    update_status document_updater::set_binary(cstring_cdata path, binary_subtypes subtype, binary_cdata value) noexcept {
+      byte_t head[sizeof(length_t) + sizeof(subtype)];
+      write_little_endian(head, value.size);
+      head[sizeof(length_t)] = static_cast<byte_t>(subtype);
+      return set(path, replacement{ types::binary, head, sizeof(head), value.data,
+                                    static_cast<std::size_t>(value.size) });
+    }
+
+    update_status document_updater::set_document(cstring_cdata path, document_cdata value) noexcept {
+      return set(path, replacement{ types::document, value.data, static_cast<std::size_t>(value.size), nullptr, 0 });
+    }
+
+    update_status document_updater::set_array(cstring_cdata path, document_cdata value) noexcept {
+      return set(path, replacement{ types::array, value.data, static_cast<std::size_t>(value.size), nullptr, 0 });
+    }
+
+    update_status document_updater::set_fixed(cstring_cdata path, types type, void const* value, std::size_t size) noexcept {
+      return set(path, replacement{ type, value, size, nullptr, 0 });
+    }
+
+    update_status document_updater::set(cstring_cdata path, replacement const& value) noexcept {
+      if (size_ <= sizeof(length_t) || size_ > capacity_)
+        return update_status::malformed;
+      std::ptrdiff_t delta = 0;
+      return replace(0, path.data, path.data + path.size - 1, value, delta);
+    }
+
+    // Replaces the element at 'path' within the document at offset
+    // 'document', and returns how much that document grew in
+    // 'delta'. Nothing is written until we know the update fits, and
+    // the enclosing lengths are fixed up on the way back out.
+    update_status document_updater::replace(std::size_t document, char const* path, char const* end,
+                                            replacement const& value, std::ptrdiff_t& delta) noexcept {
+      char const* const dot = static_cast<char const*>(std::memchr(path, '.', end - path));
+      std::size_t const name_size = (dot ? dot : end) - path;
+
+      document_view const view(document_cdata(data_ + document));
+      auto current = view.begin();
+      for (; current != view.end(); ++current)
+        if (current->has_name(path, name_size))
+          break;
+
+      if (current == view.end())
+        return current.ok() ? update_status::not_found : update_status::malformed;
+
+      element_view const& element = *current;
+      std::size_t const value_offset = element.value() - data_;
+
+      if (dot) {
+        if (element.type() != types::document && element.type() != types::array)
+          return update_status::not_found;
+        update_status const status = replace(value_offset, dot + 1, end, value, delta);
+        if (status != update_status::ok)
+          return status;
+      } else {
+        std::size_t const new_size = value.head_size + value.body_size;
+        delta = static_cast<std::ptrdiff_t>(new_size) - static_cast<std::ptrdiff_t>(element.value_size());
+
+        if (delta > 0 &&
+            (static_cast<std::size_t>(delta) > capacity_ - size_ ||
+             size_ + delta > static_cast<std::size_t>(std::numeric_limits<length_t>::max())))
+          return update_status::no_room;
+
+        if (delta != 0) {
+          std::size_t const tail = value_offset + element.value_size();
+          std::memmove(data_ + tail + delta, data_ + tail, size_ - tail);
+          size_ += delta;
+        }
+
+        data_[element.data() - data_] = static_cast<byte_t>(value.type);
+        if (value.head_size)
+          std::memcpy(data_ + value_offset, value.head, value.head_size);
+        if (value.body_size)
+          std::memcpy(data_ + value_offset + value.head_size, value.body, value.body_size);
+      }
+
+      if (delta != 0)
+        write_little_endian(data_ + document, static_cast<length_t>(read_little_endian<length_t>(data_ + document) + delta));
+
+      return update_status::ok;
+    }
+
+  } // namespace bson
+} // namespace bassoon
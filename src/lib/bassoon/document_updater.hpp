@@ -0,0 +1,112 @@
+#ifndef included_d79d1737_fa7d_4e2b_9baf_eee85e8c08aa
+#define included_d79d1737_fa7d_4e2b_9baf_eee85e8c08aa
+
+#include <cstdint>
+
+#include <bassoon/binary_data.hpp>
+#include <bassoon/document_data.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/string_data.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    enum class update_status {
+      ok,
+
+      // No element lies at the path.
+      not_found,
+
+      // The document would outgrow the buffer. It is unchanged.
+      no_room,
+
+      // The document is malformed along the path. It is unchanged.
+      malformed
+    };
+
+    ///
+    /// Modifies an encoded document in its buffer, without decoding
+    /// or re-encoding the rest of it.
+    ///
+    /// Each 'set_*' call finds the element at a dotted path such as
+    /// "a.b.0" and replaces its value, and its type if that differs.
+    /// If the new value has the same size as the old one, which is
+    /// always the case when overwriting a fixed width value with one
+    /// of the same type, only the value bytes are written. Otherwise
+    /// the bytes after the element are moved to fit, and the length
+    /// of every document enclosing the element is fixed up.
+    ///
+    /// The document must start at the beginning of the buffer, for
+    /// instance the std::array behind an array_writer once the
+    /// document is finished. Capacity past the end of the document is
+    /// room to grow into.
+    ///
+    class LIBBASSOON_EXPORT document_updater {
+    public:
+      ///
+      /// Updates the document at 'data', in a buffer of 'capacity'
+      /// bytes. The size of the document is read from its leading
+      /// length.
+      ///
+      document_updater(void* data, std::size_t capacity) noexcept;
+
+      update_status set_floating_point(cstring_cdata path, double_t value) noexcept;
+      update_status set_int32(cstring_cdata path, std::int32_t value) noexcept;
+      update_status set_int64(cstring_cdata path, std::int64_t value) noexcept;
+      update_status set_utc_datetime(cstring_cdata path, std::int64_t value) noexcept;
+      update_status set_timestamp(cstring_cdata path, std::int64_t value) noexcept;
+      update_status set_boolean(cstring_cdata path, bool value) noexcept;
+      update_status set_object_id(cstring_cdata path, object_id_cdata value) noexcept;
+      update_status set_null(cstring_cdata path) noexcept;
+
+      update_status set_utf8_string(cstring_cdata path, string_cdata value) noexcept;
+      update_status set_binary(cstring_cdata path, binary_subtypes subtype, binary_cdata value) noexcept;
+
+      ///
+      /// Replaces the value at 'path' with a copy of 'value', which
+      /// must not lie within this document.
+      ///
+      update_status set_document(cstring_cdata path, document_cdata value) noexcept;
+      update_status set_array(cstring_cdata path, document_cdata value) noexcept;
+
+      void const* data() const noexcept {
+        return data_;
+      }
+
+      ///
+      /// The current size of the document.
+      ///
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+      std::size_t capacity() const noexcept {
+        return capacity_;
+      }
+
+    private:
+      // The parts of a new value. The value is written as 'head'
+      // followed by 'body', which saves copying a string or binary
+      // payload just to put a length in front of it.
+      struct replacement {
+        types type;
+        void const* head;
+        std::size_t head_size;
+        void const* body;
+        std::size_t body_size;
+      };
+
+      update_status set_fixed(cstring_cdata path, types type, void const* value, std::size_t size) noexcept;
+      update_status set(cstring_cdata path, replacement const& value) noexcept;
+      update_status replace(std::size_t document, char const* path, char const* end,
+                            replacement const& value, std::ptrdiff_t& delta) noexcept;
+
+      byte_t* data_;
+      std::size_t size_;
+      std::size_t capacity_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_d79d1737_fa7d_4e2b_9baf_eee85e8c08aa
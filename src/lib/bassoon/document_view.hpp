@@ -0,0 +1,219 @@
+#ifndef included_41b31404_702f_4737_861b_c266e53d5721
+#define included_41b31404_702f_4737_861b_c266e53d5721
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include <bassoon/element_view.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// A read-only view of a complete BSON document in memory, which
+    /// walks its elements in place without decoding or copying
+    /// anything. The view does not own the memory it points to.
+    ///
+    class document_view {
+    public:
+
+      ///
+      /// A forward iterator over the elements of a document. Each
+      /// step checks that the next element is well formed and lies
+      /// within the document. If it is not, the iterator moves to the
+      /// end and 'ok' returns false.
+      ///
+      class iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = element_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = element_view const*;
+        using reference = element_view const&;
+
+        iterator() noexcept
+          : current_(nullptr)
+          , end_(nullptr)
+          , ok_(true) {}
+
+        iterator(byte_t const* current, byte_t const* end) noexcept
+          : current_(current)
+          , end_(end)
+          , ok_(true) {
+          check();
+        }
+
+        element_view const& operator*() const noexcept {
+          return element_;
+        }
+
+        element_view const* operator->() const noexcept {
+          return &element_;
+        }
+
+        iterator& operator++() noexcept {
+          current_ += element_.size();
+          check();
+          return *this;
+        }
+
+        iterator operator++(int) noexcept {
+          iterator result(*this);
+          ++*this;
+          return result;
+        }
+
+        bool operator==(const iterator& other) const noexcept {
+          return current_ == other.current_;
+        }
+
+        bool operator!=(const iterator& other) const noexcept {
+          return current_ != other.current_;
+        }
+
+        ///
+        /// Returns false if iteration stopped at a malformed element.
+        ///
+        bool ok() const noexcept {
+          return ok_;
+        }
+
+      private:
+        friend class document_view;
+
+        void check() noexcept {
+          using namespace element_details;
+
+          element_ = element_view();
+          if (current_ == end_)
+            return;
+
+          std::size_t const available = end_ - current_;
+          byte_t const type = current_[0];
+          byte_t const* const name_end = static_cast<byte_t const*>(
+            std::memchr(current_ + 1, 0, available - 1));
+
+          if (is_known_type(type) && name_end) {
+            byte_t const* const value = name_end + 1;
+            std::size_t const size = value_size(static_cast<types>(type), value, end_ - value);
+            if (size != k_variable_size && is_valid_value(static_cast<types>(type), value, size)) {
+              element_ = element_view(current_, value - current_ - 1, size);
+              return;
+            }
+          }
+
+          ok_ = false;
+          current_ = end_;
+        }
+
+        // Checks the parts of a value that its accessors rely on.
+        static bool is_valid_value(types type, byte_t const* value, std::size_t size) noexcept {
+          switch (type) {
+            case types::utf8_string:
+            case types::javascript:
+            case types::symbol:
+              return size > sizeof(length_t) && value[size - 1] == 0;
+            case types::document:
+            case types::array:
+              return value[size - 1] == 0;
+            case types::boolean:
+              return value[0] <= static_cast<byte_t>(values::true_);
+            default:
+              return true;
+          }
+        }
+
+        byte_t const* current_;
+        byte_t const* end_;
+        element_view element_;
+        bool ok_;
+      };
+
+      ///
+      /// Views the document at 'document', whose size is read from its
+      /// leading length.
+      ///
+      explicit document_view(void const* document) noexcept
+        : document_view(document_cdata(document)) {}
+
+      document_view(document_cdata document) noexcept
+        : data_(static_cast<byte_t const*>(document.data))
+        , size_(document.size) {}
+
+      ///
+      /// Returns an iterator at the first element. An iterator at the
+      /// end whose 'ok' is false means the document is not even
+      /// framed correctly.
+      ///
+      iterator begin() const noexcept {
+        if (size_ <= sizeof(length_t) || data_[size_ - 1] != 0) {
+          iterator result(end_address(), end_address());
+          result.ok_ = false;
+          return result;
+        }
+        return iterator(data_ + sizeof(length_t), end_address());
+      }
+
+      iterator end() const noexcept {
+        return iterator(end_address(), end_address());
+      }
+
+      ///
+      /// Returns the first top level element named 'name', or an empty
+      /// view if there is none.
+      ///
+      element_view find(char const* name, std::size_t size) const noexcept {
+        for (auto const& element : *this)
+          if (element.has_name(name, size))
+            return element;
+        return element_view();
+      }
+
+      element_view find(cstring_cdata name) const noexcept {
+        return find(name.data, name.size - 1);
+      }
+
+      ///
+      /// Follows a dotted 'path' such as "a.b.0" through nested
+      /// documents and arrays. Returns an empty view if any step is
+      /// missing or is not a document or array.
+      ///
+      element_view find_path(cstring_cdata path) const noexcept {
+        char const* component = path.data;
+        char const* const end = path.data + path.size - 1;
+        document_view current = *this;
+
+        while (true) {
+          char const* const dot = static_cast<char const*>(std::memchr(component, '.', end - component));
+          element_view const element = current.find(component, (dot ? dot : end) - component);
+          if (!element || !dot)
+            return element;
+          if (element.type() != types::document && element.type() != types::array)
+            return element_view();
+          current = document_view(element.as_document());
+          component = dot + 1;
+        }
+      }
+
+      void const* data() const noexcept {
+        return data_;
+      }
+
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+    private:
+      byte_t const* end_address() const noexcept {
+        return data_ + (size_ ? size_ - 1 : 0);
+      }
+
+      byte_t const* data_;
+      std::size_t size_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_41b31404_702f_4737_861b_c266e53d5721
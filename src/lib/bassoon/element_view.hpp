@@ -0,0 +1,259 @@
+#ifndef included_3f872691_eb20_4e5a_8ae7_adf9004a8238
+#define included_3f872691_eb20_4e5a_8ae7_adf9004a8238
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <bassoon/document_data.hpp>
+#include <bassoon/endian.hpp>
+#include <bassoon/string_data.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace element_details {
+
+      const std::size_t k_variable_size = std::numeric_limits<std::size_t>::max();
+
+      template<typename T>
+      T read_little_endian(void const* data) noexcept {
+        T value;
+        std::memcpy(&value, data, sizeof(value));
+        return endian::little_to_native(value);
+      }
+
+      template<typename T>
+      void write_little_endian(void* data, T value) noexcept {
+        value = endian::native_to_little(value);
+        std::memcpy(data, &value, sizeof(value));
+      }
+
+      // FNV-1a. Element names and dictionary strings are short, and
+      // for those this does about as well as anything fancier.
+      inline std::uint64_t hash_bytes(void const* data, std::size_t size) noexcept {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i != size; ++i) {
+          hash ^= static_cast<unsigned char const*>(data)[i];
+          hash *= 1099511628211ULL;
+        }
+        return hash;
+      }
+
+      inline bool is_known_type(byte_t type) noexcept {
+        return (type >= static_cast<byte_t>(types::floating_point) &&
+                type <= static_cast<byte_t>(types::int64)) ||
+          type == static_cast<byte_t>(types::min) ||
+          type == static_cast<byte_t>(types::max);
+      }
+
+      // The size of values whose size does not depend on their
+      // content, or k_variable_size.
+      inline std::size_t fixed_value_size(types type) noexcept {
+        switch (type) {
+          case types::floating_point:
+            return sizeof(double_t);
+          case types::object_id:
+            return k_object_id_length;
+          case types::boolean:
+            return sizeof(byte_t);
+          case types::int32:
+            return sizeof(std::int32_t);
+          case types::utc_datetime:
+          case types::timestamp:
+          case types::int64:
+            return sizeof(std::int64_t);
+          case types::undefined_no_deprecated:
+          case types::null:
+          case types::min:
+          case types::max:
+            return 0;
+          default:
+            return k_variable_size;
+        }
+      }
+
+      // Works out the size of a variable width value from its leading
+      // 'available' bytes. Returns false if those bytes are not
+      // enough to tell. Malformed lengths yield k_variable_size,
+      // which can never fit in the enclosing document.
+      inline bool variable_value_size(types type, byte_t const* data, std::size_t available, std::size_t& size) noexcept {
+        if (type == types::regex) {
+          if (available == 0)
+            return false;
+          byte_t const* const regex_end = static_cast<byte_t const*>(std::memchr(data, 0, available));
+          if (!regex_end)
+            return false;
+          std::size_t const regex_size = regex_end - data + 1;
+          byte_t const* const options_end = static_cast<byte_t const*>(
+            std::memchr(regex_end + 1, 0, available - regex_size));
+          if (!options_end)
+            return false;
+          size = options_end - data + 1;
+          return true;
+        }
+
+        if (available < sizeof(length_t))
+          return false;
+
+        length_t const length = read_little_endian<length_t>(data);
+        if (length < 0) {
+          size = k_variable_size;
+          return true;
+        }
+
+        switch (type) {
+          case types::binary:
+            size = sizeof(length_t) + sizeof(binary_subtypes) + length;
+            break;
+          case types::db_pointer_no_deprecated:
+            size = sizeof(length_t) + length + k_object_id_length;
+            break;
+          case types::document:
+          case types::array:
+            size = (static_cast<std::size_t>(length) <= sizeof(length_t)) ? k_variable_size : length;
+            break;
+          case types::scoped_javascript:
+            size = (static_cast<std::size_t>(length) < sizeof(length_t)) ? k_variable_size : length;
+            break;
+          default:
+            size = sizeof(length_t) + length;
+            break;
+        }
+        return true;
+      }
+
+      // Returns the size of the value at 'data', which must lie within
+      // 'available' bytes, or k_variable_size if it does not.
+      inline std::size_t value_size(types type, byte_t const* data, std::size_t available) noexcept {
+        std::size_t size = fixed_value_size(type);
+        if (size == k_variable_size && !variable_value_size(type, data, available, size))
+          return k_variable_size;
+        return (size <= available) ? size : k_variable_size;
+      }
+
+    }  // namespace element_details
+
+    ///
+    /// A view of one element of a BSON document in memory: its type
+    /// byte, its name, and its value. The view does not own the
+    /// memory it points to.
+    ///
+    /// The typed accessors assume that you have already checked
+    /// 'type'. A default constructed view is empty, and converts to
+    /// false.
+    ///
+    class element_view {
+    public:
+      element_view() noexcept
+        : data_(nullptr)
+        , name_size_(0)
+        , value_size_(0) {}
+
+      ///
+      /// 'data' points at the type byte. 'name_size' includes the
+      /// name's null byte.
+      ///
+      element_view(byte_t const* data, std::size_t name_size, std::size_t value_size) noexcept
+        : data_(data)
+        , name_size_(name_size)
+        , value_size_(value_size) {}
+
+      explicit operator bool() const noexcept {
+        return data_ != nullptr;
+      }
+
+      types type() const noexcept {
+        return static_cast<types>(data_[0]);
+      }
+
+      cstring_cdata name() const {
+        return cstring_cdata(reinterpret_cast<char const*>(data_ + 1), name_size_,
+                             string_data_details::null_included_tag());
+      }
+
+      ///
+      /// Returns true if this element is named 'name'.
+      ///
+      bool has_name(char const* name, std::size_t size) const noexcept {
+        return size + 1 == name_size_ && std::memcmp(data_ + 1, name, size) == 0;
+      }
+
+      byte_t const* value() const noexcept {
+        return data_ + 1 + name_size_;
+      }
+
+      std::size_t value_size() const noexcept {
+        return value_size_;
+      }
+
+      ///
+      /// The whole element, from its type byte to the end of its value.
+      ///
+      byte_t const* data() const noexcept {
+        return data_;
+      }
+
+      std::size_t size() const noexcept {
+        return 1 + name_size_ + value_size_;
+      }
+
+      double_t as_floating_point() const noexcept {
+        double_t result;
+        std::memcpy(&result, value(), sizeof(result));
+        return result;
+      }
+
+      std::int32_t as_int32() const noexcept {
+        return element_details::read_little_endian<std::int32_t>(value());
+      }
+
+      ///
+      /// For int64, utc_datetime and timestamp elements.
+      ///
+      std::int64_t as_int64() const noexcept {
+        return element_details::read_little_endian<std::int64_t>(value());
+      }
+
+      bool as_boolean() const noexcept {
+        return value()[0] != 0;
+      }
+
+      ///
+      /// For utf8_string, javascript and symbol elements.
+      ///
+      string_cdata as_string() const {
+        return string_cdata(reinterpret_cast<char const*>(value() + sizeof(length_t)),
+                            element_details::read_little_endian<length_t>(value()),
+                            string_data_details::null_included_tag());
+      }
+
+      ///
+      /// For document and array elements.
+      ///
+      document_cdata as_document() const noexcept {
+        return document_cdata(value(), value_size_);
+      }
+
+      object_id_cdata as_object_id() const noexcept {
+        return object_id_cdata(value());
+      }
+
+      binary_subtypes binary_subtype() const noexcept {
+        return static_cast<binary_subtypes>(value()[sizeof(length_t)]);
+      }
+
+      binary_cdata as_binary() const noexcept {
+        return binary_cdata(value() + sizeof(length_t) + 1, value_size_ - sizeof(length_t) - 1);
+      }
+
+    private:
+      byte_t const* data_;
+      std::size_t name_size_;
+      std::size_t value_size_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_3f872691_eb20_4e5a_8ae7_adf9004a8238
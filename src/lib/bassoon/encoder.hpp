@@ -5,15 +5,67 @@
 #include <type_traits>
 
 #include <bassoon/debug.hpp>
+#include <bassoon/document_view.hpp>
 #include <bassoon/encoder_interface.hpp>
 #include <bassoon/endian.hpp>
 
 namespace bassoon {
   namespace bson {
 
-    template<typename writer_type>
+    ///
+    /// The default statistics policy of the encoder: none. A policy
+    /// is told about every document and subdocument started and
+    /// finished, with its depth, one for a top level document, and
+    /// the address and size of the finished document, or a null
+    /// address if the writer has failed; every element encoded, with
+    /// its size; and the element during which the writer first
+    /// stopped being 'ok', with the depth of its document and its
+    /// offset in it. Its hooks are static, and the encoder only calls
+    /// them, or does the work to provide their arguments, if
+    /// 'k_enabled' is true, so this policy leaves the encoder exactly
+    /// as it would be without one. See encoder_stats.hpp for a policy
+    /// that counts.
+    ///
+    struct no_encoder_stats {
+      static bool const k_enabled = false;
+
+      static void on_start_document(std::size_t) noexcept {}
+      static void on_element(types, std::size_t) noexcept {}
+      static void on_finish_document(std::size_t, void const*, std::size_t) noexcept {}
+      static void on_failure(types, cstring_cdata, std::size_t, std::size_t) noexcept {}
+    };
+
+    template<typename writer_type, typename stats_type = no_encoder_stats>
     class encoder;
 
+    namespace details {
+      // How deeply the document of an encoder nests. Only an encoder
+      // with a statistics policy needs to know, so only it stores it.
+      template<bool enabled>
+      class encoder_depth {
+      protected:
+        explicit encoder_depth(std::size_t) noexcept {}
+
+        std::size_t depth() const noexcept {
+          return 0;
+        }
+      };
+
+      template<>
+      class encoder_depth<true> {
+      protected:
+        explicit encoder_depth(std::size_t depth) noexcept
+          : depth_(depth) {}
+
+        std::size_t depth() const noexcept {
+          return depth_;
+        }
+
+      private:
+        std::size_t depth_;
+      };
+    } // namespace details
+
     ///
     /// Create a new document encoder, using 'writer' as the
     /// underlying writer. Call this to create a new top level BSON
@@ -27,6 +79,16 @@ namespace bassoon {
       return encoder<writer_type>::start_document(writer);
     }
 
+    ///
+    /// As above, with the statistics policy 'stats_type', as in
+    /// 'start_document(writer, thread_encoder_stats())'.
+    ///
+    template<typename writer_type, typename stats_type>
+    encoder<writer_type, stats_type> start_document(writer_type& writer, stats_type)
+      noexcept(noexcept(std::declval<encoder<writer_type, stats_type>>().start_document(writer))) {
+      return encoder<writer_type, stats_type>::start_document(writer);
+    }
+
     ///
     /// The concrete BSON encoder. This class derives from
     /// encoder_interface, but is final, meaning that if you have the
@@ -40,15 +102,22 @@ namespace bassoon {
     ///
     /// See @encoder_interface for documentations on most of the methods
     /// of this class.
-    template<typename Writer_type>
-    class encoder : public encoder_interface {
+    ///
+    /// 'Stats_type' is the statistics policy, described above, which
+    /// subdocuments and subarrays share with their parents.
+    template<typename Writer_type, typename Stats_type>
+    class encoder : public encoder_interface,
+                    private details::encoder_depth<Stats_type::k_enabled> {
     public:
       using writer_type = Writer_type;
+      using stats_type = Stats_type;
 
     private:
       using cursor_type = typename writer_type::cursor;
+      using depth_type = details::encoder_depth<stats_type::k_enabled>;
 
-      explicit encoder(writer_type& writer) noexcept(noexcept(std::declval<writer_type>().position)) :
+      explicit encoder(writer_type& writer, std::size_t depth = 1) noexcept(noexcept(std::declval<writer_type>().position)) :
+        depth_type(depth),
         cursor_(writer.position()) {}
 
       static const length_t k_invalid_length = 0xabababab;
@@ -93,112 +162,245 @@ namespace bassoon {
       }
 
       virtual encoder& encode_floating_point(cstring_cdata name, double_t value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         floating_point_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::floating_point, name, mark);
         return *this;
       }
 
       virtual encoder& encode_utf8_string(cstring_cdata name, string_cdata value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         utf8_string_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::utf8_string, name, mark);
         return *this;
       }
 
       virtual encoder& encode_subdocument(cstring_cdata name, void const* subdocument) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         document_element_encoder().encode(writer(), name, subdocument);
+        if (stats_type::k_enabled)
+          count_element(types::document, name, mark);
         return *this;
       }
 
       virtual encoder& encode_as_subdocument(cstring_cdata name, binary_cdata data) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         document_element_encoder().encode(writer(), name, data);
+        if (stats_type::k_enabled)
+          count_element(types::document, name, mark);
         return *this;
       }
 
       virtual encoder& encode_subarray(cstring_cdata name, void const* subarray) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         array_element_encoder().encode(writer(), name, subarray);
+        if (stats_type::k_enabled)
+          count_element(types::array, name, mark);
         return *this;
       }
 
       virtual encoder& encode_as_subarray(cstring_cdata name, binary_cdata data) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         array_element_encoder().encode(writer(), name, data);
+        if (stats_type::k_enabled)
+          count_element(types::array, name, mark);
         return *this;
       }
 
       virtual encoder& encode_binary(cstring_cdata name, binary_subtypes subtype, binary_cdata data) noexcept(is_noexcept) {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         binary_element_encoder().encode(writer(), name, subtype, data);
+        if (stats_type::k_enabled)
+          count_element(types::binary, name, mark);
         return *this;
       }
 
       virtual encoder& encode_undefined(cstring_cdata name) noexcept(is_noexcept) final override LIBBASSOON_DEPRECATED {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         undefined_element_encoder().encode(writer(), name);
+        if (stats_type::k_enabled)
+          count_element(types::undefined_no_deprecated, name, mark);
         return *this;
       }
 
       virtual encoder& encode_object_id(cstring_cdata name, object_id_cdata id) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         object_id_element_encoder().encode(writer(), name, id);
+        if (stats_type::k_enabled)
+          count_element(types::object_id, name, mark);
         return *this;
       }
 
       virtual encoder& encode_boolean(cstring_cdata name, bool value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         boolean_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::boolean, name, mark);
         return *this;
       }
 
       virtual encoder& encode_utc_datetime(cstring_cdata name, int64_t value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         utc_datetime_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::utc_datetime, name, mark);
         return *this;
       }
 
       virtual encoder& encode_null(cstring_cdata name) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         null_element_encoder().encode(writer(), name);
+        if (stats_type::k_enabled)
+          count_element(types::null, name, mark);
         return *this;
       }
 
       virtual encoder& encode_regex(cstring_cdata name, cstring_cdata regex, cstring_cdata options) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         regex_element_encoder().encode(writer(), name, regex, options);
+        if (stats_type::k_enabled)
+          count_element(types::regex, name, mark);
         return *this;
       }
 
       virtual encoder& encode_db_pointer(cstring_cdata name, string_cdata dbname, object_id_cdata id) noexcept(is_noexcept) final override LIBBASSOON_DEPRECATED {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         db_pointer_element_encoder().encode(writer(), name, dbname, id);
+        if (stats_type::k_enabled)
+          count_element(types::db_pointer_no_deprecated, name, mark);
         return *this;
       }
 
       virtual encoder& encode_javascript(cstring_cdata name, string_cdata code) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         javascript_element_encoder().encode(writer(), name, code);
+        if (stats_type::k_enabled)
+          count_element(types::javascript, name, mark);
         return *this;
       }
 
       virtual encoder& encode_symbol(cstring_cdata name, string_cdata symbol) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         symbol_element_encoder().encode(writer(), name, symbol);
+        if (stats_type::k_enabled)
+          count_element(types::symbol, name, mark);
         return *this;
       }
 
       virtual encoder& encode_scoped_javascript(cstring_cdata name, string_cdata code, void const* scope) noexcept(is_noexcept) final override  {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         scoped_javascript_element_encoder().encode(writer(), name, code, scope);
+        if (stats_type::k_enabled)
+          count_element(types::scoped_javascript, name, mark);
         return *this;
       }
 
       virtual encoder& encode_int32(cstring_cdata name, std::int32_t value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         int32_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::int32, name, mark);
         return *this;
       }
 
       virtual encoder& encode_timestamp(cstring_cdata name, std::int64_t value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         timestamp_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::timestamp, name, mark);
         return *this;
       }
 
       virtual encoder& encode_int64(cstring_cdata name, std::int64_t value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         int64_element_encoder().encode(writer(), name, value);
+        if (stats_type::k_enabled)
+          count_element(types::int64, name, mark);
         return *this;
       }
 
       virtual encoder& encode_min_key(cstring_cdata name) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         min_element_encoder().encode(writer(), name);
+        if (stats_type::k_enabled)
+          count_element(types::min, name, mark);
         return *this;
       }
 
       virtual encoder& encode_max_key(cstring_cdata name) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         max_element_encoder().encode(writer(), name);
+        if (stats_type::k_enabled)
+          count_element(types::max, name, mark);
+        return *this;
+      }
+
+      virtual encoder& encode_raw_elements(binary_cdata elements) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
+        wrapped_writer()
+          .template encode_with<raw_data_encoder>(elements);
+        if (stats_type::k_enabled)
+          count_raw_elements(elements, mark);
+        return *this;
+      }
+
+      virtual encoder& encode_raw_value(cstring_cdata name, types type, binary_cdata value) noexcept(is_noexcept) final override {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
+        wrapped_writer()
+          .template encode_with<type_and_name_encoder>(type, name)
+          .template encode_with<raw_data_encoder>(value);
+        if (stats_type::k_enabled)
+          count_element(type, name, mark);
         return *this;
       }
 
@@ -207,8 +409,13 @@ namespace bassoon {
       /// before using this encoder.
       ///
       encoder start_subdocument(cstring_cdata name) noexcept(is_noexcept) {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         private_start_subdocument(name);
-        encoder new_document(writer());
+        if (stats_type::k_enabled)
+          count_element(types::document, name, mark);
+        encoder new_document(writer(), this->depth() + 1);
         new_document.private_start_document();
         return new_document;
       }
@@ -218,8 +425,13 @@ namespace bassoon {
       /// before using this encoder.
       ///
       encoder start_subarray(cstring_cdata name) noexcept(is_noexcept) {
+        element_mark mark {};
+        if (stats_type::k_enabled)
+          mark = mark_element();
         private_start_subarray(name);
-        encoder new_document(writer());
+        if (stats_type::k_enabled)
+          count_element(types::array, name, mark);
+        encoder new_document(writer(), this->depth() + 1);
         new_document.private_start_document();
         return new_document;
       }
@@ -228,6 +440,9 @@ namespace bassoon {
       /// Finish object or array that we are encoding.
       ///
       encoder& finish() noexcept(is_noexcept) {
+        bool was_ok = true;
+        if (stats_type::k_enabled)
+          was_ok = writer().ok();
         wrapped_writer().
           template encode_with<null_byte_encoder>();
         length_t const written = writer().distance(cursor_, writer().position());
@@ -243,6 +458,13 @@ namespace bassoon {
         }
 
         writer().write_at(cursor_, &written, sizeof(written));
+
+        if (stats_type::k_enabled) {
+          bool const ok = writer().ok();
+          if (!ok && was_ok)
+            stats_type::on_failure(types::document, cstring_cdata(""), this->depth(), written);
+          stats_type::on_finish_document(this->depth(), ok ? cursor_.address() : nullptr, written);
+        }
         return *this;
       }
 
@@ -398,12 +620,9 @@ namespace bassoon {
       struct raw_document_encoder {
         static void encode(writer_type& writer, void const* document) noexcept(is_noexcept) {
 
-          // Read length out of the provided document.
-          length_t length = read_length_from_document(document);
-
-          // TODO(acm): CHECK ME!
-          length += sizeof(length) + 1;  // account for length and \0 byte.
-          // Write the data
+          // The leading length of a document already accounts for
+          // the length itself and the trailing \0 byte.
+          length_t const length = read_length_from_document(document);
           wrap(writer).template encode_with<raw_data_encoder>(binary_cdata(document, length));
         }
 
@@ -423,11 +642,10 @@ namespace bassoon {
           // don't like the way either of these has to pre-compute the
           // length, but I'm not sure how else to do it.
 
-          // Read length out of the provided scope document.
+          // The total length covers itself, the code string and the
+          // scope document.
           length_t length = read_length_from_document(scope);
-
-          // TODO(acm): CHECK ME!
-          length += sizeof(length) + 1;  // account for length and \0 byte.
+          length += sizeof(length);  // account for the total length.
           length += sizeof(length) + code.size;  // account for length of code.
 
           wrap(writer)
@@ -521,6 +739,8 @@ namespace bassoon {
     private:
 
       virtual void private_start_document() noexcept(is_noexcept) {
+        if (stats_type::k_enabled)
+          stats_type::on_start_document(this->depth());
         wrapped_writer()
           .template encode_with<document_start_encoder>();
       }
@@ -540,6 +760,49 @@ namespace bassoon {
         return cursor_.writer();
       }
 
+      // Where an element began, in its document, and whether the
+      // writer was 'ok' then. Only taken with a statistics policy.
+      struct element_mark {
+        bool ok;
+        std::size_t offset;
+      };
+
+      element_mark mark_element() noexcept(is_noexcept) {
+        writer_type& writer = this->writer();
+        return element_mark{ writer.ok(), writer.distance(cursor_, writer.position()) };
+      }
+
+      // Tells the statistics policy how the element begun at 'mark'
+      // went: its size if the writer is still 'ok', or where it was
+      // if it made the writer fail.
+      void count_element(types type, cstring_cdata name, element_mark mark) noexcept(is_noexcept) {
+        writer_type& writer = this->writer();
+        if (writer.ok())
+          stats_type::on_element(type, writer.distance(cursor_, writer.position()) - mark.offset);
+        else if (mark.ok)
+          stats_type::on_failure(type, name, this->depth(), mark.offset);
+      }
+
+      // As 'count_element', for each of the elements copied at once
+      // from 'elements'. A failure is put down to the first of them,
+      // since the copy either fits whole or not at all.
+      void count_raw_elements(binary_cdata elements, element_mark mark) noexcept(is_noexcept) {
+        byte_t const* const begin = static_cast<byte_t const*>(elements.data);
+        byte_t const* const end = begin + elements.size;
+        document_view::iterator current(begin, end);
+        if (!this->writer().ok()) {
+          if (!mark.ok || elements.size == 0)
+            return;
+          if (*current)
+            stats_type::on_failure(current->type(), current->name(), this->depth(), mark.offset);
+          else
+            stats_type::on_failure(static_cast<types>(begin[0]), cstring_cdata("", 0), this->depth(), mark.offset);
+          return;
+        }
+        for (document_view::iterator const last(end, end); current != last; ++current)
+          stats_type::on_element(current->type(), current->size());
+      }
+
       struct writer_wrapper {
         writer_wrapper(writer_type& writer) noexcept :
           writer_(writer) {}
@@ -585,8 +848,8 @@ namespace bassoon {
       const cursor_type cursor_;
     };
 
-    template<typename writer_type>
-    const length_t encoder<writer_type>::k_invalid_length;
+    template<typename writer_type, typename stats_type>
+    const length_t encoder<writer_type, stats_type>::k_invalid_length;
 
   }  // namespace bson
 }  // namespace bassoon
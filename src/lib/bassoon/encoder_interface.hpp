@@ -184,6 +184,21 @@ namespace bassoon {
       ///
       virtual encoder_interface& encode_max_key(cstring_cdata name) = 0;
 
+      ///
+      /// Copies 'elements', a run of one or more complete and valid
+      /// BSON elements, such as a slice of another document, into the
+      /// current document verbatim. The data is copied.
+      ///
+      virtual encoder_interface& encode_raw_elements(binary_cdata elements) = 0;
+
+      ///
+      /// Encodes an element of type 'type' named 'name', whose value
+      /// is the already encoded bytes 'value', into the current
+      /// document. This lets you copy a value from another document
+      /// under a new name without decoding it. The data is copied.
+      ///
+      virtual encoder_interface& encode_raw_value(cstring_cdata name, types type, binary_cdata value) = 0;
+
     protected:
       encoder_interface() = default;
     };
@@ -0,0 +1,206 @@
+#include <bassoon/encoder_stats.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace bassoon {
+  namespace bson {
+
+    const std::size_t encoder_failure::k_name_size;
+    const std::size_t encoder_stats_snapshot::k_depth_buckets;
+    const std::size_t encoder_stats_snapshot::k_size_buckets;
+    const bool thread_encoder_stats::k_enabled;
+
+    namespace {
+
+      // What 'set_sampler' was given, published whole through one
+      // pointer so that a thread never pairs one call's sampler with
+      // another's context.
+      struct sampling {
+        encoder_sampler sampler;
+        void* context;
+        std::uint64_t period;
+        sampling* previous;
+      };
+
+      std::atomic<sampling const*> g_sampling(nullptr);
+
+    }  // namespace
+
+    // Every thread's counters, what threads that have exited left
+    // behind, and the first failure. Every sampling ever published is
+    // kept too, as a thread may still be reading one after it has
+    // been replaced.
+    struct thread_encoder_stats::registry {
+      ~registry() {
+        while (samplings) {
+          sampling* const previous = samplings->previous;
+          delete samplings;
+          samplings = previous;
+        }
+      }
+
+      std::mutex mutex;
+      counters* threads = nullptr;
+      encoder_stats_snapshot retired;
+      sampling* samplings = nullptr;
+    };
+
+    namespace {
+
+      std::size_t size_bucket(std::size_t size) {
+        std::size_t bucket = 0;
+        while (size > 1 && bucket + 1 != encoder_stats_snapshot::k_size_buckets) {
+          size >>= 1;
+          ++bucket;
+        }
+        return bucket;
+      }
+
+      template<typename Counter_type, std::size_t size>
+      void add(std::array<std::uint64_t, size>& total, Counter_type const (&counters)[size]) {
+        for (std::size_t i = 0; i != size; ++i)
+          total[i] += counters[i].load(std::memory_order_relaxed);
+      }
+
+      template<typename Counter_type, std::size_t size>
+      void clear(Counter_type (&counters)[size]) {
+        for (auto& counter : counters)
+          counter.store(0, std::memory_order_relaxed);
+      }
+
+    }  // namespace
+
+    // When a thread that has counted exits, adds its counters to
+    // those of threads that have exited, and takes them off the list.
+    struct thread_encoder_stats::retirer {
+      counters* local = nullptr;
+
+      ~retirer() {
+        if (!local)
+          return;
+
+        registry& threads = get_registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+
+        encoder_stats_snapshot& retired = threads.retired;
+        add(retired.elements, local->elements);
+        add(retired.bytes, local->bytes);
+        add(retired.depths, local->depths);
+        add(retired.sizes, local->sizes);
+        retired.documents += local->documents.load(std::memory_order_relaxed);
+        retired.failures += local->failures.load(std::memory_order_relaxed);
+
+        counters** link = &threads.threads;
+        while (*link != local)
+          link = &(*link)->next;
+        *link = local->next;
+      }
+    };
+
+    thread_encoder_stats::registry& thread_encoder_stats::get_registry() noexcept {
+      static registry result;
+      return result;
+    }
+
+    void thread_encoder_stats::enroll(counters& local) noexcept {
+      static thread_local retirer exit;
+
+      registry& threads = get_registry();
+      {
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        local.next = threads.threads;
+        threads.threads = &local;
+      }
+      local.registered = true;
+      exit.local = &local;
+    }
+
+    encoder_stats_snapshot thread_encoder_stats::snapshot() noexcept {
+      registry& threads = get_registry();
+      std::lock_guard<std::mutex> lock(threads.mutex);
+
+      encoder_stats_snapshot result = threads.retired;
+      for (counters* local = threads.threads; local; local = local->next) {
+        add(result.elements, local->elements);
+        add(result.bytes, local->bytes);
+        add(result.depths, local->depths);
+        add(result.sizes, local->sizes);
+        result.documents += local->documents.load(std::memory_order_relaxed);
+        result.failures += local->failures.load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    void thread_encoder_stats::reset() noexcept {
+      registry& threads = get_registry();
+      std::lock_guard<std::mutex> lock(threads.mutex);
+
+      threads.retired = encoder_stats_snapshot();
+      for (counters* local = threads.threads; local; local = local->next) {
+        clear(local->elements);
+        clear(local->bytes);
+        clear(local->depths);
+        clear(local->sizes);
+        local->documents.store(0, std::memory_order_relaxed);
+        local->failures.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void thread_encoder_stats::set_sampler(encoder_sampler sampler, void* context, std::uint64_t period) noexcept {
+      sampling* next = nullptr;
+      if (sampler && period != 0)
+        next = new (std::nothrow) sampling { sampler, context, period, nullptr };
+
+      if (next) {
+        registry& threads = get_registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        next->previous = threads.samplings;
+        threads.samplings = next;
+      }
+      g_sampling.store(next, std::memory_order_release);
+    }
+
+    void thread_encoder_stats::on_failure(types type, cstring_cdata name, std::size_t depth, std::size_t offset) noexcept {
+      counters& local = local_counters();
+      bump(local.failures, 1);
+
+      registry& threads = get_registry();
+      std::lock_guard<std::mutex> lock(threads.mutex);
+      encoder_stats_snapshot& retired = threads.retired;
+      if (retired.failed)
+        return;
+
+      retired.failed = true;
+      encoder_failure& failure = retired.first_failure;
+      failure.type = type;
+      std::size_t const size = std::min(name.size, encoder_failure::k_name_size - 1);
+      std::memcpy(failure.name, name.data, size);
+      failure.name[size] = '\0';
+      failure.depth = depth;
+      failure.offset = offset;
+    }
+
+    void thread_encoder_stats::finish_top_level(counters& local, void const* document, std::size_t size) noexcept {
+      std::size_t const nesting = local.max_depth;
+      local.max_depth = 0;
+      if (!document)
+        return;
+
+      bump(local.documents, 1);
+      bump(local.depths[std::min(nesting, encoder_stats_snapshot::k_depth_buckets) - 1], 1);
+      bump(local.sizes[size_bucket(size)], 1);
+
+      sampling const* const current = g_sampling.load(std::memory_order_acquire);
+      if (!current)
+        return;
+      if (local.until_sample == 0 || local.until_sample > current->period)
+        local.until_sample = current->period;
+      if (--local.until_sample == 0)
+        current->sampler(document, size, current->context);
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
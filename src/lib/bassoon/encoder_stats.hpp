@@ -0,0 +1,168 @@
+#ifndef included_75b9a3d3_d9d8_4225_9c27_eebe65abd260
+#define included_75b9a3d3_d9d8_4225_9c27_eebe65abd260
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/string_data.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Called with one in every so many finished top level documents.
+    ///
+    using encoder_sampler = void (*)(void const* document, std::size_t size, void* context);
+
+    ///
+    /// Where the writer of an encoder first stopped being 'ok': the
+    /// element being encoded, its depth, with top level elements at
+    /// depth one, and its offset in its document.
+    ///
+    struct encoder_failure {
+      static std::size_t const k_name_size = 64;
+
+      types type = types::min;
+      char name[k_name_size] = {};
+      std::size_t depth = 0;
+      std::size_t offset = 0;
+    };
+
+    ///
+    /// The counts of every thread, added up.
+    ///
+    struct encoder_stats_snapshot {
+      static std::size_t const k_depth_buckets = 32;
+      static std::size_t const k_size_buckets = 33;
+
+      // Elements encoded, and their bytes, indexed by type byte.
+      std::array<std::uint64_t, 256> elements {};
+      std::array<std::uint64_t, 256> bytes {};
+
+      // Top level documents finished, by how deeply they nest, one
+      // for a document without subdocuments, with the last bucket
+      // counting any deeper; and by size, the bucket 'n' counting
+      // sizes from 2^n up to 2^(n+1), with the last bucket counting
+      // any larger.
+      std::uint64_t documents = 0;
+      std::array<std::uint64_t, k_depth_buckets> depths {};
+      std::array<std::uint64_t, k_size_buckets> sizes {};
+
+      // Elements or documents during which a writer stopped being
+      // 'ok', and, if there were any, the first since the last reset.
+      std::uint64_t failures = 0;
+      bool failed = false;
+      encoder_failure first_failure;
+    };
+
+    ///
+    /// A statistics policy for the encoder that counts, as in
+    /// 'start_document(writer, thread_encoder_stats())'.
+    ///
+    /// Each thread counts into its own counters, which only it
+    /// writes, so counting takes a few instructions per element and
+    /// no atomic read-modify-writes. The counters need no
+    /// construction, and a thread adds them to the list of every
+    /// thread's the first time it counts. 'snapshot' adds up the
+    /// counters of every thread, and those of threads that have
+    /// exited, on demand.
+    ///
+    /// 'reset' races with threads that are encoding: counts made
+    /// while it runs may survive it.
+    ///
+    class LIBBASSOON_EXPORT thread_encoder_stats {
+    public:
+      static bool const k_enabled = true;
+
+      static encoder_stats_snapshot snapshot() noexcept;
+      static void reset() noexcept;
+
+      ///
+      /// Calls 'sampler' with one in every 'period' top level
+      /// documents that each thread finishes. A 'period' of zero, or
+      /// a null 'sampler', stops sampling. The sampler is called on
+      /// the encoding thread, while the document is still in the
+      /// writer, always with the context it was set with.
+      ///
+      /// Calls already under way are not waited for: a thread may
+      /// still be in the old sampler, with the old context, after
+      /// this returns, so the caller must keep both usable until it
+      /// knows that every encoding thread has moved on.
+      ///
+      static void set_sampler(encoder_sampler sampler, void* context, std::uint64_t period) noexcept;
+
+      static void on_start_document(std::size_t depth) noexcept {
+        counters& local = local_counters();
+        // A top level document starts afresh, even if the last was
+        // abandoned without being finished.
+        if (depth == 1 || depth > local.max_depth)
+          local.max_depth = depth;
+      }
+
+      static void on_element(types type, std::size_t size) noexcept {
+        counters& local = local_counters();
+        std::size_t const index = static_cast<byte_t>(type);
+        bump(local.elements[index], 1);
+        bump(local.bytes[index], size);
+      }
+
+      static void on_finish_document(std::size_t depth, void const* document, std::size_t size) noexcept {
+        if (depth != 1)
+          return;
+        finish_top_level(local_counters(), document, size);
+      }
+
+      static void on_failure(types type, cstring_cdata name, std::size_t depth, std::size_t offset) noexcept;
+
+    private:
+      // Trivially constructible, so that a thread's counters are
+      // zeroed with the rest of its thread local storage, and reaching
+      // them takes neither a guard nor a call.
+      struct counters {
+        std::atomic<std::uint64_t> elements[256];
+        std::atomic<std::uint64_t> bytes[256];
+        std::atomic<std::uint64_t> documents;
+        std::atomic<std::uint64_t> depths[encoder_stats_snapshot::k_depth_buckets];
+        std::atomic<std::uint64_t> sizes[encoder_stats_snapshot::k_size_buckets];
+        std::atomic<std::uint64_t> failures;
+
+        // Only ever touched by the owning thread.
+        std::size_t max_depth;
+        std::uint64_t until_sample;
+        bool registered;
+
+        counters* next;
+      };
+
+      struct registry;
+      struct retirer;
+      static registry& get_registry() noexcept;
+
+      static counters& local_counters() noexcept {
+        static thread_local counters result;
+        if (!result.registered)
+          enroll(result);
+        return result;
+      }
+
+      // Adds the counters of this thread to the registry, and has
+      // them retired when it exits.
+      static void enroll(counters& local) noexcept;
+
+      // Only the owning thread writes its counters, so a load and a
+      // store will do, and are cheaper than an atomic add.
+      static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t value) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      }
+
+      static void finish_top_level(counters& local, void const* document, std::size_t size) noexcept;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_75b9a3d3_d9d8_4225_9c27_eebe65abd260
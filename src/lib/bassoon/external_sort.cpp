@@ -0,0 +1,670 @@
+#include <bassoon/external_sort.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bassoon/parallel_scan.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      // Records, in memory and in runs alike, are the size of the key,
+      // the key, then the document.
+      std::size_t const k_key_size_size = sizeof(std::uint32_t);
+
+      std::size_t const k_min_read_size = 64 * 1024;
+      std::size_t const k_max_spill_size = 1024 * 1024;
+
+      std::uint32_t key_size_of(byte_t const* record) noexcept {
+        std::uint32_t size;
+        std::memcpy(&size, record, sizeof(size));
+        return size;
+      }
+
+      byte_t const* document_of(byte_t const* record) noexcept {
+        return record + k_key_size_size + key_size_of(record);
+      }
+
+      std::size_t record_size(byte_t const* record) noexcept {
+        return (document_of(record) - record) + document_cdata(document_of(record)).size;
+      }
+
+      int compare_records(byte_t const* a, byte_t const* b) noexcept {
+        std::uint32_t const a_size = key_size_of(a);
+        std::uint32_t const b_size = key_size_of(b);
+        int const result = std::memcmp(a + k_key_size_size, b + k_key_size_size, std::min(a_size, b_size));
+        if (result != 0)
+          return result;
+        return (a_size > b_size) - (a_size < b_size);
+      }
+
+      // The first eight bytes of a key as a big endian integer, padded
+      // with zeros, so that most comparisons in the sort are one
+      // integer comparison on the entry itself.
+      std::uint64_t key_prefix(byte_t const* key, std::size_t size) noexcept {
+        std::uint64_t prefix = 0;
+        for (std::size_t i = 0; i != 8; ++i)
+          prefix = (prefix << 8) | (i < size ? key[i] : 0);
+        return prefix;
+      }
+
+      // Keeps the key in the encoder, where the caller picks it up.
+      struct key_writer {
+        bool reserve(std::size_t) noexcept {
+          return true;
+        }
+
+        void write(void const*, std::size_t) noexcept {}
+      };
+
+      int write_all(int fd, void const* data, std::size_t size) noexcept {
+        byte_t const* current = static_cast<byte_t const*>(data);
+        while (size != 0) {
+          ssize_t const written = ::write(fd, current, size);
+          if (written < 0) {
+            if (errno == EINTR)
+              continue;
+            return errno;
+          }
+          current += written;
+          size -= written;
+        }
+        return 0;
+      }
+
+      class run_writer {
+      public:
+        run_writer(int fd, std::size_t buffer_size)
+          : fd_(fd)
+          , buffer_(buffer_size)
+          , filled_(0)
+          , size_(0)
+          , error_(0) {}
+
+        void write(void const* data, std::size_t size) {
+          if (size > buffer_.size() - filled_) {
+            flush();
+            if (size > buffer_.size()) {
+              if (error_ == 0)
+                error_ = write_all(fd_, data, size);
+              size_ += size;
+              return;
+            }
+          }
+          std::memcpy(buffer_.data() + filled_, data, size);
+          filled_ += size;
+          size_ += size;
+        }
+
+        int flush() {
+          if (error_ == 0 && filled_ != 0)
+            error_ = write_all(fd_, buffer_.data(), filled_);
+          filled_ = 0;
+          return error_;
+        }
+
+        std::uint64_t size() const noexcept {
+          return size_;
+        }
+
+      private:
+        int fd_;
+        std::vector<byte_t> buffer_;
+        std::size_t filled_;
+        std::uint64_t size_;
+        int error_;
+      };
+
+    } // namespace
+
+    ///
+    /// Records are copied in from the front of one block, and the
+    /// entries that sort them grow down from the back, so that a
+    /// buffer never takes more memory than it was given.
+    ///
+    struct external_sorter::buffer {
+      struct entry {
+        std::uint64_t prefix;
+        std::size_t offset;
+      };
+
+      buffer(index_key_encoder const& encoder, std::size_t size)
+        : encoder(encoder) {
+        reset(size);
+      }
+
+      // Empties the buffer into a block of at most 'size' bytes.
+      void reset(std::size_t size) {
+        block.reset();
+        capacity = size / sizeof(entry);
+        block.reset(new entry[capacity]);
+        clear();
+      }
+
+      void clear() noexcept {
+        records_size = 0;
+        entries_size = 0;
+      }
+
+      bool empty() const noexcept {
+        return entries_size == 0;
+      }
+
+      std::size_t memory() const noexcept {
+        return capacity * sizeof(entry);
+      }
+
+      std::size_t room() const noexcept {
+        return memory() - records_size - entries_size * sizeof(entry);
+      }
+
+      byte_t* records() noexcept {
+        return reinterpret_cast<byte_t*>(block.get());
+      }
+
+      entry* entries() noexcept {
+        return block.get() + capacity - entries_size;
+      }
+
+      void sort() {
+        byte_t const* const base = records();
+        std::sort(entries(), entries() + entries_size, [base](entry const& a, entry const& b) {
+            if (a.prefix != b.prefix)
+              return a.prefix < b.prefix;
+            return compare_records(base + a.offset, base + b.offset) < 0;
+          });
+      }
+
+      index_key_encoder encoder;
+
+      std::unique_ptr<entry[]> block;
+      std::size_t capacity;
+      std::size_t records_size;
+      std::size_t entries_size;
+    };
+
+    ///
+    /// One input of a merge: either a sorted buffer still in memory,
+    /// or a spilled run, read a buffer at a time.
+    ///
+    struct external_sorter::source {
+      explicit source(buffer* memory)
+        : memory(memory)
+        , index(0)
+        , fd(-1)
+        , offset(0)
+        , end(0)
+        , begin(0)
+        , filled(0)
+        , record(nullptr)
+        , record_size(0) {}
+
+      source(run const& spilled, std::size_t read_size)
+        : memory(nullptr)
+        , index(0)
+        , fd(spilled.fd)
+        , offset(0)
+        , end(spilled.size)
+        , data(read_size)
+        , begin(0)
+        , filled(0)
+        , record(nullptr)
+        , record_size(0) {}
+
+      // Moves on to the next record, leaving 'record' null at the end.
+      // Returns an errno value on failure.
+      int advance() {
+        if (memory) {
+          record = index == memory->entries_size ? nullptr
+            : memory->records() + memory->entries()[index++].offset;
+          return 0;
+        }
+
+        begin += record_size;
+        record = nullptr;
+        record_size = 0;
+        if (begin == filled && offset == end)
+          return 0;
+
+        int error;
+        if ((error = fill(k_key_size_size)) != 0)
+          return error;
+        std::size_t const key_end = k_key_size_size + key_size_of(data.data() + begin);
+        if ((error = fill(key_end + sizeof(length_t))) != 0)
+          return error;
+        std::size_t const size = key_end + document_cdata(data.data() + begin + key_end).size;
+        if ((error = fill(size)) != 0)
+          return error;
+
+        record = data.data() + begin;
+        record_size = size;
+        return 0;
+      }
+
+      // Makes sure that 'size' bytes from 'begin' are in 'data'.
+      int fill(std::size_t size) {
+        if (filled - begin >= size)
+          return 0;
+
+        std::memmove(data.data(), data.data() + begin, filled - begin);
+        filled -= begin;
+        begin = 0;
+        if (size > data.size())
+          data.resize(size);
+
+        while (filled < size) {
+          if (offset == end)
+            return EIO;
+          std::size_t const wanted = std::min<std::uint64_t>(data.size() - filled, end - offset);
+          ssize_t const read = ::pread(fd, data.data() + filled, wanted, offset);
+          if (read < 0) {
+            if (errno == EINTR)
+              continue;
+            return errno;
+          }
+          if (read == 0)
+            return EIO;
+          filled += read;
+          offset += read;
+        }
+        return 0;
+      }
+
+      buffer* memory;
+      std::size_t index;
+
+      int fd;
+      std::uint64_t offset;
+      std::uint64_t end;
+      std::vector<byte_t> data;
+      std::size_t begin;
+      std::size_t filled;
+
+      byte_t const* record;
+      std::size_t record_size;
+    };
+
+    ///
+    /// A k-way merge with a loser tree. Internal nodes hold the loser
+    /// of the match played there, and the root the overall winner, so
+    /// replacing the winner replays only the matches on its path.
+    ///
+    class external_sorter::merger {
+    public:
+      explicit merger(std::vector<source> sources)
+        : sources_(std::move(sources))
+        , tree_(sources_.size())
+        , started_(false) {}
+
+      // Returns the next record, or null at the end or on failure, in
+      // which case 'error' is set.
+      byte_t const* next(int& error) {
+        std::size_t const count = sources_.size();
+        if (count == 0)
+          return nullptr;
+
+        if (!started_) {
+          started_ = true;
+          for (auto& source : sources_) {
+            if ((error = source.advance()) != 0)
+              return nullptr;
+          }
+
+          std::vector<std::size_t> winners(2 * count);
+          for (std::size_t i = 0; i != count; ++i)
+            winners[count + i] = i;
+          for (std::size_t node = count - 1; node >= 1; --node) {
+            std::size_t const a = winners[2 * node];
+            std::size_t const b = winners[2 * node + 1];
+            winners[node] = less(b, a) ? b : a;
+            tree_[node] = less(b, a) ? a : b;
+          }
+          tree_[0] = winners[1];
+        } else {
+          std::size_t winner = tree_[0];
+          if ((error = sources_[winner].advance()) != 0)
+            return nullptr;
+          for (std::size_t node = (winner + count) / 2; node >= 1; node /= 2) {
+            if (less(tree_[node], winner))
+              std::swap(tree_[node], winner);
+          }
+          tree_[0] = winner;
+        }
+
+        return sources_[tree_[0]].record;
+      }
+
+    private:
+      // Exhausted sources lose to everything. Ties go to the earlier
+      // source, for a merge that is deterministic.
+      bool less(std::size_t a, std::size_t b) const noexcept {
+        byte_t const* const a_record = sources_[a].record;
+        byte_t const* const b_record = sources_[b].record;
+        if (!a_record || !b_record)
+          return a_record != nullptr;
+        int const result = compare_records(a_record, b_record);
+        return result < 0 || (result == 0 && a < b);
+      }
+
+      std::vector<source> sources_;
+      std::vector<std::size_t> tree_;
+      bool started_;
+    };
+
+    external_sorter::external_sorter(std::vector<std::string> paths, std::uint32_t descending,
+                                     external_sort_options options)
+      : encoder_(std::move(paths), descending)
+      , options_(std::move(options))
+      , error_(0)
+      , documents_(0)
+      , spilled_runs_(0)
+      , merged_(false) {
+
+      if (options_.threads == 0)
+        options_.threads = std::max(1U, std::thread::hardware_concurrency());
+      options_.merge_width = std::max<std::size_t>(options_.merge_width, 2);
+      if (options_.temporary_directory.empty()) {
+        char const* const directory = std::getenv("TMPDIR");
+        options_.temporary_directory = directory && *directory ? directory : "/tmp";
+      }
+
+      // A merge reads each run through a buffer of the same size, and
+      // writes a pass through one more, so it is narrowed until they
+      // all fit into the part of the budget kept for reading.
+      read_budget_ = options_.memory_budget / 8;
+      read_size_ = std::max(k_min_read_size, read_budget_ / (options_.merge_width + 1));
+      std::size_t const reads = read_budget_ / read_size_;
+      options_.merge_width = std::max<std::size_t>(std::min(options_.merge_width, reads > 1 ? reads - 1 : 0), 2);
+
+      std::size_t const share = (options_.memory_budget - read_budget_) / options_.threads;
+      spill_size_ = std::min(k_max_spill_size, share / 8);
+      buffer_budget_ = share - spill_size_;
+    }
+
+    external_sorter::~external_sorter() {
+      merger_.reset();
+      for (auto const& run : runs_)
+        ::close(run.fd);
+    }
+
+    bool external_sorter::add(document_sequence const& documents) {
+      if (merged_)
+        fail(EINVAL);
+      if (!ok())
+        return false;
+
+      scan_result const result = parallel_scan(documents, options_.threads, [this](document_sequence const& run) {
+          if (!ok())
+            return;
+          buffer* const buffer = acquire();
+          for (auto document : run) {
+            if (!add_document(*buffer, static_cast<byte_t const*>(document.data)))
+              break;
+          }
+          release(buffer);
+        });
+
+      documents_ += result.documents;
+      if (!result.ok)
+        fail(EINVAL);
+      return ok();
+    }
+
+    bool external_sorter::add_file(char const* path) {
+      if (merged_)
+        fail(EINVAL);
+      if (!ok())
+        return false;
+
+      int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+      if (fd == -1) {
+        fail(errno);
+        return false;
+      }
+#if defined(POSIX_FADV_SEQUENTIAL)
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+      std::vector<byte_t> chunk(std::max(k_min_read_size, read_budget_));
+      std::size_t filled = 0;
+      bool end = false;
+      while (ok() && !end) {
+        ssize_t const read = ::read(fd, chunk.data() + filled, chunk.size() - filled);
+        if (read < 0) {
+          if (errno == EINTR)
+            continue;
+          fail(errno);
+          break;
+        }
+        end = read == 0;
+        filled += read;
+
+        // Hand over the whole documents and keep the one cut off at the
+        // end of the chunk, growing the chunk if it cannot hold it. A
+        // nonsense length, or a document cut off by the end of the
+        // file, is handed over for 'add' to reject.
+        std::size_t whole = 0;
+        std::size_t needed = 0;
+        while (filled - whole >= sizeof(length_t)) {
+          length_t const length = document_cdata(chunk.data() + whole).size;
+          if (length <= static_cast<length_t>(sizeof(length_t))) {
+            whole = filled;
+            break;
+          }
+          if (static_cast<std::size_t>(length) > filled - whole) {
+            needed = length;
+            break;
+          }
+          whole += length;
+        }
+        if (end)
+          whole = filled;
+
+        if (whole != 0 && !add(document_sequence(chunk.data(), whole)))
+          break;
+        std::memmove(chunk.data(), chunk.data() + whole, filled - whole);
+        filled -= whole;
+        if (needed > chunk.size())
+          chunk.resize(needed);
+      }
+
+      ::close(fd);
+      return ok();
+    }
+
+    bool external_sorter::merge() {
+      if (merged_)
+        fail(EINVAL);
+      merged_ = true;
+      if (!ok())
+        return false;
+
+      // Let go of the empty buffers, and sort what is still in the
+      // others, a thread per buffer.
+      free_buffers_.clear();
+      buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(), [](std::unique_ptr<buffer> const& buffer) {
+            return buffer->empty();
+          }), buffers_.end());
+      std::vector<buffer*> pending;
+      for (auto const& buffer : buffers_)
+        pending.push_back(buffer.get());
+      std::vector<std::thread> threads;
+      try {
+        for (std::size_t i = 1; i < pending.size(); ++i)
+          threads.emplace_back([&pending, i]() { pending[i]->sort(); });
+      } catch (...) {
+        // As in 'parallel_scan': a thread destroyed joinable would
+        // terminate the program.
+        for (auto& thread : threads)
+          thread.join();
+        throw;
+      }
+      if (!pending.empty())
+        pending[0]->sort();
+      for (auto& thread : threads)
+        thread.join();
+
+      // Merge the oldest runs into longer ones until the rest can be
+      // read at once in one last merge, with the buffers, which take
+      // no reading.
+      std::size_t const width = options_.merge_width;
+      while (runs_.size() > width) {
+        if (!merge_runs(0, std::min(width, runs_.size() - width + 1)))
+          return false;
+      }
+
+      std::vector<source> sources;
+      for (auto const& run : runs_)
+        sources.emplace_back(run, read_size_);
+      for (buffer* buffer : pending)
+        sources.emplace_back(buffer);
+      merger_.reset(new merger(std::move(sources)));
+      return true;
+    }
+
+    void const* external_sorter::next() {
+      if (!merger_ || !ok())
+        return nullptr;
+
+      int error = 0;
+      byte_t const* const record = merger_->next(error);
+      if (error != 0) {
+        fail(error);
+        return nullptr;
+      }
+      return record ? document_of(record) : nullptr;
+    }
+
+    external_sorter::buffer* external_sorter::acquire() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_buffers_.empty()) {
+        buffers_.emplace_back(new buffer(encoder_, buffer_budget_));
+        free_buffers_.push_back(buffers_.back().get());
+      }
+      buffer* const result = free_buffers_.back();
+      free_buffers_.pop_back();
+      return result;
+    }
+
+    void external_sorter::release(buffer* buffer) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_buffers_.push_back(buffer);
+    }
+
+    bool external_sorter::add_document(buffer& buffer, byte_t const* document) {
+      key_writer writer;
+      if (!buffer.encoder.encode(document_view(document), writer)) {
+        fail(EINVAL);
+        return false;
+      }
+
+      std::size_t const key_size = buffer.encoder.size();
+      std::size_t const document_size = document_cdata(document).size;
+      std::size_t const size = k_key_size_size + key_size + document_size;
+      std::size_t const needed = size + sizeof(buffer::entry);
+      if (buffer.room() < needed) {
+        if (!buffer.empty() && !spill(buffer))
+          return false;
+        // A document too large for the buffer gets one of its own,
+        // until it is spilled.
+        if (buffer.room() < needed)
+          buffer.reset(needed + sizeof(buffer::entry));
+      }
+
+      buffer::entry const entry = { key_prefix(buffer.encoder.data(), key_size), buffer.records_size };
+      ++buffer.entries_size;
+      *buffer.entries() = entry;
+
+      std::uint32_t const stored_key_size = static_cast<std::uint32_t>(key_size);
+      byte_t* const record = buffer.records() + buffer.records_size;
+      std::memcpy(record, &stored_key_size, k_key_size_size);
+      std::memcpy(record + k_key_size_size, buffer.encoder.data(), key_size);
+      std::memcpy(record + k_key_size_size + key_size, document, document_size);
+      buffer.records_size += size;
+      return true;
+    }
+
+    bool external_sorter::spill(buffer& buffer) {
+      buffer.sort();
+
+      run spilled;
+      if (!make_run(spilled))
+        return false;
+
+      run_writer writer(spilled.fd, spill_size_);
+      byte_t const* const base = buffer.records();
+      buffer::entry const* const entries = buffer.entries();
+      for (std::size_t i = 0; i != buffer.entries_size; ++i)
+        writer.write(base + entries[i].offset, record_size(base + entries[i].offset));
+      int const error = writer.flush();
+      spilled.size = writer.size();
+      if (buffer.memory() > buffer_budget_)
+        buffer.reset(buffer_budget_);
+      else
+        buffer.clear();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      runs_.push_back(spilled);
+      ++spilled_runs_;
+      if (error != 0)
+        fail(error);
+      return error == 0;
+    }
+
+    bool external_sorter::make_run(run& created) {
+      std::string path = options_.temporary_directory + "/bassoon-sort-XXXXXX";
+      created.fd = ::mkstemp(&path[0]);
+      created.size = 0;
+      if (created.fd == -1) {
+        fail(errno);
+        return false;
+      }
+      ::unlink(path.c_str());
+      return true;
+    }
+
+    bool external_sorter::merge_runs(std::size_t first, std::size_t count) {
+      run merged;
+      if (!make_run(merged))
+        return false;
+
+      std::vector<source> sources;
+      for (std::size_t i = first; i != first + count; ++i)
+        sources.emplace_back(runs_[i], read_size_);
+      merger merger(std::move(sources));
+
+      run_writer writer(merged.fd, read_size_);
+      int error = 0;
+      byte_t const* record;
+      while ((record = merger.next(error)) != nullptr)
+        writer.write(record, record_size(record));
+      if (error == 0)
+        error = writer.flush();
+      merged.size = writer.size();
+
+      for (std::size_t i = first; i != first + count; ++i)
+        ::close(runs_[i].fd);
+      runs_.erase(runs_.begin() + first, runs_.begin() + first + count);
+      runs_.push_back(merged);
+
+      if (error != 0)
+        fail(error);
+      return error == 0;
+    }
+
+    void external_sorter::fail(int error) noexcept {
+      int expected = 0;
+      error_.compare_exchange_strong(expected, error, std::memory_order_relaxed);
+    }
+
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,188 @@
+#ifndef included_7d647a94_cb9b_4051_9e7e_6e8c20359caa
+#define included_7d647a94_cb9b_4051_9e7e_6e8c20359caa
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <bassoon/document_data.hpp>
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/index_key.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct external_sort_options {
+      // The most memory the sort holds at once, across all threads:
+      // the buffers of keys and documents, and those that runs and
+      // files are read and written through. A document too large for
+      // a thread's share is held anyway, and a budget under two
+      // megabytes is too small for the reads of the narrowest merge.
+      std::size_t memory_budget = std::size_t(256) << 20;
+
+      // Threads to sort on, counting the calling thread, or zero for
+      // one per core.
+      std::size_t threads = 0;
+
+      // Where runs are spilled. If empty, $TMPDIR, or else /tmp.
+      std::string temporary_directory;
+
+      // The most runs merged at once, fewer if the budget cannot read
+      // that many. Beyond that, runs are merged in passes, each
+      // writing a longer run.
+      std::size_t merge_width = 256;
+    };
+
+    ///
+    /// Sorts more BSON documents than fit in memory by chosen fields,
+    /// as 'compare_documents' would sort their keys.
+    ///
+    /// Each document is stored with its index key (see index_key.hpp),
+    /// so that every later comparison is a memcmp. Documents are added
+    /// on several threads at once, each filling a buffer of its share
+    /// of the budget; a full buffer is sorted and spilled to a
+    /// temporary file as a run. 'finish' then merges the spilled runs
+    /// and whatever is still in memory with a loser tree, which takes
+    /// one comparison per level to replace the smallest.
+    ///
+    /// Spilled runs are unlinked as soon as they are created, so they
+    /// go away with the sorter however it ends. An eighth of the
+    /// budget is kept for reading: the chunks of 'add_file' while
+    /// documents are added, then a buffer for each run merged, and
+    /// one to write a pass through, while the buffers still holding
+    /// documents, which are never more than the rest of the budget,
+    /// wait for the last merge.
+    ///
+    /// Documents with equal keys come out in no particular order.
+    ///
+    /// Failure is not fatal: the call that fails returns false, 'ok'
+    /// returns false from then on, and 'error' returns the errno value
+    /// of what failed, EINVAL for malformed input.
+    ///
+    class LIBBASSOON_EXPORT external_sorter {
+    public:
+      ///
+      /// 'paths' and 'descending' are the fields to sort by, as for
+      /// 'index_key_encoder'.
+      ///
+      external_sorter(std::vector<std::string> paths, std::uint32_t descending = 0,
+                      external_sort_options options = external_sort_options());
+      ~external_sorter();
+
+      external_sorter(const external_sorter&) = delete;
+      external_sorter& operator=(const external_sorter&) = delete;
+
+      ///
+      /// Adds every document in 'documents', which may be all of a
+      /// 'mapped_file'. The documents are copied, so the memory may be
+      /// reused once this returns.
+      ///
+      bool add(document_sequence const& documents);
+
+      ///
+      /// Adds every document in the file at 'path', read in chunks
+      /// rather than mapped, so that the file does not count against
+      /// the memory of the process.
+      ///
+      bool add_file(char const* path);
+
+      ///
+      /// Writes the documents in order with 'writer', which needs
+      /// only 'reserve' and 'write'. No more can be added afterwards.
+      ///
+      template<typename Writer_type>
+      bool finish(Writer_type& writer) {
+        if (!merge())
+          return false;
+        void const* document;
+        while ((document = next()) != nullptr) {
+          document_cdata const data(document);
+          if (!writer.reserve(data.size))
+            return false;
+          writer.write(data.data, data.size);
+        }
+        return ok();
+      }
+
+      ///
+      /// Or pull the documents one at a time: call 'merge' once, then
+      /// 'next' until it returns null. Each document stays valid
+      /// until the next call to 'next'; check 'ok' at the end.
+      ///
+      bool merge();
+
+      void const* next();
+
+      bool ok() const noexcept {
+        return error() == 0;
+      }
+
+      int error() const noexcept {
+        return error_.load(std::memory_order_relaxed);
+      }
+
+      ///
+      /// The number of documents added, and of runs spilled so far.
+      ///
+      std::size_t documents() const noexcept {
+        return documents_;
+      }
+
+      std::size_t spilled_runs() const noexcept {
+        return spilled_runs_;
+      }
+
+    private:
+      // A sorted run spilled to an unlinked temporary file.
+      struct run {
+        int fd;
+        std::uint64_t size;
+      };
+
+      struct buffer;
+      struct source;
+      class merger;
+
+      buffer* acquire();
+      void release(buffer* buffer);
+      bool add_document(buffer& buffer, byte_t const* document);
+      bool spill(buffer& buffer);
+      bool make_run(run& created);
+      bool merge_runs(std::size_t first, std::size_t count);
+      void fail(int error) noexcept;
+
+      index_key_encoder encoder_;
+      external_sort_options options_;
+      // The eighth of the budget kept for reading, and the part of
+      // it for each run in a merge.
+      std::size_t read_budget_;
+      std::size_t read_size_;
+
+      // The memory of each buffer, and of the writer that spills it,
+      // which together make a thread's share of the rest.
+      std::size_t buffer_budget_;
+      std::size_t spill_size_;
+
+      // Guards the lists below while documents are being added.
+      std::mutex mutex_;
+      std::vector<std::unique_ptr<buffer>> buffers_;
+      std::vector<buffer*> free_buffers_;
+      std::vector<run> runs_;
+
+      std::atomic<int> error_;
+      std::size_t documents_;
+      std::size_t spilled_runs_;
+      bool merged_;
+
+      std::unique_ptr<merger> merger_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_7d647a94_cb9b_4051_9e7e_6e8c20359caa
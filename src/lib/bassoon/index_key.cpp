@@ -0,0 +1,704 @@
+#include <bassoon/index_key.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      // The byte that starts each value, in the order of the types.
+      // All stay clear of 00 and FF, inverted or not, and of the end
+      // byte, which the escaping of strings relies on.
+      const byte_t k_end                = 0x04;
+      const byte_t k_min_key            = 10;
+      const byte_t k_undefined          = 15;
+      const byte_t k_null               = 20;
+      const byte_t k_nan                = 30;
+      const byte_t k_negative_large     = 31;
+      const byte_t k_number             = 32;
+      const byte_t k_positive_large     = 33;
+      const byte_t k_string             = 60;
+      const byte_t k_document           = 70;
+      const byte_t k_array              = 80;
+      const byte_t k_binary             = 90;
+      const byte_t k_object_id          = 100;
+      const byte_t k_false              = 110;
+      const byte_t k_true               = 111;
+      const byte_t k_date               = 120;
+      const byte_t k_timestamp          = 130;
+      const byte_t k_regex              = 140;
+      const byte_t k_db_pointer         = 150;
+      const byte_t k_javascript         = 160;
+      const byte_t k_scoped_javascript  = 170;
+      const byte_t k_max_key            = 240;
+
+      // What the type bits say about numbers and strings.
+      const byte_t k_int32_code         = 0;
+      const byte_t k_int64_code         = 1;
+      const byte_t k_double_code        = 2;
+      const byte_t k_negative_zero_code = 3;
+      const byte_t k_utf8_string_code   = 0;
+      const byte_t k_symbol_code        = 1;
+
+      const std::uint64_t k_sign_bit = std::uint64_t(1) << 63;
+
+      // 2^63 is the first double past the int64 range.
+      const double_t k_int64_limit = 9223372036854775808.0;
+
+      // Keys come from storage, so the decoder does not trust them to
+      // nest only as deep as a stack can take.
+      const std::size_t k_max_depth = 128;
+
+      std::uint64_t double_bits(double_t value) noexcept {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+      }
+
+      double_t bits_double(std::uint64_t bits) noexcept {
+        double_t value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+      }
+
+      // The class byte that stands for the type of an element within a
+      // document or array, where types compare before names and
+      // numbers or booleans of any value must tie.
+      byte_t type_class(types type) noexcept {
+        switch (type) {
+          case types::min:                      return k_min_key;
+          case types::undefined_no_deprecated:  return k_undefined;
+          case types::null:                     return k_null;
+          case types::floating_point:
+          case types::int32:
+          case types::int64:                    return k_number;
+          case types::utf8_string:
+          case types::symbol:                   return k_string;
+          case types::document:                 return k_document;
+          case types::array:                    return k_array;
+          case types::binary:                   return k_binary;
+          case types::object_id:                return k_object_id;
+          case types::boolean:                  return k_false;
+          case types::utc_datetime:             return k_date;
+          case types::timestamp:                return k_timestamp;
+          case types::regex:                    return k_regex;
+          case types::db_pointer_no_deprecated: return k_db_pointer;
+          case types::javascript:               return k_javascript;
+          case types::scoped_javascript:        return k_scoped_javascript;
+          case types::max:                      return k_max_key;
+        }
+        return k_max_key;
+      }
+
+      class key_writer {
+      public:
+        key_writer(std::vector<byte_t>& key, std::vector<byte_t>& type_bits) noexcept
+          : key_(key)
+          , type_bits_(type_bits) {}
+
+        bool put_value(element_view const& element);
+
+      private:
+        void put(byte_t byte) {
+          key_.push_back(byte);
+        }
+
+        void put(byte_t const* data, std::size_t size) {
+          key_.insert(key_.end(), data, data + size);
+        }
+
+        void put_big_endian(std::uint64_t value, std::size_t size) {
+          for (std::size_t shift = 8 * size; shift != 0; shift -= 8)
+            put(static_cast<byte_t>(value >> (shift - 8)));
+        }
+
+        void put_number(element_view const& element);
+        void put_string(byte_t const* data, std::size_t size);
+        bool put_document(document_view const& document, bool is_array);
+        bool put_scoped_javascript(element_view const& element);
+
+        std::vector<byte_t>& key_;
+        std::vector<byte_t>& type_bits_;
+      };
+
+      bool key_writer::put_value(element_view const& element) {
+        switch (element.type()) {
+          case types::floating_point:
+          case types::int32:
+          case types::int64:
+            put_number(element);
+            return true;
+
+          case types::utf8_string:
+          case types::symbol:
+            type_bits_.push_back((element.type() == types::symbol) ? k_symbol_code : k_utf8_string_code);
+            put(k_string);
+            put_string(element.value() + sizeof(length_t), element.value_size() - sizeof(length_t) - 1);
+            return true;
+
+          case types::javascript:
+            put(k_javascript);
+            put_string(element.value() + sizeof(length_t), element.value_size() - sizeof(length_t) - 1);
+            return true;
+
+          case types::document:
+          case types::array:
+            put(type_class(element.type()));
+            return put_document(document_view(element.as_document()), element.type() == types::array);
+
+          case types::binary:
+            // The size, then the subtype and the bytes.
+            put(k_binary);
+            put_big_endian(element_details::read_little_endian<length_t>(element.value()), sizeof(length_t));
+            put(element.value() + sizeof(length_t), element.value_size() - sizeof(length_t));
+            return true;
+
+          case types::object_id:
+            put(k_object_id);
+            put(element.value(), k_object_id_length);
+            return true;
+
+          case types::boolean:
+            put(element.as_boolean() ? k_true : k_false);
+            return true;
+
+          case types::utc_datetime:
+            put(k_date);
+            put_big_endian(static_cast<std::uint64_t>(element.as_int64()) ^ k_sign_bit, 8);
+            return true;
+
+          case types::timestamp:
+            put(k_timestamp);
+            put_big_endian(static_cast<std::uint64_t>(element.as_int64()), 8);
+            return true;
+
+          case types::regex:
+            // The pattern and options, null terminated as they are.
+            put(k_regex);
+            put(element.value(), element.value_size());
+            return true;
+
+          case types::db_pointer_no_deprecated:
+            // The size of the namespace, then the namespace, with its
+            // null byte, and the ObjectId.
+            put(k_db_pointer);
+            put_big_endian(element_details::read_little_endian<length_t>(element.value()), sizeof(length_t));
+            put(element.value() + sizeof(length_t), element.value_size() - sizeof(length_t));
+            return true;
+
+          case types::scoped_javascript:
+            return put_scoped_javascript(element);
+
+          default:
+            // MinKey, MaxKey, null and undefined have no value.
+            put(type_class(element.type()));
+            return true;
+        }
+      }
+
+      void key_writer::put_number(element_view const& element) {
+        std::int64_t integral;
+
+        if (element.type() == types::int32) {
+          type_bits_.push_back(k_int32_code);
+          integral = element.as_int32();
+        } else if (element.type() == types::int64) {
+          type_bits_.push_back(k_int64_code);
+          integral = element.as_int64();
+        } else {
+          double_t const value = element.as_floating_point();
+          type_bits_.push_back((value == 0 && std::signbit(value)) ? k_negative_zero_code : k_double_code);
+
+          if (std::isnan(value)) {
+            put(k_nan);
+            return;
+          }
+          if (value < -k_int64_limit) {
+            // Negative doubles sort backwards by their bits.
+            put(k_negative_large);
+            put_big_endian(~double_bits(value), 8);
+            return;
+          }
+          if (value >= k_int64_limit) {
+            put(k_positive_large);
+            put_big_endian(double_bits(value), 8);
+            return;
+          }
+
+          double_t const whole = std::trunc(value);
+          if (value != whole) {
+            // The floor, then a one and the fraction. For a negative
+            // value we write what the fraction is short of one, the
+            // exact part of the subtraction, inverted so that it sorts
+            // the right way.
+            put(k_number);
+            if (value > 0) {
+              put_big_endian(static_cast<std::uint64_t>(static_cast<std::int64_t>(whole)) ^ k_sign_bit, 8);
+              put(1);
+              put_big_endian(double_bits(value - whole), 8);
+            } else {
+              put_big_endian(static_cast<std::uint64_t>(static_cast<std::int64_t>(whole) - 1) ^ k_sign_bit, 8);
+              put(1);
+              put_big_endian(~double_bits(whole - value), 8);
+            }
+            return;
+          }
+          integral = static_cast<std::int64_t>(whole);
+        }
+
+        // Integers are a zero after the floor, which sorts them below
+        // everything between them and the next integer.
+        put(k_number);
+        put_big_endian(static_cast<std::uint64_t>(integral) ^ k_sign_bit, 8);
+        put(0);
+      }
+
+      void key_writer::put_string(byte_t const* data, std::size_t size) {
+        byte_t const* const end = data + size;
+        for (;;) {
+          byte_t const* const zero = static_cast<byte_t const*>(std::memchr(data, 0, end - data));
+          if (!zero)
+            break;
+          put(data, zero - data);
+          put(0);
+          put(0xFF);
+          data = zero + 1;
+        }
+        put(data, end - data);
+        put(0);
+      }
+
+      bool key_writer::put_document(document_view const& document, bool is_array) {
+        auto current = document.begin();
+        for (; current != document.end(); ++current) {
+          put(type_class(current->type()));
+          if (!is_array)
+            put(current->data() + 1, current->name().size);
+          if (!put_value(*current))
+            return false;
+        }
+        put(0);
+        return current.ok();
+      }
+
+      bool key_writer::put_scoped_javascript(element_view const& element) {
+        // A total length, the code as a string, and the scope.
+        std::size_t const header = 2 * sizeof(length_t);
+        if (element.value_size() < header)
+          return false;
+        byte_t const* const code = element.value() + sizeof(length_t);
+        std::size_t const rest = element.value_size() - sizeof(length_t);
+        std::size_t const code_size = sizeof(length_t) + element_details::read_little_endian<length_t>(code);
+        if (code_size > rest || code_size <= sizeof(length_t) || code[code_size - 1] != 0)
+          return false;
+
+        put(k_scoped_javascript);
+        put_string(code + sizeof(length_t), code_size - sizeof(length_t) - 1);
+        return put_document(document_view(document_cdata(code + code_size, rest - code_size)), false);
+      }
+
+      // Reads a key, undoing the inversion of descending parts, and
+      // writes its values as BSON elements.
+      class key_reader {
+      public:
+        key_reader(byte_t const* data, std::size_t size, byte_t const* type_bits, std::size_t type_bit_count,
+                   std::vector<byte_t>& elements) noexcept
+          : data_(data)
+          , end_(data + size)
+          , type_bits_(type_bits)
+          , type_bit_count_(type_bit_count)
+          , next_type_bit_(0)
+          , mask_(0)
+          , elements_(elements) {}
+
+        bool at_end() const noexcept {
+          return data_ == end_;
+        }
+
+        bool used_all_type_bits() const noexcept {
+          return next_type_bit_ == type_bit_count_;
+        }
+
+        void set_descending(bool descending) noexcept {
+          mask_ = descending ? 0xFF : 0;
+        }
+
+        // Reads the value of an element named 'name', which may be
+        // null to read the name from the key.
+        bool get_element(char const* name, std::size_t name_size, std::size_t depth);
+
+      private:
+        bool get(byte_t& byte) noexcept {
+          if (data_ == end_)
+            return false;
+          byte = *data_++ ^ mask_;
+          return true;
+        }
+
+        bool get(std::size_t size) {
+          if (static_cast<std::size_t>(end_ - data_) < size)
+            return false;
+          for (std::size_t i = 0; i != size; ++i)
+            elements_.push_back(data_[i] ^ mask_);
+          data_ += size;
+          return true;
+        }
+
+        bool get_big_endian(std::uint64_t& value, std::size_t size) noexcept {
+          value = 0;
+          for (byte_t byte; size != 0; --size) {
+            if (!get(byte))
+              return false;
+            value = (value << 8) | byte;
+          }
+          return true;
+        }
+
+        bool get_type_bits(byte_t& code) noexcept {
+          if (next_type_bit_ == type_bit_count_)
+            return false;
+          code = (type_bits_[next_type_bit_ / 4] >> (2 * (next_type_bit_ % 4))) & 3;
+          ++next_type_bit_;
+          return true;
+        }
+
+        template<typename T>
+        void put_little_endian(T value) {
+          byte_t bytes[sizeof(T)];
+          element_details::write_little_endian(bytes, value);
+          elements_.insert(elements_.end(), bytes, bytes + sizeof(T));
+        }
+
+        // Leaves room for a length to fill in with 'finish_length'.
+        std::size_t start_length() {
+          elements_.resize(elements_.size() + sizeof(length_t));
+          return elements_.size() - sizeof(length_t);
+        }
+
+        void finish_length(std::size_t at, std::size_t extra) {
+          element_details::write_little_endian(&elements_[at], static_cast<length_t>(elements_.size() - at - extra));
+        }
+
+        bool get_number(byte_t type_class, std::size_t type_at);
+        bool get_string();
+        bool get_document(bool is_array, std::size_t depth);
+
+        byte_t const* data_;
+        byte_t const* const end_;
+        byte_t const* const type_bits_;
+        std::size_t const type_bit_count_;
+        std::size_t next_type_bit_;
+        byte_t mask_;
+        std::vector<byte_t>& elements_;
+      };
+
+      bool key_reader::get_element(char const* name, std::size_t name_size, std::size_t depth) {
+        // The type goes in when we know it.
+        std::size_t const type_at = elements_.size();
+        elements_.push_back(0);
+
+        if (name) {
+          elements_.insert(elements_.end(), name, name + name_size);
+          elements_.push_back(0);
+        } else {
+          for (byte_t byte;;) {
+            if (!get(byte))
+              return false;
+            elements_.push_back(byte);
+            if (byte == 0)
+              break;
+          }
+        }
+
+        byte_t type_class;
+        if (!get(type_class))
+          return false;
+
+        types type;
+        switch (type_class) {
+          case k_min_key:   type = types::min; break;
+          case k_undefined: type = types::undefined_no_deprecated; break;
+          case k_null:      type = types::null; break;
+          case k_max_key:   type = types::max; break;
+
+          case k_nan:
+          case k_negative_large:
+          case k_number:
+          case k_positive_large:
+            return get_number(type_class, type_at);
+
+          case k_string: {
+            byte_t code;
+            if (!get_type_bits(code) || code > k_symbol_code)
+              return false;
+            type = (code == k_symbol_code) ? types::symbol : types::utf8_string;
+            if (!get_string())
+              return false;
+            break;
+          }
+
+          case k_javascript:
+            type = types::javascript;
+            if (!get_string())
+              return false;
+            break;
+
+          case k_document:
+          case k_array:
+            if (depth == k_max_depth)
+              return false;
+            type = (type_class == k_array) ? types::array : types::document;
+            if (!get_document(type_class == k_array, depth + 1))
+              return false;
+            break;
+
+          case k_binary: {
+            std::uint64_t size;
+            if (!get_big_endian(size, sizeof(length_t)) || size > static_cast<std::uint64_t>(std::numeric_limits<length_t>::max()))
+              return false;
+            type = types::binary;
+            put_little_endian(static_cast<length_t>(size));
+            if (!get(1 + size))
+              return false;
+            break;
+          }
+
+          case k_object_id:
+            type = types::object_id;
+            if (!get(k_object_id_length))
+              return false;
+            break;
+
+          case k_false:
+          case k_true:
+            type = types::boolean;
+            elements_.push_back(type_class == k_true);
+            break;
+
+          case k_date:
+          case k_timestamp: {
+            std::uint64_t value;
+            if (!get_big_endian(value, 8))
+              return false;
+            type = (type_class == k_date) ? types::utc_datetime : types::timestamp;
+            put_little_endian((type_class == k_date) ? value ^ k_sign_bit : value);
+            break;
+          }
+
+          case k_regex:
+            type = types::regex;
+            for (int terminators = 0; terminators != 2;) {
+              byte_t byte;
+              if (!get(byte))
+                return false;
+              elements_.push_back(byte);
+              terminators += (byte == 0);
+            }
+            break;
+
+          case k_db_pointer: {
+            std::uint64_t size;
+            if (!get_big_endian(size, sizeof(length_t)) || size == 0 ||
+                size > static_cast<std::uint64_t>(std::numeric_limits<length_t>::max()))
+              return false;
+            type = types::db_pointer_no_deprecated;
+            put_little_endian(static_cast<length_t>(size));
+            if (!get(size + k_object_id_length) || elements_[elements_.size() - k_object_id_length - 1] != 0)
+              return false;
+            break;
+          }
+
+          case k_scoped_javascript: {
+            if (depth == k_max_depth)
+              return false;
+            type = types::scoped_javascript;
+            std::size_t const total_at = start_length();
+            if (!get_string() || !get_document(false, depth + 1))
+              return false;
+            finish_length(total_at, 0);
+            break;
+          }
+
+          default:
+            return false;
+        }
+
+        elements_[type_at] = static_cast<byte_t>(type);
+        return true;
+      }
+
+      bool key_reader::get_number(byte_t type_class, std::size_t type_at) {
+        byte_t code;
+        if (!get_type_bits(code))
+          return false;
+
+        std::uint64_t bits = 0;
+        double_t value = 0;
+        if (type_class == k_nan) {
+          value = std::numeric_limits<double_t>::quiet_NaN();
+        } else if (type_class != k_number) {
+          if (!get_big_endian(bits, 8))
+            return false;
+          value = bits_double((type_class == k_negative_large) ? ~bits : bits);
+        } else {
+          byte_t has_fraction;
+          if (!get_big_endian(bits, 8) || !get(has_fraction) || has_fraction > 1)
+            return false;
+          std::int64_t const floor = static_cast<std::int64_t>(bits ^ k_sign_bit);
+
+          if (!has_fraction) {
+            if (code == k_int32_code) {
+              if (floor < std::numeric_limits<std::int32_t>::min() || floor > std::numeric_limits<std::int32_t>::max())
+                return false;
+              elements_[type_at] = static_cast<byte_t>(types::int32);
+              put_little_endian(static_cast<std::int32_t>(floor));
+              return true;
+            }
+            if (code == k_int64_code) {
+              elements_[type_at] = static_cast<byte_t>(types::int64);
+              put_little_endian(floor);
+              return true;
+            }
+            value = (code == k_negative_zero_code) ? -0.0 : static_cast<double_t>(floor);
+          } else {
+            std::uint64_t fraction;
+            if (!get_big_endian(fraction, 8))
+              return false;
+            value = (floor >= 0) ?
+              static_cast<double_t>(floor) + bits_double(fraction) :
+              static_cast<double_t>(floor + 1) - bits_double(~fraction);
+          }
+        }
+
+        // Only doubles get this far.
+        if (code != k_double_code && code != k_negative_zero_code)
+          return false;
+        elements_[type_at] = static_cast<byte_t>(types::floating_point);
+        put_little_endian(double_bits(value));
+        return true;
+      }
+
+      bool key_reader::get_string() {
+        std::size_t const length_at = start_length();
+        for (;;) {
+          byte_t byte;
+          if (!get(byte))
+            return false;
+          if (byte == 0) {
+            // Either an escaped null byte, or the end.
+            if (data_ == end_ || (*data_ ^ mask_) != 0xFF)
+              break;
+            ++data_;
+          }
+          elements_.push_back(byte);
+        }
+        elements_.push_back(0);
+        finish_length(length_at, sizeof(length_t));
+        return true;
+      }
+
+      bool key_reader::get_document(bool is_array, std::size_t depth) {
+        std::size_t const length_at = start_length();
+        char name[24];
+        for (std::size_t index = 0;; ++index) {
+          // The type class before each element only orders it.
+          byte_t type_class;
+          if (!get(type_class))
+            return false;
+          if (type_class == 0)
+            break;
+          if (is_array) {
+            int const name_size = std::snprintf(name, sizeof(name), "%zu", index);
+            if (!get_element(name, name_size, depth))
+              return false;
+          } else if (!get_element(nullptr, 0, depth)) {
+            return false;
+          }
+        }
+        elements_.push_back(0);
+        finish_length(length_at, 0);
+        return true;
+      }
+
+    } // namespace
+
+    index_key_encoder::index_key_encoder(std::vector<std::string> paths, std::uint32_t descending)
+      : paths_(std::move(paths))
+      , descending_(descending)
+      , body_size_(0) {}
+
+    bool index_key_encoder::build(document_view const& document) {
+      key_.clear();
+      type_bits_.clear();
+      key_writer writer(key_, type_bits_);
+
+      for (std::size_t i = 0; i != paths_.size(); ++i) {
+        std::size_t const start = key_.size();
+        element_view const element = document.find_path(paths_[i]);
+        if (!element)
+          key_.push_back(k_null);
+        else if (!writer.put_value(element))
+          return false;
+
+        if (i < 32 && ((descending_ >> i) & 1))
+          for (std::size_t j = start; j != key_.size(); ++j)
+            key_[j] = ~key_[j];
+      }
+      key_.push_back(k_end);
+      body_size_ = key_.size();
+
+      // The type bits, four to a byte, then their count, seven bits
+      // to a byte with the low bits last, and a high bit on each byte
+      // but the first, so that it reads backwards from the end.
+      std::size_t const count = type_bits_.size();
+      key_.resize(key_.size() + (count + 3) / 4);
+      for (std::size_t i = 0; i != count; ++i)
+        key_[body_size_ + i / 4] |= type_bits_[i] << (2 * (i % 4));
+
+      byte_t groups[10];
+      std::size_t group_count = 0;
+      for (std::size_t rest = count; group_count == 0 || rest != 0; rest >>= 7)
+        groups[group_count++] = rest & 0x7F;
+      for (std::size_t i = group_count; i != 0; --i)
+        key_.push_back(groups[i - 1] | ((i - 1 != group_count - 1) ? 0x80 : 0));
+      return true;
+    }
+
+    index_key_decoder::index_key_decoder(std::uint32_t descending)
+      : descending_(descending) {}
+
+    bool index_key_decoder::build(byte_t const* key, std::size_t size) {
+      elements_.clear();
+
+      // Find the type bits from the end.
+      std::size_t end = size;
+      std::uint64_t count = 0;
+      for (std::size_t shift = 0;; shift += 7) {
+        if (end == 0 || shift > 56)
+          return false;
+        byte_t const byte = key[--end];
+        count |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+          break;
+      }
+      std::uint64_t const type_bit_bytes = (count + 3) / 4;
+      if (type_bit_bytes >= end || key[end - type_bit_bytes - 1] != k_end)
+        return false;
+      std::size_t const body_size = end - type_bit_bytes - 1;
+
+      key_reader reader(key, body_size, key + body_size + 1, count, elements_);
+      for (std::size_t i = 0; !reader.at_end(); ++i) {
+        reader.set_descending(i < 32 && ((descending_ >> i) & 1));
+        if (!reader.get_element("", 0, 0))
+          return false;
+      }
+      return reader.used_all_type_bits();
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,157 @@
+#ifndef included_9739db12_1361_49c9_b33c_dc59ba906a9e
+#define included_9739db12_1361_49c9_b33c_dc59ba906a9e
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Turns chosen fields of documents into index keys: byte strings
+    /// that sort with memcmp as the field values sort with
+    /// 'compare_documents', so that a large sort or index build can
+    /// compare keys without looking at BSON again. This is the scheme
+    /// of MongoDB's KeyString.
+    ///
+    /// A key is the parts, one for each field, then an end byte. Each
+    /// part starts with a byte for the class of its type, in the
+    /// order of the types; what follows depends on the class:
+    ///
+    ///   - All numbers share one encoding, exact across int32, int64
+    ///     and double: the floor of the value as a big endian int64
+    ///     with its sign bit flipped, then the fraction, if any. NaN
+    ///     and doubles beyond the int64 range have classes of their
+    ///     own, below and around it.
+    ///   - Strings have each null byte escaped as 00 FF and end with
+    ///     00, so that a string sorts before any longer one it is a
+    ///     prefix of.
+    ///   - Documents are their elements, each a type class byte, the
+    ///     name and the value, and end with 00. Arrays leave out the
+    ///     names.
+    ///   - Other values are laid out so that their bytes sort as the
+    ///     values do: binary and DBPointer put their size first, for
+    ///     example, and dates are big endian with the sign flipped.
+    ///
+    /// A descending part has all of its bytes inverted.
+    ///
+    /// Values that compare equal get the same bytes, whatever their
+    /// types, so an int32 1 and a double 1.0 make the same key. What
+    /// is needed to decode them as they were, the exact type of each
+    /// number and whether each string is a symbol, goes after the end
+    /// byte, two bits a value, followed by their count. The bytes up
+    /// to the end byte are the 'body' of the key; compare bodies to
+    /// tell whether two keys are equal, as a unique index must.
+    ///
+    /// A field that is missing from the document has a null part, as
+    /// in an index.
+    ///
+    class LIBBASSOON_EXPORT index_key_encoder {
+    public:
+      ///
+      /// 'paths' are the fields of the key, in order, each a dotted
+      /// path as taken by 'document_view::find_path'. Bit 'i' of
+      /// 'descending' makes the 'i'th part descending; there can be
+      /// at most 32 such parts.
+      ///
+      explicit index_key_encoder(std::vector<std::string> paths, std::uint32_t descending = 0);
+
+      ///
+      /// Writes the key of 'document' with 'writer'. Returns false if a
+      /// value in the key turns out to be malformed, or if the writer
+      /// fails.
+      ///
+      /// The key is built in a buffer that the encoder keeps, as the
+      /// type bits go after the body and descending parts are inverted
+      /// once built, and then copied to the writer in one write. The
+      /// buffer grows to the largest key and is reused, so encoding
+      /// allocates only until it has seen that.
+      ///
+      template<typename Writer_type>
+      bool encode(document_view const& document, Writer_type& writer) {
+        if (!build(document) || !writer.reserve(key_.size()))
+          return false;
+        writer.write(key_.data(), key_.size());
+        return true;
+      }
+
+      ///
+      /// The last key built, and the size of its body.
+      ///
+      byte_t const* data() const noexcept {
+        return key_.data();
+      }
+
+      std::size_t size() const noexcept {
+        return key_.size();
+      }
+
+      std::size_t body_size() const noexcept {
+        return body_size_;
+      }
+
+    private:
+      bool build(document_view const& document);
+
+      std::vector<std::string> paths_;
+      std::uint32_t descending_;
+
+      // Both only grow.
+      std::vector<byte_t> key_;
+      std::vector<byte_t> type_bits_;
+      std::size_t body_size_;
+    };
+
+    ///
+    /// Turns index keys back into BSON: a document with one element,
+    /// named "", for each part, as MongoDB returns index keys.
+    ///
+    /// Values come back as they went in, but for NaN, which comes back
+    /// as the quiet NaN, and arrays, whose elements are named "0",
+    /// "1" and so on.
+    ///
+    class LIBBASSOON_EXPORT index_key_decoder {
+    public:
+      ///
+      /// 'descending' must be what the keys were encoded with.
+      ///
+      explicit index_key_decoder(std::uint32_t descending = 0);
+
+      ///
+      /// Writes the document for the 'size' byte 'key' with 'writer'.
+      /// Returns false if the key is malformed, in which case nothing
+      /// is written, or if the writer fails.
+      ///
+      /// As with the encoder, the elements are decoded into a buffer
+      /// that is kept and reused, and then copied to the writer.
+      ///
+      template<typename Writer_type>
+      bool decode(void const* key, std::size_t size, Writer_type& writer) {
+        if (!build(static_cast<byte_t const*>(key), size))
+          return false;
+        auto document = start_document(writer);
+        document.encode_raw_elements(binary_cdata(elements_.data(), elements_.size()));
+        document.finish();
+        return document.ok();
+      }
+
+    private:
+      bool build(byte_t const* key, std::size_t size);
+
+      std::uint32_t descending_;
+
+      // The elements decoded, as BSON. Only grows.
+      std::vector<byte_t> elements_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_9739db12_1361_49c9_b33c_dc59ba906a9e
@@ -0,0 +1,436 @@
+#include <bassoon/json_parser.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      // What each byte of a 64 byte block is, one bit per byte.
+      struct block_masks {
+        std::uint64_t quote;
+        std::uint64_t backslash;
+        std::uint64_t structural;
+        std::uint64_t whitespace;
+        std::uint64_t control;
+      };
+
+      void classify(char const* block, block_masks& masks) noexcept {
+        masks = block_masks{ 0, 0, 0, 0, 0 };
+
+#if defined(__SSE2__)
+        __m128i const quote = _mm_set1_epi8('"');
+        __m128i const backslash = _mm_set1_epi8('\\');
+        __m128i const case_bit = _mm_set1_epi8(0x20);
+        __m128i const open = _mm_set1_epi8('{');
+        __m128i const close = _mm_set1_epi8('}');
+        __m128i const colon = _mm_set1_epi8(':');
+        __m128i const comma = _mm_set1_epi8(',');
+        __m128i const space = _mm_set1_epi8(' ');
+        __m128i const tab = _mm_set1_epi8('\t');
+        __m128i const newline = _mm_set1_epi8('\n');
+        __m128i const carriage_return = _mm_set1_epi8('\r');
+        __m128i const last_control = _mm_set1_epi8(0x1F);
+
+        for (int i = 0; i != 64; i += 16) {
+          __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + i));
+
+          // Setting 0x20 folds '[' onto '{' and ']' onto '}'.
+          __m128i const folded = _mm_or_si128(chunk, case_bit);
+          __m128i const structural = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+          __m128i const whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, carriage_return)));
+
+          auto const bits = [i](__m128i matches) {
+            return static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(matches))) << i;
+          };
+          masks.quote |= bits(_mm_cmpeq_epi8(chunk, quote));
+          masks.backslash |= bits(_mm_cmpeq_epi8(chunk, backslash));
+          masks.structural |= bits(structural);
+          masks.whitespace |= bits(whitespace);
+          masks.control |= bits(_mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk));
+        }
+#else
+        for (int i = 0; i != 64; ++i) {
+          std::uint64_t const bit = std::uint64_t(1) << i;
+          unsigned char const c = static_cast<unsigned char>(block[i]);
+          switch (c) {
+            case '"':
+              masks.quote |= bit;
+              break;
+            case '\\':
+              masks.backslash |= bit;
+              break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+              masks.structural |= bit;
+              break;
+            case ' ': case '\t': case '\n': case '\r':
+              masks.whitespace |= bit;
+              break;
+            default:
+              break;
+          }
+          if (c < 0x20)
+            masks.control |= bit;
+        }
+#endif
+      }
+
+      // Returns the bytes that follow an unescaped backslash. 'carry'
+      // says whether the last byte of the previous block was one.
+      // Backslashes are rare, so we simply visit each of them.
+      std::uint64_t find_escaped(std::uint64_t backslash, std::uint64_t& carry) noexcept {
+        std::uint64_t escaped = carry;
+        carry = 0;
+        backslash &= ~escaped;
+        while (backslash) {
+          int const i = __builtin_ctzll(backslash);
+          backslash &= backslash - 1;
+          if (i == 63) {
+            carry = 1;
+          } else {
+            escaped |= std::uint64_t(1) << (i + 1);
+            backslash &= ~escaped;
+          }
+        }
+        return escaped;
+      }
+
+      // Sets each bit to the xor of it and all the bits below it, so
+      // that bits between an odd and an even quote are set.
+      std::uint64_t prefix_xor(std::uint64_t bits) noexcept {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+      }
+
+      bool is_delimiter(char c) noexcept {
+        switch (c) {
+          case ',': case ']': case '}': case ':': case '[': case '{': case '"':
+          case ' ': case '\t': case '\n': case '\r':
+            return true;
+          default:
+            return false;
+        }
+      }
+
+      bool is_digit(char c) noexcept {
+        return c >= '0' && c <= '9';
+      }
+
+      // The powers of ten that doubles hold exactly.
+      double_t const k_exact_powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+
+      int read_hex_digit(char c) noexcept {
+        if (c >= '0' && c <= '9')
+          return c - '0';
+        if (c >= 'a' && c <= 'f')
+          return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+          return c - 'A' + 10;
+        return -1;
+      }
+
+      // Reads the four hex digits of a \u escape, or returns -1.
+      long read_hex4(char const* data) noexcept {
+        long value = 0;
+        for (int i = 0; i != 4; ++i) {
+          int const digit = read_hex_digit(data[i]);
+          if (digit < 0)
+            return -1;
+          value = (value << 4) | digit;
+        }
+        return value;
+      }
+
+      std::size_t encode_utf8(unsigned long code_point, char* out) noexcept {
+        if (code_point < 0x80) {
+          out[0] = static_cast<char>(code_point);
+          return 1;
+        }
+        if (code_point < 0x800) {
+          out[0] = static_cast<char>(0xC0 | (code_point >> 6));
+          out[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+          return 2;
+        }
+        if (code_point < 0x10000) {
+          out[0] = static_cast<char>(0xE0 | (code_point >> 12));
+          out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+          out[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+          return 3;
+        }
+        out[0] = static_cast<char>(0xF0 | (code_point >> 18));
+        out[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+        return 4;
+      }
+
+    } // namespace
+
+    json_parser::json_parser(json_number_policy policy, std::size_t max_depth)
+      : policy_(policy)
+      , max_depth_(max_depth)
+      , count_(0)
+      , json_(nullptr)
+      , size_(0)
+      , next_(0)
+      , position_(0)
+      , status_(json_parse_status::ok)
+      , error_offset_(0) {}
+
+    bool json_parser::index(char const* json, std::size_t size) {
+      count_ = 0;
+      if (size > static_cast<std::size_t>(std::numeric_limits<length_t>::max()))
+        return false;
+
+      // At most one position per byte.
+      if (structurals_.size() < size + 1)
+        structurals_.resize(size + 1);
+      std::uint32_t* out = structurals_.data();
+
+      std::uint64_t in_string_carry = 0;
+      std::uint64_t escape_carry = 0;
+      std::uint64_t scalar_carry = 0;
+
+      for (std::size_t offset = 0; offset < size; offset += 64) {
+        char const* block = json + offset;
+        char padded[64];
+        if (size - offset < 64) {
+          std::memset(padded, ' ', sizeof(padded));
+          std::memcpy(padded, block, size - offset);
+          block = padded;
+        }
+
+        block_masks masks;
+        classify(block, masks);
+
+        std::uint64_t const quotes = masks.quote & ~find_escaped(masks.backslash, escape_carry);
+
+        // From each opening quote up to, but not including, its
+        // closing quote.
+        std::uint64_t const in_string = prefix_xor(quotes) ^ in_string_carry;
+        in_string_carry = static_cast<std::uint64_t>(static_cast<std::int64_t>(in_string) >> 63);
+
+        std::uint64_t const bad_control = masks.control & in_string;
+        if (bad_control) {
+          error_offset_ = offset + __builtin_ctzll(bad_control);
+          return false;
+        }
+
+        // Numbers and literals start wherever something other than
+        // whitespace or punctuation follows whitespace or punctuation.
+        std::uint64_t const scalar = ~(masks.structural | masks.whitespace | masks.quote | in_string);
+        std::uint64_t const scalar_start = scalar & ~((scalar << 1) | scalar_carry);
+        scalar_carry = scalar >> 63;
+
+        std::uint64_t bits = (masks.structural & ~in_string) | quotes | scalar_start;
+        while (bits) {
+          *out++ = static_cast<std::uint32_t>(offset + __builtin_ctzll(bits));
+          bits &= bits - 1;
+        }
+      }
+
+      count_ = out - structurals_.data();
+      if (in_string_carry) {
+        error_offset_ = size;
+        return false;
+      }
+      return true;
+    }
+
+    bool json_parser::take_string(char*& data, std::size_t& size) noexcept {
+      // Every unescaped quote is indexed, so the next position closes
+      // the string.
+      char* const begin = json_ + position_ + 1;
+      if (advance() != '"')
+        return false;
+      char* const end = json_ + position_;
+
+      data = begin;
+      if (!std::memchr(begin, '\\', end - begin)) {
+        *end = '\0';
+        size = end - begin;
+        return true;
+      }
+
+      std::ptrdiff_t const unescaped = unescape(begin, end);
+      if (unescaped < 0)
+        return false;
+      size = unescaped;
+      return true;
+    }
+
+    bool json_parser::take_literal(char const* literal, std::size_t size) noexcept {
+      if (size_ - position_ < size || std::memcmp(json_ + position_, literal, size) != 0)
+        return false;
+      return position_ + size == size_ || is_delimiter(json_[position_ + size]);
+    }
+
+    std::ptrdiff_t json_parser::unescape(char* begin, char* end) noexcept {
+      char* out = begin;
+      char const* in = begin;
+
+      for (;;) {
+        char const* const backslash = static_cast<char const*>(std::memchr(in, '\\', end - in));
+        char const* const run_end = backslash ? backslash : end;
+        std::memmove(out, in, run_end - in);
+        out += run_end - in;
+        if (!backslash)
+          break;
+
+        // The closing quote is never escaped, so the escaped char is
+        // within the string.
+        in = backslash + 2;
+        switch (backslash[1]) {
+          case '"':  *out++ = '"';  break;
+          case '\\': *out++ = '\\'; break;
+          case '/':  *out++ = '/';  break;
+          case 'b':  *out++ = '\b'; break;
+          case 'f':  *out++ = '\f'; break;
+          case 'n':  *out++ = '\n'; break;
+          case 'r':  *out++ = '\r'; break;
+          case 't':  *out++ = '\t'; break;
+          case 'u': {
+            if (end - in < 4)
+              return -1;
+            long code_point = read_hex4(in);
+            in += 4;
+            if (code_point >= 0xD800 && code_point < 0xDC00) {
+              // A high surrogate must be followed by a low one.
+              long const low = (end - in >= 6 && in[0] == '\\' && in[1] == 'u') ? read_hex4(in + 2) : -1;
+              if (low < 0xDC00 || low >= 0xE000)
+                return -1;
+              in += 6;
+              code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code_point < 0 || (code_point >= 0xDC00 && code_point < 0xE000)) {
+              return -1;
+            }
+            out += encode_utf8(code_point, out);
+            break;
+          }
+          default:
+            return -1;
+        }
+      }
+
+      *out = '\0';
+      return out - begin;
+    }
+
+    bool json_parser::parse_number(char const* begin, char const* end, number& result) const noexcept {
+      char const* current = begin;
+      bool const negative = (current != end && *current == '-');
+      if (negative)
+        ++current;
+
+      // The first 19 significant digits, which always fit, and the
+      // power of ten that scales them.
+      std::uint64_t mantissa = 0;
+      int significant = 0;
+      int exponent = 0;
+      bool truncated = false;
+      bool is_integer = true;
+
+      if (current == end || !is_digit(*current))
+        return false;
+      if (*current == '0') {
+        ++current;
+      } else {
+        for (; current != end && is_digit(*current); ++current) {
+          if (significant < 19) {
+            mantissa = mantissa * 10 + (*current - '0');
+            ++significant;
+          } else {
+            truncated = true;
+            ++exponent;
+          }
+        }
+      }
+
+      if (current != end && *current == '.') {
+        is_integer = false;
+        ++current;
+        if (current == end || !is_digit(*current))
+          return false;
+        for (; current != end && is_digit(*current); ++current) {
+          if (significant < 19) {
+            mantissa = mantissa * 10 + (*current - '0');
+            if (mantissa != 0)
+              ++significant;
+            --exponent;
+          } else {
+            truncated = true;
+          }
+        }
+      }
+
+      if (current != end && (*current == 'e' || *current == 'E')) {
+        is_integer = false;
+        ++current;
+        bool const negative_exponent = (current != end && *current == '-');
+        if (current != end && (*current == '-' || *current == '+'))
+          ++current;
+        if (current == end || !is_digit(*current))
+          return false;
+        int written = 0;
+        for (; current != end && is_digit(*current); ++current)
+          if (written < 100000)
+            written = written * 10 + (*current - '0');
+        exponent += negative_exponent ? -written : written;
+      }
+
+      if (current != end && !is_delimiter(*current))
+        return false;
+
+      if (is_integer && !truncated && policy_ != json_number_policy::floating_point) {
+        std::uint64_t const k_int64_max = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+        if (mantissa <= k_int64_max + (negative ? 1 : 0)) {
+          result.integer = negative ?
+            static_cast<std::int64_t>(0 - mantissa) :
+            static_cast<std::int64_t>(mantissa);
+          bool const fits_int32 =
+            result.integer >= std::numeric_limits<std::int32_t>::min() &&
+            result.integer <= std::numeric_limits<std::int32_t>::max();
+          result.type = (policy_ == json_number_policy::narrowest && fits_int32) ? types::int32 : types::int64;
+          return true;
+        }
+      }
+
+      result.type = types::floating_point;
+
+      // A mantissa that a double holds exactly, times or divided by a
+      // power of ten that it also holds exactly, rounds correctly.
+      if (!truncated && mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double_t value = static_cast<double_t>(mantissa);
+        value = (exponent < 0) ? value / k_exact_powers_of_ten[-exponent] : value * k_exact_powers_of_ten[exponent];
+        result.floating_point = negative ? -value : value;
+        return true;
+      }
+
+      // Otherwise let the C library round it, from a terminated copy.
+      std::string const text(begin, current);
+      result.floating_point = std::strtod(text.c_str(), nullptr);
+      return true;
+    }
+
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,300 @@
+#ifndef included_858defc1_8814_4ab3_a14e_93564edfcfd4
+#define included_858defc1_8814_4ab3_a14e_93564edfcfd4
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <bassoon/encoder.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/json_transcoder.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Which BSON type a JSON number becomes.
+    ///
+    enum class json_number_policy {
+      // Integers are int32 when they fit, then int64; anything else
+      // is a double.
+      narrowest,
+
+      // Integers are int64 when they fit; anything else is a double.
+      int64,
+
+      // Every number is a double, as in JavaScript.
+      floating_point
+    };
+
+    enum class json_parse_status {
+      ok,
+      malformed,
+      too_deep,
+      no_room
+    };
+
+    ///
+    /// Parses a JSON object into a BSON document, driving the encoder
+    /// as it goes. No tree is built.
+    ///
+    /// The parse takes two passes, in the manner of simdjson. The
+    /// first classifies the input in 64 byte blocks, each as four 16
+    /// byte SSE2 compares into one bit per byte, and records where
+    /// each brace, bracket, colon, comma, quote and scalar starts,
+    /// outside of strings; escaped quotes are worked out from the runs
+    /// of backslashes before them. The second walks those
+    /// positions and calls start_subdocument, start_subarray and
+    /// finish, and the encode_ calls for the values, directly.
+    ///
+    /// Strings are unescaped in place and null terminated over their
+    /// closing quote, so that names and values go to the encoder
+    /// without being copied.
+    ///
+    /// The input is plain JSON: Extended JSON wrappers such as $oid
+    /// come out as the subdocuments they look like.
+    ///
+    class LIBBASSOON_EXPORT json_parser {
+    public:
+      explicit json_parser(json_number_policy policy = json_number_policy::narrowest,
+                           std::size_t max_depth = 100);
+
+      ///
+      /// Parses the 'size' bytes of 'json', which it overwrites, and
+      /// writes the document into 'writer'. On failure the document
+      /// written so far is finished, and 'error_offset' says where in
+      /// 'json' the problem was found.
+      ///
+      template<typename Writer_type>
+      json_parse_status parse_in_place(char* json, std::size_t size, Writer_type& writer);
+
+      ///
+      /// As above, for input that we may not overwrite. It is copied
+      /// into a buffer that the parser keeps for the next time.
+      ///
+      template<typename Writer_type>
+      json_parse_status parse(char const* json, std::size_t size, Writer_type& writer);
+
+      std::size_t error_offset() const noexcept {
+        return error_offset_;
+      }
+
+    private:
+      struct number {
+        types type;
+        std::int64_t integer;
+        double_t floating_point;
+      };
+
+      bool index(char const* json, std::size_t size);
+
+      // Reads the number at 'begin', which must run up to 'end' or to
+      // something that can follow a value.
+      bool parse_number(char const* begin, char const* end, number& result) const noexcept;
+
+      // Unescapes the string between 'begin' and 'end' in place and
+      // null terminates it. Returns its size, or -1.
+      static std::ptrdiff_t unescape(char* begin, char* end) noexcept;
+
+      template<typename Encoder_type>
+      bool parse_object(Encoder_type& encoder, std::size_t depth);
+
+      template<typename Encoder_type>
+      bool parse_array(Encoder_type& encoder, std::size_t depth);
+
+      template<typename Encoder_type>
+      bool parse_value(Encoder_type& encoder, cstring_cdata name, std::size_t depth);
+
+      // Moves to the next indexed position and returns its char, or a
+      // null char at the end of the input.
+      char advance() noexcept {
+        if (next_ == count_) {
+          position_ = size_;
+          return '\0';
+        }
+        position_ = structurals_[next_++];
+        return json_[position_];
+      }
+
+      char peek() const noexcept {
+        return (next_ == count_) ? '\0' : json_[structurals_[next_]];
+      }
+
+      // Takes the string whose opening quote is the current position.
+      bool take_string(char*& data, std::size_t& size) noexcept;
+
+      // Takes the literal at the current position.
+      bool take_literal(char const* literal, std::size_t size) noexcept;
+
+      bool fail() noexcept {
+        if (status_ == json_parse_status::ok) {
+          status_ = json_parse_status::malformed;
+          error_offset_ = position_;
+        }
+        return false;
+      }
+
+      json_number_policy policy_;
+      std::size_t max_depth_;
+
+      // The positions found by 'index'. The vector only grows.
+      std::vector<std::uint32_t> structurals_;
+      std::size_t count_;
+
+      std::vector<char> copy_;
+
+      char* json_;
+      std::size_t size_;
+      std::size_t next_;
+      std::size_t position_;
+
+      json_parse_status status_;
+      std::size_t error_offset_;
+    };
+
+    template<typename Writer_type>
+    json_parse_status json_parser::parse_in_place(char* json, std::size_t size, Writer_type& writer) {
+      json_ = json;
+      size_ = size;
+      next_ = 0;
+      position_ = 0;
+      status_ = json_parse_status::ok;
+      error_offset_ = 0;
+
+      auto document = start_document(writer);
+      if (!index(json, size)) {
+        status_ = json_parse_status::malformed;
+      } else if (advance() != '{') {
+        fail();
+      } else if (parse_object(document, 1) && next_ != count_) {
+        advance();
+        fail();
+      }
+      document.finish();
+
+      if (status_ == json_parse_status::ok && !document.ok())
+        status_ = json_parse_status::no_room;
+      return status_;
+    }
+
+    template<typename Writer_type>
+    json_parse_status json_parser::parse(char const* json, std::size_t size, Writer_type& writer) {
+      copy_.assign(json, json + size);
+      return parse_in_place(copy_.data(), size, writer);
+    }
+
+    template<typename Encoder_type>
+    bool json_parser::parse_object(Encoder_type& encoder, std::size_t depth) {
+      if (peek() == '}') {
+        advance();
+        return true;
+      }
+
+      for (;;) {
+        char* name;
+        std::size_t name_size;
+        if (advance() != '"' || !take_string(name, name_size))
+          return fail();
+
+        // BSON names end at their first null byte.
+        if (std::memchr(name, '\0', name_size))
+          return fail();
+
+        if (advance() != ':')
+          return fail();
+        if (!parse_value(encoder, cstring_cdata(name, name_size + 1, string_data_details::null_included_tag()), depth))
+          return false;
+
+        char const next = advance();
+        if (next == '}')
+          return true;
+        if (next != ',')
+          return fail();
+      }
+    }
+
+    template<typename Encoder_type>
+    bool json_parser::parse_array(Encoder_type& encoder, std::size_t depth) {
+      if (peek() == ']') {
+        advance();
+        return true;
+      }
+
+      char name[json_details::k_max_number_size];
+      for (std::int64_t index = 0;; ++index) {
+        std::size_t const name_size = json_details::format_int64(index, name);
+        name[name_size] = '\0';
+        if (!parse_value(encoder, cstring_cdata(name, name_size + 1, string_data_details::null_included_tag()), depth))
+          return false;
+
+        char const next = advance();
+        if (next == ']')
+          return true;
+        if (next != ',')
+          return fail();
+      }
+    }
+
+    template<typename Encoder_type>
+    bool json_parser::parse_value(Encoder_type& encoder, cstring_cdata name, std::size_t depth) {
+      char const c = advance();
+      switch (c) {
+        case '{':
+        case '[': {
+          if (depth == max_depth_) {
+            status_ = json_parse_status::too_deep;
+            error_offset_ = position_;
+            return false;
+          }
+          auto nested = (c == '{') ? encoder.start_subdocument(name) : encoder.start_subarray(name);
+          bool const ok = (c == '{') ? parse_object(nested, depth + 1) : parse_array(nested, depth + 1);
+          nested.finish();
+          return ok;
+        }
+
+        case '"': {
+          char* data;
+          std::size_t size;
+          if (!take_string(data, size))
+            return fail();
+          encoder.encode_utf8_string(name, string_cdata(data, size + 1, string_data_details::null_included_tag()));
+          return true;
+        }
+
+        case 't':
+          if (!take_literal("true", 4))
+            return fail();
+          encoder.encode_boolean(name, true);
+          return true;
+
+        case 'f':
+          if (!take_literal("false", 5))
+            return fail();
+          encoder.encode_boolean(name, false);
+          return true;
+
+        case 'n':
+          if (!take_literal("null", 4))
+            return fail();
+          encoder.encode_null(name);
+          return true;
+
+        default: {
+          number value;
+          if (!parse_number(json_ + position_, json_ + size_, value))
+            return fail();
+          if (value.type == types::int32)
+            encoder.encode_int32(name, static_cast<std::int32_t>(value.integer));
+          else if (value.type == types::int64)
+            encoder.encode_int64(name, value.integer);
+          else
+            encoder.encode_floating_point(name, value.floating_point);
+          return true;
+        }
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_858defc1_8814_4ab3_a14e_93564edfcfd4
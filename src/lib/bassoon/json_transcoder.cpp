@@ -0,0 +1,540 @@
+#include <bassoon/json_transcoder.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bassoon {
+  namespace bson {
+    namespace json_details {
+
+      namespace {
+
+        char const k_digit_pairs[] =
+          "00010203040506070809"
+          "10111213141516171819"
+          "20212223242526272829"
+          "30313233343536373839"
+          "40414243444546474849"
+          "50515253545556575859"
+          "60616263646566676869"
+          "70717273747576777879"
+          "80818283848586878889"
+          "90919293949596979899";
+
+        char const k_hex_digits[] = "0123456789abcdef";
+
+        char const k_base64_digits[] =
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        // Writes the digits of 'value' two at a time, from the back.
+        std::size_t format_uint64(std::uint64_t value, char* buffer) noexcept {
+          char digits[20];
+          char* const end = digits + sizeof(digits);
+          char* current = end;
+          while (value >= 100) {
+            std::size_t const pair = static_cast<std::size_t>(value % 100) * 2;
+            value /= 100;
+            current -= 2;
+            std::memcpy(current, k_digit_pairs + pair, 2);
+          }
+          if (value >= 10) {
+            current -= 2;
+            std::memcpy(current, k_digit_pairs + value * 2, 2);
+          } else {
+            *--current = static_cast<char>('0' + value);
+          }
+          std::memcpy(buffer, current, end - current);
+          return end - current;
+        }
+
+        void format_two_digits(unsigned value, char* buffer) noexcept {
+          std::memcpy(buffer, k_digit_pairs + value * 2, 2);
+        }
+
+        // Shortest round trip formatting of doubles, after Loitsch,
+        // "Printing Floating-Point Numbers Quickly and Accurately
+        // with Integers" (PLDI 2010). Grisu3 finds the shortest
+        // digits with 64 bit integer arithmetic for about 99.5% of
+        // doubles, and knows when it has failed; for those we fall
+        // back to trying each precision with snprintf.
+
+        struct diy_fp {
+          std::uint64_t f;
+          int e;
+        };
+
+        diy_fp multiply(diy_fp x, diy_fp y) noexcept {
+          std::uint64_t const k_mask = 0xFFFFFFFFU;
+          std::uint64_t const a = x.f >> 32;
+          std::uint64_t const b = x.f & k_mask;
+          std::uint64_t const c = y.f >> 32;
+          std::uint64_t const d = y.f & k_mask;
+          std::uint64_t const ac = a * c;
+          std::uint64_t const bc = b * c;
+          std::uint64_t const ad = a * d;
+          std::uint64_t const bd = b * d;
+          std::uint64_t middle = (bd >> 32) + (ad & k_mask) + (bc & k_mask);
+          middle += 1U << 31;  // Round.
+          return diy_fp{ ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64 };
+        }
+
+        diy_fp normalize(diy_fp x) noexcept {
+          int const shift = __builtin_clzll(x.f);
+          return diy_fp{ x.f << shift, x.e - shift };
+        }
+
+        struct cached_power {
+          std::uint64_t f;
+          int e;
+          int k;
+        };
+
+        // 10^k for every eighth k from -348 to 340, rounded to 64 bits.
+        cached_power const k_cached_powers[] = {
+          { 0xfa8fd5a0081c0288ULL, -1220, -348 },
+          { 0xbaaee17fa23ebf76ULL, -1193, -340 },
+          { 0x8b16fb203055ac76ULL, -1166, -332 },
+          { 0xcf42894a5dce35eaULL, -1140, -324 },
+          { 0x9a6bb0aa55653b2dULL, -1113, -316 },
+          { 0xe61acf033d1a45dfULL, -1087, -308 },
+          { 0xab70fe17c79ac6caULL, -1060, -300 },
+          { 0xff77b1fcbebcdc4fULL, -1034, -292 },
+          { 0xbe5691ef416bd60cULL, -1007, -284 },
+          { 0x8dd01fad907ffc3cULL, -980, -276 },
+          { 0xd3515c2831559a83ULL, -954, -268 },
+          { 0x9d71ac8fada6c9b5ULL, -927, -260 },
+          { 0xea9c227723ee8bcbULL, -901, -252 },
+          { 0xaecc49914078536dULL, -874, -244 },
+          { 0x823c12795db6ce57ULL, -847, -236 },
+          { 0xc21094364dfb5637ULL, -821, -228 },
+          { 0x9096ea6f3848984fULL, -794, -220 },
+          { 0xd77485cb25823ac7ULL, -768, -212 },
+          { 0xa086cfcd97bf97f4ULL, -741, -204 },
+          { 0xef340a98172aace5ULL, -715, -196 },
+          { 0xb23867fb2a35b28eULL, -688, -188 },
+          { 0x84c8d4dfd2c63f3bULL, -661, -180 },
+          { 0xc5dd44271ad3cdbaULL, -635, -172 },
+          { 0x936b9fcebb25c996ULL, -608, -164 },
+          { 0xdbac6c247d62a584ULL, -582, -156 },
+          { 0xa3ab66580d5fdaf6ULL, -555, -148 },
+          { 0xf3e2f893dec3f126ULL, -529, -140 },
+          { 0xb5b5ada8aaff80b8ULL, -502, -132 },
+          { 0x87625f056c7c4a8bULL, -475, -124 },
+          { 0xc9bcff6034c13053ULL, -449, -116 },
+          { 0x964e858c91ba2655ULL, -422, -108 },
+          { 0xdff9772470297ebdULL, -396, -100 },
+          { 0xa6dfbd9fb8e5b88fULL, -369, -92 },
+          { 0xf8a95fcf88747d94ULL, -343, -84 },
+          { 0xb94470938fa89bcfULL, -316, -76 },
+          { 0x8a08f0f8bf0f156bULL, -289, -68 },
+          { 0xcdb02555653131b6ULL, -263, -60 },
+          { 0x993fe2c6d07b7facULL, -236, -52 },
+          { 0xe45c10c42a2b3b06ULL, -210, -44 },
+          { 0xaa242499697392d3ULL, -183, -36 },
+          { 0xfd87b5f28300ca0eULL, -157, -28 },
+          { 0xbce5086492111aebULL, -130, -20 },
+          { 0x8cbccc096f5088ccULL, -103, -12 },
+          { 0xd1b71758e219652cULL, -77, -4 },
+          { 0x9c40000000000000ULL, -50, 4 },
+          { 0xe8d4a51000000000ULL, -24, 12 },
+          { 0xad78ebc5ac620000ULL, 3, 20 },
+          { 0x813f3978f8940984ULL, 30, 28 },
+          { 0xc097ce7bc90715b3ULL, 56, 36 },
+          { 0x8f7e32ce7bea5c70ULL, 83, 44 },
+          { 0xd5d238a4abe98068ULL, 109, 52 },
+          { 0x9f4f2726179a2245ULL, 136, 60 },
+          { 0xed63a231d4c4fb27ULL, 162, 68 },
+          { 0xb0de65388cc8ada8ULL, 189, 76 },
+          { 0x83c7088e1aab65dbULL, 216, 84 },
+          { 0xc45d1df942711d9aULL, 242, 92 },
+          { 0x924d692ca61be758ULL, 269, 100 },
+          { 0xda01ee641a708deaULL, 295, 108 },
+          { 0xa26da3999aef774aULL, 322, 116 },
+          { 0xf209787bb47d6b85ULL, 348, 124 },
+          { 0xb454e4a179dd1877ULL, 375, 132 },
+          { 0x865b86925b9bc5c2ULL, 402, 140 },
+          { 0xc83553c5c8965d3dULL, 428, 148 },
+          { 0x952ab45cfa97a0b3ULL, 455, 156 },
+          { 0xde469fbd99a05fe3ULL, 481, 164 },
+          { 0xa59bc234db398c25ULL, 508, 172 },
+          { 0xf6c69a72a3989f5cULL, 534, 180 },
+          { 0xb7dcbf5354e9beceULL, 561, 188 },
+          { 0x88fcf317f22241e2ULL, 588, 196 },
+          { 0xcc20ce9bd35c78a5ULL, 614, 204 },
+          { 0x98165af37b2153dfULL, 641, 212 },
+          { 0xe2a0b5dc971f303aULL, 667, 220 },
+          { 0xa8d9d1535ce3b396ULL, 694, 228 },
+          { 0xfb9b7cd9a4a7443cULL, 720, 236 },
+          { 0xbb764c4ca7a44410ULL, 747, 244 },
+          { 0x8bab8eefb6409c1aULL, 774, 252 },
+          { 0xd01fef10a657842cULL, 800, 260 },
+          { 0x9b10a4e5e9913129ULL, 827, 268 },
+          { 0xe7109bfba19c0c9dULL, 853, 276 },
+          { 0xac2820d9623bf429ULL, 880, 284 },
+          { 0x80444b5e7aa7cf85ULL, 907, 292 },
+          { 0xbf21e44003acdd2dULL, 933, 300 },
+          { 0x8e679c2f5e44ff8fULL, 960, 308 },
+          { 0xd433179d9c8cb841ULL, 986, 316 },
+          { 0x9e19db92b4e31ba9ULL, 1013, 324 },
+          { 0xeb96bf6ebadf77d9ULL, 1039, 332 },
+          { 0xaf87023b9bf0ee6bULL, 1066, 340 },
+        };
+
+        int const k_first_cached_power = -348;
+        int const k_cached_power_step = 8;
+
+        // The scaled value must have its binary point within the
+        // range that digit generation works in.
+        int const k_min_target_exponent = -60;
+
+        cached_power const& find_cached_power(int e) noexcept {
+          int const min_exponent = k_min_target_exponent - (e + 64);
+          int const k = static_cast<int>(std::ceil((min_exponent + 63) * 0.30102999566398114));
+          return k_cached_powers[(k - k_first_cached_power - 1) / k_cached_power_step + 1];
+        }
+
+        // Moves the last digit towards 'w' while that stays within the
+        // safe interval, and says whether the result is certainly the
+        // closest of the shortest digits. All quantities are scaled.
+        bool round_weed(char* digits, int length, std::uint64_t distance_to_high,
+                        std::uint64_t unsafe_interval, std::uint64_t rest,
+                        std::uint64_t ten_kappa, std::uint64_t unit) noexcept {
+          std::uint64_t const small_distance = distance_to_high - unit;
+          std::uint64_t const big_distance = distance_to_high + unit;
+
+          while (rest < small_distance &&
+                 unsafe_interval - rest >= ten_kappa &&
+                 (rest + ten_kappa < small_distance ||
+                  small_distance - rest >= rest + ten_kappa - small_distance)) {
+            --digits[length - 1];
+            rest += ten_kappa;
+          }
+
+          if (rest < big_distance &&
+              unsafe_interval - rest >= ten_kappa &&
+              (rest + ten_kappa < big_distance ||
+               big_distance - rest > rest + ten_kappa - big_distance))
+            return false;
+
+          return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+        }
+
+        bool generate_digits(diy_fp low, diy_fp w, diy_fp high, char* digits, int& length, int& kappa) noexcept {
+          std::uint64_t unit = 1;
+          diy_fp const too_low = { low.f - unit, low.e };
+          diy_fp const too_high = { high.f + unit, high.e };
+          std::uint64_t unsafe_interval = too_high.f - too_low.f;
+
+          int const shift = -w.e;
+          std::uint64_t const one = std::uint64_t(1) << shift;
+          std::uint32_t integrals = static_cast<std::uint32_t>(too_high.f >> shift);
+          std::uint64_t fractionals = too_high.f & (one - 1);
+
+          std::uint32_t divisor = 1;
+          kappa = 1;
+          while (divisor <= integrals / 10) {
+            divisor *= 10;
+            ++kappa;
+          }
+
+          length = 0;
+          while (kappa > 0) {
+            digits[length++] = static_cast<char>('0' + integrals / divisor);
+            integrals %= divisor;
+            --kappa;
+            std::uint64_t const rest = (static_cast<std::uint64_t>(integrals) << shift) + fractionals;
+            if (rest < unsafe_interval)
+              return round_weed(digits, length, too_high.f - w.f, unsafe_interval, rest,
+                                static_cast<std::uint64_t>(divisor) << shift, unit);
+            divisor /= 10;
+          }
+
+          for (;;) {
+            fractionals *= 10;
+            unit *= 10;
+            unsafe_interval *= 10;
+            digits[length++] = static_cast<char>('0' + (fractionals >> shift));
+            fractionals &= one - 1;
+            --kappa;
+            if (fractionals < unsafe_interval)
+              return round_weed(digits, length, (too_high.f - w.f) * unit, unsafe_interval,
+                                fractionals, one, unit);
+          }
+        }
+
+        // Finds the digits of a positive, finite 'value' such that
+        // value = digits * 10^exponent.
+        bool grisu3(double_t value, char* digits, int& length, int& exponent) noexcept {
+          std::uint64_t bits;
+          std::memcpy(&bits, &value, sizeof(bits));
+          std::uint64_t const k_hidden_bit = std::uint64_t(1) << 52;
+          std::uint64_t const significand = bits & (k_hidden_bit - 1);
+          int const biased_exponent = static_cast<int>(bits >> 52) & 0x7FF;
+
+          diy_fp const v = (biased_exponent == 0) ?
+            diy_fp{ significand, -1074 } :
+            diy_fp{ significand + k_hidden_bit, biased_exponent - 1075 };
+
+          // The boundaries halfway to the neighbouring doubles. Below
+          // a power of two, the lower neighbour is closer.
+          diy_fp const high = normalize(diy_fp{ (v.f << 1) + 1, v.e - 1 });
+          diy_fp low = (significand == 0 && biased_exponent > 1) ?
+            diy_fp{ (v.f << 2) - 1, v.e - 2 } :
+            diy_fp{ (v.f << 1) - 1, v.e - 1 };
+          low.f <<= low.e - high.e;
+          low.e = high.e;
+
+          diy_fp const w = normalize(v);
+          cached_power const& power = find_cached_power(w.e);
+          diy_fp const scale = { power.f, power.e };
+
+          int kappa;
+          bool const ok = generate_digits(multiply(low, scale), multiply(w, scale), multiply(high, scale),
+                                          digits, length, kappa);
+          exponent = kappa - power.k;
+          return ok;
+        }
+
+        // The slow path: the lowest precision that reads back as
+        // 'value' gives its shortest digits.
+        void shortest_by_printf(double_t value, char* digits, int& length, int& exponent) noexcept {
+          char text[32];
+          for (int precision = 1; precision <= 17; ++precision) {
+            std::snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+            if (precision == 17 || std::strtod(text, nullptr) == value) {
+              // The text is d.ddde+xx, or just de+xx.
+              length = 0;
+              char const* current = text;
+              for (; *current != 'e'; ++current)
+                if (*current != '.')
+                  digits[length++] = *current;
+              exponent = std::atoi(current + 1) - (length - 1);
+              return;
+            }
+          }
+        }
+
+        // Lays out value = digits * 10^exponent the way JavaScript
+        // does, except that there is always a fraction and the
+        // exponent is written as E+n or E-n.
+        std::size_t format_decimal(char const* digits, int length, int exponent, char* buffer) noexcept {
+          while (length > 1 && digits[length - 1] == '0') {
+            --length;
+            ++exponent;
+          }
+
+          // Where the decimal point falls relative to the digits.
+          int const point = length + exponent;
+          char* current = buffer;
+
+          if (length <= point && point <= 21) {
+            std::memcpy(current, digits, length);
+            current += length;
+            std::memset(current, '0', point - length);
+            current += point - length;
+            *current++ = '.';
+            *current++ = '0';
+          } else if (0 < point && point <= 21) {
+            std::memcpy(current, digits, point);
+            current += point;
+            *current++ = '.';
+            std::memcpy(current, digits + point, length - point);
+            current += length - point;
+          } else if (-6 < point && point <= 0) {
+            *current++ = '0';
+            *current++ = '.';
+            std::memset(current, '0', -point);
+            current += -point;
+            std::memcpy(current, digits, length);
+            current += length;
+          } else {
+            *current++ = digits[0];
+            *current++ = '.';
+            if (length == 1) {
+              *current++ = '0';
+            } else {
+              std::memcpy(current, digits + 1, length - 1);
+              current += length - 1;
+            }
+            *current++ = 'E';
+            int const scientific = point - 1;
+            *current++ = (scientific < 0) ? '-' : '+';
+            current += format_uint64(static_cast<std::uint64_t>(scientific < 0 ? -scientific : scientific), current);
+          }
+          return current - buffer;
+        }
+
+      } // namespace
+
+      std::size_t format_int64(std::int64_t value, char* buffer) noexcept {
+        if (value >= 0)
+          return format_uint64(static_cast<std::uint64_t>(value), buffer);
+        *buffer = '-';
+        return 1 + format_uint64(0 - static_cast<std::uint64_t>(value), buffer + 1);
+      }
+
+      std::size_t format_double(double_t value, char* buffer) noexcept {
+        if (std::isnan(value)) {
+          std::memcpy(buffer, "NaN", 3);
+          return 3;
+        }
+
+        char* current = buffer;
+        if (std::signbit(value)) {
+          *current++ = '-';
+          value = -value;
+        }
+
+        if (std::isinf(value)) {
+          std::memcpy(current, "Infinity", 8);
+          return current - buffer + 8;
+        }
+
+        // Small integers, which are common, need no digit search.
+        if (value < 9007199254740992.0 && value == static_cast<double_t>(static_cast<std::int64_t>(value))) {
+          current += format_uint64(static_cast<std::uint64_t>(value), current);
+          *current++ = '.';
+          *current++ = '0';
+          return current - buffer;
+        }
+
+        char digits[20];
+        int length;
+        int exponent;
+        if (!grisu3(value, digits, length, exponent))
+          shortest_by_printf(value, digits, length, exponent);
+        return current - buffer + format_decimal(digits, length, exponent, current);
+      }
+
+      std::size_t format_iso_date(std::int64_t milliseconds, char* buffer) noexcept {
+        // 9999-12-31T23:59:59.999Z
+        if (milliseconds < 0 || milliseconds > 253402300799999LL)
+          return 0;
+
+        std::int64_t const k_milliseconds_per_day = 86400000;
+        unsigned const days = static_cast<unsigned>(milliseconds / k_milliseconds_per_day);
+        unsigned const of_day = static_cast<unsigned>(milliseconds % k_milliseconds_per_day);
+
+        // Days since 1970 to a civil date, after Howard Hinnant's
+        // days_from_civil. Eras are 400 year cycles from 0000-03-01.
+        unsigned const shifted = days + 719468;
+        unsigned const era = shifted / 146097;
+        unsigned const day_of_era = shifted - era * 146097;
+        unsigned const year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+        unsigned const day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+        unsigned const month_from_march = (5 * day_of_year + 2) / 153;
+        unsigned const day = day_of_year - (153 * month_from_march + 2) / 5 + 1;
+        unsigned const month = (month_from_march < 10) ? month_from_march + 3 : month_from_march - 9;
+        unsigned const year = year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+
+        unsigned const millisecond = of_day % 1000;
+        unsigned const second = of_day / 1000 % 60;
+        unsigned const minute = of_day / 60000 % 60;
+        unsigned const hour = of_day / 3600000;
+
+        char* current = buffer;
+        format_two_digits(year / 100, current);
+        format_two_digits(year % 100, current + 2);
+        current[4] = '-';
+        format_two_digits(month, current + 5);
+        current[7] = '-';
+        format_two_digits(day, current + 8);
+        current[10] = 'T';
+        format_two_digits(hour, current + 11);
+        current[13] = ':';
+        format_two_digits(minute, current + 14);
+        current[16] = ':';
+        format_two_digits(second, current + 17);
+        current += 19;
+        if (millisecond != 0) {
+          *current++ = '.';
+          *current++ = static_cast<char>('0' + millisecond / 100);
+          format_two_digits(millisecond % 100, current);
+          current += 2;
+        }
+        *current++ = 'Z';
+        return current - buffer;
+      }
+
+      void format_hex(byte_t const* data, std::size_t size, char* buffer) noexcept {
+        for (std::size_t i = 0; i != size; ++i) {
+          buffer[2 * i] = k_hex_digits[data[i] >> 4];
+          buffer[2 * i + 1] = k_hex_digits[data[i] & 0x0F];
+        }
+      }
+
+      std::size_t format_base64(byte_t const* data, std::size_t size, char* buffer) noexcept {
+        char* current = buffer;
+        std::size_t i = 0;
+        for (; i + 3 <= size; i += 3) {
+          std::uint32_t const group = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+          current[0] = k_base64_digits[group >> 18];
+          current[1] = k_base64_digits[(group >> 12) & 0x3F];
+          current[2] = k_base64_digits[(group >> 6) & 0x3F];
+          current[3] = k_base64_digits[group & 0x3F];
+          current += 4;
+        }
+        if (i != size) {
+          std::uint32_t const group = (data[i] << 16) | ((i + 1 != size) ? (data[i + 1] << 8) : 0);
+          current[0] = k_base64_digits[group >> 18];
+          current[1] = k_base64_digits[(group >> 12) & 0x3F];
+          current[2] = (i + 1 != size) ? k_base64_digits[(group >> 6) & 0x3F] : '=';
+          current[3] = '=';
+          current += 4;
+        }
+        return current - buffer;
+      }
+
+      char const* find_escape(char const* begin, char const* end) noexcept {
+#if defined(__SSE2__)
+        // Compares sixteen chars at once against the quote, the
+        // backslash and, as unsigned bytes, everything below 0x20.
+        __m128i const quote = _mm_set1_epi8('"');
+        __m128i const backslash = _mm_set1_epi8('\\');
+        __m128i const last_control = _mm_set1_epi8(0x1F);
+        while (end - begin >= 16) {
+          __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+          __m128i const special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk));
+          int const mask = _mm_movemask_epi8(special);
+          if (mask != 0)
+            return begin + __builtin_ctz(mask);
+          begin += 16;
+        }
+#endif
+        for (; begin != end; ++begin) {
+          unsigned char const c = static_cast<unsigned char>(*begin);
+          if (c < 0x20 || c == '"' || c == '\\')
+            break;
+        }
+        return begin;
+      }
+
+      std::size_t format_escape(char c, char* buffer) noexcept {
+        buffer[0] = '\\';
+        switch (c) {
+          case '"':  buffer[1] = '"';  return 2;
+          case '\\': buffer[1] = '\\'; return 2;
+          case '\b': buffer[1] = 'b';  return 2;
+          case '\f': buffer[1] = 'f';  return 2;
+          case '\n': buffer[1] = 'n';  return 2;
+          case '\r': buffer[1] = 'r';  return 2;
+          case '\t': buffer[1] = 't';  return 2;
+          default:
+            break;
+        }
+        unsigned char const byte = static_cast<unsigned char>(c);
+        std::memcpy(buffer + 1, "u00", 3);
+        buffer[4] = k_hex_digits[byte >> 4];
+        buffer[5] = k_hex_digits[byte & 0x0F];
+        return 6;
+      }
+
+    } // namespace json_details
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,450 @@
+#ifndef included_a210f993_28d6_4467_bd0b_b9a9ce0d05ff
+#define included_a210f993_28d6_4467_bd0b_b9a9ce0d05ff
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// The flavours of MongoDB Extended JSON.
+    ///
+    enum class json_mode {
+      // Numbers and dates as plain JSON where that loses nothing that
+      // matters to most readers: { "a" : 1, "b" : 2.5 }.
+      relaxed,
+
+      // Every value keeps its BSON type: { "a" : { "$numberInt" : "1" } }.
+      canonical
+    };
+
+    namespace json_details {
+
+      // Room for any number, date or escape sequence that we format.
+      const std::size_t k_max_number_size = 32;
+
+      // Writes 'value' in decimal and returns the number of chars.
+      LIBBASSOON_EXPORT std::size_t format_int64(std::int64_t value, char* buffer) noexcept;
+
+      // Writes the shortest decimal that reads back as 'value', such
+      // as 0.1, 1.0 or 1.0E+300, or NaN, Infinity or -Infinity.
+      LIBBASSOON_EXPORT std::size_t format_double(double_t value, char* buffer) noexcept;
+
+      // Writes the ISO-8601 form of a UTC datetime, or returns zero
+      // if its year is outside of 1970 to 9999.
+      LIBBASSOON_EXPORT std::size_t format_iso_date(std::int64_t milliseconds, char* buffer) noexcept;
+
+      // Writes 'size' bytes as lower case hex, two chars per byte.
+      LIBBASSOON_EXPORT void format_hex(byte_t const* data, std::size_t size, char* buffer) noexcept;
+
+      // Writes the base64 of 'size' bytes and returns the number of
+      // chars. Only the last chunk of a value may have a 'size' that
+      // is not a multiple of three.
+      LIBBASSOON_EXPORT std::size_t format_base64(byte_t const* data, std::size_t size, char* buffer) noexcept;
+
+      // Returns the first char in the range that JSON strings must
+      // escape, or 'end'.
+      LIBBASSOON_EXPORT char const* find_escape(char const* begin, char const* end) noexcept;
+
+      // Writes the escape sequence for 'c' and returns its size.
+      LIBBASSOON_EXPORT std::size_t format_escape(char c, char* buffer) noexcept;
+
+    } // namespace json_details
+
+    ///
+    /// Writes documents as Extended JSON into a writer, the same
+    /// writers that the encoder uses.
+    ///
+    /// Output is staged in a small buffer and handed to the writer in
+    /// blocks. Strings are scanned for characters to escape sixteen
+    /// bytes at a time, and copied in runs between them. Bytes outside
+    /// of ASCII are copied as they are, so the output is UTF-8 if the
+    /// strings in the document are.
+    ///
+    template<typename Writer_type>
+    class json_transcoder {
+    public:
+      explicit json_transcoder(Writer_type& writer, json_mode mode = json_mode::relaxed) noexcept
+        : writer_(writer)
+        , mode_(mode)
+        , buffered_(0)
+        , ok_(true) {}
+
+      ///
+      /// Writes 'document' as a JSON object. Returns false if the
+      /// document is malformed, in which case the output stops where
+      /// the problem was found, or if the writer fails.
+      ///
+      bool transcode(document_view const& document) {
+        bool const ok = write_document(document, false);
+        flush();
+        return ok && ok_;
+      }
+
+      bool ok() const noexcept {
+        return ok_;
+      }
+
+    private:
+      static const std::size_t k_buffer_size = 1024;
+
+      // Base64 turns 96 bytes into 128 chars.
+      static const std::size_t k_base64_chunk = 96;
+
+      bool write_document(document_view const& document, bool is_array);
+      bool write_value(element_view const& element);
+      bool write_binary(element_view const& element);
+      bool write_db_pointer(element_view const& element);
+      bool write_scoped_javascript(element_view const& element);
+      void write_double(double_t value);
+      void write_date(std::int64_t value);
+      void write_string(char const* data, std::size_t size);
+
+      void write_int64(std::int64_t value) {
+        commit(json_details::format_int64(value, reserve(json_details::k_max_number_size)));
+      }
+
+      void write_object_id(byte_t const* data) {
+        put_literal("{\"$oid\":\"");
+        json_details::format_hex(data, k_object_id_length, reserve(2 * k_object_id_length));
+        commit(2 * k_object_id_length);
+        put_literal("\"}");
+      }
+
+      // Returns room for 'size' chars, at most k_buffer_size, at the
+      // end of the buffer.
+      char* reserve(std::size_t size) {
+        if (k_buffer_size - buffered_ < size)
+          flush();
+        return buffer_ + buffered_;
+      }
+
+      void commit(std::size_t size) noexcept {
+        buffered_ += size;
+      }
+
+      void put_char(char c) {
+        *reserve(1) = c;
+        commit(1);
+      }
+
+      template<std::size_t size>
+      void put_literal(char const (&literal)[size]) {
+        std::memcpy(reserve(size - 1), literal, size - 1);
+        commit(size - 1);
+      }
+
+      void put(char const* data, std::size_t size) {
+        if (size > k_buffer_size - buffered_) {
+          flush();
+          if (size > k_buffer_size) {
+            write_through(data, size);
+            return;
+          }
+        }
+        std::memcpy(buffer_ + buffered_, data, size);
+        buffered_ += size;
+      }
+
+      void flush() {
+        write_through(buffer_, buffered_);
+        buffered_ = 0;
+      }
+
+      void write_through(char const* data, std::size_t size) {
+        if (!ok_ || size == 0)
+          return;
+        ok_ = writer_.reserve(size);
+        if (ok_)
+          writer_.write(data, size);
+      }
+
+      Writer_type& writer_;
+      json_mode mode_;
+      char buffer_[k_buffer_size];
+      std::size_t buffered_;
+      bool ok_;
+    };
+
+    ///
+    /// Writes 'document' as Extended JSON into 'writer'.
+    ///
+    template<typename Writer_type>
+    bool transcode_to_json(document_view const& document, Writer_type& writer,
+                           json_mode mode = json_mode::relaxed) {
+      json_transcoder<Writer_type> transcoder(writer, mode);
+      return transcoder.transcode(document);
+    }
+
+    template<typename Writer_type>
+    bool json_transcoder<Writer_type>::write_document(document_view const& document, bool is_array) {
+      put_char(is_array ? '[' : '{');
+
+      bool first = true;
+      auto current = document.begin();
+      for (; current != document.end(); ++current) {
+        element_view const& element = *current;
+        if (!first)
+          put_char(',');
+        first = false;
+
+        if (!is_array) {
+          cstring_cdata const name = element.name();
+          write_string(name.data, name.size - 1);
+          put_char(':');
+        }
+        if (!write_value(element))
+          return false;
+      }
+      if (!current.ok())
+        return false;
+
+      put_char(is_array ? ']' : '}');
+      return true;
+    }
+
+    template<typename Writer_type>
+    bool json_transcoder<Writer_type>::write_value(element_view const& element) {
+      switch (element.type()) {
+        case types::floating_point:
+          write_double(element.as_floating_point());
+          return true;
+
+        case types::utf8_string: {
+          string_cdata const value = element.as_string();
+          write_string(value.data, value.size - 1);
+          return true;
+        }
+
+        case types::document:
+        case types::array:
+          return write_document(document_view(element.as_document()), element.type() == types::array);
+
+        case types::binary:
+          return write_binary(element);
+
+        case types::undefined_no_deprecated:
+          put_literal("{\"$undefined\":true}");
+          return true;
+
+        case types::object_id:
+          write_object_id(element.value());
+          return true;
+
+        case types::boolean:
+          if (element.as_boolean())
+            put_literal("true");
+          else
+            put_literal("false");
+          return true;
+
+        case types::utc_datetime:
+          write_date(element.as_int64());
+          return true;
+
+        case types::null:
+          put_literal("null");
+          return true;
+
+        case types::regex: {
+          char const* const pattern = reinterpret_cast<char const*>(element.value());
+          std::size_t const pattern_size = std::strlen(pattern);
+          char const* const options = pattern + pattern_size + 1;
+          put_literal("{\"$regularExpression\":{\"pattern\":");
+          write_string(pattern, pattern_size);
+          put_literal(",\"options\":");
+          write_string(options, std::strlen(options));
+          put_literal("}}");
+          return true;
+        }
+
+        case types::db_pointer_no_deprecated:
+          return write_db_pointer(element);
+
+        case types::javascript:
+        case types::symbol: {
+          string_cdata const value = element.as_string();
+          if (element.type() == types::javascript)
+            put_literal("{\"$code\":");
+          else
+            put_literal("{\"$symbol\":");
+          write_string(value.data, value.size - 1);
+          put_char('}');
+          return true;
+        }
+
+        case types::scoped_javascript:
+          return write_scoped_javascript(element);
+
+        case types::int32:
+        case types::int64: {
+          bool const is_int32 = (element.type() == types::int32);
+          std::int64_t const value = is_int32 ? element.as_int32() : element.as_int64();
+          if (mode_ == json_mode::relaxed) {
+            write_int64(value);
+            return true;
+          }
+          if (is_int32)
+            put_literal("{\"$numberInt\":\"");
+          else
+            put_literal("{\"$numberLong\":\"");
+          write_int64(value);
+          put_literal("\"}");
+          return true;
+        }
+
+        case types::timestamp: {
+          std::uint64_t const value = static_cast<std::uint64_t>(element.as_int64());
+          put_literal("{\"$timestamp\":{\"t\":");
+          write_int64(static_cast<std::int64_t>(value >> 32));
+          put_literal(",\"i\":");
+          write_int64(static_cast<std::int64_t>(value & 0xFFFFFFFFU));
+          put_literal("}}");
+          return true;
+        }
+
+        case types::min:
+          put_literal("{\"$minKey\":1}");
+          return true;
+
+        case types::max:
+          put_literal("{\"$maxKey\":1}");
+          return true;
+      }
+      return false;
+    }
+
+    template<typename Writer_type>
+    bool json_transcoder<Writer_type>::write_binary(element_view const& element) {
+      binary_cdata const value = element.as_binary();
+      byte_t const* data = static_cast<byte_t const*>(value.data);
+      std::size_t size = value.size;
+
+      // The old binary subtype repeats the length inside the value;
+      // Extended JSON carries only the bytes after it.
+      binary_subtypes const subtype = element.binary_subtype();
+      if (subtype == binary_subtypes::oldbinary) {
+        if (size < sizeof(length_t))
+          return false;
+        data += sizeof(length_t);
+        size -= sizeof(length_t);
+      }
+
+      put_literal("{\"$binary\":{\"base64\":\"");
+      while (size != 0) {
+        std::size_t const chunk = (size < k_base64_chunk) ? size : k_base64_chunk;
+        commit(json_details::format_base64(data, chunk, reserve(k_base64_chunk / 3 * 4)));
+        data += chunk;
+        size -= chunk;
+      }
+      put_literal("\",\"subType\":\"");
+      byte_t const subtype_byte = static_cast<byte_t>(subtype);
+      json_details::format_hex(&subtype_byte, 1, reserve(2));
+      commit(2);
+      put_literal("\"}}");
+      return true;
+    }
+
+    template<typename Writer_type>
+    bool json_transcoder<Writer_type>::write_db_pointer(element_view const& element) {
+      // The size of the value was worked out from the length of its
+      // string, so only the terminator is left to check.
+      byte_t const* const value = element.value();
+      length_t const length = element_details::read_little_endian<length_t>(value);
+      char const* const name = reinterpret_cast<char const*>(value + sizeof(length_t));
+      if (length < 1 || name[length - 1] != 0)
+        return false;
+
+      put_literal("{\"$dbPointer\":{\"$ref\":");
+      write_string(name, length - 1);
+      put_literal(",\"$id\":");
+      write_object_id(value + sizeof(length_t) + length);
+      put_literal("}}");
+      return true;
+    }
+
+    template<typename Writer_type>
+    bool json_transcoder<Writer_type>::write_scoped_javascript(element_view const& element) {
+      // The value is its total length, the code as a string, and the
+      // scope as a document, which must account for the rest of it.
+      byte_t const* const value = element.value();
+      std::size_t const size = element.value_size();
+      std::size_t const k_min_document_size = sizeof(length_t) + 1;
+      if (size < 2 * sizeof(length_t) + 1 + k_min_document_size)
+        return false;
+
+      length_t const code_length = element_details::read_little_endian<length_t>(value + sizeof(length_t));
+      std::size_t const scope_offset = 2 * sizeof(length_t) + code_length;
+      if (code_length < 1 || size - k_min_document_size < scope_offset)
+        return false;
+
+      char const* const code = reinterpret_cast<char const*>(value + 2 * sizeof(length_t));
+      length_t const scope_length = element_details::read_little_endian<length_t>(value + scope_offset);
+      if (code[code_length - 1] != 0 || static_cast<std::size_t>(scope_length) != size - scope_offset)
+        return false;
+
+      put_literal("{\"$code\":");
+      write_string(code, code_length - 1);
+      put_literal(",\"$scope\":");
+      if (!write_document(document_view(document_cdata(value + scope_offset, scope_length)), false))
+        return false;
+      put_char('}');
+      return true;
+    }
+
+    template<typename Writer_type>
+    void json_transcoder<Writer_type>::write_double(double_t value) {
+      if (mode_ == json_mode::relaxed && std::isfinite(value)) {
+        commit(json_details::format_double(value, reserve(json_details::k_max_number_size)));
+        return;
+      }
+      put_literal("{\"$numberDouble\":\"");
+      commit(json_details::format_double(value, reserve(json_details::k_max_number_size)));
+      put_literal("\"}");
+    }
+
+    template<typename Writer_type>
+    void json_transcoder<Writer_type>::write_date(std::int64_t value) {
+      put_literal("{\"$date\":");
+      if (mode_ == json_mode::relaxed) {
+        char* const out = reserve(json_details::k_max_number_size);
+        std::size_t const size = json_details::format_iso_date(value, out + 1);
+        if (size != 0) {
+          out[0] = '"';
+          out[size + 1] = '"';
+          commit(size + 2);
+          put_char('}');
+          return;
+        }
+      }
+      put_literal("{\"$numberLong\":\"");
+      write_int64(value);
+      put_literal("\"}}");
+    }
+
+    template<typename Writer_type>
+    void json_transcoder<Writer_type>::write_string(char const* data, std::size_t size) {
+      put_char('"');
+      char const* const end = data + size;
+      for (;;) {
+        char const* const special = json_details::find_escape(data, end);
+        put(data, special - data);
+        if (special == end)
+          break;
+        commit(json_details::format_escape(*special, reserve(json_details::k_max_number_size)));
+        data = special + 1;
+      }
+      put_char('"');
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_a210f993_28d6_4467_bd0b_b9a9ce0d05ff
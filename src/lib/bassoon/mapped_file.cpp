@@ -0,0 +1,71 @@
+#include <bassoon/mapped_file.hpp>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    mapped_file::mapped_file(char const* path) noexcept
+      : data_(nullptr)
+      , size_(0)
+      , error_(0) {
+
+      int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+      if (fd == -1) {
+        error_ = errno;
+        return;
+      }
+
+      struct stat status;
+      if (::fstat(fd, &status) == -1) {
+        error_ = errno;
+        ::close(fd);
+        return;
+      }
+
+      // mmap refuses zero length mappings, but an empty file is
+      // simply an empty sequence of documents.
+      if (status.st_size != 0) {
+        void* const data = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+          error_ = errno;
+        } else {
+          data_ = data;
+          size_ = status.st_size;
+
+          // These are only hints, so failures are ignored.
+          ::madvise(data_, size_, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+          ::madvise(data_, size_, MADV_HUGEPAGE);
+#endif
+        }
+      }
+
+      // The mapping holds its own reference to the file.
+      ::close(fd);
+    }
+
+    mapped_file::~mapped_file() {
+      if (data_)
+        ::munmap(data_, size_);
+    }
+
+    void mapped_file::will_need(std::size_t offset, std::size_t size) const noexcept {
+      if (offset >= size_)
+        return;
+      if (size > size_ - offset)
+        size = size_ - offset;
+
+      // madvise needs a page aligned address.
+      std::size_t const page_size = ::sysconf(_SC_PAGESIZE);
+      std::size_t const aligned = offset - (offset % page_size);
+      ::madvise(static_cast<char*>(data_) + aligned, size + (offset - aligned), MADV_WILLNEED);
+    }
+
+  } // namespace bson
+} // namespace bassoon
@@ -0,0 +1,72 @@
+#ifndef included_14c0e6df_741d_452f_af21_8d5c5a1327a0
+#define included_14c0e6df_741d_452f_af21_8d5c5a1327a0
+
+#include <cstddef>
+
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// A read-only memory mapping of an entire file, typically a
+    /// file of back to back BSON documents.
+    ///
+    /// The mapping is advised for sequential access, so the kernel
+    /// reads ahead aggressively and can drop pages behind us, and,
+    /// where the platform supports it, for transparent huge pages to
+    /// cut TLB misses over multi-GB files.
+    ///
+    /// Failure to open or map the file is not fatal: 'ok' returns
+    /// false, 'error' returns the errno value of the failed call, and
+    /// the mapping is empty.
+    ///
+    class LIBBASSOON_EXPORT mapped_file {
+    public:
+      explicit mapped_file(char const* path) noexcept;
+      ~mapped_file();
+
+      mapped_file(const mapped_file&) = delete;
+      mapped_file& operator=(const mapped_file&) = delete;
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      void const* data() const noexcept {
+        return data_;
+      }
+
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+      ///
+      /// Returns the file viewed as a sequence of BSON documents.
+      ///
+      document_sequence documents() const noexcept {
+        return document_sequence(data_, size_);
+      }
+
+      ///
+      /// Tells the kernel that we will soon read the 'size' bytes at
+      /// 'offset', so that it can start reading them in. Useful when
+      /// several threads each scan their own region of the file.
+      ///
+      void will_need(std::size_t offset, std::size_t size) const noexcept;
+
+    private:
+      void* data_;
+      std::size_t size_;
+      int error_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_14c0e6df_741d_452f_af21_8d5c5a1327a0
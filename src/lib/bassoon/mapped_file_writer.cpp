@@ -0,0 +1,119 @@
+#include <bassoon/mapped_file_writer.hpp>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      std::size_t round_up(std::size_t size, std::size_t multiple) {
+        return (size + multiple - 1) / multiple * multiple;
+      }
+
+    }  // namespace
+
+    mapped_file_writer::mapped_file_writer(char const* path, mapped_file_writer_options options) noexcept
+      : options_(options)
+      , fd_(-1)
+      , base_(nullptr)
+      , mapped_(0)
+      , used_(0)
+      , finished_(0)
+      , error_(0) {
+
+      std::size_t const page = ::sysconf(_SC_PAGESIZE);
+      options_.extent = round_up(options_.extent == 0 ? 1 : options_.extent, page);
+      options_.reservation = round_up(options_.reservation == 0 ? 1 : options_.reservation, page);
+
+      fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd_ == -1) {
+        fail(errno);
+        return;
+      }
+
+      // Address space only: nothing is committed until an extent of
+      // the file is mapped over it.
+      void* const reserved = ::mmap(nullptr, options_.reservation, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (reserved == MAP_FAILED) {
+        fail(errno);
+        return;
+      }
+      base_ = static_cast<byte_t*>(reserved);
+    }
+
+    mapped_file_writer::~mapped_file_writer() {
+      close();
+    }
+
+    bool mapped_file_writer::grow(std::size_t size) noexcept {
+      if (!ok())
+        return false;
+
+      std::size_t const wanted = round_up(used_ + size, options_.extent);
+      if (wanted > options_.reservation || wanted < used_)
+        return fail(EFBIG);
+
+      // Allocate the blocks now, so that a full disk is an error here
+      // rather than SIGBUS on a store into the mapping. Not every file
+      // system can; those just grow the file.
+      int const allocated = ::posix_fallocate(fd_, mapped_, wanted - mapped_);
+      if (allocated != 0) {
+        if (allocated != EOPNOTSUPP && allocated != EINVAL)
+          return fail(allocated);
+        if (::ftruncate(fd_, wanted) == -1)
+          return fail(errno);
+      }
+
+      void* const extent = ::mmap(base_ + mapped_, wanted - mapped_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_FIXED, fd_, mapped_);
+      if (extent == MAP_FAILED)
+        return fail(errno);
+
+      mapped_ = wanted;
+      return true;
+    }
+
+    bool mapped_file_writer::sync() noexcept {
+      if (fd_ == -1)
+        return fail(EBADF);
+      if (used_ != 0 && ::msync(base_, round_up(used_, ::sysconf(_SC_PAGESIZE)), MS_SYNC) == -1)
+        return fail(errno);
+      return ok();
+    }
+
+    bool mapped_file_writer::close() noexcept {
+      if (base_) {
+        if (options_.durable && fd_ != -1 && finished_ != 0 &&
+            ::msync(base_, round_up(finished_, ::sysconf(_SC_PAGESIZE)), MS_SYNC) == -1)
+          fail(errno);
+        ::munmap(base_, options_.reservation);
+        base_ = nullptr;
+      }
+
+      if (fd_ == -1)
+        return ok();
+
+      // Drop the unused part of the last extent, and any document
+      // that was not finished.
+      if (::ftruncate(fd_, finished_) == -1)
+        fail(errno);
+      if (options_.durable && ::fsync(fd_) == -1)
+        fail(errno);
+      if (::close(fd_) == -1)
+        fail(errno);
+      fd_ = -1;
+
+      // So that 'reserve' has to grow, and fails, from now on.
+      used_ = finished_;
+      mapped_ = used_;
+      return ok();
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
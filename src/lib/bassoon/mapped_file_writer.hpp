@@ -0,0 +1,143 @@
+#ifndef included_2d26e342_da6f_4f0c_93bc_efca50c7e6b1
+#define included_2d26e342_da6f_4f0c_93bc_efca50c7e6b1
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct mapped_file_writer_options {
+      // The file grows, and more of it is mapped, this many bytes at
+      // a time, rounded up to whole pages.
+      std::size_t extent = std::size_t(64) << 20;
+
+      // The address space set aside for the mapping, which is the
+      // most that the file can hold. It costs no memory until used.
+      std::size_t reservation = std::size_t(1) << 40;
+
+      // Have 'close' force the file to disk, and wait for it, before
+      // unmapping it.
+      bool durable = false;
+    };
+
+    ///
+    /// A writer that encodes straight into a memory mapping of an
+    /// output file, so that encoded bytes land in the page cache
+    /// without a staging buffer or a copy through write().
+    ///
+    /// The writer sets aside address space for the whole file up
+    /// front and maps the file into it an extent at a time as it
+    /// grows. The mapping never moves, so the cursors that the
+    /// encoder holds to backpatch lengths stay valid however far the
+    /// file grows. Each extent is allocated on disk before it is
+    /// mapped, where the file system allows, so that running out of
+    /// space fails 'reserve' rather than faulting on a later store.
+    ///
+    /// Documents are written back to back, one 'start_document' after
+    /// another. 'close', which the destructor calls, truncates the
+    /// file to the end of the last document finished, so that a
+    /// document left half written by a failure is not kept. 'sync'
+    /// forces what was written so far to disk.
+    ///
+    /// Failure is not fatal: 'reserve' fails, 'ok' returns false from
+    /// then on, and 'error' returns the errno value of what failed.
+    ///
+    class LIBBASSOON_EXPORT mapped_file_writer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<mapped_file_writer>;
+
+      explicit mapped_file_writer(char const* path,
+                                  mapped_file_writer_options options = mapped_file_writer_options()) noexcept;
+      ~mapped_file_writer();
+
+      mapped_file_writer(const mapped_file_writer&) = delete;
+      mapped_file_writer& operator=(const mapped_file_writer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        if (mapped_ - used_ >= size)
+          return ok();
+        return grow(size);
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, base_ + used_);
+      }
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(size <= mapped_ - used_);
+        std::memcpy(base_ + used_, data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        // After a failure, the encoder may still patch lengths past
+        // what it could reserve.
+        if (!ok())
+          return;
+        std::memcpy(cursor.address(), data, size);
+        // The length of a top level document is written last.
+        if (cursor.address() == base_ + finished_)
+          finished_ = used_;
+      }
+
+      ///
+      /// The bytes written so far.
+      ///
+      std::size_t valid() const noexcept {
+        return used_;
+      }
+
+      ///
+      /// Writes what was written so far to disk, and waits for it.
+      ///
+      bool sync() noexcept;
+
+      ///
+      /// Unmaps the file, truncates it to the documents finished and
+      /// closes it, forcing it to disk first if the options ask for
+      /// that. Nothing can be written afterwards.
+      ///
+      bool close() noexcept;
+
+    private:
+      bool grow(std::size_t size) noexcept;
+
+      bool fail(int error) noexcept {
+        if (error_ == 0)
+          error_ = error;
+        return false;
+      }
+
+      mapped_file_writer_options options_;
+      int fd_;
+      byte_t* base_;
+      std::size_t mapped_;
+      std::size_t used_;
+      std::size_t finished_;
+      int error_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_2d26e342_da6f_4f0c_93bc_efca50c7e6b1
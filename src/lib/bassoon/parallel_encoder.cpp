@@ -0,0 +1,234 @@
+#include <bassoon/parallel_encoder.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace {
+
+      // A range of runs, [begin, end), in one word, so that the owner
+      // taking from the front and thieves taking from the back agree
+      // with a compare and swap.
+      std::uint64_t pack(std::uint64_t begin, std::uint64_t end) {
+        return begin | end << 32;
+      }
+
+      std::size_t begin_of(std::uint64_t range) {
+        return range & 0xffffffff;
+      }
+
+      std::size_t end_of(std::uint64_t range) {
+        return range >> 32;
+      }
+
+    }  // namespace
+
+    struct parallel_encoder::worker {
+      explicit worker(arena_writer_options const& options)
+        : arena(options)
+        , runs(0) {}
+
+      arena_writer arena;
+      std::atomic<std::uint64_t> runs;
+      std::thread thread;
+    };
+
+    parallel_encoder::parallel_encoder(parallel_encoder_options options)
+      : options_(options)
+      , size_(0)
+      , error_(0)
+      , task_(nullptr)
+      , context_(nullptr)
+      , records_(0)
+      , grain_(1)
+      , failed_(false)
+      , batch_(0)
+      , participants_(0)
+      , pending_(0)
+      , stopping_(false) {
+
+      std::size_t threads = options_.threads;
+      if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+      options_.min_grain = std::max<std::size_t>(options_.min_grain, 1);
+
+      for (std::size_t i = 0; i != threads; ++i)
+        workers_.emplace_back(new worker(options_.arena));
+
+      // The calling thread is the first worker. If a thread can not
+      // be started, the destructor does not run, so stop the ones that
+      // were before passing the failure on.
+      try {
+        for (std::size_t i = 1; i != threads; ++i)
+          workers_[i]->thread = std::thread([this, i]() { loop(i); });
+      } catch (...) {
+        stop();
+        throw;
+      }
+    }
+
+    parallel_encoder::~parallel_encoder() {
+      stop();
+    }
+
+    void parallel_encoder::stop() noexcept {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      start_.notify_all();
+      for (auto& worker : workers_) {
+        if (worker->thread.joinable())
+          worker->thread.join();
+      }
+    }
+
+    void parallel_encoder::concatenate(std::vector<byte_t>& output) const {
+      output.reserve(output.size() + size_);
+      for (auto const& segment : segments_) {
+        byte_t const* const data = static_cast<byte_t const*>(segment.iov_base);
+        output.insert(output.end(), data, data + segment.iov_len);
+      }
+    }
+
+    bool parallel_encoder::run(std::size_t records, task_type task, void const* context) {
+      segments_.clear();
+      size_ = 0;
+      error_ = 0;
+      if (records == 0)
+        return true;
+
+      // Enough runs that a thread which falls behind can be helped,
+      // but no more than that.
+      std::size_t grain = options_.min_grain;
+      if (!options_.deterministic)
+        grain = std::max(grain, (records + workers_.size() * 8 - 1) / (workers_.size() * 8));
+      grain = std::max(grain, (records >> 31) + 1);
+
+      std::size_t const runs = (records + grain - 1) / grain;
+      std::size_t const participants = std::min(workers_.size(), runs);
+      runs_.resize(runs);
+
+      task_ = task;
+      context_ = context;
+      records_ = records;
+      grain_ = grain;
+      failed_.store(false, std::memory_order_relaxed);
+      for (std::size_t i = 0; i != participants; ++i) {
+        worker& current = *workers_[i];
+        current.arena.clear();
+        current.runs.store(pack(i * runs / participants, (i + 1) * runs / participants), std::memory_order_relaxed);
+      }
+
+      if (participants > 1) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          participants_ = participants;
+          pending_ = participants - 1;
+          ++batch_;
+        }
+        start_.notify_all();
+      }
+
+      work(0, participants);
+
+      if (participants > 1) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_.wait(lock, [this]() { return pending_ == 0; });
+      }
+
+      for (std::size_t i = 0; i != participants; ++i) {
+        if (!workers_[i]->arena.ok()) {
+          error_ = workers_[i]->arena.error();
+          return false;
+        }
+      }
+
+      for (auto const& result : runs_) {
+        byte_t* const data = const_cast<byte_t*>(workers_[result.worker]->arena.data()) + result.begin;
+        std::size_t const size = result.end - result.begin;
+        size_ += size;
+        if (!options_.deterministic && !segments_.empty()) {
+          iovec& last = segments_.back();
+          if (static_cast<byte_t*>(last.iov_base) + last.iov_len == data) {
+            last.iov_len += size;
+            continue;
+          }
+        }
+        segments_.push_back(iovec{ data, size });
+      }
+      return true;
+    }
+
+    void parallel_encoder::work(std::size_t index, std::size_t participants) noexcept {
+      worker& self = *workers_[index];
+      std::size_t run;
+      while (!failed_.load(std::memory_order_relaxed) && (take(self, run) || steal(index, participants, run))) {
+        std::size_t const begin = self.arena.valid();
+        task_(context_, self.arena, run * grain_, std::min(records_, (run + 1) * grain_));
+        runs_[run] = run_result{ static_cast<std::uint32_t>(index), begin, self.arena.valid() };
+        if (!self.arena.ok())
+          failed_.store(true, std::memory_order_relaxed);
+      }
+    }
+
+    bool parallel_encoder::take(worker& self, std::size_t& run) noexcept {
+      std::uint64_t range = self.runs.load(std::memory_order_acquire);
+      while (begin_of(range) < end_of(range)) {
+        if (self.runs.compare_exchange_weak(range, pack(begin_of(range) + 1, end_of(range)),
+                                            std::memory_order_acq_rel, std::memory_order_acquire)) {
+          run = begin_of(range);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool parallel_encoder::steal(std::size_t index, std::size_t participants, std::size_t& run) noexcept {
+      for (std::size_t i = 1; i < participants; ++i) {
+        worker& victim = *workers_[(index + i) % participants];
+        std::uint64_t range = victim.runs.load(std::memory_order_acquire);
+        while (begin_of(range) < end_of(range)) {
+          // The later half, rounded up, so that a last run is taken
+          // too. It becomes the thief's own, to take from the front.
+          std::size_t const end = end_of(range);
+          std::size_t const split = end - (end - begin_of(range) + 1) / 2;
+          if (victim.runs.compare_exchange_weak(range, pack(begin_of(range), split),
+                                                std::memory_order_acq_rel, std::memory_order_acquire)) {
+            run = split;
+            workers_[index]->runs.store(pack(split + 1, end), std::memory_order_release);
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    void parallel_encoder::loop(std::size_t index) noexcept {
+      std::uint64_t seen = 0;
+      for (;;) {
+        std::size_t participants;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          start_.wait(lock, [&]() { return stopping_ || batch_ != seen; });
+          if (stopping_)
+            return;
+          seen = batch_;
+          participants = participants_;
+        }
+
+        if (index >= participants)
+          continue;
+        work(index, participants);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0)
+          finished_.notify_one();
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,179 @@
+#ifndef included_32a15f5d_7769_4696_ba3c_b425e993aaef
+#define included_32a15f5d_7769_4696_ba3c_b425e993aaef
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <bassoon/arena_writer.hpp>
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct parallel_encoder_options {
+      // The threads to encode on, counting the calling thread, or one
+      // per core if zero.
+      std::size_t threads = 0;
+
+      // The fewest records handed to a thread at once. A batch of no
+      // more than this is encoded on the calling thread alone.
+      std::size_t min_grain = 512;
+
+      // Cut batches into runs of exactly 'min_grain' records, and give
+      // each its own segment, so that 'segments' is the same for the
+      // same input whatever the number of threads and however the
+      // work was shared out. Otherwise, runs are sized to the batch
+      // and the threads, and runs that one thread encoded one after
+      // another are joined into one segment. The bytes encoded are
+      // the same either way.
+      bool deterministic = false;
+
+      // For each thread's arena.
+      arena_writer_options arena;
+    };
+
+    ///
+    /// Encodes a batch of records into documents on a pool of threads,
+    /// and hands back the documents in the order of the records, as a
+    /// list of segments to pass to writev or as one buffer.
+    ///
+    /// The batch is cut into runs of records, which are dealt out
+    /// evenly to the threads, each of which encodes its runs, first
+    /// to last, into an arena_writer of its own. A thread that runs
+    /// out steals the later half of the runs that another has left,
+    /// so that a thread that draws expensive records, or is descheduled,
+    /// does not hold up the rest. The threads are started once, and
+    /// sleep between batches.
+    ///
+    /// The segments point into the arenas, and stay valid until the
+    /// next batch. The arenas keep their memory from batch to batch.
+    ///
+    /// A parallel_encoder encodes one batch at a time.
+    ///
+    class LIBBASSOON_EXPORT parallel_encoder {
+    public:
+      explicit parallel_encoder(parallel_encoder_options options = parallel_encoder_options());
+      ~parallel_encoder();
+
+      parallel_encoder(const parallel_encoder&) = delete;
+      parallel_encoder& operator=(const parallel_encoder&) = delete;
+
+      ///
+      /// Calls 'function(writer, *record)' for each record from
+      /// 'first' to 'last', which are random access iterators, to
+      /// encode it into 'writer', an arena_writer, as any number of
+      /// top level documents: usually one, begun with start_document.
+      ///
+      /// 'function' is called concurrently and must not throw. Returns
+      /// false if some arena ran out of room, in which case 'error'
+      /// says why, and there are no segments. The batch stops early:
+      /// once one arena fails, every thread stops after the record it
+      /// is encoding.
+      ///
+      template<typename Iterator, typename Function>
+      bool encode(Iterator first, Iterator last, Function function) {
+        auto const task = [&](arena_writer& writer, std::size_t begin, std::size_t end) {
+          for (Iterator record = first + begin, stop = first + end;
+               record != stop && writer.ok() && !failed_.load(std::memory_order_relaxed); ++record)
+            function(writer, *record);
+        };
+        return run(static_cast<std::size_t>(std::distance(first, last)), &invoke<decltype(task)>, &task);
+      }
+
+      ///
+      /// The documents of the last batch, in order.
+      ///
+      std::vector<iovec> const& segments() const noexcept {
+        return segments_;
+      }
+
+      ///
+      /// The bytes of the documents of the last batch.
+      ///
+      std::size_t size() const noexcept {
+        return size_;
+      }
+
+      ///
+      /// Appends the documents of the last batch, back to back, to
+      /// 'output'.
+      ///
+      void concatenate(std::vector<byte_t>& output) const;
+
+      ///
+      /// The errno value of the first arena to fail in the last batch,
+      /// or zero.
+      ///
+      int error() const noexcept {
+        return error_;
+      }
+
+      std::size_t threads() const noexcept {
+        return workers_.size();
+      }
+
+    private:
+      // A thread, its arena, and the runs it has left.
+      struct worker;
+
+      // Where a run of records was encoded.
+      struct run_result {
+        std::uint32_t worker;
+        std::size_t begin;
+        std::size_t end;
+      };
+
+      using task_type = void (*)(void const* task, arena_writer& writer, std::size_t begin, std::size_t end);
+
+      template<typename Task>
+      static void invoke(void const* task, arena_writer& writer, std::size_t begin, std::size_t end) {
+        (*static_cast<Task const*>(task))(writer, begin, end);
+      }
+
+      bool run(std::size_t records, task_type task, void const* context);
+      void work(std::size_t index, std::size_t participants) noexcept;
+      bool take(worker& self, std::size_t& run) noexcept;
+      bool steal(std::size_t index, std::size_t participants, std::size_t& run) noexcept;
+      void loop(std::size_t index) noexcept;
+      void stop() noexcept;
+
+      parallel_encoder_options options_;
+      std::vector<std::unique_ptr<worker>> workers_;
+      std::vector<iovec> segments_;
+      std::size_t size_;
+      int error_;
+
+      // The batch in hand, which the workers read once woken.
+      task_type task_;
+      void const* context_;
+      std::size_t records_;
+      std::size_t grain_;
+      std::vector<run_result> runs_;
+
+      // Set by the first thread whose arena fails, to stop the rest.
+      std::atomic<bool> failed_;
+
+      // Guards the rest, with which the calling thread starts the
+      // workers on a batch and waits for them to finish it.
+      std::mutex mutex_;
+      std::condition_variable start_;
+      std::condition_variable finished_;
+      std::uint64_t batch_;
+      std::size_t participants_;
+      std::size_t pending_;
+      bool stopping_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_32a15f5d_7769_4696_ba3c_b425e993aaef
@@ -0,0 +1,102 @@
+#ifndef included_30f9d901_2823_4782_b969_3bc3637056f1
+#define included_30f9d901_2823_4782_b969_3bc3637056f1
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <bassoon/document_sequence.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct scan_result {
+      // The number of well formed documents found.
+      std::size_t documents;
+
+      // The number of bytes that those documents cover.
+      std::size_t size;
+
+      // False if the input ended with malformed data, which then
+      // starts at offset 'size'.
+      bool ok;
+    };
+
+    // Runs smaller than this cost more to hand out than to scan.
+    const std::size_t k_min_scan_run_size = 1U << 20;
+
+    ///
+    /// Scans 'sequence' on 'threads' threads, counting the calling
+    /// thread, or on one thread per core if 'threads' is zero.
+    ///
+    /// A cheap serial first pass follows the length prefixes to cut
+    /// the sequence into contiguous runs of whole documents, reading
+    /// one cache line per document. The runs are then handed out to
+    /// the threads, each of which calls 'function(run)' with a
+    /// document_sequence for every run it draws. We cut several runs
+    /// per thread so that a thread that draws expensive documents
+    /// does not hold up the rest.
+    ///
+    /// 'function' is called concurrently and must not throw.
+    /// Malformed data ends the scan: nothing past it is handed out.
+    ///
+    template<typename Function>
+    scan_result parallel_scan(document_sequence const& sequence, std::size_t threads, Function function) {
+      if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
+      std::size_t const run_size = std::max(k_min_scan_run_size, sequence.size() / (threads * 8));
+
+      byte_t const* const base = static_cast<byte_t const*>(sequence.data());
+      std::vector<document_sequence> runs;
+      scan_result result = { 0, 0, true };
+      std::size_t run_start = 0;
+
+      auto current = sequence.begin();
+      auto const end = sequence.end();
+      for (; current != end; ++current) {
+        ++result.documents;
+        std::size_t const next = current.offset() + (*current).size;
+        if (next - run_start >= run_size) {
+          runs.emplace_back(base + run_start, next - run_start);
+          run_start = next;
+        }
+      }
+
+      result.ok = current.ok();
+      result.size = current.offset();
+      if (result.size != run_start)
+        runs.emplace_back(base + run_start, result.size - run_start);
+
+      std::atomic<std::size_t> next_run(0);
+      auto const worker = [&]() {
+        std::size_t run;
+        while ((run = next_run.fetch_add(1, std::memory_order_relaxed)) < runs.size())
+          function(runs[run]);
+      };
+
+      std::vector<std::thread> pool;
+      threads = std::min(threads, runs.size());
+      try {
+        for (std::size_t i = 1; i < threads; ++i)
+          pool.emplace_back(worker);
+      } catch (...) {
+        // A thread that is destroyed joinable terminates the program,
+        // so wait for those that started, which share out every run
+        // between them, before passing the failure on.
+        for (auto& thread : pool)
+          thread.join();
+        throw;
+      }
+      worker();
+      for (auto& thread : pool)
+        thread.join();
+
+      return result;
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_30f9d901_2823_4782_b969_3bc3637056f1
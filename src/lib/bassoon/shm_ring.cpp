@@ -0,0 +1,477 @@
+#include <bassoon/shm_ring.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace shm_ring_details {
+
+      static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                    "The ring's atomics must work across processes");
+
+      std::uint64_t const k_magic = 0x676e6972736e7362ULL;  // "bsnsring"
+      std::uint32_t const k_version = 3;
+
+      enum slot_state : std::uint32_t {
+        k_free,
+        k_active,
+      };
+
+      // An owner that is neither free nor a reader: the producer,
+      // while it frees the slot of one that died.
+      std::uint64_t const k_reclaiming = ~std::uint64_t(0);
+
+      struct alignas(64) slot {
+        std::atomic<std::uint32_t> state;
+
+        // Zero if the slot is free. Otherwise the reader's pid, in the
+        // low half, and the low half of when its process started, or
+        // zero if unknown, in the high half, which tells it from a
+        // later process given the same pid. A reader claims the slot
+        // by setting both at once, so that there is never a claim
+        // that does not say whose it is.
+        std::atomic<std::uint64_t> owner;
+
+        // The start of the oldest document the reader may still be
+        // looking at.
+        std::atomic<std::uint64_t> position;
+      };
+
+      struct header {
+        std::atomic<std::uint64_t> magic;
+        std::uint32_t version;
+        std::uint64_t capacity;
+
+        // Written by the producer. 'sequence' is the futex that
+        // readers sleep on, and 'waiters' counts them.
+        alignas(64) std::atomic<std::uint64_t> published;
+        std::atomic<std::uint32_t> sequence;
+        std::atomic<std::uint32_t> waiters;
+        std::atomic<std::uint32_t> closed;
+
+        // Written by the readers: the futex that the producer sleeps
+        // on, and whether it does.
+        alignas(64) std::atomic<std::uint32_t> consumed;
+        std::atomic<std::uint32_t> producer_waiting;
+
+        slot slots[k_max_shm_ring_readers];
+      };
+
+    }  // namespace shm_ring_details
+
+    namespace {
+
+      using shm_ring_details::header;
+
+      // How long the producer sleeps on readers before it checks that
+      // they are still alive.
+      long const k_reader_check_nanoseconds = 100 * 1000 * 1000;
+
+      std::size_t page_size() {
+        return ::sysconf(_SC_PAGESIZE);
+      }
+
+      std::size_t header_size() {
+        return (sizeof(header) + page_size() - 1) / page_size() * page_size();
+      }
+
+      int futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected, timespec const* timeout) {
+        return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, timeout,
+                         nullptr, 0);
+      }
+
+      void futex_wake(std::atomic<std::uint32_t>& word, int count) {
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+      }
+
+      // When the process 'pid' started, in clock ticks since boot, or
+      // zero if there is no such process or it can not be seen.
+      std::uint64_t process_start_time(pid_t pid) {
+        char path[32];
+        std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+        int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+          return 0;
+        char stat[1024];
+        ssize_t const size = ::read(fd, stat, sizeof(stat) - 1);
+        ::close(fd);
+        if (size <= 0)
+          return 0;
+        stat[size] = '\0';
+
+        // The second field, the command, is in parentheses and may
+        // hold anything, so count the rest from its end. The start
+        // time is the twenty second.
+        char const* field = std::strrchr(stat, ')');
+        for (int i = 2; field && i != 22; ++i)
+          field = std::strchr(field + 1, ' ');
+        return field ? std::strtoull(field + 1, nullptr, 10) : 0;
+      }
+
+      std::uint64_t make_owner(pid_t pid) {
+        std::uint64_t const started = process_start_time(pid) & 0xffffffffU;
+        return started << 32 | static_cast<std::uint32_t>(pid);
+      }
+
+      // Whether 'owner', taken from a slot, is a reader that died. A
+      // process with its pid is only it if it started when it did, as
+      // pids are reused; where that can not be seen, any process will
+      // do.
+      bool owner_died(std::uint64_t owner) {
+        if (owner == 0 || owner == shm_ring_details::k_reclaiming)
+          return false;
+        pid_t const pid = static_cast<pid_t>(owner & 0xffffffffU);
+        std::uint64_t const started = owner >> 32;
+        std::uint64_t const now = process_start_time(pid);
+        if (now == 0)
+          return ::kill(pid, 0) == -1 && errno == ESRCH;
+        return started != 0 && (now & 0xffffffffU) != started;
+      }
+
+      // Claims a free slot for 'self' or, if 'take_over', one whose
+      // reader died. Returns its index, or k_max_shm_ring_readers if
+      // there is none.
+      std::size_t claim_slot(header& ring, std::uint64_t self, bool take_over) {
+        for (std::size_t i = 0; i != k_max_shm_ring_readers; ++i) {
+          std::uint64_t owner = take_over ? ring.slots[i].owner.load(std::memory_order_seq_cst) : 0;
+          if ((!take_over || owner_died(owner)) && ring.slots[i].owner.compare_exchange_strong(owner, self))
+            return i;
+        }
+        return k_max_shm_ring_readers;
+      }
+
+      // Maps the header, then the data, then the data again straight
+      // after it. Returns the header, or null with errno set.
+      header* map_ring(int fd, std::size_t capacity) {
+        std::size_t const head = header_size();
+        void* const reserved = ::mmap(nullptr, head + 2 * capacity, PROT_NONE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED)
+          return nullptr;
+
+        byte_t* const base = static_cast<byte_t*>(reserved);
+        if (::mmap(base, head + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            ::mmap(base + head + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, head) ==
+              MAP_FAILED) {
+          int const error = errno;
+          ::munmap(reserved, head + 2 * capacity);
+          errno = error;
+          return nullptr;
+        }
+        return reinterpret_cast<header*>(base);
+      }
+
+      void unmap_ring(header* ring, std::size_t capacity) {
+        ::munmap(ring, header_size() + 2 * capacity);
+      }
+
+      byte_t* ring_data(header* ring) {
+        return reinterpret_cast<byte_t*>(ring) + header_size();
+      }
+
+    }  // namespace
+
+    shm_ring_writer::shm_ring_writer(shm_ring_options options)
+      : name_(options.name ? options.name : "")
+      , fd_(-1)
+      , header_(nullptr)
+      , data_(nullptr)
+      , capacity_(0)
+      , published_(0)
+      , used_(0)
+      , limit_(0)
+      , start_(nullptr)
+      , error_(0) {
+
+      std::size_t const page = page_size();
+      std::size_t const capacity = (std::max<std::size_t>(options.capacity, 1) + page - 1) / page * page;
+
+      if (options.name)
+        fd_ = ::shm_open(options.name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+      else
+        fd_ = ::memfd_create("bassoon-shm-ring", MFD_CLOEXEC);
+      if (fd_ == -1) {
+        name_.clear();
+        fail(errno);
+        return;
+      }
+
+      if (::ftruncate(fd_, header_size() + capacity) == -1) {
+        fail(errno);
+        return;
+      }
+
+      header* const ring = map_ring(fd_, capacity);
+      if (!ring) {
+        fail(errno);
+        return;
+      }
+
+      // The segment starts out zeroed, which is every field's initial
+      // value; construct them properly all the same. The magic number
+      // goes last, so a reader never attaches to half a header.
+      new (ring) header();
+      ring->version = shm_ring_details::k_version;
+      ring->capacity = capacity;
+      ring->magic.store(shm_ring_details::k_magic, std::memory_order_release);
+
+      header_ = ring;
+      data_ = ring_data(ring);
+      capacity_ = capacity;
+      limit_ = capacity;
+      start_ = data_;
+    }
+
+    shm_ring_writer::~shm_ring_writer() {
+      close();
+      if (header_)
+        unmap_ring(header_, capacity_);
+      if (fd_ != -1)
+        ::close(fd_);
+      if (!name_.empty())
+        ::shm_unlink(name_.c_str());
+    }
+
+    void shm_ring_writer::close() noexcept {
+      if (!header_ || header_->closed.load(std::memory_order_relaxed))
+        return;
+      header_->closed.store(1, std::memory_order_release);
+      header_->sequence.fetch_add(1, std::memory_order_seq_cst);
+      futex_wake(header_->sequence, INT_MAX);
+
+      // So that 'reserve' has to make room, and fails, from now on.
+      limit_ = 0;
+    }
+
+    bool shm_ring_writer::make_room(std::size_t size) noexcept {
+      if (!ok())
+        return false;
+      if (header_->closed.load(std::memory_order_relaxed))
+        return fail(EPIPE);
+      if (used_ + size - published_ > capacity_)
+        return fail(EMSGSIZE);
+
+      header& ring = *header_;
+      for (;;) {
+        // Announce the wait before looking at the readers, so that one
+        // that moves on after the look sees it, and wakes us.
+        ring.producer_waiting.store(1, std::memory_order_seq_cst);
+        std::uint32_t const consumed = ring.consumed.load(std::memory_order_seq_cst);
+
+        std::uint64_t oldest = published_;
+        for (auto& slot : ring.slots) {
+          if (slot.state.load(std::memory_order_seq_cst) == shm_ring_details::k_active)
+            oldest = std::min(oldest, slot.position.load(std::memory_order_seq_cst));
+        }
+
+        if (used_ + size <= oldest + capacity_) {
+          ring.producer_waiting.store(0, std::memory_order_relaxed);
+          limit_ = oldest + capacity_;
+          return true;
+        }
+
+        timespec const timeout = { 0, k_reader_check_nanoseconds };
+        if (futex_wait(ring.consumed, consumed, &timeout) == -1 && errno == ETIMEDOUT) {
+          // Free the slots of readers that died without detaching,
+          // whether or not they got as far as becoming active. Take
+          // each from its owner first, so that a reader taking it
+          // over at the same time does not have it freed under it.
+          for (auto& slot : ring.slots) {
+            std::uint64_t owner = slot.owner.load(std::memory_order_seq_cst);
+            if (owner_died(owner) &&
+                slot.owner.compare_exchange_strong(owner, shm_ring_details::k_reclaiming)) {
+              slot.state.store(shm_ring_details::k_free, std::memory_order_seq_cst);
+              slot.owner.store(0, std::memory_order_seq_cst);
+            }
+          }
+        }
+      }
+    }
+
+    void shm_ring_writer::publish() noexcept {
+      published_ = used_;
+      start_ = data_ + published_ % capacity_;
+
+      header& ring = *header_;
+      ring.published.store(published_, std::memory_order_release);
+
+      // Read 'waiters' with a read-modify-write, which orders it after
+      // the store above: a reader increments it before it looks at
+      // 'published' and sleeps, so either it sees the document, or we
+      // see it, and wake it.
+      if (ring.waiters.fetch_add(0, std::memory_order_seq_cst) != 0) {
+        ring.sequence.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(ring.sequence, INT_MAX);
+      }
+    }
+
+    shm_ring_reader::shm_ring_reader(int fd) noexcept
+      : header_(nullptr)
+      , data_(nullptr)
+      , capacity_(0)
+      , slot_(0)
+      , position_(0)
+      , current_(0)
+      , error_(0) {
+      attach(fd);
+    }
+
+    shm_ring_reader::shm_ring_reader(char const* name) noexcept
+      : header_(nullptr)
+      , data_(nullptr)
+      , capacity_(0)
+      , slot_(0)
+      , position_(0)
+      , current_(0)
+      , error_(0) {
+
+      int const fd = ::shm_open(name, O_RDWR | O_CLOEXEC, 0);
+      if (fd == -1) {
+        fail(errno);
+        return;
+      }
+      attach(fd);
+      ::close(fd);
+    }
+
+    shm_ring_reader::~shm_ring_reader() {
+      if (!header_)
+        return;
+      if (ok()) {
+        header_->slots[slot_].state.store(shm_ring_details::k_free, std::memory_order_seq_cst);
+        header_->slots[slot_].owner.store(0, std::memory_order_seq_cst);
+        if (header_->producer_waiting.load(std::memory_order_seq_cst)) {
+          header_->consumed.fetch_add(1, std::memory_order_seq_cst);
+          futex_wake(header_->consumed, 1);
+        }
+      }
+      unmap_ring(header_, capacity_);
+    }
+
+    void shm_ring_reader::attach(int fd) noexcept {
+      struct stat status;
+      if (::fstat(fd, &status) == -1) {
+        fail(errno);
+        return;
+      }
+      if (static_cast<std::size_t>(status.st_size) <= header_size()) {
+        fail(EINVAL);
+        return;
+      }
+
+      std::size_t const capacity = status.st_size - header_size();
+      header* const ring = map_ring(fd, capacity);
+      if (!ring) {
+        fail(errno);
+        return;
+      }
+      header_ = ring;
+      data_ = ring_data(ring);
+      capacity_ = capacity;
+
+      if (ring->magic.load(std::memory_order_acquire) != shm_ring_details::k_magic ||
+          ring->version != shm_ring_details::k_version || ring->capacity != capacity) {
+        fail(EINVAL);
+        return;
+      }
+
+      // Claim a free slot or, failing that, take over one whose reader
+      // died, which only the producer would otherwise notice, and only
+      // if that reader held it up.
+      std::uint64_t const self = make_owner(::getpid());
+      slot_ = claim_slot(*ring, self, false);
+      if (slot_ == k_max_shm_ring_readers)
+        slot_ = claim_slot(*ring, self, true);
+      if (slot_ == k_max_shm_ring_readers) {
+        fail(EBUSY);
+        return;
+      }
+
+      // Become visible to the producer at a position no later than
+      // where we will start, and only then pick where to start: the
+      // producer can not have gone a whole ring past anything
+      // published after it could see us. A slot taken over may still
+      // be active at its last reader's position, which holds the
+      // producer back until then, and no further.
+      auto& slot = ring->slots[slot_];
+      slot.position.store(ring->published.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+      slot.state.store(shm_ring_details::k_active, std::memory_order_seq_cst);
+      position_ = ring->published.load(std::memory_order_seq_cst);
+      slot.position.store(position_, std::memory_order_seq_cst);
+    }
+
+    document_cdata shm_ring_reader::try_next() noexcept {
+      if (!ok())
+        return document_cdata(nullptr, 0);
+
+      header& ring = *header_;
+      if (current_ != 0) {
+        // Hand the last document back to the producer.
+        position_ += current_;
+        current_ = 0;
+        ring.slots[slot_].position.store(position_, std::memory_order_seq_cst);
+        if (ring.producer_waiting.load(std::memory_order_seq_cst)) {
+          ring.consumed.fetch_add(1, std::memory_order_seq_cst);
+          futex_wake(ring.consumed, 1);
+        }
+      }
+
+      std::uint64_t const published = ring.published.load(std::memory_order_acquire);
+      if (published == position_)
+        return document_cdata(nullptr, 0);
+
+      byte_t const* const data = data_ + position_ % capacity_;
+      std::uint64_t const available = published - position_;
+      length_t const length = document_cdata(data).size;
+      if (length <= static_cast<length_t>(sizeof(length_t)) || static_cast<std::uint64_t>(length) > available ||
+          data[length - 1] != 0) {
+        fail(EBADMSG);
+        return document_cdata(nullptr, 0);
+      }
+
+      current_ = length;
+      return document_cdata(data, length);
+    }
+
+    document_cdata shm_ring_reader::next() noexcept {
+      for (;;) {
+        {
+          document_cdata const document = try_next();
+          if (document.data || !ok())
+            return document;
+        }
+
+        header& ring = *header_;
+        ring.waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::uint32_t const sequence = ring.sequence.load(std::memory_order_seq_cst);
+        bool const idle = ring.published.load(std::memory_order_seq_cst) == position_;
+        bool const closed = ring.closed.load(std::memory_order_acquire) != 0;
+        if (idle && !closed)
+          futex_wait(ring.sequence, sequence, nullptr);
+        ring.waiters.fetch_sub(1, std::memory_order_relaxed);
+
+        // Closed, and nothing more was published before it was.
+        if (idle && closed && ring.published.load(std::memory_order_acquire) == position_)
+          return document_cdata(nullptr, 0);
+      }
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,242 @@
+#ifndef included_d9e53054_8af8_4570_95aa_b62d37e37fa2
+#define included_d9e53054_8af8_4570_95aa_b62d37e37fa2
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/document_data.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    namespace shm_ring_details {
+      // The control block at the start of the segment.
+      struct header;
+    }  // namespace shm_ring_details
+
+    // The most readers that can attach to a ring at once.
+    const std::size_t k_max_shm_ring_readers = 32;
+
+    struct shm_ring_options {
+      // The bytes of documents that the ring holds, rounded up to
+      // whole pages. It bounds the size of a document.
+      std::size_t capacity = std::size_t(16) << 20;
+
+      // With a name, the segment is made with shm_open, and readers
+      // can open it by name; the writer unlinks it when it goes.
+      // Without, it is an anonymous memfd, which readers open from an
+      // inherited or passed file descriptor: see 'fd'.
+      char const* name = nullptr;
+    };
+
+    ///
+    /// The producer end of a ring of documents in shared memory, and a
+    /// writer that encodes straight into it, for passing documents to
+    /// consumer processes on the same host without copying them.
+    ///
+    /// The ring has one producer and up to 'k_max_shm_ring_readers'
+    /// consumers, each of which sees every document. A document is
+    /// encoded in place, in the next free bytes of the ring, and
+    /// published by a release store of the ring's write position when
+    /// its top level 'finish' writes its length. Consumers never see a
+    /// partial document.
+    ///
+    /// The producer never overwrites a document that some consumer has
+    /// not moved past: 'reserve' waits for the slowest. It sleeps on a
+    /// futex, as consumers waiting for documents do, so that neither
+    /// side spins, and neither makes a system call while the other is
+    /// awake. A consumer that dies without detaching, even partway
+    /// through attaching, is noticed while the producer waits on it,
+    /// and dropped, or when another finds no free slot, and takes its
+    /// slot. It is known by its pid and when its process started, so
+    /// that a process that is later given the same pid does not keep
+    /// it.
+    ///
+    /// The data is mapped twice end to end, as in streaming_writer,
+    /// so documents are contiguous even where they wrap.
+    ///
+    /// A document larger than the ring fails 'reserve' with EMSGSIZE.
+    /// As with any failure, 'ok' returns false from then on, and
+    /// 'error' returns the errno value of what failed.
+    ///
+    class LIBBASSOON_EXPORT shm_ring_writer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<shm_ring_writer>;
+
+      explicit shm_ring_writer(shm_ring_options options = shm_ring_options());
+
+      ///
+      /// Closes the ring, as 'close' does, and unlinks a named one.
+      ///
+      ~shm_ring_writer();
+
+      shm_ring_writer(const shm_ring_writer&) = delete;
+      shm_ring_writer& operator=(const shm_ring_writer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        if (used_ + size <= limit_)
+          return ok();
+        return make_room(size);
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, start_ + (used_ - published_));
+      }
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(used_ + size <= limit_);
+        std::memcpy(start_ + (used_ - published_), data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        // After a failure, the encoder may still patch lengths past
+        // what it could reserve, over documents not yet consumed.
+        if (!ok())
+          return;
+        std::memcpy(cursor.address(), data, size);
+        if (cursor.address() == start_ && used_ != published_)
+          publish();
+      }
+
+      ///
+      /// The segment, for a consumer process to map with a reader. It
+      /// is close-on-exec: clear that to pass it through exec.
+      ///
+      int fd() const noexcept {
+        return fd_;
+      }
+
+      ///
+      /// Tells the consumers that no more documents are coming: once
+      /// they have read what was published, 'next' returns null.
+      /// Nothing can be written afterwards.
+      ///
+      void close() noexcept;
+
+      ///
+      /// The bytes of documents published so far.
+      ///
+      std::uint64_t published() const noexcept {
+        return published_;
+      }
+
+    private:
+      bool make_room(std::size_t size) noexcept;
+      void publish() noexcept;
+
+      bool fail(int error) noexcept {
+        if (error_ == 0)
+          error_ = error;
+        return false;
+      }
+
+      std::string name_;
+      int fd_;
+      shm_ring_details::header* header_;
+      byte_t* data_;
+      std::size_t capacity_;
+
+      // Positions in the ring's stream of bytes, which only grow: the
+      // end of what is published, the end of what is written, and how
+      // far the writer may go without waiting on the consumers. The
+      // document in progress starts at 'start_' in memory.
+      std::uint64_t published_;
+      std::uint64_t used_;
+      std::uint64_t limit_;
+      byte_t* start_;
+
+      int error_;
+    };
+
+    ///
+    /// A consumer of a shm_ring_writer's ring, in this process or
+    /// another, which reads the documents published after it attaches.
+    ///
+    /// Documents are read in place: each stays valid, and the producer
+    /// waits rather than overwrite it, until the next call to 'next'
+    /// or 'try_next'. Read them promptly, as a slow reader holds up the
+    /// producer. A reader belongs to one thread.
+    ///
+    class LIBBASSOON_EXPORT shm_ring_reader {
+    public:
+      ///
+      /// Attaches to the ring in 'fd', which stays open.
+      ///
+      explicit shm_ring_reader(int fd) noexcept;
+
+      ///
+      /// Attaches to the ring named 'name'.
+      ///
+      explicit shm_ring_reader(char const* name) noexcept;
+
+      ~shm_ring_reader();
+
+      shm_ring_reader(const shm_ring_reader&) = delete;
+      shm_ring_reader& operator=(const shm_ring_reader&) = delete;
+
+      ///
+      /// The next document, waiting for it to be published. Null once
+      /// the producer has closed the ring and every document published
+      /// before that has been read, or on failure.
+      ///
+      document_cdata next() noexcept;
+
+      ///
+      /// The next document, or null if none is published yet.
+      ///
+      document_cdata try_next() noexcept;
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+    private:
+      void attach(int fd) noexcept;
+
+      bool fail(int error) noexcept {
+        if (error_ == 0)
+          error_ = error;
+        return false;
+      }
+
+      shm_ring_details::header* header_;
+      byte_t* data_;
+      std::size_t capacity_;
+      std::size_t slot_;
+
+      // Where the document last handed out starts, and its size.
+      std::uint64_t position_;
+      std::size_t current_;
+
+      int error_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_d9e53054_8af8_4570_95aa_b62d37e37fa2
@@ -0,0 +1,510 @@
+#ifndef included_060f07a4_2fb2_4388_9db8_695a37c54e2a
+#define included_060f07a4_2fb2_4388_9db8_695a37c54e2a
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <bassoon/decoder_handler.hpp>
+#include <bassoon/element_view.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    enum class streaming_decoder_status {
+      ok,
+      stopped,
+      invalid
+    };
+
+    ///
+    /// A resumable BSON decoder that accepts its input in arbitrarily
+    /// sized chunks, as it arrives from a socket or a pipe, and
+    /// delivers the events described in decoder_handler.hpp to
+    /// 'Handler_type'. Any number of back to back top level
+    /// documents may be fed through a single decoder.
+    ///
+    /// Elements that lie entirely within one chunk are delivered
+    /// zero-copy, pointing into the caller's chunk. The decoder only
+    /// copies bytes that straddle a chunk boundary: a pending length
+    /// prefix or fixed width value (at most twelve bytes), a partial
+    /// element name, and, for variable length values (strings,
+    /// binary, regex, code) that span chunks, the bytes of that one
+    /// value. Apart from that, its only state is a stack holding the
+    /// number of bytes left in each open document.
+    ///
+    /// The caller may reuse the memory passed to 'feed' as soon as
+    /// 'feed' returns.
+    ///
+    template<typename Handler_type>
+    class streaming_decoder {
+    public:
+      using handler_type = Handler_type;
+
+      explicit streaming_decoder(handler_type& handler)
+        : handler_(handler) {
+        reset();
+      }
+
+      streaming_decoder(const streaming_decoder&) = delete;
+      streaming_decoder& operator=(const streaming_decoder&) = delete;
+
+      ///
+      /// Decodes the next 'size' bytes of the stream, delivering
+      /// events for every element that they complete. Returns the
+      /// number of bytes consumed, which is 'size' unless the handler
+      /// stopped decoding or the input was found to be invalid.
+      ///
+      std::size_t feed(void const* data, std::size_t size) {
+        byte_t const* const begin = static_cast<byte_t const*>(data);
+        byte_t const* const end = begin + size;
+        byte_t const* current = begin;
+
+        while (current != end && ok()) {
+          switch (state_) {
+            case state::length:
+              current = consume_length(current, end);
+              break;
+            case state::type:
+              current = consume_type(current, end);
+              break;
+            case state::name:
+              current = consume_name(current, end);
+              break;
+            case state::value:
+              current = consume_value(current, end);
+              break;
+          }
+        }
+
+        // An element name that we have not yet delivered may still
+        // point into the caller's chunk, which goes away when we
+        // return, so move it into our own storage.
+        if (name_pending_ && name_data_ != name_.data()) {
+          name_.assign(name_data_, name_size_);
+          name_data_ = name_.data();
+        }
+
+        return current - begin;
+      }
+
+      ///
+      /// Returns true if neither the handler nor invalid input has
+      /// stopped the decoder.
+      ///
+      bool ok() const noexcept {
+        return status_ == streaming_decoder_status::ok;
+      }
+
+      streaming_decoder_status status() const noexcept {
+        return status_;
+      }
+
+      ///
+      /// Returns true if the decoder sits between two top level
+      /// documents, holding no partial state.
+      ///
+      bool idle() const noexcept {
+        return frames_.empty() && pending_size_ == 0;
+      }
+
+      ///
+      /// Returns the number of currently open documents and arrays.
+      ///
+      std::size_t depth() const noexcept {
+        return frames_.size();
+      }
+
+      ///
+      /// Discards all partial state, including a stopped or invalid
+      /// status. The next byte fed is taken to begin a new top level
+      /// document.
+      ///
+      void reset() {
+        state_ = state::length;
+        status_ = streaming_decoder_status::ok;
+        frames_.clear();
+        pending_size_ = 0;
+        name_.clear();
+        name_data_ = nullptr;
+        name_size_ = 0;
+        name_pending_ = false;
+        value_.clear();
+      }
+
+    private:
+      enum class state {
+        length,
+        type,
+        name,
+        value
+      };
+
+      // One open document or array. 'remaining' counts the bytes after
+      // its length prefix that we have not consumed yet, including
+      // the trailing null byte.
+      struct frame {
+        std::size_t remaining;
+      };
+
+      // Returns a pointer to 'size' contiguous bytes of input, either
+      // in place in the chunk or gathered into 'pending_' across
+      // chunks. Returns nullptr if the chunk ran out first.
+      byte_t const* gather(byte_t const*& current, byte_t const* end, std::size_t size) noexcept {
+        std::size_t const available = end - current;
+        if (pending_size_ == 0 && available >= size) {
+          byte_t const* const result = current;
+          current += size;
+          return result;
+        }
+
+        std::size_t const count = std::min(size - pending_size_, available);
+        std::memcpy(&pending_[pending_size_], current, count);
+        pending_size_ += count;
+        current += count;
+
+        if (pending_size_ != size)
+          return nullptr;
+
+        pending_size_ = 0;
+        return pending_.data();
+      }
+
+      // Accounts for 'size' bytes of element data in the innermost
+      // document, which must leave room for its trailing null byte.
+      bool take(std::size_t size) noexcept {
+        frame& current = frames_.back();
+        if (size >= current.remaining)
+          return invalid();
+        current.remaining -= size;
+        return true;
+      }
+
+      bool invalid() noexcept {
+        status_ = streaming_decoder_status::invalid;
+        return false;
+      }
+
+      void deliver(handler_result result) noexcept {
+        if (result == handler_result::stop)
+          status_ = streaming_decoder_status::stopped;
+      }
+
+      cstring_cdata name() const {
+        return cstring_cdata(name_data_, name_size_, string_data_details::null_included_tag());
+      }
+
+      byte_t const* consume_length(byte_t const* current, byte_t const* end) {
+        byte_t const* const data = gather(current, end, sizeof(length_t));
+        if (!data)
+          return current;
+
+        length_t const length = element_details::read_little_endian<length_t>(data);
+        if (length < static_cast<length_t>(sizeof(length_t) + 1)) {
+          invalid();
+          return current;
+        }
+
+        state_ = state::type;
+
+        if (frames_.empty()) {
+          frames_.push_back(frame{length - sizeof(length_t)});
+          deliver(handler_.on_start_document());
+          return current;
+        }
+
+        frame& parent = frames_.back();
+        if (static_cast<std::size_t>(length) >= parent.remaining) {
+          invalid();
+          return current;
+        }
+        parent.remaining -= length;
+        frames_.push_back(frame{length - sizeof(length_t)});
+
+        name_pending_ = false;
+        if (type_ == types::array)
+          deliver(handler_.on_start_subarray(name()));
+        else
+          deliver(handler_.on_start_subdocument(name()));
+        return current;
+      }
+
+      byte_t const* consume_type(byte_t const* current, byte_t const* end) {
+        byte_t const type = *current++;
+
+        if (type == 0) {
+          if (frames_.back().remaining != 1) {
+            invalid();
+            return current;
+          }
+          frames_.pop_back();
+          state_ = frames_.empty() ? state::length : state::type;
+          deliver(handler_.on_finish());
+          return current;
+        }
+
+        if (!element_details::is_known_type(type) || !take(1)) {
+          invalid();
+          return current;
+        }
+
+        type_ = static_cast<types>(type);
+        name_.clear();
+        state_ = state::name;
+        return current;
+      }
+
+      byte_t const* consume_name(byte_t const* current, byte_t const* end) {
+        std::size_t const available = end - current;
+        byte_t const* const terminator = static_cast<byte_t const*>(std::memchr(current, 0, available));
+        std::size_t const count = terminator ? (terminator - current + 1) : available;
+        if (!take(count))
+          return current;
+
+        char const* const chars = reinterpret_cast<char const*>(current);
+        current += count;
+
+        if (!terminator) {
+          name_.append(chars, count);
+          return current;
+        }
+
+        if (name_.empty()) {
+          name_data_ = chars;
+          name_size_ = count;
+        } else {
+          name_.append(chars, count);
+          name_data_ = name_.data();
+          name_size_ = name_.size();
+        }
+        name_pending_ = true;
+
+        if (type_ == types::document || type_ == types::array) {
+          state_ = state::length;
+          return current;
+        }
+
+        state_ = state::value;
+
+        // Valueless elements are complete now, even at the very end
+        // of a chunk.
+        if (element_details::fixed_value_size(type_) == 0)
+          return consume_value(current, end);
+        return current;
+      }
+
+      byte_t const* consume_value(byte_t const* current, byte_t const* end) {
+        std::size_t const fixed_size = element_details::fixed_value_size(type_);
+        if (fixed_size != element_details::k_variable_size) {
+          byte_t const* const start = current;
+          byte_t const* const data = gather(current, end, fixed_size);
+          if (take(current - start) && data)
+            dispatch(data, fixed_size);
+          return current;
+        }
+
+        std::size_t size;
+        std::size_t const available = end - current;
+        if (value_.empty() &&
+            element_details::variable_value_size(type_, current, available, size) &&
+            size <= available) {
+          if (take(size))
+            dispatch(current, size);
+          return current + size;
+        }
+
+        return stage_value(current, end);
+      }
+
+      // The slow path for a variable width value that straddles a
+      // chunk boundary: accumulate it in 'value_' until complete.
+      byte_t const* stage_value(byte_t const* current, byte_t const* end) {
+        std::size_t size;
+        while (!element_details::variable_value_size(type_, value_.data(), value_.size(), size)) {
+          if (current == end)
+            return current;
+
+          std::size_t count = end - current;
+          if (type_ == types::regex) {
+            byte_t const* const terminator = static_cast<byte_t const*>(std::memchr(current, 0, count));
+            if (terminator)
+              count = terminator - current + 1;
+          } else {
+            count = std::min(sizeof(length_t) - value_.size(), count);
+          }
+
+          if (!take(count))
+            return current;
+          value_.insert(value_.end(), current, current + count);
+          current += count;
+        }
+
+        if (size < value_.size() || size - value_.size() >= frames_.back().remaining) {
+          invalid();
+          return current;
+        }
+
+        std::size_t const count = std::min<std::size_t>(size - value_.size(), end - current);
+        take(count);
+        value_.insert(value_.end(), current, current + count);
+        current += count;
+
+        if (value_.size() == size) {
+          dispatch(value_.data(), size);
+          value_.clear();
+        }
+        return current;
+      }
+
+      // Checks that 'data' holds a well formed BSON string of
+      // exactly 'size' bytes.
+      static bool is_valid_string(byte_t const* data, std::size_t size) noexcept {
+        return size > sizeof(length_t) &&
+          element_details::read_little_endian<length_t>(data) == static_cast<length_t>(size - sizeof(length_t)) &&
+          data[size - 1] == 0;
+      }
+
+      static string_cdata make_string(byte_t const* data) {
+        return string_cdata(reinterpret_cast<char const*>(data + sizeof(length_t)),
+                            element_details::read_little_endian<length_t>(data),
+                            string_data_details::null_included_tag());
+      }
+
+      static cstring_cdata make_cstring(byte_t const* data) {
+        char const* const chars = reinterpret_cast<char const*>(data);
+        return cstring_cdata(chars, std::strlen(chars));
+      }
+
+      // Delivers the complete value of 'size' bytes at 'data' for the
+      // element whose type and name we have already consumed.
+      void dispatch(byte_t const* data, std::size_t size) {
+        name_pending_ = false;
+        state_ = state::type;
+
+        switch (type_) {
+          case types::floating_point: {
+            double_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return deliver(handler_.on_floating_point(name(), value));
+          }
+
+          case types::utf8_string:
+            if (!is_valid_string(data, size))
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_utf8_string(name(), make_string(data)));
+
+          case types::binary:
+            return deliver(handler_.on_binary(
+                             name(),
+                             static_cast<binary_subtypes>(data[sizeof(length_t)]),
+                             binary_cdata(data + sizeof(length_t) + 1, element_details::read_little_endian<length_t>(data))));
+
+          case types::undefined_no_deprecated:
+            return deliver(handler_.on_undefined(name()));
+
+          case types::object_id:
+            return deliver(handler_.on_object_id(name(), object_id_cdata(data)));
+
+          case types::boolean:
+            if (data[0] > static_cast<byte_t>(values::true_))
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_boolean(name(), data[0] != 0));
+
+          case types::utc_datetime:
+            return deliver(handler_.on_utc_datetime(name(), element_details::read_little_endian<std::int64_t>(data)));
+
+          case types::null:
+            return deliver(handler_.on_null(name()));
+
+          case types::regex: {
+            cstring_cdata const regex = make_cstring(data);
+            return deliver(handler_.on_regex(name(), regex, make_cstring(data + regex.size)));
+          }
+
+          case types::db_pointer_no_deprecated:
+            if (!is_valid_string(data, size - k_object_id_length))
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_db_pointer(
+                             name(),
+                             make_string(data),
+                             object_id_cdata(data + size - k_object_id_length)));
+
+          case types::javascript:
+            if (!is_valid_string(data, size))
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_javascript(name(), make_string(data)));
+
+          case types::symbol:
+            if (!is_valid_string(data, size))
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_symbol(name(), make_string(data)));
+
+          case types::scoped_javascript: {
+            // Layout: total length, code string, scope document.
+            byte_t const* const code = data + sizeof(length_t);
+            std::size_t const rest = size - sizeof(length_t);
+            if (rest < sizeof(length_t))
+              return static_cast<void>(invalid());
+            length_t const code_length = element_details::read_little_endian<length_t>(code);
+            if (code_length < 1 ||
+                static_cast<std::size_t>(code_length) + 2 * sizeof(length_t) + 1 > rest)
+              return static_cast<void>(invalid());
+            std::size_t const code_size = sizeof(length_t) + code_length;
+            byte_t const* const scope = code + code_size;
+            if (!is_valid_string(code, code_size) ||
+                element_details::read_little_endian<length_t>(scope) != static_cast<length_t>(rest - code_size) ||
+                data[size - 1] != 0)
+              return static_cast<void>(invalid());
+            return deliver(handler_.on_scoped_javascript(name(), make_string(code), scope));
+          }
+
+          case types::int32:
+            return deliver(handler_.on_int32(name(), element_details::read_little_endian<std::int32_t>(data)));
+
+          case types::timestamp:
+            return deliver(handler_.on_timestamp(name(), element_details::read_little_endian<std::int64_t>(data)));
+
+          case types::int64:
+            return deliver(handler_.on_int64(name(), element_details::read_little_endian<std::int64_t>(data)));
+
+          case types::min:
+            return deliver(handler_.on_min_key(name()));
+
+          case types::max:
+            return deliver(handler_.on_max_key(name()));
+
+          default:
+            return static_cast<void>(invalid());
+        }
+      }
+
+      handler_type& handler_;
+
+      state state_;
+      streaming_decoder_status status_;
+      types type_;
+
+      std::vector<frame> frames_;
+
+      // A length prefix or fixed width value split across chunks.
+      std::array<byte_t, 16> pending_;
+      std::size_t pending_size_;
+
+      // The name of the current element. Points either into the
+      // caller's chunk, or into 'name_' if the name straddled chunks
+      // or had to outlive one.
+      std::string name_;
+      char const* name_data_;
+      std::size_t name_size_;
+      bool name_pending_;
+
+      // A variable width value split across chunks.
+      std::vector<byte_t> value_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_060f07a4_2fb2_4388_9db8_695a37c54e2a
@@ -0,0 +1,111 @@
+#include <bassoon/streaming_writer.hpp>
+
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace bassoon {
+  namespace bson {
+
+    streaming_writer::streaming_writer(int fd, streaming_writer_options options) noexcept
+      : fd_(fd)
+      , flush_bytes_(options.flush_bytes)
+      , capacity_(0)
+      , base_(nullptr)
+      , flushed_(0)
+      , finished_(0)
+      , used_(0)
+      , written_(0)
+      , error_(0) {
+
+      std::size_t const page = ::sysconf(_SC_PAGESIZE);
+      std::size_t const capacity = (options.capacity + page - 1) / page * page;
+      if (capacity == 0) {
+        fail(EINVAL);
+        return;
+      }
+
+      int const memory = ::memfd_create("bassoon-streaming-writer", MFD_CLOEXEC);
+      if (memory == -1) {
+        fail(errno);
+        return;
+      }
+
+      // The same pages twice in a row, in address space reserved for
+      // both, so that whatever wraps around the end of the ring reads
+      // on into its start.
+      void* reserved = MAP_FAILED;
+      if (::ftruncate(memory, capacity) == -1 ||
+          (reserved = ::mmap(nullptr, 2 * capacity, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED) {
+        fail(errno);
+      } else {
+        byte_t* const base = static_cast<byte_t*>(reserved);
+        for (std::size_t half = 0; ok() && half != 2; ++half) {
+          if (::mmap(base + half * capacity, capacity, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, memory, 0) == MAP_FAILED)
+            fail(errno);
+        }
+        if (ok()) {
+          base_ = base;
+          capacity_ = capacity;
+        } else {
+          ::munmap(reserved, 2 * capacity);
+        }
+      }
+      ::close(memory);
+    }
+
+    streaming_writer::~streaming_writer() {
+      if (ok())
+        write_out();
+      if (base_)
+        ::munmap(base_, 2 * capacity_);
+    }
+
+    bool streaming_writer::flush() noexcept {
+      if (!ok())
+        return false;
+      finish_document(true);
+      return ok();
+    }
+
+    void streaming_writer::finish_document(bool force) noexcept {
+      finished_ = used_;
+      if (!force && finished_ - flushed_ < flush_bytes_ && finished_ < capacity_)
+        return;
+
+      // Once everything has been written out, and no document is in
+      // progress, bring the offsets back into the first mapping.
+      if (write_out() && flushed_ >= capacity_) {
+        flushed_ -= capacity_;
+        finished_ -= capacity_;
+        used_ -= capacity_;
+      }
+    }
+
+    bool streaming_writer::make_room(std::size_t size) noexcept {
+      if (!ok() || !write_out())
+        return false;
+      if (used_ + size - flushed_ > capacity_)
+        return fail(EMSGSIZE);
+      return true;
+    }
+
+    bool streaming_writer::write_out() noexcept {
+      while (flushed_ != finished_) {
+        ssize_t const result = ::write(fd_, base_ + flushed_, finished_ - flushed_);
+        if (result == -1) {
+          if (errno == EINTR)
+            continue;
+          return fail(errno);
+        }
+        flushed_ += result;
+        written_ += result;
+      }
+      return true;
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
@@ -0,0 +1,153 @@
+#ifndef included_18fb1fbb_b4b0_4fcc_b58c_cc4acb960807
+#define included_18fb1fbb_b4b0_4fcc_b58c_cc4acb960807
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include <bassoon/bson.hpp>
+#include <bassoon/export.hpp>
+#include <bassoon/linear_cursor.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    struct streaming_writer_options {
+      // The memory for documents not yet written out, rounded up to
+      // whole pages. It bounds the size of a document.
+      std::size_t capacity = std::size_t(4) << 20;
+
+      // Finished documents are written out once at least this many
+      // bytes of them are waiting, or sooner if room is needed. Zero
+      // writes out every document as soon as it is finished.
+      std::size_t flush_bytes = std::size_t(256) << 10;
+    };
+
+    ///
+    /// A writer that streams top level documents to a file descriptor,
+    /// a file or a socket, in bounded memory, however many there are.
+    ///
+    /// Documents are encoded into a ring buffer, mapped twice end to
+    /// end so that a document that wraps around the end of the ring
+    /// is still contiguous in memory. Each is written out after its
+    /// top level 'finish', which the writer recognizes as the
+    /// 'write_at' of the length at the start of the document, so the
+    /// length backpatches of 'finish' always land in memory that has
+    /// not been written out yet. Finished documents are batched into
+    /// one 'write' of everything that is waiting.
+    ///
+    /// Documents follow one another, one 'start_document' after
+    /// another; writing anything else, call 'flush' after each piece.
+    ///
+    /// A document larger than the ring fails cleanly: 'reserve' fails,
+    /// with 'error' EMSGSIZE, and everything finished before it is
+    /// still written out. As with any failure, 'ok' returns false from
+    /// then on, and 'error' returns the errno value of what failed.
+    /// The file descriptor is not closed.
+    ///
+    class LIBBASSOON_EXPORT streaming_writer {
+    public:
+      using base_cursor_type = byte_t*;
+      using cursor = linear_cursor<streaming_writer>;
+
+      explicit streaming_writer(int fd, streaming_writer_options options = streaming_writer_options()) noexcept;
+
+      ///
+      /// Writes out the finished documents. A document in progress is
+      /// dropped.
+      ///
+      ~streaming_writer();
+
+      streaming_writer(const streaming_writer&) = delete;
+      streaming_writer& operator=(const streaming_writer&) = delete;
+
+      bool reserve(std::size_t size) noexcept {
+        if (used_ + size - flushed_ <= capacity_)
+          return ok();
+        return make_room(size);
+      }
+
+      cursor position() noexcept {
+        return cursor(*this, base_ + used_);
+      }
+
+      bool ok() const noexcept {
+        return error_ == 0;
+      }
+
+      int error() const noexcept {
+        return error_;
+      }
+
+      std::size_t distance(const cursor& a, const cursor& b) noexcept {
+        return std::distance(a.address(), b.address());
+      }
+
+      void write(void const* data, std::size_t size) noexcept {
+        assert(used_ + size - flushed_ <= capacity_);
+        std::memcpy(base_ + used_, data, size);
+        used_ += size;
+      }
+
+      void write_at(cursor cursor, void const* data, std::size_t size) noexcept {
+        // After a failure, the encoder may still patch lengths past
+        // what it could reserve.
+        if (!ok())
+          return;
+        std::memcpy(cursor.address(), data, size);
+        if (cursor.address() == base_ + finished_ && used_ != finished_)
+          finish_document(false);
+      }
+
+      ///
+      /// Takes everything written so far as finished, and writes it
+      /// out. Returns 'ok'.
+      ///
+      bool flush() noexcept;
+
+      ///
+      /// The bytes written out so far.
+      ///
+      std::size_t written() const noexcept {
+        return written_;
+      }
+
+    private:
+      // Takes everything written as finished, and writes it out if
+      // 'force' or enough is waiting.
+      void finish_document(bool force) noexcept;
+      bool make_room(std::size_t size) noexcept;
+
+      // Writes out the finished documents.
+      bool write_out() noexcept;
+
+      bool fail(int error) noexcept {
+        if (error_ == 0)
+          error_ = error;
+        return false;
+      }
+
+      int fd_;
+      std::size_t flush_bytes_;
+      std::size_t capacity_;
+      byte_t* base_;
+
+      // Offsets into the doubled mapping: what has been written out,
+      // the end of the finished documents, and the end of what has
+      // been written into the ring. Between documents 'flushed_' and
+      // 'finished_' are brought back under 'capacity_', so a document
+      // starts in the first mapping and ends before the end of the
+      // second.
+      std::size_t flushed_;
+      std::size_t finished_;
+      std::size_t used_;
+
+      std::size_t written_;
+      int error_;
+    };
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_18fb1fbb_b4b0_4fcc_b58c_cc4acb960807
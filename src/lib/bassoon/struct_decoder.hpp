@@ -0,0 +1,363 @@
+#ifndef included_32cf2166_a77c_4194_8d93_b4dcfab48b7c
+#define included_32cf2166_a77c_4194_8d93_b4dcfab48b7c
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <bassoon/document_view.hpp>
+
+namespace bassoon {
+  namespace bson {
+
+    ///
+    /// Describes how to decode BSON documents into the C++ struct
+    /// 'Struct'. Specialize it for your struct, declaring each field
+    /// once with BASSOON_STRUCT_FIELD and listing them in 'fields':
+    ///
+    ///   struct point {
+    ///     std::int64_t ts;
+    ///     double value;
+    ///   };
+    ///
+    ///   namespace bassoon { namespace bson {
+    ///     template<>
+    ///     struct struct_schema<point> {
+    ///       BASSOON_STRUCT_FIELD(point, ts);
+    ///       BASSOON_STRUCT_FIELD(point, value);
+    ///       using fields = field_list<ts_field, value_field>;
+    ///     };
+    ///   }}
+    ///
+    /// A schema may list at most 64 fields.
+    ///
+    template<typename Struct>
+    struct struct_schema;
+
+    template<typename... Fields>
+    struct field_list {};
+
+    ///
+    /// Declares a field named 'member##_field' that maps the BSON
+    /// element 'name' to 'Struct::member'.
+    ///
+#define BASSOON_STRUCT_FIELD_NAMED(Struct, member, bson_name)           \
+    struct member##_field {                                             \
+      using value_type = decltype(Struct::member);                      \
+      static constexpr char const* name() { return bson_name; }         \
+      static constexpr std::size_t name_size() { return sizeof(bson_name) - 1; } \
+      static value_type& get(Struct& object) { return object.member; }  \
+    }
+
+    ///
+    /// As BASSOON_STRUCT_FIELD_NAMED, with the BSON element named
+    /// after the member.
+    ///
+#define BASSOON_STRUCT_FIELD(Struct, member)                            \
+    BASSOON_STRUCT_FIELD_NAMED(Struct, member, #member)
+
+    ///
+    /// The outcome of decoding a document into a struct. Bit 'i' of
+    /// the masks refers to field 'i' of the schema's field list.
+    /// Nothing here throws: a field of the wrong type is left as it
+    /// was, even an array or subdocument that only failed partway
+    /// through, and reported in 'mismatched'.
+    ///
+    struct struct_decode_result {
+      // Fields that were found and decoded.
+      std::uint64_t decoded;
+
+      // Fields that were found with a type we cannot decode into them.
+      std::uint64_t mismatched;
+
+      // Elements that matched no field, and were skipped.
+      std::size_t unknown;
+
+      // True if the document was malformed. Fields after the
+      // malformed element are not decoded.
+      bool malformed;
+
+      bool ok() const noexcept {
+        return !malformed && mismatched == 0;
+      }
+    };
+
+    template<typename Struct>
+    struct_decode_result decode_struct(document_view const& document, Struct& object);
+
+    ///
+    /// Reads one element into a value of type T. Returns false if the
+    /// element's type does not fit, leaving 'value' alone.
+    /// Specialize it to teach the decoder new field types, keeping
+    /// that promise. Class types default to being decoded as
+    /// subdocuments through their own struct_schema, into a copy that
+    /// replaces 'value' only if every field fits, so that fields the
+    /// subdocument lacks keep what they had.
+    ///
+    template<typename T>
+    struct field_reader {
+      static bool read(element_view const& element, T& value) {
+        if (element.type() != types::document)
+          return false;
+        T decoded(value);
+        if (!decode_struct(document_view(element.as_document()), decoded).ok())
+          return false;
+        value = std::move(decoded);
+        return true;
+      }
+    };
+
+    template<>
+    struct field_reader<std::int32_t> {
+      static bool read(element_view const& element, std::int32_t& value) noexcept {
+        if (element.type() != types::int32)
+          return false;
+        value = element.as_int32();
+        return true;
+      }
+    };
+
+    ///
+    /// int64 fields also accept int32, which widens exactly, and the
+    /// 64 bit utc_datetime and timestamp types.
+    ///
+    template<>
+    struct field_reader<std::int64_t> {
+      static bool read(element_view const& element, std::int64_t& value) noexcept {
+        switch (element.type()) {
+          case types::int32:
+            value = element.as_int32();
+            return true;
+          case types::int64:
+          case types::utc_datetime:
+          case types::timestamp:
+            value = element.as_int64();
+            return true;
+          default:
+            return false;
+        }
+      }
+    };
+
+    template<>
+    struct field_reader<double_t> {
+      static bool read(element_view const& element, double_t& value) noexcept {
+        switch (element.type()) {
+          case types::floating_point:
+            value = element.as_floating_point();
+            return true;
+          case types::int32:
+            value = element.as_int32();
+            return true;
+          case types::int64:
+            value = element.as_int64();
+            return true;
+          default:
+            return false;
+        }
+      }
+    };
+
+    template<>
+    struct field_reader<bool> {
+      static bool read(element_view const& element, bool& value) noexcept {
+        if (element.type() != types::boolean)
+          return false;
+        value = element.as_boolean();
+        return true;
+      }
+    };
+
+    template<>
+    struct field_reader<std::string> {
+      static bool read(element_view const& element, std::string& value) {
+        if (element.type() != types::utf8_string && element.type() != types::symbol)
+          return false;
+        string_cdata const string = element.as_string();
+        value.assign(string.data, string.size - 1);
+        return true;
+      }
+    };
+
+    template<>
+    struct field_reader<std::array<byte_t, k_object_id_length>> {
+      static bool read(element_view const& element, std::array<byte_t, k_object_id_length>& value) noexcept {
+        if (element.type() != types::object_id)
+          return false;
+        std::memcpy(value.data(), element.value(), k_object_id_length);
+        return true;
+      }
+    };
+
+    ///
+    /// Arrays decode into vectors, element by element. The vector is
+    /// replaced, not appended to, once every element has been read.
+    ///
+    template<typename T>
+    struct field_reader<std::vector<T>> {
+      static bool read(element_view const& element, std::vector<T>& value) {
+        if (element.type() != types::array)
+          return false;
+        std::vector<T> decoded;
+        document_view const array(element.as_document());
+        auto current = array.begin();
+        for (; current != array.end(); ++current) {
+          decoded.emplace_back();
+          if (!field_reader<T>::read(*current, decoded.back()))
+            return false;
+        }
+        if (!current.ok())
+          return false;
+        value.swap(decoded);
+        return true;
+      }
+    };
+
+    namespace struct_decoder_details {
+
+      // The fields whose names are 'Size' bytes long, the ones that an
+      // element name of that size can match. Every other field drops
+      // out at compile time, so a bucket tests only names of the right
+      // length, each on its first byte before a fixed size memcmp.
+      // 'Index' is the position of the first of 'Fields' in the list.
+      template<std::size_t Size, std::size_t Index, typename Struct, typename... Fields>
+      struct bucket;
+
+      template<std::size_t Size, std::size_t Index, typename Struct>
+      struct bucket<Size, Index, Struct> {
+        static bool decode(element_view const&, char const*, std::size_t, Struct&, struct_decode_result&) {
+          return false;
+        }
+      };
+
+      template<std::size_t Size, std::size_t Index, typename Struct, typename Field, typename... Rest>
+      struct bucket<Size, Index, Struct, Field, Rest...> {
+        static bool decode(element_view const& element, char const* name, std::size_t size,
+                           Struct& object, struct_decode_result& result) {
+          if (!matches(name, size))
+            return bucket<Size, Index + 1, Struct, Rest...>::decode(element, name, size, object, result);
+
+          // If a field repeats, the first occurrence wins.
+          std::uint64_t const bit = std::uint64_t(1) << Index;
+          if ((result.decoded | result.mismatched) & bit)
+            return true;
+
+          if (field_reader<typename Field::value_type>::read(element, Field::get(object)))
+            result.decoded |= bit;
+          else
+            result.mismatched |= bit;
+          return true;
+        }
+
+        // With 'Size' zero, the bucket that the switch's default takes,
+        // for the empty name and those too long for a case of their
+        // own, which compares sizes as it goes.
+        static bool matches(char const* name, std::size_t size) {
+          if (Size == 0 ? size != Field::name_size() : Field::name_size() != Size)
+            return false;
+          return size == 0 ||
+            (name[0] == Field::name()[0] && std::memcmp(name, Field::name(), Field::name_size()) == 0);
+        }
+      };
+
+      // Dispatches an element name by a switch on its size, which the
+      // compiler makes a jump table, straight to its bucket.
+      template<typename Struct, typename... Fields>
+      struct dispatcher {
+        static bool decode(element_view const& element, char const* name, std::size_t size,
+                           Struct& object, struct_decode_result& result) {
+#define BASSOON_STRUCT_DECODER_CASE(n)                                  \
+          case n:                                                       \
+            return bucket<n, 0, Struct, Fields...>::decode(element, name, size, object, result)
+
+          switch (size) {
+            BASSOON_STRUCT_DECODER_CASE(1);
+            BASSOON_STRUCT_DECODER_CASE(2);
+            BASSOON_STRUCT_DECODER_CASE(3);
+            BASSOON_STRUCT_DECODER_CASE(4);
+            BASSOON_STRUCT_DECODER_CASE(5);
+            BASSOON_STRUCT_DECODER_CASE(6);
+            BASSOON_STRUCT_DECODER_CASE(7);
+            BASSOON_STRUCT_DECODER_CASE(8);
+            BASSOON_STRUCT_DECODER_CASE(9);
+            BASSOON_STRUCT_DECODER_CASE(10);
+            BASSOON_STRUCT_DECODER_CASE(11);
+            BASSOON_STRUCT_DECODER_CASE(12);
+            BASSOON_STRUCT_DECODER_CASE(13);
+            BASSOON_STRUCT_DECODER_CASE(14);
+            BASSOON_STRUCT_DECODER_CASE(15);
+            BASSOON_STRUCT_DECODER_CASE(16);
+            BASSOON_STRUCT_DECODER_CASE(17);
+            BASSOON_STRUCT_DECODER_CASE(18);
+            BASSOON_STRUCT_DECODER_CASE(19);
+            BASSOON_STRUCT_DECODER_CASE(20);
+            BASSOON_STRUCT_DECODER_CASE(21);
+            BASSOON_STRUCT_DECODER_CASE(22);
+            BASSOON_STRUCT_DECODER_CASE(23);
+            BASSOON_STRUCT_DECODER_CASE(24);
+            BASSOON_STRUCT_DECODER_CASE(25);
+            BASSOON_STRUCT_DECODER_CASE(26);
+            BASSOON_STRUCT_DECODER_CASE(27);
+            BASSOON_STRUCT_DECODER_CASE(28);
+            BASSOON_STRUCT_DECODER_CASE(29);
+            BASSOON_STRUCT_DECODER_CASE(30);
+            BASSOON_STRUCT_DECODER_CASE(31);
+            default:
+              // The empty name, and names of 32 bytes or more.
+              return bucket<0, 0, Struct, Fields...>::decode(element, name, size, object, result);
+          }
+
+#undef BASSOON_STRUCT_DECODER_CASE
+        }
+      };
+
+      template<typename Struct, typename List>
+      struct struct_decoder;
+
+      template<typename Struct, typename... Fields>
+      struct struct_decoder<Struct, field_list<Fields...>> {
+
+        static_assert(sizeof...(Fields) <= 64, "struct_schema may list at most 64 fields");
+
+        static struct_decode_result decode(document_view const& document, Struct& object) {
+          struct_decode_result result = { 0, 0, 0, false };
+
+          auto current = document.begin();
+          for (; current != document.end(); ++current) {
+            element_view const& element = *current;
+            cstring_cdata const name = element.name();
+            if (!dispatcher<Struct, Fields...>::decode(element, name.data, name.size - 1, object, result))
+              ++result.unknown;
+          }
+
+          result.malformed = !current.ok();
+          return result;
+        }
+      };
+
+    }  // namespace struct_decoder_details
+
+    ///
+    /// Decodes 'document' into 'object' as described by
+    /// struct_schema<Struct>, walking the document in place. Unknown
+    /// elements are skipped using their lengths; fields missing from
+    /// the document are left as they were.
+    ///
+    template<typename Struct>
+    struct_decode_result decode_struct(document_view const& document, Struct& object) {
+      return struct_decoder_details::struct_decoder<
+        Struct, typename struct_schema<Struct>::fields>::decode(document, object);
+    }
+
+    template<typename Struct>
+    struct_decode_result decode_struct(void const* document, Struct& object) {
+      return decode_struct(document_view(document), object);
+    }
+
+  }  // namespace bson
+}  // namespace bassoon
+
+#endif // included_32cf2166_a77c_4194_8d93_b4dcfab48b7c
@@ -0,0 +1,226 @@
+#ifndef included_1a5b72a4_7c21_4d30_98b8_3ded8f5ebe20
+#define included_1a5b72a4_7c21_4d30_98b8_3ded8f5ebe20
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts the heap allocations of each thread, so that tests and
+// benchmarks can check that code does not allocate, and, with glibc,
+// the heap memory in use across all threads, so that they can check
+// how much code holds at once.
+//
+// This replaces the global allocation functions, so include it in
+// exactly one translation unit of a test or benchmark executable.
+//
+// With glibc, malloc, calloc, realloc, free and the memalign family are
+// replaced, which catches allocations in C code as well as through
+// operator new, which calls malloc. Elsewhere, or under the address
+// or thread sanitizer, which replace malloc themselves, only operator
+// new is.
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BASSOON_COUNT_MALLOC 1
+#include <malloc.h>
+#else
+#define BASSOON_COUNT_MALLOC 0
+#endif
+
+namespace bassoon {
+  namespace testing {
+
+    struct allocation_counts {
+      std::size_t allocations;
+      std::size_t bytes;
+    };
+
+    namespace allocation_counter_details {
+      // Plain data, so that reading it from inside malloc can never
+      // itself allocate.
+      thread_local allocation_counts t_counts = { 0, 0 };
+
+      inline void count(std::size_t size) noexcept {
+        ++t_counts.allocations;
+        t_counts.bytes += size;
+      }
+
+      // Signed, so that freeing what was allocated before counting
+      // began, as the loader may, leaves differences right.
+      std::atomic<std::ptrdiff_t> g_in_use(0);
+      std::atomic<std::ptrdiff_t> g_peak(0);
+
+      inline void add_in_use(std::ptrdiff_t size) noexcept {
+        std::ptrdiff_t const in_use = g_in_use.fetch_add(size, std::memory_order_relaxed) + size;
+        std::ptrdiff_t peak = g_peak.load(std::memory_order_relaxed);
+        while (in_use > peak && !g_peak.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {}
+      }
+    }  // namespace allocation_counter_details
+
+    ///
+    /// Counts the allocations that the calling thread makes while it
+    /// lives.
+    ///
+    class allocation_scope {
+    public:
+      allocation_scope() noexcept
+        : start_(allocation_counter_details::t_counts) {}
+
+      allocation_counts counts() const noexcept {
+        allocation_counts const& now = allocation_counter_details::t_counts;
+        return { now.allocations - start_.allocations, now.bytes - start_.bytes };
+      }
+
+      std::size_t allocations() const noexcept {
+        return counts().allocations;
+      }
+
+    private:
+      allocation_counts start_;
+    };
+
+    ///
+    /// The most heap memory in use at once, across all threads, while
+    /// it lives, over what was in use when it started. Only counted
+    /// where BASSOON_COUNT_MALLOC is; elsewhere it is always zero.
+    ///
+    class allocation_peak {
+    public:
+      allocation_peak() noexcept
+        : start_(allocation_counter_details::g_in_use.load(std::memory_order_relaxed)) {
+        allocation_counter_details::g_peak.store(start_, std::memory_order_relaxed);
+      }
+
+      std::size_t bytes() const noexcept {
+        return allocation_counter_details::g_peak.load(std::memory_order_relaxed) - start_;
+      }
+
+    private:
+      std::ptrdiff_t start_;
+    };
+
+  }  // namespace testing
+}  // namespace bassoon
+
+#if BASSOON_COUNT_MALLOC
+
+extern "C" {
+  void* __libc_malloc(std::size_t size);
+  void* __libc_calloc(std::size_t count, std::size_t size);
+  void* __libc_realloc(void* pointer, std::size_t size);
+  void* __libc_memalign(std::size_t alignment, std::size_t size);
+  void __libc_free(void* pointer);
+}
+
+namespace bassoon {
+  namespace testing {
+    namespace allocation_counter_details {
+      inline void* allocated(void* pointer) noexcept {
+        if (pointer)
+          add_in_use(::malloc_usable_size(pointer));
+        return pointer;
+      }
+    }  // namespace allocation_counter_details
+  }  // namespace testing
+}  // namespace bassoon
+
+extern "C" {
+  void* malloc(std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(size);
+    return bassoon::testing::allocation_counter_details::allocated(__libc_malloc(size));
+  }
+
+  void* calloc(std::size_t count, std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(count * size);
+    return bassoon::testing::allocation_counter_details::allocated(__libc_calloc(count, size));
+  }
+
+  void* realloc(void* pointer, std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(size);
+    std::ptrdiff_t const old_size = pointer ? ::malloc_usable_size(pointer) : 0;
+    void* const result = __libc_realloc(pointer, size);
+    if (result || size == 0)
+      bassoon::testing::allocation_counter_details::add_in_use(-old_size);
+    return bassoon::testing::allocation_counter_details::allocated(result);
+  }
+
+  void* memalign(std::size_t alignment, std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(size);
+    return bassoon::testing::allocation_counter_details::allocated(__libc_memalign(alignment, size));
+  }
+
+  void* aligned_alloc(std::size_t alignment, std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(size);
+    return bassoon::testing::allocation_counter_details::allocated(__libc_memalign(alignment, size));
+  }
+
+  int posix_memalign(void** pointer, std::size_t alignment, std::size_t size) {
+    bassoon::testing::allocation_counter_details::count(size);
+    void* const result = bassoon::testing::allocation_counter_details::allocated(__libc_memalign(alignment, size));
+    if (!result)
+      return ENOMEM;
+    *pointer = result;
+    return 0;
+  }
+
+  void free(void* pointer) {
+    if (pointer)
+      bassoon::testing::allocation_counter_details::add_in_use(-static_cast<std::ptrdiff_t>(::malloc_usable_size(pointer)));
+    __libc_free(pointer);
+  }
+}
+
+#else
+
+// Out of line, so that the compiler does not see these pair operator
+// new with free.
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+  bassoon::testing::allocation_counter_details::count(size);
+  if (void* const result = std::malloc(size == 0 ? 1 : size))
+    return result;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return ::operator new(size);
+}
+
+__attribute__((noinline)) void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+  bassoon::testing::allocation_counter_details::count(size);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const& tag) noexcept {
+  return ::operator new(size, tag);
+}
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer) noexcept {
+  std::free(pointer);
+}
+
+// The sized forms, which code built as C++14 or later calls.
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, std::nothrow_t const&) noexcept {
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete[](void* pointer, std::nothrow_t const&) noexcept {
+  std::free(pointer);
+}
+
+#endif
+
+#endif // included_1a5b72a4_7c21_4d30_98b8_3ded8f5ebe20
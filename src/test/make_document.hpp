@@ -0,0 +1,34 @@
+#ifndef included_7fd899ee_2820_46e5_8db0_7e890c6480a6
+#define included_7fd899ee_2820_46e5_8db0_7e890c6480a6
+
+#include <gtest/gtest.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+
+// Builds test documents in a std::array, from a function that encodes
+// the elements, so that a test reads as the document it uses.
+
+namespace bassoon {
+  namespace testing {
+
+    ///
+    /// Encodes a document into a new 'Buffer', a std::array of bytes,
+    /// calling 'function(document)' with the top level encoder to fill
+    /// it in. A document that does not fit fails the test.
+    ///
+    template<typename Buffer, typename Function>
+    Buffer make_document(Function function) {
+      Buffer buffer;
+      auto writer = bson::make_array_writer(buffer);
+      auto document = bson::start_document(writer);
+      function(document);
+      document.finish();
+      EXPECT_TRUE(document.ok());
+      return buffer;
+    }
+
+  }  // namespace testing
+}  // namespace bassoon
+
+#endif // included_7fd899ee_2820_46e5_8db0_7e890c6480a6
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_encoder.hpp>
+#include <bassoon/array_writer.hpp>
+#include <bassoon/concrete_encoder.hpp>
+#include <bassoon/document_hash.hpp>
+#include <bassoon/document_queue.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/encoder_stats.hpp>
+
+#include "allocation_counter.hpp"
+
+// The encoder is meant never to allocate: it holds only a cursor into
+// its writer. These tests hold it to that, for every entry point and
+// every writer in the library.
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::allocation_scope;
+
+  using buffer_type = std::array<byte_t, 4096>;
+
+  buffer_type const& subdocument() {
+    static buffer_type result;
+    static bool const encoded = [] {
+      auto writer = make_array_writer(result);
+      auto document = start_document(writer);
+      document.encode_int32("x", 1);
+      document.finish();
+      return document.ok();
+    }();
+    (void)encoded;
+    return result;
+  }
+
+  // Calls every entry point of 'document'.
+  template<typename Encoder_type>
+  void encode_everything(Encoder_type& document) {
+    static byte_t const id[k_object_id_length] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    static byte_t const raw_int32[] = { 42, 0, 0, 0 };
+    void const* const nested = subdocument().data();
+    std::size_t const nested_size = document_cdata(nested).size;
+
+    document.encode_floating_point("double", 1.5);
+    document.encode_utf8_string("string", "a string");
+    document.encode_subdocument("subdocument", nested);
+    document.encode_as_subdocument("as_subdocument", binary_cdata(nested, nested_size));
+    document.encode_subarray("subarray", nested);
+    document.encode_as_subarray("as_subarray", binary_cdata(nested, nested_size));
+    document.encode_binary("binary", binary_subtypes::generic, binary_cdata(id, sizeof(id)));
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    document.encode_undefined("undefined");
+    document.encode_db_pointer("db_pointer", "db.collection", object_id_cdata(&id[0]));
+#pragma GCC diagnostic pop
+    document.encode_object_id("object_id", object_id_cdata(&id[0]));
+    document.encode_boolean("boolean", true);
+    document.encode_utc_datetime("utc_datetime", 1500000000000LL);
+    document.encode_null("null");
+    document.encode_regex("regex", "^a.*z$", "i");
+    document.encode_javascript("javascript", "function() {}");
+    document.encode_symbol("symbol", "a symbol");
+    document.encode_scoped_javascript("scoped_javascript", "function() { return x; }", nested);
+    document.encode_int32("int32", 32);
+    document.encode_timestamp("timestamp", 64);
+    document.encode_int64("int64", 64);
+    document.encode_min_key("min_key");
+    document.encode_max_key("max_key");
+    document.encode_raw_value("raw_value", types::int32, binary_cdata(raw_int32, sizeof(raw_int32)));
+
+    auto&& child = document.start_subdocument("child");
+    child.encode_int32("a", 1);
+    auto&& list = child.start_subarray("list");
+    list.encode_int32("0", 1);
+    list.finish();
+    child.finish();
+  }
+
+  TEST(Allocations, CountsAllocations) {
+    allocation_scope scope;
+    std::vector<int> allocated(100);
+    EXPECT_EQ(1u, scope.allocations());
+    EXPECT_GE(scope.counts().bytes, 100 * sizeof(int));
+  }
+
+  TEST(Allocations, EncoderDoesNotAllocate) {
+    buffer_type buffer;
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer);
+    encode_everything(document);
+    document.finish();
+    EXPECT_TRUE(document.ok());
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  TEST(Allocations, EncoderDoesNotAllocateWhenTheWriterFails) {
+    std::array<byte_t, 16> buffer;
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer);
+    document.encode_utf8_string("string", "longer than the buffer");
+    document.encode_int64("int64", 64);
+    document.finish();
+    EXPECT_FALSE(document.ok());
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  TEST(Allocations, EncoderWithStatisticsDoesNotAllocate) {
+    buffer_type buffer;
+
+    // The first use on a thread sets up its counters.
+    auto first = make_array_writer(buffer);
+    start_document(first, thread_encoder_stats()).finish();
+
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer, thread_encoder_stats());
+    encode_everything(document);
+    document.finish();
+    EXPECT_TRUE(document.ok());
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  TEST(Allocations, HashingWriterDoesNotAllocate) {
+    buffer_type buffer;
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    auto hashing = make_hashing_writer(writer);
+    auto document = start_document(hashing);
+    encode_everything(document);
+    document.finish();
+    EXPECT_TRUE(document.ok());
+    (void)hashing.digest();
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  TEST(Allocations, ArrayEncoderDoesNotAllocate) {
+    buffer_type buffer;
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer);
+    make_array_encoder(document.start_subarray("array"))
+      .encode_utf8_string("hello")
+      .encode_int32(1)
+      .encode_floating_point(2.5)
+      .encode_boolean(false)
+      .finish();
+    document.finish();
+    EXPECT_TRUE(document.ok());
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  // Producers allocate their buffers when they are registered, and
+  // not again: acquiring, encoding, pushing and draining is free.
+  TEST(Allocations, DocumentQueueProducerDoesNotAllocate) {
+    document_queue_options options;
+    options.capacity = 4;
+    options.pool_size = 4;
+    document_queue queue(options);
+    document_queue_producer* const producer = queue.register_producer();
+
+    allocation_scope scope;
+    for (int i = 0; i != 16; ++i) {
+      document_queue_buffer* const buffer = producer->acquire();
+      auto document = start_document(*buffer);
+      encode_everything(document);
+      document.finish();
+      EXPECT_TRUE(document.ok());
+      EXPECT_EQ(document_queue_push::queued, producer->push(buffer));
+      EXPECT_EQ(1u, queue.drain([](document_cdata) {}));
+    }
+    EXPECT_EQ(0u, scope.allocations());
+  }
+
+  // The concrete encoder keeps a stack of encoders on the heap. This
+  // records how much it allocates, rather than requiring that it does
+  // not, so that a change shows up in the test output.
+  TEST(Allocations, ConcreteEncoderAllocations) {
+    buffer_type buffer;
+    allocation_scope scope;
+    auto writer = make_array_writer(buffer);
+    concrete_encoder<decltype(writer)> document(writer);
+    encode_everything(document);
+    document.finish();
+    EXPECT_TRUE(writer.ok());
+    RecordProperty("allocations", static_cast<int>(scope.allocations()));
+    RecordProperty("bytes", static_cast<int>(scope.counts().bytes));
+  }
+
+} // namespace
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/async_sink.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 8192>;
+
+  // A document of about 'size' bytes, with its length backpatched
+  // around a nested subdocument.
+  template<typename Writer_type>
+  bool encode(Writer_type& writer, int i, std::size_t size) {
+    auto document = start_document(writer);
+    document.encode_int32("i", i);
+    auto&& nested = document.start_subdocument("nested");
+    nested.encode_utf8_string("padding", std::string(size, 'a' + i % 26));
+    nested.finish();
+    document.finish();
+    return document.ok();
+  }
+
+  std::size_t document_size(int i) {
+    return 100 + (i * 37) % 3000;
+  }
+
+  std::vector<byte_t> expected_documents(int count) {
+    std::vector<byte_t> result;
+    for (int i = 0; i != count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      encode(writer, i, document_size(i));
+      result.insert(result.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    return result;
+  }
+
+  class AsyncSink : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char path[] = "/tmp/bassoon-test-XXXXXX";
+      fd_ = ::mkstemp(path);
+      ASSERT_NE(-1, fd_);
+      path_ = path;
+    }
+
+    void TearDown() override {
+      ::close(fd_);
+      ::unlink(path_.c_str());
+    }
+
+    std::vector<byte_t> contents() const {
+      mapped_file file(path_.c_str());
+      if (!file.ok())
+        return std::vector<byte_t>();
+      byte_t const* const data = static_cast<byte_t const*>(file.data());
+      return std::vector<byte_t>(data, data + file.size());
+    }
+
+    // Streams 'count' documents through a sink, starting a new batch
+    // whenever one does not fit in the current buffer.
+    void stream(async_sink_options const& options, int count) {
+      async_sink sink(fd_, options);
+      ASSERT_TRUE(sink.ok());
+      if (options.backend != async_sink_backend::automatic) {
+        EXPECT_EQ(options.backend, sink.backend());
+      }
+
+      async_sink_buffer* buffer = sink.acquire();
+      ASSERT_NE(nullptr, buffer);
+      for (int i = 0; i != count; ++i) {
+        if (!encode(*buffer, i, document_size(i))) {
+          ASSERT_TRUE(sink.submit(buffer));
+          buffer = sink.acquire();
+          ASSERT_NE(nullptr, buffer);
+          ASSERT_TRUE(encode(*buffer, i, document_size(i)));
+        }
+      }
+      ASSERT_TRUE(sink.submit(buffer));
+      ASSERT_TRUE(sink.flush());
+      EXPECT_EQ(expected_documents(count).size(), sink.written());
+    }
+
+    int fd_;
+    std::string path_;
+  };
+
+  TEST_F(AsyncSink, WritesBatchesInOrder) {
+    async_sink_options options;
+    options.queue_depth = 4;
+    options.buffer_size = 16 << 10;
+    stream(options, 500);
+    EXPECT_EQ(expected_documents(500), contents());
+  }
+
+  TEST_F(AsyncSink, WritesBatchesInOrderOnTheThreadPool) {
+    async_sink_options options;
+    options.queue_depth = 4;
+    options.buffer_size = 16 << 10;
+    options.backend = async_sink_backend::thread_pool;
+    options.threads = 3;
+    stream(options, 500);
+    EXPECT_EQ(expected_documents(500), contents());
+  }
+
+  TEST_F(AsyncSink, BufferKeepsTheDocumentsBeforeOneThatDoesNotFit) {
+    async_sink_options options;
+    options.queue_depth = 1;
+    options.buffer_size = 4096;
+
+    async_sink sink(fd_, options);
+    async_sink_buffer* buffer = sink.acquire();
+    ASSERT_NE(nullptr, buffer);
+    ASSERT_TRUE(encode(*buffer, 0, document_size(0)));
+    std::size_t const first = buffer->valid();
+    EXPECT_FALSE(encode(*buffer, 1, 6000));
+    EXPECT_EQ(first, buffer->valid());
+
+    // Failing a document fails the buffer, not the sink.
+    EXPECT_TRUE(sink.submit(buffer));
+    EXPECT_TRUE(sink.flush());
+    EXPECT_EQ(expected_documents(1), contents());
+
+    // With one buffer, this waits for it to be recycled.
+    buffer = sink.acquire();
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_TRUE(buffer->ok());
+    EXPECT_EQ(0u, buffer->valid());
+    sink.submit(buffer);
+  }
+
+  TEST_F(AsyncSink, AppendsAtTheFilePosition) {
+    ASSERT_EQ(5, ::write(fd_, "head:", 5));
+    {
+      async_sink sink(fd_);
+      async_sink_buffer* buffer = sink.acquire();
+      ASSERT_TRUE(encode(*buffer, 0, document_size(0)));
+      ASSERT_TRUE(sink.submit(buffer));
+    }
+    ASSERT_EQ(5, ::write(fd_, ":tail", 5));
+
+    std::vector<byte_t> const document = expected_documents(1);
+    std::vector<byte_t> const file = contents();
+    ASSERT_EQ(document.size() + 10, file.size());
+    EXPECT_EQ(document, std::vector<byte_t>(file.begin() + 5, file.end() - 5));
+    EXPECT_EQ(std::string(":tail"), std::string(file.end() - 5, file.end()));
+  }
+
+  void check_write_failure(std::string const& path, async_sink_backend backend) {
+    int const read_only = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_NE(-1, read_only);
+
+    async_sink_options options;
+    options.backend = backend;
+    {
+      async_sink sink(read_only, options);
+      ASSERT_TRUE(sink.ok());
+      async_sink_buffer* buffer = sink.acquire();
+      ASSERT_TRUE(encode(*buffer, 0, document_size(0)));
+      sink.submit(buffer);
+      EXPECT_FALSE(sink.flush());
+      EXPECT_EQ(EBADF, sink.error());
+      EXPECT_EQ(nullptr, sink.acquire());
+    }
+    ::close(read_only);
+  }
+
+  TEST_F(AsyncSink, ReportsWriteFailures) {
+    check_write_failure(path_, async_sink_backend::automatic);
+    check_write_failure(path_, async_sink_backend::thread_pool);
+  }
+
+} // namespace
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/columnar_extractor.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  bool is_valid(std::vector<std::uint8_t> const& validity, std::size_t row) {
+    return validity[row / 8] & (1U << (row % 8));
+  }
+
+  class ColumnarExtractorTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      // Rows alternate between a few hosts; every third row lacks
+      // 'value', and every fifth stores 'ts' as an int32.
+      for (int row = 0; row != k_rows; ++row) {
+        std::array<byte_t, 128> buffer;
+        auto writer = make_array_writer(buffer);
+        auto document = start_document(writer);
+        if (row % 5 == 0)
+          document.encode_int32("ts", row);
+        else
+          document.encode_int64("ts", 1000000000000LL + row);
+        if (row % 3 != 0)
+          document.encode_floating_point("value", row * 0.5);
+        auto tags = document.start_subdocument("tags");
+        tags.encode_utf8_string("host", (row % 2) ? "alpha" : "beta");
+        tags.finish();
+        document.encode_boolean("up", row % 2);
+        document.finish();
+        ASSERT_TRUE(document.ok());
+        data_.insert(data_.end(), buffer.begin(), buffer.begin() + writer.valid());
+      }
+    }
+
+    static const int k_rows = 20;
+    std::vector<byte_t> data_;
+  };
+
+  TEST_F(ColumnarExtractorTest, ExtractsColumns) {
+    std::vector<std::int64_t> ts(k_rows);
+    std::vector<double> value(k_rows);
+    std::vector<std::int32_t> host(k_rows);
+    std::vector<std::uint8_t> up(k_rows);
+    std::vector<std::int32_t> missing(k_rows);
+
+    // Start with dirty validity bitmaps to check that they get cleared.
+    std::vector<std::uint8_t> ts_valid(3, 0xff), value_valid(3, 0xff), host_valid(3, 0xff),
+      up_valid(3, 0xff), missing_valid(3, 0xff);
+    string_dictionary hosts;
+
+    const column_spec columns[] = {
+      { "ts", column_type::int64, ts.data(), ts_valid.data(), nullptr },
+      { "value", column_type::floating_point, value.data(), value_valid.data(), nullptr },
+      { "tags.host", column_type::dictionary_string, host.data(), host_valid.data(), &hosts },
+      { "up", column_type::boolean, up.data(), up_valid.data(), nullptr },
+      { "tags.missing", column_type::int32, missing.data(), missing_valid.data(), nullptr },
+    };
+
+    columnar_extractor extractor(columns, 5, k_rows);
+    EXPECT_EQ(static_cast<std::size_t>(k_rows), extractor.extract(document_sequence(data_.data(), data_.size())));
+
+    ASSERT_EQ(2U, hosts.count());
+    EXPECT_EQ("beta", hosts.value(0));
+    EXPECT_EQ("alpha", hosts.value(1));
+
+    for (int row = 0; row != k_rows; ++row) {
+      EXPECT_TRUE(is_valid(ts_valid, row));
+      EXPECT_EQ((row % 5 == 0) ? row : 1000000000000LL + row, ts[row]);
+
+      EXPECT_EQ(row % 3 != 0, is_valid(value_valid, row));
+      EXPECT_EQ((row % 3 != 0) ? row * 0.5 : 0.0, value[row]);
+
+      EXPECT_TRUE(is_valid(host_valid, row));
+      EXPECT_EQ(row % 2 ? 1 : 0, host[row]);
+
+      EXPECT_TRUE(is_valid(up_valid, row));
+      EXPECT_EQ(row % 2, up[row]);
+
+      EXPECT_FALSE(is_valid(missing_valid, row));
+    }
+  }
+
+  TEST_F(ColumnarExtractorTest, TypeMismatchIsMissing) {
+    std::vector<std::int32_t> ts(k_rows);
+    std::vector<std::uint8_t> ts_valid(3);
+    const column_spec columns[] = {
+      { "ts", column_type::int32, ts.data(), ts_valid.data(), nullptr },
+    };
+
+    columnar_extractor extractor(columns, 1, k_rows);
+    extractor.extract(document_sequence(data_.data(), data_.size()));
+
+    for (int row = 0; row != k_rows; ++row) {
+      EXPECT_EQ(row % 5 == 0, is_valid(ts_valid, row));
+      EXPECT_EQ((row % 5 == 0) ? row : 0, ts[row]);
+    }
+  }
+
+  TEST_F(ColumnarExtractorTest, SharedPathsAndCapacity) {
+    std::vector<std::int64_t> as_int(4);
+    std::vector<double> as_double(4);
+    std::vector<std::uint8_t> int_valid(1), double_valid(1);
+    const column_spec columns[] = {
+      { "ts", column_type::int64, as_int.data(), int_valid.data(), nullptr },
+      { "ts", column_type::floating_point, as_double.data(), double_valid.data(), nullptr },
+    };
+
+    columnar_extractor extractor(columns, 2, 4);
+    EXPECT_EQ(4U, extractor.extract(document_sequence(data_.data(), data_.size())));
+    for (int row = 0; row != 4; ++row)
+      EXPECT_EQ(static_cast<double>(as_int[row]), as_double[row]);
+    EXPECT_EQ(0x0f, int_valid[0]);
+    EXPECT_EQ(0x0f, double_valid[0]);
+  }
+
+  TEST(StringDictionaryTest, InternsDistinctStrings) {
+    string_dictionary dictionary;
+    std::vector<std::string> values;
+    for (int i = 0; i != 1000; ++i)
+      values.push_back("host-" + std::to_string(i));
+
+    for (int pass = 0; pass != 2; ++pass)
+      for (int i = 0; i != 1000; ++i)
+        EXPECT_EQ(i, dictionary.intern(values[i].data(), values[i].size()));
+
+    EXPECT_EQ(1000U, dictionary.count());
+    EXPECT_EQ("host-999", dictionary.value(999));
+    EXPECT_EQ(dictionary.bytes().size(), dictionary.offsets().back());
+
+    dictionary.clear();
+    EXPECT_EQ(0U, dictionary.count());
+    EXPECT_EQ(0, dictionary.intern("x", 1));
+  }
+
+} // namespace
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/corpus_generator.hpp>
+#include <bassoon/decoder_handler.hpp>
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/mapped_file.hpp>
+#include <bassoon/streaming_decoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  corpus_preset const k_presets[] = {
+    corpus_preset::telemetry,
+    corpus_preset::user_profile,
+    corpus_preset::log_event,
+    corpus_preset::wide_sparse,
+  };
+
+  std::vector<byte_t> generate(corpus_profile const& profile, std::uint64_t seed, std::size_t count) {
+    std::vector<byte_t> result;
+    corpus_generator(profile, seed).append(result, count);
+    return result;
+  }
+
+  // How deeply 'document' nests, one for a document without
+  // subdocuments or subarrays.
+  std::size_t depth(document_view const& document) {
+    std::size_t deepest = 0;
+    for (auto const& element : document) {
+      if (element.type() == types::document || element.type() == types::array)
+        deepest = std::max(deepest, depth(document_view(element.value())));
+    }
+    return deepest + 1;
+  }
+
+  TEST(CorpusGenerator, PresetsHaveNames) {
+    for (auto preset : k_presets) {
+      corpus_preset found;
+      ASSERT_TRUE(find_corpus_preset(corpus_preset_name(preset), found));
+      EXPECT_EQ(preset, found);
+    }
+    corpus_preset found;
+    EXPECT_FALSE(find_corpus_preset("no_such_preset", found));
+  }
+
+  TEST(CorpusGenerator, PresetsGenerateValidDocuments) {
+    for (auto preset : k_presets) {
+      corpus_profile const profile = make_corpus_profile(preset);
+      std::vector<byte_t> const corpus = generate(profile, 1, 500);
+
+      std::size_t documents = 0;
+      document_sequence const sequence(corpus.data(), corpus.size());
+      for (auto it = sequence.begin(); it != sequence.end(); ++it) {
+        document_cdata const document = *it;
+        ++documents;
+
+        null_decoder_handler handler;
+        streaming_decoder<null_decoder_handler> decoder(handler);
+        EXPECT_EQ(document.size, decoder.feed(document.data, document.size));
+        EXPECT_TRUE(decoder.ok());
+        EXPECT_LE(depth(document_view(document.data)), profile.max_depth + 1);
+      }
+      EXPECT_EQ(500u, documents) << corpus_preset_name(preset);
+    }
+  }
+
+  TEST(CorpusGenerator, SameSeedSameDocuments) {
+    corpus_profile const profile = make_corpus_profile(corpus_preset::user_profile);
+    EXPECT_EQ(generate(profile, 42, 200), generate(profile, 42, 200));
+    EXPECT_NE(generate(profile, 42, 200), generate(profile, 43, 200));
+
+    // Generating one at a time or all at once makes no difference.
+    corpus_generator generator(profile, 42);
+    std::vector<byte_t> piecewise;
+    for (int i = 0; i != 200; ++i)
+      generator.append(piecewise, 1);
+    EXPECT_EQ(generate(profile, 42, 200), piecewise);
+  }
+
+  TEST(CorpusGenerator, FollowsTheProfile) {
+    corpus_profile profile;
+    profile.min_fields = 3;
+    profile.max_fields = 3;
+    profile.max_depth = 0;
+    profile.weights.utf8_string = 1;
+    profile.min_string_length = 10;
+    profile.max_string_length = 10;
+    profile.key_vocabulary = 3;
+
+    std::vector<byte_t> const corpus = generate(profile, 7, 50);
+    std::set<std::string> names;
+    for (auto document : document_sequence(corpus.data(), corpus.size())) {
+      std::size_t fields = 0;
+      for (auto const& element : document_view(document.data)) {
+        ++fields;
+        EXPECT_EQ(types::utf8_string, element.type());
+        EXPECT_EQ(11u, element.as_string().size);
+        names.insert(element.name().data);
+      }
+      EXPECT_EQ(3u, fields);
+    }
+    EXPECT_EQ(3u, names.size());
+  }
+
+  TEST(CorpusGenerator, WideProfilesDrawDifferentNames) {
+    corpus_profile const profile = make_corpus_profile(corpus_preset::wide_sparse);
+    std::vector<byte_t> const corpus = generate(profile, 3, 100);
+    std::set<std::string> names;
+    for (auto document : document_sequence(corpus.data(), corpus.size())) {
+      for (auto const& element : document_view(document.data))
+        names.insert(element.name().data);
+    }
+    EXPECT_GT(names.size(), 1000u);
+  }
+
+  TEST(CorpusGenerator, WritesFiles) {
+    char path[] = "/tmp/bassoon-test-XXXXXX";
+    int const fd = ::mkstemp(path);
+    ASSERT_NE(-1, fd);
+    ::close(fd);
+
+    corpus_profile const profile = make_corpus_profile(corpus_preset::log_event);
+    ASSERT_TRUE(corpus_generator(profile, 9).write(path, 300));
+
+    mapped_file file(path);
+    ASSERT_TRUE(file.ok());
+    std::vector<byte_t> const expected = generate(profile, 9, 300);
+    ASSERT_EQ(expected.size(), file.size());
+    EXPECT_EQ(0, std::memcmp(expected.data(), file.data(), file.size()));
+    ::unlink(path);
+
+    EXPECT_FALSE(corpus_generator(profile, 9).write("/nonexistent/directory/corpus", 1));
+  }
+
+} // namespace
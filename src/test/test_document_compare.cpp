@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_compare.hpp>
+#include <bassoon/encoder.hpp>
+
+#include "make_document.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::make_document;
+
+  using buffer_type = std::array<byte_t, 256>;
+  using encoder_type = encoder<array_writer<byte_t, 256>>;
+
+  template<typename A, typename B>
+  int compare(A a, B b, std::uint32_t descending = 0) {
+    buffer_type const a_document = make_document<buffer_type>(a);
+    buffer_type const b_document = make_document<buffer_type>(b);
+    int const result = compare_documents(document_view(a_document.data()), document_view(b_document.data()), descending);
+    EXPECT_EQ(-result, compare_documents(document_view(b_document.data()), document_view(a_document.data()), descending));
+    return result;
+  }
+
+  TEST(DocumentCompareTest, OrdersTypes) {
+    byte_t const id[k_object_id_length] = {};
+    byte_t const db_pointer[] = { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    byte_t const scope[] = { 5, 0, 0, 0, 0 };
+
+    // One of each place, in order.
+    std::vector<std::function<void(encoder_type&)>> const values = {
+      [](encoder_type& d) { d.encode_min_key(""); },
+      [&](encoder_type& d) { d.encode_raw_value("", types::undefined_no_deprecated, binary_cdata(id, 0)); },
+      [](encoder_type& d) { d.encode_null(""); },
+      [](encoder_type& d) { d.encode_int32("", 5); },
+      [](encoder_type& d) { d.encode_utf8_string("", ""); },
+      [](encoder_type& d) { d.start_subdocument("").finish(); },
+      [](encoder_type& d) { d.start_subarray("").finish(); },
+      [&](encoder_type& d) { d.encode_binary("", binary_subtypes::generic, binary_cdata(id, 0)); },
+      [&](encoder_type& d) { d.encode_object_id("", object_id_cdata(&id[0])); },
+      [](encoder_type& d) { d.encode_boolean("", false); },
+      [](encoder_type& d) { d.encode_utc_datetime("", -1); },
+      [](encoder_type& d) { d.encode_timestamp("", 0); },
+      [](encoder_type& d) { d.encode_regex("", "", ""); },
+      [&](encoder_type& d) { d.encode_raw_value("", types::db_pointer_no_deprecated, binary_cdata(db_pointer, sizeof(db_pointer))); },
+      [](encoder_type& d) { d.encode_javascript("", ""); },
+      [&](encoder_type& d) { d.encode_scoped_javascript("", "", scope); },
+      [](encoder_type& d) { d.encode_max_key(""); }
+    };
+
+    for (std::size_t i = 0; i != values.size(); ++i) {
+      EXPECT_EQ(0, compare(values[i], values[i])) << i;
+      for (std::size_t j = i + 1; j != values.size(); ++j)
+        EXPECT_EQ(-1, compare(values[i], values[j])) << i << " " << j;
+    }
+
+    // Strings and symbols are alike.
+    EXPECT_EQ(0, compare([](encoder_type& d) { d.encode_utf8_string("", "abc"); },
+                         [](encoder_type& d) { d.encode_symbol("", "abc"); }));
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_symbol("", "abc"); },
+                          [](encoder_type& d) { d.encode_utf8_string("", "abd"); }));
+  }
+
+  TEST(DocumentCompareTest, ComparesNumbersExactly) {
+    std::int64_t const big = (std::int64_t(1) << 53) + 1;
+    double_t const nan = std::numeric_limits<double_t>::quiet_NaN();
+    double_t const infinity = std::numeric_limits<double_t>::infinity();
+
+    auto const int32 = [](std::int32_t v) { return [=](encoder_type& d) { d.encode_int32("", v); }; };
+    auto const int64 = [](std::int64_t v) { return [=](encoder_type& d) { d.encode_int64("", v); }; };
+    auto const real = [](double_t v) { return [=](encoder_type& d) { d.encode_floating_point("", v); }; };
+
+    EXPECT_EQ(0, compare(int32(1), int64(1)));
+    EXPECT_EQ(0, compare(int32(1), real(1.0)));
+    EXPECT_EQ(0, compare(int64(-7), real(-7.0)));
+    EXPECT_EQ(0, compare(real(0.0), real(-0.0)));
+    EXPECT_EQ(0, compare(int32(0), real(-0.0)));
+    EXPECT_EQ(-1, compare(int32(1), real(1.5)));
+    EXPECT_EQ(1, compare(int32(2), real(1.5)));
+    EXPECT_EQ(1, compare(int32(-1), real(-1.5)));
+    EXPECT_EQ(-1, compare(int32(-2), real(-1.5)));
+    EXPECT_EQ(-1, compare(int32(std::numeric_limits<std::int32_t>::max()), int64(std::int64_t(1) << 31)));
+
+    // 2^53 + 1 rounds to 2^53 as a double, but is still greater.
+    EXPECT_EQ(1, compare(int64(big), real(9007199254740992.0)));
+    EXPECT_EQ(-1, compare(int64(big), real(9007199254740994.0)));
+    EXPECT_EQ(-1, compare(int64(std::numeric_limits<std::int64_t>::max()), real(9223372036854775808.0)));
+    EXPECT_EQ(0, compare(int64(std::numeric_limits<std::int64_t>::min()), real(-9223372036854775808.0)));
+    EXPECT_EQ(1, compare(int64(std::numeric_limits<std::int64_t>::min()), real(-infinity)));
+
+    // NaN is below every number, and equal to itself.
+    EXPECT_EQ(0, compare(real(nan), real(-nan)));
+    EXPECT_EQ(-1, compare(real(nan), real(-infinity)));
+    EXPECT_EQ(-1, compare(real(nan), int32(std::numeric_limits<std::int32_t>::min())));
+    EXPECT_EQ(-1, compare(real(nan), int64(std::numeric_limits<std::int64_t>::min())));
+  }
+
+  TEST(DocumentCompareTest, ComparesOtherValues) {
+    auto const string = [](std::string v) { return [=](encoder_type& d) { d.encode_utf8_string("", v); }; };
+    EXPECT_EQ(-1, compare(string("ab"), string("abc")));
+    EXPECT_EQ(-1, compare(string("abc"), string("b")));
+    EXPECT_EQ(-1, compare(string(std::string("a\0b", 3)), string("a\x01")));
+    EXPECT_EQ(1, compare(string("\xc3\xa9"), string("z")));
+
+    // Binary compares by size before content.
+    auto const binary = [](binary_subtypes subtype, std::string v) {
+      return [=](encoder_type& d) { d.encode_binary("", subtype, binary_cdata(v.data(), v.size())); };
+    };
+    EXPECT_EQ(-1, compare(binary(binary_subtypes::generic, "z"), binary(binary_subtypes::generic, "aa")));
+    EXPECT_EQ(-1, compare(binary(binary_subtypes::generic, "z"), binary(binary_subtypes::uuid, "a")));
+
+    // Timestamps are unsigned; dates are not.
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_timestamp("", 1); },
+                          [](encoder_type& d) { d.encode_timestamp("", -1); }));
+    EXPECT_EQ(1, compare([](encoder_type& d) { d.encode_utc_datetime("", 1); },
+                         [](encoder_type& d) { d.encode_utc_datetime("", -1); }));
+
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_regex("", "a", "z"); },
+                          [](encoder_type& d) { d.encode_regex("", "ab", ""); }));
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_regex("", "a", "i"); },
+                          [](encoder_type& d) { d.encode_regex("", "a", "m"); }));
+    EXPECT_EQ(1, compare([](encoder_type& d) { d.encode_boolean("", true); },
+                         [](encoder_type& d) { d.encode_boolean("", false); }));
+
+    byte_t const x1[] = { 12, 0, 0, 0, 0x10, 'x', 0, 1, 0, 0, 0, 0 };
+    byte_t const x2[] = { 12, 0, 0, 0, 0x10, 'x', 0, 2, 0, 0, 0, 0 };
+    EXPECT_EQ(-1, compare([&](encoder_type& d) { d.encode_scoped_javascript("", "f", x2); },
+                          [&](encoder_type& d) { d.encode_scoped_javascript("", "g", x1); }));
+    EXPECT_EQ(-1, compare([&](encoder_type& d) { d.encode_scoped_javascript("", "f", x1); },
+                          [&](encoder_type& d) { d.encode_scoped_javascript("", "f", x2); }));
+  }
+
+  TEST(DocumentCompareTest, ComparesDocuments) {
+    // Type, then name, then value, one element at a time.
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_int32("b", 9); },
+                          [](encoder_type& d) { d.encode_utf8_string("a", ""); }));
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_int32("a", 9); },
+                          [](encoder_type& d) { d.encode_floating_point("b", 1.0); }));
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_int32("a", 9); },
+                          [](encoder_type& d) { d.encode_int32("ab", 1); }));
+    EXPECT_EQ(0, compare([](encoder_type& d) { d.encode_int32("a", 1); d.encode_int64("b", 2); },
+                         [](encoder_type& d) { d.encode_floating_point("a", 1.0); d.encode_int32("b", 2); }));
+
+    // The shorter document is the lesser.
+    EXPECT_EQ(-1, compare([](encoder_type& d) { d.encode_int32("a", 1); },
+                          [](encoder_type& d) { d.encode_int32("a", 1); d.encode_null("b"); }));
+
+    // Within arrays and subdocuments too.
+    EXPECT_EQ(-1, compare([](encoder_type& d) {
+          auto array = d.start_subarray("a");
+          array.encode_int32("0", 1);
+          array.finish();
+        }, [](encoder_type& d) {
+          auto array = d.start_subarray("a");
+          array.encode_int32("0", 1);
+          array.encode_int32("1", 0);
+          array.finish();
+        }));
+    EXPECT_EQ(1, compare([](encoder_type& d) {
+          auto nested = d.start_subdocument("a");
+          nested.encode_utf8_string("x", "b");
+          nested.finish();
+        }, [](encoder_type& d) {
+          auto nested = d.start_subdocument("a");
+          nested.encode_utf8_string("x", "a");
+          nested.encode_utf8_string("y", "z");
+          nested.finish();
+        }));
+  }
+
+  TEST(DocumentCompareTest, ReversesDescendingParts) {
+    auto const key = [](std::int32_t a, std::int32_t b) {
+      return [=](encoder_type& d) { d.encode_int32("", a); d.encode_int32("", b); };
+    };
+    EXPECT_EQ(-1, compare(key(1, 2), key(1, 3)));
+    EXPECT_EQ(1, compare(key(1, 2), key(1, 3), 2));
+    EXPECT_EQ(-1, compare(key(1, 2), key(2, 1), 2));
+    EXPECT_EQ(1, compare(key(1, 2), key(2, 1), 1));
+    EXPECT_EQ(0, compare(key(1, 2), key(1, 2), 3));
+  }
+
+  TEST(DocumentCompareTest, SortsMixedNumbers) {
+    // Sorted as documents, mixed numbers come out in the order of
+    // their values.
+    std::mt19937_64 random(5);
+    std::vector<buffer_type> documents;
+    std::vector<long double> values;
+    for (int i = 0; i != 2000; ++i) {
+      std::int64_t const integer = static_cast<std::int64_t>(random() >> (random() % 64));
+      double_t const real = static_cast<double_t>(integer) + ((random() % 3) - 1) * 0.5;
+      documents.push_back(make_document<buffer_type>([&](encoder_type& d) {
+            switch (i % 3) {
+              case 0:
+                d.encode_int32("", static_cast<std::int32_t>(integer));
+                values.push_back(static_cast<std::int32_t>(integer));
+                break;
+              case 1:
+                d.encode_int64("", integer);
+                values.push_back(integer);
+                break;
+              default:
+                d.encode_floating_point("", real);
+                values.push_back(real);
+                break;
+            }
+          }));
+    }
+
+    std::vector<byte_t const*> sorted;
+    for (auto const& document : documents)
+      sorted.push_back(document.data());
+    std::sort(sorted.begin(), sorted.end(), document_less());
+    std::sort(values.begin(), values.end());
+
+    for (std::size_t i = 0; i != sorted.size(); ++i) {
+      element_view const element = *document_view(sorted[i]).begin();
+      long double value = element.as_floating_point();
+      if (element.type() == types::int32)
+        value = element.as_int32();
+      else if (element.type() == types::int64)
+        value = element.as_int64();
+      EXPECT_EQ(values[i], value) << i;
+    }
+  }
+
+} // namespace
@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_diff.hpp>
+#include <bassoon/encoder.hpp>
+
+#include "make_document.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::make_document;
+
+  using buffer_type = std::array<byte_t, 1024>;
+
+  class DocumentDiffTest : public ::testing::Test {
+  protected:
+    // Diffs 'from' against 'to', applies the patch back to 'from',
+    // and checks that we get 'to' exactly.
+    void round_trip(buffer_type const& from, buffer_type const& to) {
+      document_differ differ;
+      ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(to.data())));
+
+      auto patch_writer = make_array_writer(patch_);
+      ASSERT_TRUE(differ.encode(patch_writer));
+
+      patch_applier applier;
+      ASSERT_TRUE(applier.load(document_view(patch_.data())));
+
+      buffer_type result;
+      auto writer = make_array_writer(result);
+      ASSERT_TRUE(applier.apply(document_view(from.data()), writer));
+
+      document_view const expected(to.data());
+      ASSERT_EQ(expected.size(), writer.valid());
+      EXPECT_EQ(0, std::memcmp(to.data(), result.data(), expected.size()));
+    }
+
+    buffer_type patch_;
+  };
+
+  template<typename Encoder>
+  void encode_base(Encoder& document) {
+    document.encode_int64("_id", 17);
+    document.encode_utf8_string("host", "alpha");
+    auto stats = document.start_subdocument("stats");
+    stats.encode_int32("hits", 10);
+    stats.encode_int32("misses", 2);
+    auto history = stats.start_subarray("history");
+    history.encode_int32("0", 1);
+    history.encode_int32("1", 2);
+    history.finish();
+    stats.finish();
+    document.encode_boolean("up", true);
+  }
+
+  TEST_F(DocumentDiffTest, IdenticalDocumentsGiveEmptyPatch) {
+    buffer_type const from = make_document<buffer_type>([](encoder<array_writer<byte_t, 1024>>& d) { encode_base(d); });
+    document_differ differ;
+    ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(from.data())));
+    EXPECT_TRUE(differ.identical());
+
+    auto writer = make_array_writer(patch_);
+    ASSERT_TRUE(differ.encode(writer));
+    EXPECT_EQ(5U, writer.valid());
+    round_trip(from, from);
+  }
+
+  TEST_F(DocumentDiffTest, SetsOnlyChangedLeaves) {
+    typedef encoder<array_writer<byte_t, 1024>> encoder_type;
+    buffer_type const from = make_document<buffer_type>([](encoder_type& d) { encode_base(d); });
+    buffer_type const to = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int64("_id", 17);
+        d.encode_utf8_string("host", "a much longer host name");
+        auto stats = d.start_subdocument("stats");
+        stats.encode_int32("hits", 11);
+        stats.encode_int32("misses", 2);
+        auto history = stats.start_subarray("history");
+        history.encode_int32("0", 1);
+        history.encode_int32("1", 2);
+        history.encode_int32("2", 3);
+        history.finish();
+        stats.finish();
+        d.encode_boolean("up", true);
+      });
+
+    document_differ differ;
+    ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(to.data())));
+    EXPECT_EQ(3U, differ.set_count());
+    EXPECT_EQ(0U, differ.unset_count());
+
+    auto writer = make_array_writer(patch_);
+    ASSERT_TRUE(differ.encode(writer));
+    document_view const patch(patch_.data());
+    document_view const set(patch.find("$set").as_document());
+    EXPECT_EQ(11, set.find("stats.hits").as_int32());
+    EXPECT_EQ(3, set.find("stats.history.2").as_int32());
+    EXPECT_STREQ("a much longer host name", set.find("host").as_string().data);
+
+    round_trip(from, to);
+  }
+
+  TEST_F(DocumentDiffTest, UnsetsRemovedElementsAndAppendsNewOnes) {
+    typedef encoder<array_writer<byte_t, 1024>> encoder_type;
+    buffer_type const from = make_document<buffer_type>([](encoder_type& d) { encode_base(d); });
+    buffer_type const to = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int64("_id", 17);
+        auto stats = d.start_subdocument("stats");
+        stats.encode_int32("hits", 10);
+        stats.encode_int32("misses", 2);
+        stats.finish();
+        d.encode_boolean("up", true);
+        d.encode_utf8_string("region", "eu");
+        auto extra = d.start_subdocument("extra");
+        extra.encode_null("x");
+        extra.finish();
+      });
+
+    document_differ differ;
+    ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(to.data())));
+    EXPECT_EQ(2U, differ.unset_count());
+    EXPECT_EQ(2U, differ.set_count());
+    round_trip(from, to);
+  }
+
+  TEST_F(DocumentDiffTest, ReplacesReorderedDocuments) {
+    typedef encoder<array_writer<byte_t, 1024>> encoder_type;
+    buffer_type const from = make_document<buffer_type>([](encoder_type& d) { encode_base(d); });
+
+    // Reordering within a subdocument sends the subdocument.
+    buffer_type const nested = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int64("_id", 17);
+        d.encode_utf8_string("host", "alpha");
+        auto stats = d.start_subdocument("stats");
+        stats.encode_int32("misses", 2);
+        stats.encode_int32("hits", 10);
+        stats.finish();
+        d.encode_boolean("up", true);
+      });
+
+    document_differ differ;
+    ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(nested.data())));
+    EXPECT_EQ(1U, differ.set_count());
+    round_trip(from, nested);
+
+    // Reordering at the top level replaces the document.
+    buffer_type const top = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_boolean("up", true);
+        d.encode_int64("_id", 17);
+      });
+    ASSERT_TRUE(differ.diff(document_view(from.data()), document_view(top.data())));
+    EXPECT_FALSE(differ.identical());
+    EXPECT_EQ(0U, differ.set_count());
+    round_trip(from, top);
+  }
+
+  TEST_F(DocumentDiffTest, RandomMutationsRoundTrip) {
+    typedef encoder<array_writer<byte_t, 1024>> encoder_type;
+    std::mt19937 random(42);
+
+    auto encode_random = [&](encoder_type& d) {
+      for (int i = 0; i != 12; ++i) {
+        if (random() % 4 == 0)
+          continue;
+        std::string const name = "f" + std::to_string(i);
+        switch (random() % 3) {
+          case 0:
+            d.encode_int32(name, random() % 3);
+            break;
+          case 1:
+            d.encode_utf8_string(name, std::string(random() % 3, 'x'));
+            break;
+          case 2: {
+            auto nested = d.start_subdocument(name);
+            for (int j = 0; j != 3; ++j)
+              if (random() % 2)
+                nested.encode_int32("n" + std::to_string(j), random() % 2);
+            nested.finish();
+            break;
+          }
+        }
+      }
+    };
+
+    for (int i = 0; i != 200; ++i) {
+      buffer_type const from = make_document<buffer_type>(encode_random);
+      buffer_type const to = make_document<buffer_type>(encode_random);
+      round_trip(from, to);
+      round_trip(to, from);
+    }
+  }
+
+  TEST(PatchApplierTest, RejectsPatchesThatDoNotFit) {
+    buffer_type from;
+    {
+      auto writer = make_array_writer(from);
+      auto document = start_document(writer);
+      document.encode_int32("a", 1);
+      document.finish();
+    }
+
+    buffer_type patch;
+    {
+      auto writer = make_array_writer(patch);
+      auto document = start_document(writer);
+      auto unset = document.start_subdocument("$unset");
+      unset.encode_boolean("b", true);
+      unset.finish();
+      document.finish();
+    }
+
+    patch_applier applier;
+    ASSERT_TRUE(applier.load(document_view(patch.data())));
+    buffer_type result;
+    auto writer = make_array_writer(result);
+    EXPECT_FALSE(applier.apply(document_view(from.data()), writer));
+
+    EXPECT_FALSE(applier.load(document_view(from.data())));
+  }
+
+} // namespace
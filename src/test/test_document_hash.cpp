@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_hash.hpp>
+#include <bassoon/encoder.hpp>
+
+#include "make_document.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::make_document;
+
+  using buffer_type = std::array<byte_t, 4096>;
+  using encoder_type = encoder<array_writer<byte_t, 4096>>;
+
+  template<typename Function>
+  hash_digest hash(Function function, hash_mode mode = hash_mode::canonical,
+                   field_order order = field_order::significant) {
+    buffer_type const document = make_document<buffer_type>(function);
+    hash_digest result;
+    EXPECT_TRUE(hash_document(document_view(document.data()), result, mode, order));
+    return result;
+  }
+
+  TEST(DocumentHashTest, StreamsInAnyPieces) {
+    std::mt19937 random(3);
+    std::vector<byte_t> data(1000);
+    for (auto& byte : data)
+      byte = static_cast<byte_t>(random());
+
+    for (std::size_t size : { 0, 1, 63, 64, 65, 128, 1000 }) {
+      content_hasher whole;
+      whole.update(data.data(), size);
+
+      for (int i = 0; i != 20; ++i) {
+        content_hasher pieces;
+        for (std::size_t offset = 0; offset != size;) {
+          std::size_t const piece = std::min<std::size_t>(random() % 80, size - offset);
+          pieces.update(data.data() + offset, piece);
+          offset += piece;
+        }
+        EXPECT_EQ(whole.digest(), pieces.digest()) << size;
+      }
+    }
+
+    // Trailing zeros and the seed both count.
+    content_hasher a;
+    content_hasher b;
+    content_hasher c(1);
+    a.update(data.data(), 10);
+    b.update(data.data(), 10);
+    c.update(data.data(), 10);
+    b.update("\0", 1);
+    EXPECT_NE(a.digest(), b.digest());
+    EXPECT_NE(a.digest(), c.digest());
+  }
+
+  TEST(DocumentHashTest, SpreadsSingleBitChanges) {
+    std::vector<byte_t> data(200, 0);
+    content_hasher base;
+    base.update(data.data(), data.size());
+    hash_digest const original = base.digest();
+
+    for (std::size_t bit = 0; bit != data.size() * 8; ++bit) {
+      data[bit / 8] ^= static_cast<byte_t>(1 << (bit % 8));
+      content_hasher hasher;
+      hasher.update(data.data(), data.size());
+      hash_digest const changed = hasher.digest();
+      data[bit / 8] ^= static_cast<byte_t>(1 << (bit % 8));
+
+      // About half of the bits of each half should flip.
+      int const low = __builtin_popcountll(original.low ^ changed.low);
+      int const high = __builtin_popcountll(original.high ^ changed.high);
+      EXPECT_GT(low, 12) << bit;
+      EXPECT_LT(low, 52) << bit;
+      EXPECT_GT(high, 12) << bit;
+      EXPECT_LT(high, 52) << bit;
+    }
+  }
+
+  TEST(DocumentHashTest, HashesWhileEncoding) {
+    std::mt19937 random(11);
+    buffer_type const inner = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_utf8_string("copied", "as raw bytes, lengths and all");
+      });
+
+    for (int i = 0; i != 200; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      auto hashing = make_hashing_writer(writer);
+      auto document = start_document(hashing);
+
+      // Subdocuments of every size, so that the patched lengths fall
+      // across block boundaries.
+      for (int j = random() % 12; j != 0; --j) {
+        std::string const name(1 + random() % 20, 'n');
+        switch (random() % 4) {
+          case 0:
+            document.encode_int64(name, random());
+            break;
+          case 1:
+            document.encode_utf8_string(name, std::string(random() % 100, 's'));
+            break;
+          case 2:
+            document.encode_subdocument(name, inner.data());
+            break;
+          default: {
+            auto nested = document.start_subdocument(name);
+            auto array = nested.start_subarray("a");
+            array.encode_utf8_string("0", std::string(random() % 70, 'a'));
+            array.finish();
+            nested.encode_boolean("b", true);
+            nested.finish();
+            break;
+          }
+        }
+      }
+      document.finish();
+      ASSERT_TRUE(document.ok());
+
+      hash_digest expected;
+      ASSERT_TRUE(hash_document(document_view(buffer.data()), expected));
+      EXPECT_EQ(writer.valid(), hashing.size());
+      EXPECT_EQ(expected, hashing.digest());
+    }
+  }
+
+  TEST(DocumentHashTest, NormalizesNumbers) {
+    hash_digest const one = hash([](encoder_type& d) {
+        d.encode_int32("a", 1);
+        auto array = d.start_subarray("b");
+        array.encode_floating_point("0", -0.0);
+        array.finish();
+      });
+
+    EXPECT_EQ(one, hash([](encoder_type& d) {
+          d.encode_int64("a", 1);
+          auto array = d.start_subarray("b");
+          array.encode_int32("0", 0);
+          array.finish();
+        }));
+    EXPECT_EQ(one, hash([](encoder_type& d) {
+          d.encode_floating_point("a", 1.0);
+          auto array = d.start_subarray("b");
+          array.encode_int64("0", 0);
+          array.finish();
+        }));
+
+    // Bytewise, they all differ.
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int32("a", 1); }, hash_mode::bytewise),
+              hash([](encoder_type& d) { d.encode_int64("a", 1); }, hash_mode::bytewise));
+
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int32("a", 1); }),
+              hash([](encoder_type& d) { d.encode_floating_point("a", 1.5); }));
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int32("a", 1); }),
+              hash([](encoder_type& d) { d.encode_utf8_string("a", "1"); }));
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int32("a", 1); }),
+              hash([](encoder_type& d) { d.encode_int32("b", 1); }));
+
+    EXPECT_EQ(hash([](encoder_type& d) { d.encode_int64("a", std::numeric_limits<std::int64_t>::min()); }),
+              hash([](encoder_type& d) { d.encode_floating_point("a", -9223372036854775808.0); }));
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int64("a", std::numeric_limits<std::int64_t>::max()); }),
+              hash([](encoder_type& d) { d.encode_floating_point("a", 9223372036854775808.0); }));
+
+    EXPECT_EQ(hash([](encoder_type& d) { d.encode_floating_point("a", std::numeric_limits<double_t>::quiet_NaN()); }),
+              hash([](encoder_type& d) { d.encode_floating_point("a", -std::numeric_limits<double_t>::signaling_NaN()); }));
+  }
+
+  TEST(DocumentHashTest, CanIgnoreFieldOrder) {
+    auto const forward = [](encoder_type& d) {
+      d.encode_int32("a", 1);
+      d.encode_utf8_string("b", "two");
+      auto nested = d.start_subdocument("c");
+      nested.encode_int32("x", 1);
+      nested.encode_int32("y", 2);
+      nested.finish();
+    };
+    auto const backward = [](encoder_type& d) {
+      auto nested = d.start_subdocument("c");
+      nested.encode_int32("x", 1);
+      nested.encode_int32("y", 2);
+      nested.finish();
+      d.encode_utf8_string("b", "two");
+      d.encode_floating_point("a", 1.0);
+    };
+    auto const nested_swapped = [](encoder_type& d) {
+      d.encode_int32("a", 1);
+      d.encode_utf8_string("b", "two");
+      auto nested = d.start_subdocument("c");
+      nested.encode_int32("y", 2);
+      nested.encode_int32("x", 1);
+      nested.finish();
+    };
+    auto const repeated = [](encoder_type& d) {
+      d.encode_int32("a", 1);
+      d.encode_int32("a", 1);
+    };
+
+    EXPECT_NE(hash(forward), hash(backward));
+    EXPECT_EQ(hash(forward, hash_mode::canonical, field_order::ignored),
+              hash(backward, hash_mode::canonical, field_order::ignored));
+    EXPECT_NE(hash(forward, hash_mode::canonical, field_order::ignored),
+              hash(nested_swapped, hash_mode::canonical, field_order::ignored));
+    EXPECT_NE(hash([](encoder_type& d) { d.encode_int32("a", 1); }, hash_mode::canonical, field_order::ignored),
+              hash(repeated, hash_mode::canonical, field_order::ignored));
+  }
+
+  TEST(DocumentHashTest, RejectsMalformed) {
+    buffer_type document = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_utf8_string("s", "value");
+      });
+
+    // Claim a string longer than the document.
+    document[4 + 1 + 2] = 0xFF;
+    hash_digest result;
+    EXPECT_FALSE(hash_document(document_view(document.data()), result, hash_mode::canonical));
+    EXPECT_FALSE(hash_document(document_view(document.data()), result, hash_mode::canonical, field_order::ignored));
+    EXPECT_TRUE(hash_document(document_view(document.data()), result, hash_mode::bytewise));
+  }
+
+} // namespace
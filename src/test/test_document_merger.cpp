@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_merger.hpp>
+#include <bassoon/encoder.hpp>
+
+#include "make_document.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::make_document;
+
+  using buffer_type = std::array<byte_t, 512>;
+  using encoder_type = encoder<array_writer<byte_t, 512>>;
+
+  class DocumentMergerTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      base_ = make_document<buffer_type>([](encoder_type& d) {
+          d.encode_int64("_id", 1);
+          d.encode_utf8_string("name", "widget");
+          auto meta = d.start_subdocument("meta");
+          meta.encode_int32("version", 1);
+          meta.encode_utf8_string("owner", "alice");
+          meta.finish();
+          d.encode_int32("count", 5);
+        });
+      overlay_ = make_document<buffer_type>([](encoder_type& d) {
+          d.encode_int32("count", 6);
+          auto meta = d.start_subdocument("meta");
+          meta.encode_int32("version", 2);
+          meta.encode_boolean("locked", true);
+          meta.finish();
+          d.encode_utf8_string("color", "blue");
+          d.encode_null("extra");
+        });
+    }
+
+    void expect_merge(document_merger& merger, buffer_type const& expected) {
+      buffer_type result;
+      auto writer = make_array_writer(result);
+      ASSERT_TRUE(merger.merge(document_view(base_.data()), document_view(overlay_.data()), writer));
+      document_view const view(expected.data());
+      ASSERT_EQ(view.size(), writer.valid());
+      EXPECT_EQ(0, std::memcmp(expected.data(), result.data(), view.size()));
+    }
+
+    buffer_type base_;
+    buffer_type overlay_;
+  };
+
+  TEST_F(DocumentMergerTest, OverlayWinsAtTopLevel) {
+    buffer_type const expected = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int64("_id", 1);
+        d.encode_utf8_string("name", "widget");
+        auto meta = d.start_subdocument("meta");
+        meta.encode_int32("version", 2);
+        meta.encode_boolean("locked", true);
+        meta.finish();
+        d.encode_int32("count", 6);
+        d.encode_utf8_string("color", "blue");
+        d.encode_null("extra");
+      });
+
+    document_merger merger;
+    expect_merge(merger, expected);
+  }
+
+  TEST_F(DocumentMergerTest, MergesNestedDocuments) {
+    buffer_type const expected = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int64("_id", 1);
+        d.encode_utf8_string("name", "widget");
+        auto meta = d.start_subdocument("meta");
+        meta.encode_int32("version", 2);
+        meta.encode_utf8_string("owner", "alice");
+        meta.encode_boolean("locked", true);
+        meta.finish();
+        d.encode_int32("count", 6);
+        d.encode_utf8_string("color", "blue");
+        d.encode_null("extra");
+      });
+
+    document_merger merger(2);
+    expect_merge(merger, expected);
+
+    // The merger can be reused.
+    expect_merge(merger, expected);
+  }
+
+  TEST_F(DocumentMergerTest, HandlesDuplicateNames) {
+    base_ = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int32("a", 1);
+        d.encode_int32("b", 2);
+        d.encode_int32("a", 3);
+        d.encode_int32("b", 7);
+      });
+    overlay_ = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int32("a", 4);
+        d.encode_int32("c", 5);
+        d.encode_int32("a", 6);
+      });
+    // 'b' is not in the overlay, so both of its occurrences are kept.
+    buffer_type const expected = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_int32("a", 6);
+        d.encode_int32("b", 2);
+        d.encode_int32("b", 7);
+        d.encode_int32("c", 5);
+      });
+
+    document_merger merger;
+    expect_merge(merger, expected);
+  }
+
+  TEST_F(DocumentMergerTest, EmptyOverlayCopiesBase) {
+    overlay_ = make_document<buffer_type>([](encoder_type&) {});
+    document_merger merger(3);
+    expect_merge(merger, base_);
+  }
+
+  TEST_F(DocumentMergerTest, ManyOverlayFields) {
+    base_ = make_document<buffer_type>([](encoder_type& d) {
+        for (int i = 0; i < 40; i += 2)
+          d.encode_int32(std::to_string(i), i);
+      });
+    overlay_ = make_document<buffer_type>([](encoder_type& d) {
+        for (int i = 0; i < 40; i += 3)
+          d.encode_int32(std::to_string(i), -i);
+      });
+    buffer_type const expected = make_document<buffer_type>([](encoder_type& d) {
+        for (int i = 0; i < 40; i += 2)
+          d.encode_int32(std::to_string(i), (i % 3) ? i : -i);
+        for (int i = 0; i < 40; i += 3)
+          if (i % 2)
+            d.encode_int32(std::to_string(i), -i);
+      });
+
+    document_merger merger;
+    expect_merge(merger, expected);
+  }
+
+  TEST_F(DocumentMergerTest, RejectsMalformedDocuments) {
+    document_merger merger;
+    buffer_type result;
+
+    buffer_type bad = overlay_;
+    bad[document_view(bad.data()).size() - 1] = 1;
+    auto writer = make_array_writer(result);
+    EXPECT_FALSE(merger.merge(document_view(base_.data()), document_view(bad.data()), writer));
+
+    bad = base_;
+    bad[document_view(bad.data()).size() - 1] = 1;
+    auto other_writer = make_array_writer(result);
+    EXPECT_FALSE(merger.merge(document_view(bad.data()), document_view(overlay_.data()), other_writer));
+  }
+
+} // namespace
@@ -0,0 +1,273 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_queue.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 1024>;
+
+  // A document that says which producer made it, and when.
+  template<typename Writer_type>
+  bool encode(Writer_type& writer, int producer, int i) {
+    auto document = start_document(writer);
+    document.encode_int32("producer", producer);
+    document.encode_int32("i", i);
+    document.encode_utf8_string("padding", std::string(i % 50, 'a' + i % 26));
+    document.finish();
+    return document.ok();
+  }
+
+  std::vector<byte_t> expected_documents(int first, int last) {
+    std::vector<byte_t> result;
+    for (int i = first; i != last; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      encode(writer, 0, i);
+      result.insert(result.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    return result;
+  }
+
+  std::size_t document_size(int i) {
+    return 40 + i % 50;
+  }
+
+  // Pushes documents 'first' to 'last' of one producer, starting a
+  // new buffer of 'buffer_size' bytes whenever one would not fit.
+  void produce(document_queue_producer& producer, std::size_t buffer_size, int index, int first, int last) {
+    document_queue_buffer* buffer = producer.acquire();
+    for (int i = first; i != last; ++i) {
+      if (buffer->valid() + document_size(i) > buffer_size) {
+        producer.push(buffer);
+        buffer = producer.acquire();
+      }
+      ASSERT_TRUE(encode(*buffer, index, i));
+    }
+    producer.push(buffer);
+  }
+
+  TEST(DocumentQueue, DrainsDocumentsInOrder) {
+    document_queue_options options;
+    options.buffer_size = 512;
+    document_queue queue(options);
+    produce(*queue.register_producer(), options.buffer_size, 0, 0, 100);
+
+    std::vector<byte_t> drained;
+    EXPECT_TRUE(queue.wait());
+    EXPECT_EQ(100u, queue.drain(drained));
+    EXPECT_EQ(expected_documents(0, 100), drained);
+
+    document_queue_stats const stats = queue.stats();
+    EXPECT_EQ(100u, stats.queued);
+    EXPECT_EQ(100u, stats.drained);
+    EXPECT_EQ(0u, stats.dropped);
+    EXPECT_EQ(0u, stats.spilled);
+  }
+
+  TEST(DocumentQueue, DrainStopsAfterTheBufferThatReachesTheLimit) {
+    document_queue_options options;
+    options.buffer_size = 512;
+    document_queue queue(options);
+    produce(*queue.register_producer(), options.buffer_size, 0, 0, 100);
+
+    std::vector<byte_t> drained;
+    std::size_t const first = queue.drain(drained, 1);
+    EXPECT_LE(1u, first);
+    EXPECT_GT(100u, first);
+    EXPECT_EQ(100u - first, queue.drain(drained));
+    EXPECT_EQ(expected_documents(0, 100), drained);
+  }
+
+  // Many producers, with few buffers each, and a queue too short for
+  // them all, so that producers wait on the consumer, and it on them.
+  TEST(DocumentQueue, DeliversEveryDocumentOnceInProducerOrder) {
+    const int k_producers = 8;
+    const int k_documents = 2000;
+
+    document_queue_options options;
+    options.capacity = 4;
+    options.pool_size = 2;
+    options.buffer_size = 256;
+    document_queue queue(options);
+
+    std::vector<int> next(k_producers, 0);
+    bool in_order = true;
+    std::thread consumer([&]() {
+      while (queue.wait()) {
+        queue.drain([&](document_cdata document) {
+          document_view const view(document);
+          int const producer = view.find("producer").as_int32();
+          in_order = in_order && view.find("i").as_int32() == next[producer]++;
+        });
+      }
+    });
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p != k_producers; ++p) {
+      producers.emplace_back([&, p]() {
+        document_queue_producer* const producer = queue.register_producer();
+        produce(*producer, options.buffer_size, p, 0, k_documents);
+        queue.release_producer(producer);
+      });
+    }
+    for (auto& producer : producers)
+      producer.join();
+    queue.close();
+    consumer.join();
+
+    EXPECT_TRUE(in_order);
+    for (int p = 0; p != k_producers; ++p)
+      EXPECT_EQ(k_documents, next[p]);
+
+    document_queue_stats const stats = queue.stats();
+    EXPECT_EQ(std::uint64_t(k_producers * k_documents), stats.queued);
+    EXPECT_EQ(std::uint64_t(k_producers * k_documents), stats.drained);
+    EXPECT_EQ(0u, stats.dropped);
+  }
+
+  TEST(DocumentQueue, DropsWhenFull) {
+    document_queue_options options;
+    options.capacity = 2;
+    options.pool_size = 4;
+    options.policy = document_queue_policy::drop;
+    document_queue queue(options);
+    document_queue_producer& producer = *queue.register_producer();
+
+    std::vector<document_queue_buffer*> buffers;
+    for (int i = 0; i != 4; ++i) {
+      buffers.push_back(producer.acquire());
+      ASSERT_TRUE(encode(*buffers.back(), 0, i));
+    }
+    EXPECT_EQ(document_queue_push::queued, producer.push(buffers[0]));
+    EXPECT_EQ(document_queue_push::queued, producer.push(buffers[1]));
+    EXPECT_EQ(document_queue_push::dropped, producer.push(buffers[2]));
+    EXPECT_EQ(document_queue_push::dropped, producer.push(buffers[3]));
+
+    // The two dropped came back to the pool; past them, the spare.
+    for (int i = 0; i != 3; ++i) {
+      document_queue_buffer* const buffer = producer.acquire();
+      ASSERT_TRUE(encode(*buffer, 0, i));
+      EXPECT_EQ(document_queue_push::dropped, producer.push(buffer));
+    }
+
+    std::vector<byte_t> drained;
+    EXPECT_EQ(2u, queue.drain(drained));
+    EXPECT_EQ(expected_documents(0, 2), drained);
+
+    document_queue_stats const stats = queue.stats();
+    EXPECT_EQ(2u, stats.queued);
+    EXPECT_EQ(2u, stats.drained);
+    EXPECT_EQ(5u, stats.dropped);
+    EXPECT_EQ(0u, stats.spilled);
+  }
+
+  TEST(DocumentQueue, SpillsWhenFull) {
+    // A pipe, whose writes of this size land whole, as they do on a
+    // file opened with O_APPEND.
+    int fds[2];
+    ASSERT_EQ(0, ::pipe(fds));
+
+    document_queue_options options;
+    options.capacity = 2;
+    options.pool_size = 4;
+    options.buffer_size = 512;
+    options.policy = document_queue_policy::spill;
+    options.spill_fd = fds[1];
+    {
+      document_queue queue(options);
+      document_queue_producer& producer = *queue.register_producer();
+
+      std::vector<document_queue_push> results;
+      for (int i = 0; i != 4; ++i) {
+        document_queue_buffer* const buffer = producer.acquire();
+        ASSERT_TRUE(encode(*buffer, 0, i));
+        results.push_back(producer.push(buffer));
+      }
+      EXPECT_EQ(document_queue_push::queued, results[0]);
+      EXPECT_EQ(document_queue_push::queued, results[1]);
+      EXPECT_EQ(document_queue_push::spilled, results[2]);
+      EXPECT_EQ(document_queue_push::spilled, results[3]);
+
+      std::vector<byte_t> drained;
+      EXPECT_EQ(2u, queue.drain(drained));
+      EXPECT_EQ(expected_documents(0, 2), drained);
+      EXPECT_EQ(2u, queue.stats().spilled);
+    }
+    ::close(fds[1]);
+
+    std::vector<byte_t> spilled;
+    byte_t chunk[512];
+    ssize_t size;
+    while ((size = ::read(fds[0], chunk, sizeof(chunk))) > 0)
+      spilled.insert(spilled.end(), chunk, chunk + size);
+    ::close(fds[0]);
+    EXPECT_EQ(expected_documents(2, 4), spilled);
+  }
+
+  TEST(DocumentQueue, PushingAnEmptyBufferGivesItBack) {
+    document_queue_options options;
+    options.capacity = 2;
+    options.pool_size = 1;
+    options.policy = document_queue_policy::drop;
+    document_queue queue(options);
+    document_queue_producer& producer = *queue.register_producer();
+
+    // The one buffer in the pool, over and over.
+    for (int i = 0; i != 4; ++i)
+      EXPECT_EQ(document_queue_push::queued, producer.push(producer.acquire()));
+
+    // With it queued, the spare, which is not dropped when empty.
+    document_queue_buffer* const buffer = producer.acquire();
+    ASSERT_TRUE(encode(*buffer, 0, 0));
+    EXPECT_EQ(document_queue_push::queued, producer.push(buffer));
+    EXPECT_EQ(document_queue_push::queued, producer.push(producer.acquire()));
+
+    document_queue_stats const stats = queue.stats();
+    EXPECT_EQ(1u, stats.queued);
+    EXPECT_EQ(0u, stats.dropped);
+  }
+
+  TEST(DocumentQueue, CloseReleasesBlockedProducers) {
+    document_queue_options options;
+    options.capacity = 2;
+    options.pool_size = 1;
+    document_queue queue(options);
+    document_queue_producer& producer = *queue.register_producer();
+
+    document_queue_buffer* const first = producer.acquire();
+    ASSERT_TRUE(encode(*first, 0, 0));
+    EXPECT_EQ(document_queue_push::queued, producer.push(first));
+
+    // The pool is empty until the consumer drains, which it never
+    // does: the producer waits until the queue closes.
+    document_queue_push result = document_queue_push::queued;
+    std::thread blocked([&]() {
+      document_queue_buffer* const buffer = producer.acquire();
+      encode(*buffer, 0, 1);
+      result = producer.push(buffer);
+    });
+    queue.close();
+    blocked.join();
+    EXPECT_EQ(document_queue_push::dropped, result);
+
+    // What was queued before still drains.
+    std::vector<byte_t> drained;
+    EXPECT_TRUE(queue.wait());
+    EXPECT_EQ(1u, queue.drain(drained));
+    EXPECT_EQ(expected_documents(0, 1), drained);
+    EXPECT_FALSE(queue.wait());
+  }
+
+}  // namespace
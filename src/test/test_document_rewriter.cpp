@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_rewriter.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/encoder_stats.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  // Redacts 'password' anywhere, renames 'user' to 'login' at the top
+  // level, descends into 'auth', and stamps the result.
+  class proxy_rewriter : public null_rewriter {
+  public:
+    rewrite_action on_element(element_view const& element, std::size_t depth) {
+      ++seen;
+      if (element.has_name("password", 8))
+        return rewrite_action::drop;
+      if (depth == 0 && element.has_name("user", 4))
+        return rewrite_action::replace;
+      if (element.has_name("auth", 4))
+        return rewrite_action::descend;
+      return rewrite_action::keep;
+    }
+
+    template<typename Encoder_type>
+    void on_replace(element_view const& element, std::size_t, Encoder_type& encoder) {
+      encoder.encode_raw_value("login", element.type(), binary_cdata(element.value(), element.value_size()));
+    }
+
+    template<typename Encoder_type>
+    void on_finish(std::size_t depth, Encoder_type& encoder) {
+      if (depth == 0)
+        encoder.encode_int32("proxied", 1);
+    }
+
+    int seen = 0;
+  };
+
+  class DocumentRewriterTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      auto writer = make_array_writer(source_);
+      auto document = start_document(writer);
+      document.encode_utf8_string("user", "alice");
+      document.encode_int64("ts", 1234);
+      auto auth = document.start_subdocument("auth");
+      auth.encode_utf8_string("method", "scram");
+      auth.encode_utf8_string("password", "hunter2");
+      auth.finish();
+      auto payload = document.start_subdocument("payload");
+      payload.encode_utf8_string("password", "untouched, not descended");
+      payload.encode_floating_point("x", 1.5);
+      payload.finish();
+      document.encode_utf8_string("password", "hunter2");
+      document.encode_boolean("last", true);
+      document.finish();
+      ASSERT_TRUE(document.ok());
+    }
+
+    std::array<byte_t, 512> source_;
+    std::array<byte_t, 512> target_;
+  };
+
+  TEST_F(DocumentRewriterTest, NullRewriterCopiesVerbatim) {
+    document_view const source(source_.data());
+    auto writer = make_array_writer(target_);
+    null_rewriter rewriter;
+    EXPECT_TRUE(rewrite_document(source, writer, rewriter));
+    ASSERT_EQ(source.size(), writer.valid());
+    EXPECT_EQ(0, std::memcmp(source_.data(), target_.data(), source.size()));
+  }
+
+  TEST_F(DocumentRewriterTest, RewritesOnlyWhatChanged) {
+    std::array<byte_t, 512> expected;
+    auto expected_writer = make_array_writer(expected);
+    auto document = start_document(expected_writer);
+    document.encode_utf8_string("login", "alice");
+    document.encode_int64("ts", 1234);
+    auto auth = document.start_subdocument("auth");
+    auth.encode_utf8_string("method", "scram");
+    auth.finish();
+    auto payload = document.start_subdocument("payload");
+    payload.encode_utf8_string("password", "untouched, not descended");
+    payload.encode_floating_point("x", 1.5);
+    payload.finish();
+    document.encode_boolean("last", true);
+    document.encode_int32("proxied", 1);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    auto writer = make_array_writer(target_);
+    proxy_rewriter rewriter;
+    EXPECT_TRUE(rewrite_document(document_view(source_.data()), writer, rewriter));
+    ASSERT_EQ(expected_writer.valid(), writer.valid());
+    EXPECT_EQ(0, std::memcmp(expected.data(), target_.data(), writer.valid()));
+
+    // We never look inside 'payload'.
+    EXPECT_EQ(8, rewriter.seen);
+  }
+
+  TEST_F(DocumentRewriterTest, RewritesWithAStatisticsPolicy) {
+    std::array<byte_t, 512> expected;
+    auto expected_writer = make_array_writer(expected);
+    proxy_rewriter plain;
+    ASSERT_TRUE(rewrite_document(document_view(source_.data()), expected_writer, plain));
+
+    thread_encoder_stats::reset();
+    auto writer = make_array_writer(target_);
+    proxy_rewriter rewriter;
+    EXPECT_TRUE(rewrite_document(document_view(source_.data()), writer, rewriter, thread_encoder_stats()));
+    ASSERT_EQ(expected_writer.valid(), writer.valid());
+    EXPECT_EQ(0, std::memcmp(expected.data(), target_.data(), writer.valid()));
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(1u, stats.documents);
+    EXPECT_EQ(1u, stats.depths[1]);
+
+    // Kept elements, copied in runs, are counted as well as those
+    // encoded one at a time; 'payload' is kept whole, so 'x' is not.
+    auto const counted = [&stats](types type) { return stats.elements[static_cast<byte_t>(type)]; };
+    EXPECT_EQ(2u, counted(types::utf8_string));
+    EXPECT_EQ(1u, counted(types::int64));
+    EXPECT_EQ(2u, counted(types::document));
+    EXPECT_EQ(1u, counted(types::boolean));
+    EXPECT_EQ(1u, counted(types::int32));
+    EXPECT_EQ(0u, counted(types::floating_point));
+  }
+
+  TEST_F(DocumentRewriterTest, StopsAtMalformedSource) {
+    // Make the length of the 'alice' string overrun the document.
+    source_[4 + 6 + 1] = 0x7f;
+
+    auto writer = make_array_writer(target_);
+    null_rewriter rewriter;
+    EXPECT_FALSE(rewrite_document(document_view(source_.data()), writer, rewriter));
+  }
+
+  TEST_F(DocumentRewriterTest, FailsWhenTargetIsFull) {
+    std::array<byte_t, 32> small;
+    auto writer = make_array_writer(small);
+    null_rewriter rewriter;
+    EXPECT_FALSE(rewrite_document(document_view(source_.data()), writer, rewriter));
+    EXPECT_FALSE(writer.ok());
+  }
+
+} // namespace
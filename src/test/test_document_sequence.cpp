@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file.hpp>
+#include <bassoon/parallel_scan.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  // Appends 'count' documents of the form { i : <n>, s : "..." } to 'out'.
+  void append_documents(std::vector<byte_t>& out, int count) {
+    for (int i = 0; i != count; ++i) {
+      std::array<byte_t, 64> buffer;
+      auto writer = make_array_writer(buffer);
+      auto document = start_document(writer);
+      document.encode_int32("i", i);
+      document.encode_utf8_string("s", (i % 2) ? "odd" : "even");
+      document.finish();
+      out.insert(out.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+  }
+
+  class DocumentFileTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      char path[] = "/tmp/bassoon_test_XXXXXX";
+      int const fd = ::mkstemp(path);
+      ASSERT_NE(-1, fd);
+      ::close(fd);
+      path_ = path;
+    }
+
+    virtual void TearDown() override {
+      std::remove(path_.c_str());
+    }
+
+    void write_file(std::vector<byte_t> const& contents) {
+      FILE* const file = std::fopen(path_.c_str(), "wb");
+      ASSERT_TRUE(file);
+      ASSERT_EQ(contents.size(), std::fwrite(contents.data(), 1, contents.size(), file));
+      std::fclose(file);
+    }
+
+    std::string path_;
+  };
+
+  TEST(DocumentSequenceTest, IteratesDocuments) {
+    std::vector<byte_t> data;
+    append_documents(data, 10);
+
+    document_sequence const sequence(data.data(), data.size());
+    int count = 0;
+    std::size_t offset = 0;
+    auto current = sequence.begin();
+    for (; current != sequence.end(); ++current, ++count) {
+      EXPECT_EQ(offset, current.offset());
+      EXPECT_EQ(&data[offset], (*current).data);
+      offset += (*current).size;
+    }
+    EXPECT_EQ(10, count);
+    EXPECT_TRUE(current.ok());
+    EXPECT_EQ(data.size(), current.offset());
+  }
+
+  TEST(DocumentSequenceTest, StopsAtTruncatedDocument) {
+    std::vector<byte_t> data;
+    append_documents(data, 3);
+    std::size_t const whole = data.size();
+    append_documents(data, 1);
+    data.pop_back();
+
+    document_sequence const sequence(data.data(), data.size());
+    auto current = sequence.begin();
+    int count = 0;
+    for (; current != sequence.end(); ++current)
+      ++count;
+    EXPECT_EQ(3, count);
+    EXPECT_FALSE(current.ok());
+    EXPECT_EQ(whole, current.offset());
+  }
+
+  TEST(DocumentSequenceTest, EmptySequence) {
+    document_sequence const sequence;
+    EXPECT_TRUE(sequence.begin() == sequence.end());
+    EXPECT_TRUE(sequence.begin().ok());
+  }
+
+  TEST_F(DocumentFileTest, MapsFile) {
+    std::vector<byte_t> data;
+    append_documents(data, 100);
+    write_file(data);
+
+    mapped_file const file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+    ASSERT_EQ(data.size(), file.size());
+    EXPECT_EQ(0, std::memcmp(data.data(), file.data(), data.size()));
+
+    int count = 0;
+    for (auto document : file.documents()) {
+      EXPECT_GT(document.size, 0);
+      ++count;
+    }
+    EXPECT_EQ(100, count);
+  }
+
+  TEST_F(DocumentFileTest, MapsEmptyFile) {
+    mapped_file const file(path_.c_str());
+    EXPECT_TRUE(file.ok());
+    EXPECT_EQ(0U, file.size());
+    EXPECT_TRUE(file.documents().begin() == file.documents().end());
+  }
+
+  TEST(MappedFileTest, ReportsMissingFile) {
+    mapped_file const file("/nonexistent/bassoon/file.bson");
+    EXPECT_FALSE(file.ok());
+    EXPECT_EQ(ENOENT, file.error());
+    EXPECT_EQ(0U, file.size());
+  }
+
+  TEST_F(DocumentFileTest, ParallelScanVisitsEveryDocumentOnce) {
+    // Enough data for several runs.
+    std::vector<byte_t> data;
+    append_documents(data, 200000);
+    write_file(data);
+
+    mapped_file const file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+
+    for (std::size_t threads : { 1, 2, 4, 0 }) {
+      std::atomic<std::size_t> documents(0);
+      std::atomic<std::size_t> bytes(0);
+      std::atomic<std::int64_t> sum(0);
+
+      scan_result const result = parallel_scan(file.documents(), threads, [&](document_sequence const& run) {
+        std::int64_t local_sum = 0;
+        std::size_t local_documents = 0;
+        for (auto document : run) {
+          std::int32_t value;
+          // The first element is 'i', an int32 after a type byte and "i\0".
+          std::memcpy(&value, static_cast<byte_t const*>(document.data) + 7, sizeof(value));
+          local_sum += value;
+          ++local_documents;
+        }
+        documents += local_documents;
+        bytes += run.size();
+        sum += local_sum;
+      });
+
+      EXPECT_TRUE(result.ok);
+      EXPECT_EQ(200000U, result.documents);
+      EXPECT_EQ(data.size(), result.size);
+      EXPECT_EQ(200000U, documents.load());
+      EXPECT_EQ(data.size(), bytes.load());
+      EXPECT_EQ(199999LL * 200000LL / 2, sum.load());
+    }
+  }
+
+  TEST(ParallelScanTest, StopsAtMalformedData) {
+    std::vector<byte_t> data;
+    append_documents(data, 5);
+    std::size_t const whole = data.size();
+    data.push_back(0xff);
+
+    std::atomic<std::size_t> bytes(0);
+    scan_result const result = parallel_scan(document_sequence(data.data(), data.size()), 2,
+                                             [&](document_sequence const& run) {
+                                               bytes += run.size();
+                                             });
+    EXPECT_FALSE(result.ok);
+    EXPECT_EQ(5U, result.documents);
+    EXPECT_EQ(whole, result.size);
+    EXPECT_EQ(whole, bytes.load());
+  }
+
+} // namespace
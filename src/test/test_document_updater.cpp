@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_updater.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  class DocumentUpdaterTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      buffer_.fill(0xee);
+      auto writer = make_array_writer(buffer_);
+      auto document = start_document(writer);
+      document.encode_int32("count", 1);
+      document.encode_utf8_string("name", "short");
+      auto nested = document.start_subdocument("nested");
+      nested.encode_utc_datetime("when", 1000);
+      auto array = nested.start_subarray("tags");
+      array.encode_utf8_string("0", "a");
+      array.encode_utf8_string("1", "b");
+      array.finish();
+      nested.encode_boolean("flag", false);
+      nested.finish();
+      document.encode_floating_point("last", 1.5);
+      document.finish();
+      ASSERT_TRUE(document.ok());
+      size_ = writer.valid();
+    }
+
+    // Checks that the document and each subdocument are framed
+    // correctly after an update.
+    static void expect_well_formed(document_view const& view) {
+      auto current = view.begin();
+      for (; current != view.end(); ++current)
+        if (current->type() == types::document || current->type() == types::array)
+          expect_well_formed(document_view(current->as_document()));
+      EXPECT_TRUE(current.ok());
+    }
+
+    std::array<byte_t, 256> buffer_;
+    std::size_t size_;
+  };
+
+  TEST_F(DocumentUpdaterTest, OverwritesFixedWidthValues) {
+    document_updater updater(buffer_.data(), buffer_.size());
+    EXPECT_EQ(size_, updater.size());
+
+    EXPECT_EQ(update_status::ok, updater.set_int32("count", 2));
+    EXPECT_EQ(update_status::ok, updater.set_utc_datetime("nested.when", 2000));
+    EXPECT_EQ(update_status::ok, updater.set_boolean("nested.flag", true));
+    EXPECT_EQ(update_status::ok, updater.set_floating_point("last", -3.25));
+    EXPECT_EQ(size_, updater.size());
+
+    document_view const view(buffer_.data());
+    EXPECT_EQ(2, view.find("count").as_int32());
+    EXPECT_EQ(2000, view.find_path("nested.when").as_int64());
+    EXPECT_TRUE(view.find_path("nested.flag").as_boolean());
+    EXPECT_EQ(-3.25, view.find("last").as_floating_point());
+    expect_well_formed(view);
+  }
+
+  TEST_F(DocumentUpdaterTest, ChangesTypeOfSameSize) {
+    document_updater updater(buffer_.data(), buffer_.size());
+    EXPECT_EQ(update_status::ok, updater.set_int64("nested.when", 7));
+    EXPECT_EQ(size_, updater.size());
+    EXPECT_EQ(types::int64, document_view(buffer_.data()).find_path("nested.when").type());
+  }
+
+  TEST_F(DocumentUpdaterTest, GrowsAndShrinksNestedValues) {
+    document_updater updater(buffer_.data(), buffer_.size());
+
+    EXPECT_EQ(update_status::ok, updater.set_utf8_string("nested.tags.1", "a much longer string"));
+    EXPECT_EQ(size_ + 19, updater.size());
+    EXPECT_EQ(static_cast<std::size_t>(updater.size()), document_view(buffer_.data()).size());
+
+    {
+      document_view const view(buffer_.data());
+      EXPECT_STREQ("a much longer string", view.find_path("nested.tags.1").as_string().data);
+      EXPECT_STREQ("a", view.find_path("nested.tags.0").as_string().data);
+      EXPECT_FALSE(view.find_path("nested.flag").as_boolean());
+      EXPECT_EQ(1.5, view.find("last").as_floating_point());
+      expect_well_formed(view);
+    }
+
+    EXPECT_EQ(update_status::ok, updater.set_null("nested.tags.1"));
+    EXPECT_EQ(update_status::ok, updater.set_int32("name", 5));
+    EXPECT_EQ(size_ - 6 - 6, updater.size());
+
+    document_view const view(buffer_.data());
+    EXPECT_EQ(types::null, view.find_path("nested.tags.1").type());
+    EXPECT_EQ(5, view.find("name").as_int32());
+    EXPECT_EQ(1.5, view.find("last").as_floating_point());
+    expect_well_formed(view);
+  }
+
+  TEST_F(DocumentUpdaterTest, ReplacesWithSubdocument) {
+    std::array<byte_t, 64> other;
+    auto writer = make_array_writer(other);
+    auto document = start_document(writer);
+    document.encode_int64("x", 9);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    document_updater updater(buffer_.data(), buffer_.size());
+    EXPECT_EQ(update_status::ok, updater.set_document("count", document_cdata(other.data())));
+
+    document_view const view(buffer_.data());
+    EXPECT_EQ(9, view.find_path("count.x").as_int64());
+    expect_well_formed(view);
+  }
+
+  TEST_F(DocumentUpdaterTest, FailsWithoutRoom) {
+    std::vector<byte_t> const before(buffer_.begin(), buffer_.begin() + size_);
+
+    document_updater updater(buffer_.data(), size_ + 4);
+    std::string const longer(10, 'x');
+    EXPECT_EQ(update_status::no_room, updater.set_utf8_string("nested.tags.0", longer));
+    EXPECT_EQ(size_, updater.size());
+    EXPECT_TRUE(std::equal(before.begin(), before.end(), buffer_.begin()));
+
+    // Exactly filling the buffer is fine.
+    EXPECT_EQ(update_status::ok, updater.set_utf8_string("nested.tags.0", "abcde"));
+    EXPECT_EQ(size_ + 4, updater.size());
+    expect_well_formed(document_view(buffer_.data()));
+  }
+
+  TEST_F(DocumentUpdaterTest, ReportsMissingPaths) {
+    document_updater updater(buffer_.data(), buffer_.size());
+    EXPECT_EQ(update_status::not_found, updater.set_int32("missing", 1));
+    EXPECT_EQ(update_status::not_found, updater.set_int32("count.x", 1));
+    EXPECT_EQ(update_status::not_found, updater.set_int32("nested.tags.2", 1));
+    EXPECT_EQ(update_status::not_found, updater.set_int32("nested.whe", 1));
+
+    buffer_[size_ - 1] = 1;
+    EXPECT_EQ(update_status::malformed, updater.set_int32("count", 1));
+  }
+
+} // namespace
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_view.hpp>
+#include <bassoon/encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  class DocumentViewTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      auto writer = make_array_writer(buffer_);
+      auto document = start_document(writer);
+      document.encode_int32("a", 1);
+      document.encode_utf8_string("b", "bee");
+      auto nested = document.start_subdocument("c");
+      nested.encode_floating_point("d", 2.5);
+      auto array = nested.start_subarray("e");
+      array.encode_int64("0", 10);
+      array.encode_boolean("1", true);
+      array.finish();
+      nested.finish();
+      document.encode_null("f");
+      document.finish();
+      ASSERT_TRUE(document.ok());
+      size_ = writer.valid();
+    }
+
+    std::array<byte_t, 256> buffer_;
+    std::size_t size_;
+  };
+
+  TEST_F(DocumentViewTest, IteratesTopLevelElements) {
+    document_view const view(buffer_.data());
+    EXPECT_EQ(size_, view.size());
+
+    std::string names;
+    auto current = view.begin();
+    for (; current != view.end(); ++current)
+      names += current->name().data;
+    EXPECT_EQ("abcf", names);
+    EXPECT_TRUE(current.ok());
+  }
+
+  TEST_F(DocumentViewTest, ReadsValues) {
+    document_view const view(buffer_.data());
+
+    element_view const a = view.find("a");
+    ASSERT_TRUE(static_cast<bool>(a));
+    EXPECT_EQ(types::int32, a.type());
+    EXPECT_EQ(1, a.as_int32());
+    EXPECT_EQ(1U + 2U + 4U, a.size());
+
+    element_view const b = view.find("b");
+    ASSERT_TRUE(static_cast<bool>(b));
+    EXPECT_STREQ("bee", b.as_string().data);
+
+    EXPECT_EQ(types::null, view.find("f").type());
+    EXPECT_FALSE(static_cast<bool>(view.find("missing")));
+  }
+
+  TEST_F(DocumentViewTest, FindsPaths) {
+    document_view const view(buffer_.data());
+
+    EXPECT_EQ(2.5, view.find_path("c.d").as_floating_point());
+    EXPECT_EQ(10, view.find_path("c.e.0").as_int64());
+    EXPECT_TRUE(view.find_path("c.e.1").as_boolean());
+    EXPECT_EQ(types::document, view.find_path("c").type());
+
+    EXPECT_FALSE(static_cast<bool>(view.find_path("c.e.2")));
+    EXPECT_FALSE(static_cast<bool>(view.find_path("a.b")));
+    EXPECT_FALSE(static_cast<bool>(view.find_path("c.x.y")));
+  }
+
+  TEST_F(DocumentViewTest, StopsAtMalformedElement) {
+    // Make the string length of 'b' overrun the document.
+    buffer_[4 + 7 + 3] = 0x7f;
+
+    document_view const view(buffer_.data());
+    auto current = view.begin();
+    int count = 0;
+    for (; current != view.end(); ++current)
+      ++count;
+    EXPECT_EQ(1, count);
+    EXPECT_FALSE(current.ok());
+  }
+
+  TEST_F(DocumentViewTest, RejectsBadFraming) {
+    buffer_[size_ - 1] = 0x01;
+    document_view const view(buffer_.data());
+    EXPECT_TRUE(view.begin() == view.end());
+    EXPECT_FALSE(view.begin().ok());
+  }
+
+} // namespace
@@ -84,4 +84,29 @@ namespace {
     EXPECT_EQ(0, std::memcmp(&expected[0], writer.begin().address(), sizeof(expected)));
   }
 
+  // Same as above, but copying in an array that was encoded separately.
+  TEST(BSONSpecDotOrgExamplesTest, EncodeCopiedBSONIsAwesome) {
+
+    std::array<byte_t, 64> array_buffer;
+    auto array_writer = make_array_writer(array_buffer);
+    auto array = start_document(array_writer);
+    array.encode_utf8_string("0", "awesome");
+    array.encode_floating_point("1", 5.05);
+    array.encode_int32("2", 1986);
+    array.finish();
+    EXPECT_TRUE(array_writer.ok());
+
+    std::array<byte_t, 64> buffer;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer);
+    document.encode_subarray("BSON", array_buffer.data());
+    document.finish();
+    EXPECT_TRUE(writer.ok());
+
+    EXPECT_EQ(0x31U, writer.valid());
+    EXPECT_EQ(0x31, buffer[0]);
+    EXPECT_EQ(0, std::memcmp(array_buffer.data(), &buffer[10], array_writer.valid()));
+    EXPECT_EQ(0, buffer[writer.valid() - 1]);
+  }
+
 }
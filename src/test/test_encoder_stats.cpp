@@ -0,0 +1,279 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_data.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/encoder_stats.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 256>;
+
+  std::uint64_t count(encoder_stats_snapshot const& stats, types type) {
+    return stats.elements[static_cast<byte_t>(type)];
+  }
+
+  std::uint64_t bytes(encoder_stats_snapshot const& stats, types type) {
+    return stats.bytes[static_cast<byte_t>(type)];
+  }
+
+  template<typename stats_type>
+  std::size_t encode_record(buffer_type& buffer) {
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer, stats_type());
+    document.encode_int32("a", 1);
+    document.encode_int32("b", 2);
+    document.encode_utf8_string("name", "value");
+    auto&& child = document.start_subdocument("child");
+    child.encode_boolean("flag", true);
+    auto&& grandchild = child.start_subarray("list");
+    grandchild.encode_int64("0", 3);
+    grandchild.finish();
+    child.finish();
+    document.finish();
+    return writer.ok() ? writer.valid() : 0;
+  }
+
+  class EncoderStats : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      thread_encoder_stats::reset();
+    }
+
+    void TearDown() override {
+      thread_encoder_stats::set_sampler(nullptr, nullptr, 0);
+    }
+  };
+
+  TEST_F(EncoderStats, DisabledEncodesTheSameBytes) {
+    buffer_type plain {};
+    buffer_type counted {};
+    std::size_t const size = encode_record<no_encoder_stats>(plain);
+    ASSERT_NE(0u, size);
+    ASSERT_EQ(size, encode_record<thread_encoder_stats>(counted));
+    EXPECT_EQ(0, std::memcmp(plain.data(), counted.data(), size));
+
+    // Nothing was counted for the encoder without statistics.
+    thread_encoder_stats::reset();
+    encode_record<no_encoder_stats>(plain);
+    EXPECT_EQ(0u, thread_encoder_stats::snapshot().documents);
+  }
+
+  TEST_F(EncoderStats, CountsElementsAndBytesByType) {
+    buffer_type buffer;
+    encode_record<thread_encoder_stats>(buffer);
+    encode_record<thread_encoder_stats>(buffer);
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(4u, count(stats, types::int32));
+    EXPECT_EQ(4u * (1 + 2 + 4), bytes(stats, types::int32));
+    EXPECT_EQ(2u, count(stats, types::utf8_string));
+    EXPECT_EQ(2u * (1 + 5 + 4 + 6), bytes(stats, types::utf8_string));
+    EXPECT_EQ(2u, count(stats, types::document));
+    EXPECT_EQ(2u, count(stats, types::array));
+    EXPECT_EQ(2u, count(stats, types::boolean));
+    EXPECT_EQ(2u, count(stats, types::int64));
+    EXPECT_EQ(0u, stats.failures);
+    EXPECT_FALSE(stats.failed);
+  }
+
+  TEST_F(EncoderStats, CountsTopLevelDocumentsByDepthAndSize) {
+    buffer_type buffer;
+    std::size_t const size = encode_record<thread_encoder_stats>(buffer);
+
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer, thread_encoder_stats());
+    document.finish();
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(2u, stats.documents);
+    EXPECT_EQ(1u, stats.depths[0]);
+    EXPECT_EQ(1u, stats.depths[2]);
+
+    // An empty document is five bytes, in bucket two.
+    EXPECT_EQ(1u, stats.sizes[2]);
+    std::size_t bucket = 0;
+    for (std::size_t remaining = size; remaining > 1; remaining >>= 1)
+      ++bucket;
+    EXPECT_EQ(1u, stats.sizes[bucket]);
+  }
+
+  TEST_F(EncoderStats, AbandonedDocumentsDoNotSkewDepths) {
+    buffer_type abandoned;
+    {
+      auto writer = make_array_writer(abandoned);
+      auto document = start_document(writer, thread_encoder_stats());
+      auto&& child = document.start_subdocument("child");
+      child.encode_int32("a", 1);
+    }
+
+    buffer_type buffer;
+    encode_record<thread_encoder_stats>(buffer);
+    encode_record<thread_encoder_stats>(buffer);
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(2u, stats.documents);
+    EXPECT_EQ(2u, stats.depths[2]);
+  }
+
+  TEST_F(EncoderStats, RecordsTheFirstFailure) {
+    std::array<byte_t, 32> buffer;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer, thread_encoder_stats());
+    document.encode_int32("fits", 1);
+    auto&& child = document.start_subdocument("child");
+    child.encode_utf8_string("too_long", "this string does not fit");
+    child.encode_int32("after", 2);
+    child.finish();
+    document.finish();
+    ASSERT_FALSE(writer.ok());
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(1u, stats.failures);
+    ASSERT_TRUE(stats.failed);
+    EXPECT_EQ(types::utf8_string, stats.first_failure.type);
+    EXPECT_STREQ("too_long", stats.first_failure.name);
+    EXPECT_EQ(2u, stats.first_failure.depth);
+    EXPECT_EQ(4u, stats.first_failure.offset);
+
+    // The failed document is not counted, and the next one is.
+    EXPECT_EQ(0u, stats.documents);
+    buffer_type other;
+    encode_record<thread_encoder_stats>(other);
+    EXPECT_EQ(1u, thread_encoder_stats::snapshot().documents);
+  }
+
+  TEST_F(EncoderStats, CountsElementsCopiedAtOnce) {
+    buffer_type source;
+    ASSERT_NE(0u, encode_record<no_encoder_stats>(source));
+    document_cdata const record(source.data());
+    binary_cdata const elements(source.data() + sizeof(length_t), record.size - sizeof(length_t) - 1);
+
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    auto document = start_document(writer, thread_encoder_stats());
+    document.encode_raw_elements(elements);
+    document.finish();
+    ASSERT_TRUE(writer.ok());
+
+    // Only the top level elements are copied as elements; the child
+    // and what is in it come along as the value of one.
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(2u, count(stats, types::int32));
+    EXPECT_EQ(2u * (1 + 2 + 4), bytes(stats, types::int32));
+    EXPECT_EQ(1u, count(stats, types::utf8_string));
+    EXPECT_EQ(1u, count(stats, types::document));
+    EXPECT_EQ(0u, count(stats, types::boolean));
+    EXPECT_EQ(1u, stats.documents);
+
+    // Too little room for the copy puts the failure down to the
+    // first element copied.
+    thread_encoder_stats::reset();
+    std::array<byte_t, 16> small;
+    auto small_writer = make_array_writer(small);
+    auto failed = start_document(small_writer, thread_encoder_stats());
+    failed.encode_raw_elements(elements);
+    ASSERT_FALSE(small_writer.ok());
+
+    encoder_stats_snapshot const failures = thread_encoder_stats::snapshot();
+    EXPECT_EQ(1u, failures.failures);
+    ASSERT_TRUE(failures.failed);
+    EXPECT_EQ(types::int32, failures.first_failure.type);
+    EXPECT_STREQ("a", failures.first_failure.name);
+    EXPECT_EQ(4u, failures.first_failure.offset);
+  }
+
+  TEST_F(EncoderStats, SamplesOneInEveryPeriodDocuments) {
+    std::vector<std::size_t> sampled;
+    thread_encoder_stats::set_sampler([](void const* document, std::size_t size, void* context) {
+        EXPECT_EQ(size, document_cdata(document).size);
+        static_cast<std::vector<std::size_t>*>(context)->push_back(size);
+      }, &sampled, 3);
+
+    buffer_type buffer;
+    for (int i = 0; i != 10; ++i)
+      encode_record<thread_encoder_stats>(buffer);
+    EXPECT_EQ(3u, sampled.size());
+
+    thread_encoder_stats::set_sampler(nullptr, nullptr, 0);
+    encode_record<thread_encoder_stats>(buffer);
+    EXPECT_EQ(3u, sampled.size());
+  }
+
+  // Which sampler a context belongs to, and how often it was handed
+  // to the other.
+  struct sampler_context {
+    int owner;
+    std::atomic<int>* mismatches;
+  };
+
+  template<int owner>
+  void check_owner(void const*, std::size_t, void* context) {
+    sampler_context const* const checked = static_cast<sampler_context const*>(context);
+    if (checked->owner != owner)
+      checked->mismatches->fetch_add(1);
+  }
+
+  TEST_F(EncoderStats, NeverPairsASamplerWithAnotherContext) {
+    std::atomic<int> mismatches(0);
+    sampler_context const first = { 1, &mismatches };
+    sampler_context const second = { 2, &mismatches };
+    std::atomic<int> started(0);
+    std::atomic<bool> done(false);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i) {
+      threads.emplace_back([&started, &done] {
+          buffer_type buffer;
+          started.fetch_add(1);
+          while (!done.load())
+            encode_record<thread_encoder_stats>(buffer);
+        });
+    }
+    while (started.load() != 4)
+      std::this_thread::yield();
+    for (int i = 0; i != 100000; ++i) {
+      if (i % 2)
+        thread_encoder_stats::set_sampler(check_owner<1>, const_cast<sampler_context*>(&first), 1);
+      else
+        thread_encoder_stats::set_sampler(check_owner<2>, const_cast<sampler_context*>(&second), 1);
+    }
+    done.store(true);
+    for (auto& thread : threads)
+      thread.join();
+
+    // Both contexts outlive every call, so turning sampling off last
+    // is enough.
+    thread_encoder_stats::set_sampler(nullptr, nullptr, 0);
+    EXPECT_EQ(0, mismatches.load());
+  }
+
+  TEST_F(EncoderStats, AddsUpThreadsThatHaveExited) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 4; ++i) {
+      threads.emplace_back([] {
+          buffer_type buffer;
+          for (int j = 0; j != 100; ++j)
+            encode_record<thread_encoder_stats>(buffer);
+        });
+    }
+    for (auto& thread : threads)
+      thread.join();
+
+    buffer_type buffer;
+    encode_record<thread_encoder_stats>(buffer);
+
+    encoder_stats_snapshot const stats = thread_encoder_stats::snapshot();
+    EXPECT_EQ(401u, stats.documents);
+    EXPECT_EQ(802u, count(stats, types::int32));
+  }
+
+} // namespace
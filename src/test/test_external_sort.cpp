@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/external_sort.hpp>
+#include <bassoon/index_key.hpp>
+
+#include "allocation_counter.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 256>;
+  using output_type = std::array<byte_t, 8 << 20>;
+
+  // Documents with a few fields to sort by, some of them missing or
+  // of mixed types, packed one after the other.
+  std::vector<byte_t> make_documents(std::size_t count, unsigned seed) {
+    std::mt19937_64 random(seed);
+    std::vector<byte_t> result;
+    for (std::size_t i = 0; i != count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      auto document = start_document(writer);
+      document.encode_int64("_id", i);
+      if (random() % 8)
+        document.encode_utf8_string("name", "name-" + std::to_string(random() % 50));
+      switch (random() % 3) {
+        case 0:
+          document.encode_int32("value", random() % 100);
+          break;
+        case 1:
+          document.encode_floating_point("value", (random() % 400) / 4.0);
+          break;
+        default:
+          document.encode_utf8_string("value", std::string(random() % 40, 'x'));
+          break;
+      }
+      document.finish();
+      result.insert(result.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    return result;
+  }
+
+  std::vector<std::string> split(byte_t const* data, std::size_t size) {
+    std::vector<std::string> result;
+    for (auto document : document_sequence(data, size))
+      result.emplace_back(static_cast<char const*>(document.data), document.size);
+    return result;
+  }
+
+  // Checks that 'sorted' holds the same documents as 'input', in
+  // order of their keys.
+  void expect_sorted(std::vector<byte_t> const& input, byte_t const* sorted, std::size_t size,
+                     std::uint32_t descending) {
+    std::vector<std::string> expected = split(input.data(), input.size());
+    std::vector<std::string> actual = split(sorted, size);
+    ASSERT_EQ(expected.size(), actual.size());
+
+    index_key_encoder encoder({ "name", "value" }, descending);
+    std::string previous;
+    for (std::size_t i = 0; i != actual.size(); ++i) {
+      std::array<byte_t, 256> key;
+      auto writer = make_array_writer(key);
+      ASSERT_TRUE(encoder.encode(document_view(actual[i].data()), writer));
+      std::string const current(reinterpret_cast<char const*>(key.data()), encoder.body_size());
+      ASSERT_LE(previous, current) << i;
+      previous = current;
+    }
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    EXPECT_EQ(expected, actual);
+  }
+
+  TEST(ExternalSortTest, SortsInMemory) {
+    std::vector<byte_t> const input = make_documents(5000, 1);
+    external_sorter sorter({ "name", "value" });
+    ASSERT_TRUE(sorter.add(document_sequence(input.data(), input.size())));
+    EXPECT_EQ(5000U, sorter.documents());
+    EXPECT_EQ(0U, sorter.spilled_runs());
+
+    std::unique_ptr<output_type> output(new output_type);
+    auto writer = make_array_writer(*output);
+    ASSERT_TRUE(sorter.finish(writer));
+    expect_sorted(input, output->data(), writer.valid(), 0);
+  }
+
+  TEST(ExternalSortTest, SpillsAndMergesInPasses) {
+    std::vector<byte_t> const input = make_documents(40000, 2);
+    for (std::uint32_t descending : { 0u, 1u, 2u }) {
+      external_sort_options options;
+      options.memory_budget = 64 * 1024;
+      options.threads = 4;
+      options.merge_width = 3;
+      external_sorter sorter({ "name", "value" }, descending, options);
+
+      // In several pieces, as a caller streaming its input would.
+      std::size_t offset = 0;
+      std::vector<std::string> const documents = split(input.data(), input.size());
+      for (std::size_t piece = 0; piece != 4; ++piece) {
+        std::size_t size = 0;
+        for (std::size_t i = piece * 10000; i != (piece + 1) * 10000; ++i)
+          size += documents[i].size();
+        ASSERT_TRUE(sorter.add(document_sequence(input.data() + offset, size)));
+        offset += size;
+      }
+      EXPECT_GT(sorter.spilled_runs(), 3U);
+
+      std::unique_ptr<output_type> output(new output_type);
+      auto writer = make_array_writer(*output);
+      ASSERT_TRUE(sorter.finish(writer)) << sorter.error();
+      expect_sorted(input, output->data(), writer.valid(), descending);
+    }
+  }
+
+  TEST(ExternalSortTest, SortsFiles) {
+    std::vector<byte_t> const input = make_documents(20000, 3);
+    char path[] = "/tmp/bassoon-test-XXXXXX";
+    int const fd = ::mkstemp(path);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(static_cast<ssize_t>(input.size()), ::write(fd, input.data(), input.size()));
+    ::close(fd);
+
+    external_sort_options options;
+    options.memory_budget = 256 * 1024;
+    external_sorter sorter({ "name", "value" }, 0, options);
+    bool const added = sorter.add_file(path);
+    ::unlink(path);
+    ASSERT_TRUE(added);
+
+    std::vector<byte_t> sorted;
+    ASSERT_TRUE(sorter.merge());
+    void const* document;
+    while ((document = sorter.next()) != nullptr) {
+      byte_t const* const begin = static_cast<byte_t const*>(document);
+      sorted.insert(sorted.end(), begin, begin + document_cdata(document).size);
+    }
+    ASSERT_TRUE(sorter.ok());
+    expect_sorted(input, sorted.data(), sorted.size(), 0);
+  }
+
+  TEST(ExternalSortTest, StaysWithinTheBudget) {
+    // Only glibc builds without the address sanitizer count the heap
+    // in use.
+    if (!BASSOON_COUNT_MALLOC)
+      return;
+
+    std::vector<byte_t> const input = make_documents(250000, 6);
+    char path[] = "/tmp/bassoon-test-XXXXXX";
+    int const fd = ::mkstemp(path);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(static_cast<ssize_t>(input.size()), ::write(fd, input.data(), input.size()));
+    ::close(fd);
+
+    std::size_t documents = 0;
+    std::size_t spilled_runs = 0;
+    bassoon::testing::allocation_peak peak;
+    {
+      external_sort_options options;
+      options.memory_budget = 4 << 20;
+      options.threads = 2;
+      external_sorter sorter({ "name", "value" }, 0, options);
+
+      // Once from memory, which fills both threads' buffers at once,
+      // and once from the file, a chunk at a time.
+      ASSERT_TRUE(sorter.add(document_sequence(input.data(), input.size())));
+      bool const added = sorter.add_file(path);
+      ::unlink(path);
+      ASSERT_TRUE(added);
+      spilled_runs = sorter.spilled_runs();
+
+      ASSERT_TRUE(sorter.merge());
+      while (sorter.next() != nullptr)
+        ++documents;
+      ASSERT_TRUE(sorter.ok());
+    }
+    EXPECT_EQ(500000U, documents);
+
+    // Enough runs for a pass before the last merge, which reads
+    // through the part of the budget that the chunks did.
+    EXPECT_GT(spilled_runs, 16U);
+
+    // Allow for the threads, the sources of the merge and the like.
+    EXPECT_LE(peak.bytes(), (4U << 20) + (64U << 10));
+  }
+
+  TEST(ExternalSortTest, RejectsMalformedInput) {
+    std::vector<byte_t> const input = make_documents(100, 4);
+    external_sorter sorter({ "name" });
+    EXPECT_FALSE(sorter.add(document_sequence(input.data(), input.size() - 1)));
+    EXPECT_EQ(EINVAL, sorter.error());
+
+    // Nothing more is accepted.
+    EXPECT_FALSE(sorter.add(document_sequence(input.data(), input.size())));
+    EXPECT_FALSE(sorter.merge());
+
+    external_sorter missing({ "name" });
+    EXPECT_FALSE(missing.add_file("/nonexistent/bassoon"));
+    EXPECT_EQ(ENOENT, missing.error());
+  }
+
+  TEST(ExternalSortTest, SortsNothing) {
+    external_sorter sorter({ "name" });
+    ASSERT_TRUE(sorter.add(document_sequence()));
+    std::array<byte_t, 16> output;
+    auto writer = make_array_writer(output);
+    ASSERT_TRUE(sorter.finish(writer));
+    EXPECT_EQ(0U, writer.valid());
+
+    // Too little room for the output.
+    std::vector<byte_t> const input = make_documents(10, 5);
+    external_sorter small({ "name" });
+    ASSERT_TRUE(small.add(document_sequence(input.data(), input.size())));
+    auto small_writer = make_array_writer(output);
+    EXPECT_FALSE(small.finish(small_writer));
+  }
+
+} // namespace
@@ -0,0 +1,300 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_compare.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/index_key.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 512>;
+  using encoder_type = encoder<array_writer<byte_t, 512>>;
+
+  std::string key_of(index_key_encoder& encoder, buffer_type const& document) {
+    std::array<byte_t, 1024> key;
+    auto writer = make_array_writer(key);
+    EXPECT_TRUE(encoder.encode(document_view(document.data()), writer));
+    EXPECT_EQ(encoder.size(), writer.valid());
+    return std::string(reinterpret_cast<char const*>(key.data()), writer.valid());
+  }
+
+  int sign(int value) {
+    return (value > 0) - (value < 0);
+  }
+
+  int compare_keys(std::string const& a, std::string const& b) {
+    return sign(a.compare(b));
+  }
+
+  // Encodes one random value, of any type, named 'name'.
+  void encode_random_value(encoder_type& d, char const* name, std::mt19937_64& random, int depth = 0) {
+    static char const* const strings[] = { "", "a", "ab", "abc", "b", "a\xff", "\xc3\xa9" };
+    static double_t const doubles[] = {
+      0.0, -0.0, 0.5, -0.5, 1.0, -1.0, 1.5, -1.5, 1e-300, -1e-300, 4503599627370495.5, -4503599627370495.5,
+      9007199254740992.0, 9223372036854775808.0, -9223372036854775808.0, 1e300, -1e300,
+      std::numeric_limits<double_t>::infinity(), -std::numeric_limits<double_t>::infinity(),
+      std::numeric_limits<double_t>::quiet_NaN(), 2147483647.5, -2147483648.5
+    };
+    static std::int64_t const integers[] = {
+      0, 1, -1, 2, 2147483647, -2147483648LL, 9007199254740993LL, std::numeric_limits<std::int64_t>::max(),
+      std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::min() + 1
+    };
+    byte_t const id[k_object_id_length] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, static_cast<byte_t>(random() % 3) };
+
+    switch (random() % (depth < 2 ? 16 : 14)) {
+      case 0:
+        d.encode_floating_point(name, doubles[random() % (sizeof(doubles) / sizeof(doubles[0]))]);
+        break;
+      case 1: {
+        std::int64_t const value = integers[random() % (sizeof(integers) / sizeof(integers[0]))];
+        if (value == static_cast<std::int32_t>(value) && random() % 2)
+          d.encode_int32(name, static_cast<std::int32_t>(value));
+        else
+          d.encode_int64(name, value);
+        break;
+      }
+      case 2: {
+        std::string value = strings[random() % (sizeof(strings) / sizeof(strings[0]))];
+        if (random() % 4 == 0)
+          value.insert(random() % (value.size() + 1), 1, '\0');
+        if (random() % 4 == 0)
+          d.encode_symbol(name, value);
+        else
+          d.encode_utf8_string(name, value);
+        break;
+      }
+      case 3:
+        d.encode_binary(name, static_cast<binary_subtypes>(random() % 2), binary_cdata("ab", random() % 3));
+        break;
+      case 4:
+        d.encode_object_id(name, object_id_cdata(&id[0]));
+        break;
+      case 5:
+        d.encode_boolean(name, random() % 2 == 0);
+        break;
+      case 6:
+        d.encode_utc_datetime(name, static_cast<std::int64_t>(random() % 5) - 2);
+        break;
+      case 7:
+        d.encode_timestamp(name, static_cast<std::int64_t>(random() % 3) - 1);
+        break;
+      case 8:
+        d.encode_regex(name, strings[random() % 4], strings[random() % 3]);
+        break;
+      case 9:
+        d.encode_javascript(name, strings[random() % 4]);
+        break;
+      case 10:
+        d.encode_null(name);
+        break;
+      case 11:
+        if (random() % 2)
+          d.encode_min_key(name);
+        else
+          d.encode_max_key(name);
+        break;
+      case 12: {
+        byte_t const scope[] = { 12, 0, 0, 0, 0x10, 'x', 0, static_cast<byte_t>(random() % 2), 0, 0, 0, 0 };
+        d.encode_scoped_javascript(name, strings[random() % 3], scope);
+        break;
+      }
+      case 13: {
+        byte_t pointer[] = { 2, 0, 0, 0, static_cast<byte_t>('a' + random() % 2), 0,
+                             1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, static_cast<byte_t>(random() % 2) };
+        d.encode_raw_value(name, types::db_pointer_no_deprecated, binary_cdata(pointer, sizeof(pointer)));
+        break;
+      }
+      case 14: {
+        auto nested = d.start_subdocument(name);
+        for (int i = random() % 3; i != 0; --i)
+          encode_random_value(nested, (random() % 2) ? "a" : "b", random, depth + 1);
+        nested.finish();
+        break;
+      }
+      default: {
+        auto nested = d.start_subarray(name);
+        int const count = random() % 3;
+        for (int i = 0; i != count; ++i)
+          encode_random_value(nested, std::to_string(i).c_str(), random, depth + 1);
+        nested.finish();
+        break;
+      }
+    }
+  }
+
+  TEST(IndexKeyTest, SortsAsDocumentsCompare) {
+    std::mt19937_64 random(17);
+    for (std::uint32_t descending : { 0u, 1u, 2u, 3u }) {
+      index_key_encoder encoder({ "a", "b" }, descending);
+
+      std::vector<buffer_type> documents;
+      std::vector<buffer_type> keys;
+      std::vector<std::string> encoded;
+      for (int i = 0; i != 300; ++i) {
+        buffer_type document;
+        buffer_type key;
+        auto writer = make_array_writer(document);
+        auto key_writer = make_array_writer(key);
+        auto d = start_document(writer);
+        auto k = start_document(key_writer);
+        std::mt19937_64 replay = random;
+        encode_random_value(d, "a", random);
+        encode_random_value(d, "b", random);
+        encode_random_value(k, "", replay);
+        encode_random_value(k, "", replay);
+        d.finish();
+        k.finish();
+        ASSERT_TRUE(d.ok() && k.ok());
+        documents.push_back(document);
+        keys.push_back(key);
+        encoded.push_back(key_of(encoder, document));
+      }
+
+      for (std::size_t i = 0; i != documents.size(); ++i) {
+        for (std::size_t j = 0; j != documents.size(); ++j) {
+          int const expected = sign(compare_documents(document_view(keys[i].data()), document_view(keys[j].data()),
+                                                      descending));
+          if (expected != 0) {
+            ASSERT_EQ(expected, compare_keys(encoded[i], encoded[j])) << i << " " << j << " " << descending;
+          } else {
+            // Equal values make equal bodies, whatever their types.
+            index_key_encoder body(encoder);
+            key_of(body, documents[i]);
+            std::size_t const size = body.body_size();
+            key_of(body, documents[j]);
+            ASSERT_EQ(size, body.body_size()) << i << " " << j;
+            ASSERT_EQ(0, encoded[i].compare(0, size, encoded[j], 0, size)) << i << " " << j;
+          }
+        }
+      }
+    }
+  }
+
+  TEST(IndexKeyTest, DecodesWhatWasEncoded) {
+    std::mt19937_64 random(23);
+    for (std::uint32_t descending : { 0u, 1u, 2u, 3u }) {
+      index_key_encoder encoder({ "a", "b" }, descending);
+      index_key_decoder decoder(descending);
+
+      for (int i = 0; i != 2000; ++i) {
+        buffer_type document;
+        buffer_type expected;
+        auto writer = make_array_writer(document);
+        auto expected_writer = make_array_writer(expected);
+        auto d = start_document(writer);
+        auto e = start_document(expected_writer);
+        std::mt19937_64 replay = random;
+        encode_random_value(d, "a", random);
+        encode_random_value(d, "b", random);
+        encode_random_value(e, "", replay);
+        encode_random_value(e, "", replay);
+        d.finish();
+        e.finish();
+
+        std::string const key = key_of(encoder, document);
+        buffer_type decoded;
+        auto decoded_writer = make_array_writer(decoded);
+        ASSERT_TRUE(decoder.decode(key.data(), key.size(), decoded_writer));
+        ASSERT_EQ(expected_writer.valid(), decoded_writer.valid()) << i;
+        EXPECT_EQ(0, std::memcmp(expected.data(), decoded.data(), decoded_writer.valid())) << i;
+      }
+    }
+  }
+
+  TEST(IndexKeyTest, EncodesNumbersAlike) {
+    index_key_encoder encoder({ "x" });
+    auto const key = [&](double_t value, types type) {
+      buffer_type document;
+      auto writer = make_array_writer(document);
+      auto d = start_document(writer);
+      if (type == types::int32)
+        d.encode_int32("x", static_cast<std::int32_t>(value));
+      else if (type == types::int64)
+        d.encode_int64("x", static_cast<std::int64_t>(value));
+      else
+        d.encode_floating_point("x", value);
+      d.finish();
+      key_of(encoder, document);
+      return std::string(reinterpret_cast<char const*>(encoder.data()), encoder.body_size());
+    };
+
+    EXPECT_EQ(key(7, types::int32), key(7, types::int64));
+    EXPECT_EQ(key(7, types::int32), key(7, types::floating_point));
+    EXPECT_EQ(key(0, types::int32), key(-0.0, types::floating_point));
+    EXPECT_LT(key(-1, types::int32), key(-0.5, types::floating_point));
+    EXPECT_LT(key(-0.5, types::floating_point), key(-1e-300, types::floating_point));
+    EXPECT_LT(key(-1e-300, types::floating_point), key(0, types::int64));
+    EXPECT_LT(key(0, types::int64), key(1e-300, types::floating_point));
+    EXPECT_LT(key(1e-300, types::floating_point), key(1, types::int32));
+  }
+
+  TEST(IndexKeyTest, HandlesPathsAndMissingFields) {
+    buffer_type document;
+    auto writer = make_array_writer(document);
+    auto d = start_document(writer);
+    auto nested = d.start_subdocument("a");
+    nested.encode_int32("b", 5);
+    nested.finish();
+    d.finish();
+
+    index_key_encoder encoder({ "a.b", "missing" });
+    std::string const key = key_of(encoder, document);
+
+    buffer_type decoded;
+    auto decoded_writer = make_array_writer(decoded);
+    ASSERT_TRUE(index_key_decoder().decode(key.data(), key.size(), decoded_writer));
+
+    buffer_type expected;
+    auto expected_writer = make_array_writer(expected);
+    auto e = start_document(expected_writer);
+    e.encode_int32("", 5);
+    e.encode_null("");
+    e.finish();
+    ASSERT_EQ(expected_writer.valid(), decoded_writer.valid());
+    EXPECT_EQ(0, std::memcmp(expected.data(), decoded.data(), decoded_writer.valid()));
+  }
+
+  TEST(IndexKeyTest, RejectsMalformedKeys) {
+    buffer_type document;
+    auto writer = make_array_writer(document);
+    auto d = start_document(writer);
+    d.encode_utf8_string("a", std::string("x\0y", 3));
+    d.encode_floating_point("b", 2.25);
+    auto nested = d.start_subarray("c");
+    nested.encode_int64("0", -3);
+    nested.finish();
+    d.finish();
+
+    index_key_encoder encoder({ "a", "b", "c" });
+    std::string const key = key_of(encoder, document);
+    index_key_decoder decoder;
+    buffer_type decoded;
+
+    // Every truncation, and a byte of garbage at every position.
+    for (std::size_t size = 0; size != key.size(); ++size) {
+      auto decoded_writer = make_array_writer(decoded);
+      EXPECT_FALSE(decoder.decode(key.data(), size, decoded_writer)) << size;
+    }
+    for (std::size_t i = 0; i != key.size(); ++i) {
+      std::string corrupt = key;
+      corrupt[i] = '\xee';
+      auto decoded_writer = make_array_writer(decoded);
+      decoder.decode(corrupt.data(), corrupt.size(), decoded_writer);
+    }
+
+    // Too little room.
+    std::array<byte_t, 8> small;
+    auto small_writer = make_array_writer(small);
+    EXPECT_FALSE(encoder.encode(document_view(document.data()), small_writer));
+  }
+
+} // namespace
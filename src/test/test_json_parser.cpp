@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/json_parser.hpp>
+#include <bassoon/json_transcoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 4096>;
+
+  // Parses 'json' and prints the document back as relaxed JSON.
+  std::string round_trip(std::string const& json) {
+    json_parser parser;
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    EXPECT_EQ(json_parse_status::ok, parser.parse(json.data(), json.size(), writer)) << json;
+
+    std::array<char, 8192> text;
+    auto text_writer = make_array_writer(text);
+    EXPECT_TRUE(transcode_to_json(document_view(buffer.data()), text_writer));
+    return std::string(text.data(), text_writer.valid());
+  }
+
+  json_parse_status parse_status(std::string const& json, std::size_t max_depth = 100) {
+    json_parser parser(json_number_policy::narrowest, max_depth);
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    return parser.parse(json.data(), json.size(), writer);
+  }
+
+  // One letter per element: i for int32, l for int64, d for double.
+  std::string number_types(std::string const& json, json_number_policy policy) {
+    json_parser parser(policy);
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    EXPECT_EQ(json_parse_status::ok, parser.parse(json.data(), json.size(), writer));
+    std::string result;
+    for (auto const& element : document_view(buffer.data()))
+      result += (element.type() == types::int32) ? 'i' : (element.type() == types::int64) ? 'l' : 'd';
+    return result;
+  }
+
+  TEST(JsonParserTest, ParsesNestedValues) {
+    EXPECT_EQ("{\"a\":1,\"b\":[true,false,null,\"x\",{}],\"c\":{\"d\":-2.5,\"e\":[]},\"f\":\"\"}",
+              round_trip(" {\n\t\"a\" : 1 , \"b\":[ true,false , null,\"x\", { } ],\r\n"
+                         "  \"c\": {\"d\":-25e-1, \"e\" : [ ]}, \"f\":\"\" }  "));
+    EXPECT_EQ("{}", round_trip("{}"));
+  }
+
+  TEST(JsonParserTest, AppliesNumberPolicy) {
+    std::string const json =
+      "{\"a\":1,\"b\":3000000000,\"c\":-2147483648,\"d\":1.5,\"e\":99999999999999999999,"
+      "\"f\":-9223372036854775808,\"g\":1E2,\"h\":0.1}";
+
+    EXPECT_EQ("iliddldd", number_types(json, json_number_policy::narrowest));
+    EXPECT_EQ("lllddldd", number_types(json, json_number_policy::int64));
+    EXPECT_EQ("dddddddd", number_types(json, json_number_policy::floating_point));
+
+    EXPECT_EQ("{\"a\":0.1,\"b\":1.0E+100,\"c\":100000000000000000000.0,\"d\":-0.0,\"e\":2.2250738585072014E-308,"
+              "\"f\":1.7976931348623157E+308,\"g\":0.30000000000000004}",
+              round_trip("{\"a\":0.1,\"b\":1e100,\"c\":100000000000000000000,\"d\":-0.0,"
+                         "\"e\":2.2250738585072014e-308,\"f\":1.7976931348623157e308,"
+                         "\"g\":0.30000000000000004}"));
+  }
+
+  TEST(JsonParserTest, UnescapesStrings) {
+    EXPECT_EQ("{\"k\\\"ey\":\"\\\"\\\\/\\b\\f\\n\\r\\t\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"}",
+              round_trip("{\"k\\\"ey\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\u20AC\\ud83d\\ude00\"}"));
+
+    // Runs of backslashes that end on either side of each block
+    // boundary, before a quote that they may or may not escape.
+    for (std::size_t padding = 50; padding != 80; ++padding) {
+      std::string const json = "{\"a\":\"" + std::string(padding, 'x') + "\\\\\",\"b\":\"\\\\\\\\\\\"\"}";
+      EXPECT_EQ(json, round_trip(json));
+    }
+  }
+
+  TEST(JsonParserTest, ParsesInPlace) {
+    char json[] = "{\"name\":\"value\",\"list\":[\"a\"]}";
+    json_parser parser;
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    ASSERT_EQ(json_parse_status::ok, parser.parse_in_place(json, sizeof(json) - 1, writer));
+
+    // Strings were terminated where their closing quotes were.
+    EXPECT_EQ(0, std::strcmp(json + 2, "name"));
+    EXPECT_EQ(0, std::strcmp(json + 9, "value"));
+
+    document_view const document(buffer.data());
+    ASSERT_TRUE(document.find("name", 4));
+    EXPECT_EQ(0, std::strcmp(document.find("name", 4).as_string().data, "value"));
+  }
+
+  TEST(JsonParserTest, RejectsMalformedInput) {
+    char const* const malformed[] = {
+      "", "   ", "[1]", "\"a\"", "{", "}", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1 \"b\":2}",
+      "{\"a\":1}x", "{\"a\":1}{}", "{\"a\":01}", "{\"a\":1.}", "{\"a\":.5}", "{\"a\":1e}", "{\"a\":-}",
+      "{\"a\":tru}", "{\"a\":truex}", "{\"a\":nul}", "{\"a\":[1,]}", "{\"a\":[1 2]}", "{\"a\":\"b}",
+      "{\"a\":\"\\x\"}", "{\"a\":\"\\u12\"}", "{\"a\":\"\\ud800\"}", "{\"a\":\"\\udc00\"}",
+      "{\"a\\u0000\":1}", "{\"a\":\"tab\there\"}", "{1:2}", "{\"a\":1:2}"
+    };
+    for (char const* json : malformed)
+      EXPECT_EQ(json_parse_status::malformed, parse_status(json)) << json;
+
+    json_parser parser;
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    std::string const json = "{\"a\":[1, 2, fals]}";
+    EXPECT_EQ(json_parse_status::malformed, parser.parse(json.data(), json.size(), writer));
+    EXPECT_EQ(json.find("fals"), parser.error_offset());
+  }
+
+  TEST(JsonParserTest, LimitsDepthAndSize) {
+    EXPECT_EQ(json_parse_status::ok, parse_status("{\"a\":{\"b\":[1]}}", 3));
+    EXPECT_EQ(json_parse_status::too_deep, parse_status("{\"a\":{\"b\":[[1]]}}", 3));
+
+    std::array<byte_t, 16> small;
+    auto writer = make_array_writer(small);
+    json_parser parser;
+    std::string const json = "{\"a\":\"a string that does not fit\"}";
+    EXPECT_EQ(json_parse_status::no_room, parser.parse(json.data(), json.size(), writer));
+  }
+
+  TEST(JsonParserTest, RoundTripsTranscodedDocuments) {
+    // Integers that fit in 32 bits are int32 and others are int64,
+    // and doubles print with a fraction or exponent, so under the
+    // narrowest policy we get back exactly the bytes we started with.
+    std::mt19937 random(7);
+    json_parser parser;
+
+    for (int i = 0; i != 200; ++i) {
+      buffer_type original;
+      auto writer = make_array_writer(original);
+      auto document = start_document(writer);
+      for (int j = 0; j != 20; ++j) {
+        std::string const name = "field \"" + std::to_string(j) + "\"";
+        switch (random() % 6) {
+          case 0:
+            document.encode_int32(name, static_cast<std::int32_t>(random()));
+            break;
+          case 1:
+            document.encode_int64(name, (static_cast<std::int64_t>(random()) << 32) | random());
+            break;
+          case 2:
+            document.encode_floating_point(name, static_cast<std::int32_t>(random()) / 977.0);
+            break;
+          case 3: {
+            std::string value;
+            for (std::size_t k = random() % 90; k != 0; --k)
+              value += static_cast<char>(1 + random() % 127);
+            document.encode_utf8_string(name, value);
+            break;
+          }
+          case 4: {
+            auto nested = document.start_subarray(name);
+            nested.encode_boolean("0", random() % 2 == 0);
+            nested.encode_null("1");
+            nested.finish();
+            break;
+          }
+          default: {
+            auto nested = document.start_subdocument(name);
+            nested.encode_utf8_string("s", "\\\"\\");
+            nested.finish();
+            break;
+          }
+        }
+      }
+      document.finish();
+      ASSERT_TRUE(document.ok());
+
+      std::array<char, 8192> json;
+      auto json_writer = make_array_writer(json);
+      ASSERT_TRUE(transcode_to_json(document_view(original.data()), json_writer));
+
+      buffer_type parsed;
+      auto parsed_writer = make_array_writer(parsed);
+      ASSERT_EQ(json_parse_status::ok, parser.parse(json.data(), json_writer.valid(), parsed_writer))
+        << std::string(json.data(), json_writer.valid());
+      ASSERT_EQ(writer.valid(), parsed_writer.valid());
+      EXPECT_EQ(0, std::memcmp(original.data(), parsed.data(), writer.valid()));
+    }
+  }
+
+} // namespace
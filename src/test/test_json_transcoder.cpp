@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/json_transcoder.hpp>
+
+#include "make_document.hpp"
+
+namespace {
+
+  using namespace bassoon::bson;
+  using bassoon::testing::make_document;
+
+  using buffer_type = std::array<byte_t, 1024>;
+  using encoder_type = encoder<array_writer<byte_t, 1024>>;
+
+  template<typename Function>
+  std::string to_json(Function function, json_mode mode = json_mode::relaxed) {
+    buffer_type const document = make_document<buffer_type>(function);
+    std::array<char, 4096> json;
+    auto writer = make_array_writer(json);
+    EXPECT_TRUE(transcode_to_json(document_view(document.data()), writer, mode));
+    return std::string(json.data(), writer.valid());
+  }
+
+  std::string format_double(double_t value) {
+    char buffer[json_details::k_max_number_size];
+    return std::string(buffer, json_details::format_double(value, buffer));
+  }
+
+  TEST(JsonTranscoderTest, HandlesEveryType) {
+    byte_t const id[k_object_id_length] = { 0x5f, 0x1d, 0x7a, 0xc2, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xff };
+    byte_t const undefined[] = { 0 };
+    byte_t const db_pointer[] = {
+      4, 0, 0, 0, 'd', 'b', '.', 0,
+      0x5f, 0x1d, 0x7a, 0xc2, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xff };
+    byte_t const scope[] = { 12, 0, 0, 0, 0x10, 'x', 0, 1, 0, 0, 0, 0 };
+
+    auto const build = [&](encoder_type& d) {
+        d.encode_floating_point("double", 2.5);
+        d.encode_utf8_string("string", "hello");
+        auto sub = d.start_subdocument("document");
+        sub.encode_boolean("nested", true);
+        sub.finish();
+        auto array = d.start_subarray("array");
+        array.encode_int32("0", 1);
+        array.encode_utf8_string("1", "two");
+        array.finish();
+        d.encode_binary("binary", binary_subtypes::generic, binary_cdata("abcd", 4));
+        d.encode_raw_value("undefined", types::undefined_no_deprecated, binary_cdata(undefined, 0));
+        d.encode_object_id("oid", object_id_cdata(&id[0]));
+        d.encode_boolean("bool", false);
+        d.encode_utc_datetime("date", 1356351330501LL);
+        d.encode_null("null");
+        d.encode_regex("regex", "^a.*b$", "im");
+        d.encode_raw_value("dbpointer", types::db_pointer_no_deprecated, binary_cdata(db_pointer, sizeof(db_pointer)));
+        d.encode_javascript("code", "f()");
+        d.encode_symbol("symbol", "sym");
+        d.encode_scoped_javascript("scoped", "g(x)", scope);
+        d.encode_int32("int32", -42);
+        d.encode_timestamp("timestamp", (std::int64_t(7) << 32) | 3);
+        d.encode_int64("int64", 1LL << 40);
+        d.encode_min_key("min");
+        d.encode_max_key("max");
+      };
+
+    EXPECT_EQ("{\"double\":2.5,"
+              "\"string\":\"hello\","
+              "\"document\":{\"nested\":true},"
+              "\"array\":[1,\"two\"],"
+              "\"binary\":{\"$binary\":{\"base64\":\"YWJjZA==\",\"subType\":\"00\"}},"
+              "\"undefined\":{\"$undefined\":true},"
+              "\"oid\":{\"$oid\":\"5f1d7ac200010203040506ff\"},"
+              "\"bool\":false,"
+              "\"date\":{\"$date\":\"2012-12-24T12:15:30.501Z\"},"
+              "\"null\":null,"
+              "\"regex\":{\"$regularExpression\":{\"pattern\":\"^a.*b$\",\"options\":\"im\"}},"
+              "\"dbpointer\":{\"$dbPointer\":{\"$ref\":\"db.\",\"$id\":{\"$oid\":\"5f1d7ac200010203040506ff\"}}},"
+              "\"code\":{\"$code\":\"f()\"},"
+              "\"symbol\":{\"$symbol\":\"sym\"},"
+              "\"scoped\":{\"$code\":\"g(x)\",\"$scope\":{\"x\":1}},"
+              "\"int32\":-42,"
+              "\"timestamp\":{\"$timestamp\":{\"t\":7,\"i\":3}},"
+              "\"int64\":1099511627776,"
+              "\"min\":{\"$minKey\":1},"
+              "\"max\":{\"$maxKey\":1}}",
+              to_json(build));
+
+    EXPECT_EQ("{\"double\":{\"$numberDouble\":\"2.5\"},"
+              "\"string\":\"hello\","
+              "\"document\":{\"nested\":true},"
+              "\"array\":[{\"$numberInt\":\"1\"},\"two\"],"
+              "\"binary\":{\"$binary\":{\"base64\":\"YWJjZA==\",\"subType\":\"00\"}},"
+              "\"undefined\":{\"$undefined\":true},"
+              "\"oid\":{\"$oid\":\"5f1d7ac200010203040506ff\"},"
+              "\"bool\":false,"
+              "\"date\":{\"$date\":{\"$numberLong\":\"1356351330501\"}},"
+              "\"null\":null,"
+              "\"regex\":{\"$regularExpression\":{\"pattern\":\"^a.*b$\",\"options\":\"im\"}},"
+              "\"dbpointer\":{\"$dbPointer\":{\"$ref\":\"db.\",\"$id\":{\"$oid\":\"5f1d7ac200010203040506ff\"}}},"
+              "\"code\":{\"$code\":\"f()\"},"
+              "\"symbol\":{\"$symbol\":\"sym\"},"
+              "\"scoped\":{\"$code\":\"g(x)\",\"$scope\":{\"x\":{\"$numberInt\":\"1\"}}},"
+              "\"int32\":{\"$numberInt\":\"-42\"},"
+              "\"timestamp\":{\"$timestamp\":{\"t\":7,\"i\":3}},"
+              "\"int64\":{\"$numberLong\":\"1099511627776\"},"
+              "\"min\":{\"$minKey\":1},"
+              "\"max\":{\"$maxKey\":1}}",
+              to_json(build, json_mode::canonical));
+  }
+
+  TEST(JsonTranscoderTest, EscapesStrings) {
+    std::string const plain(40, 'a');
+    std::string const quoted = plain + "\"quoted\" \\ back\tslash\n" + plain + '\x01' + "\xc3\xa9t\xc3\xa9";
+
+    EXPECT_EQ("{\"a\\\"b\":\"" + plain + "\\\"quoted\\\" \\\\ back\\tslash\\n" + plain + "\\u0001\xc3\xa9t\xc3\xa9\"}",
+              to_json([&](encoder_type& d) {
+                  d.encode_utf8_string("a\"b", quoted);
+                }));
+
+    // Every position within a sixteen byte block, and the tail.
+    for (std::size_t i = 0; i != 40; ++i) {
+      std::string value(40, 'x');
+      value[i] = '\x1f';
+      std::string expected = value;
+      expected.replace(i, 1, "\\u001f");
+      EXPECT_EQ("{\"s\":\"" + expected + "\"}", to_json([&](encoder_type& d) {
+            d.encode_utf8_string("s", value);
+          }));
+    }
+  }
+
+  TEST(JsonTranscoderTest, FormatsSpecialValues) {
+    EXPECT_EQ("{\"d\":{\"$date\":{\"$numberLong\":\"-1\"}},\"e\":{\"$date\":\"1970-01-01T00:00:00Z\"}}",
+              to_json([](encoder_type& d) {
+                  d.encode_utc_datetime("d", -1);
+                  d.encode_utc_datetime("e", 0);
+                }));
+
+    EXPECT_EQ("{\"n\":{\"$numberDouble\":\"NaN\"},\"i\":{\"$numberDouble\":\"-Infinity\"}}",
+              to_json([](encoder_type& d) {
+                  d.encode_floating_point("n", std::numeric_limits<double_t>::quiet_NaN());
+                  d.encode_floating_point("i", -std::numeric_limits<double_t>::infinity());
+                }));
+
+    EXPECT_EQ("{\"l\":-9223372036854775808,\"b\":{\"$binary\":{\"base64\":\"//8=\",\"subType\":\"02\"}}}",
+              to_json([](encoder_type& d) {
+                  byte_t const old[] = { 2, 0, 0, 0, 0xff, 0xff };
+                  d.encode_int64("l", std::numeric_limits<std::int64_t>::min());
+                  d.encode_binary("b", binary_subtypes::oldbinary, binary_cdata(old, sizeof(old)));
+                }));
+  }
+
+  TEST(JsonTranscoderTest, FormatsDoublesShortest) {
+    EXPECT_EQ("0.0", format_double(0.0));
+    EXPECT_EQ("-0.0", format_double(-0.0));
+    EXPECT_EQ("1.0", format_double(1.0));
+    EXPECT_EQ("0.1", format_double(0.1));
+    EXPECT_EQ("0.30000000000000004", format_double(0.1 + 0.2));
+    EXPECT_EQ("123456.789", format_double(123456.789));
+    EXPECT_EQ("100000000000000000000.0", format_double(1e20));
+    EXPECT_EQ("1.0E+21", format_double(1e21));
+    EXPECT_EQ("0.000001", format_double(1e-6));
+    EXPECT_EQ("1.0E-7", format_double(1e-7));
+    EXPECT_EQ("5.0E-324", format_double(5e-324));
+    EXPECT_EQ("1.7976931348623157E+308", format_double(std::numeric_limits<double_t>::max()));
+    EXPECT_EQ("2.2250738585072014E-308", format_double(std::numeric_limits<double_t>::min()));
+  }
+
+  TEST(JsonTranscoderTest, DoublesRoundTrip) {
+    // Whatever we print must read back exactly, and no shorter
+    // precision may do so.
+    std::mt19937_64 random(1);
+    char expected[32];
+    for (int i = 0; i != 100000; ++i) {
+      std::uint64_t const bits = random();
+      double_t value;
+      std::memcpy(&value, &bits, sizeof(value));
+      if (!std::isfinite(value))
+        continue;
+
+      std::string const text = format_double(value);
+      ASSERT_EQ(value, std::strtod(text.c_str(), nullptr)) << text;
+
+      int precision = 1;
+      for (; precision != 17; ++precision) {
+        std::snprintf(expected, sizeof(expected), "%.*e", precision - 1, value);
+        if (std::strtod(expected, nullptr) == value)
+          break;
+      }
+      // Count the significant digits, which the ".0" or the zeros
+      // that pad out an integral value are not.
+      std::string digits = text.substr(0, text.find('E'));
+      digits.erase(std::remove_if(digits.begin(), digits.end(),
+                                  [](char c) { return c == '-' || c == '.'; }),
+                   digits.end());
+      digits.erase(0, digits.find_first_not_of('0'));
+      digits.erase(digits.find_last_not_of('0') + 1);
+      ASSERT_EQ(static_cast<std::size_t>(precision), digits.size()) << text;
+    }
+  }
+
+  TEST(JsonTranscoderTest, RejectsMalformedAndReportsFullWriter) {
+    buffer_type document = make_document<buffer_type>([](encoder_type& d) {
+        d.encode_utf8_string("s", std::string(100, 'x'));
+      });
+
+    std::array<char, 64> small;
+    auto small_writer = make_array_writer(small);
+    EXPECT_FALSE(transcode_to_json(document_view(document.data()), small_writer));
+
+    // Claim a string longer than the document.
+    document[4 + 1 + 2] = 0xFF;
+    std::array<char, 4096> json;
+    auto writer = make_array_writer(json);
+    EXPECT_FALSE(transcode_to_json(document_view(document.data()), writer));
+  }
+
+} // namespace
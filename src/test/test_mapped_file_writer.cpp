@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/document_sequence.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file.hpp>
+#include <bassoon/mapped_file_writer.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 8192>;
+
+  class MappedFileWriter : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char path[] = "/tmp/bassoon-test-XXXXXX";
+      int const fd = ::mkstemp(path);
+      ASSERT_NE(-1, fd);
+      ::close(fd);
+      path_ = path;
+    }
+
+    void TearDown() override {
+      ::unlink(path_.c_str());
+    }
+
+    std::string path_;
+  };
+
+  // A document of about 'size' bytes, with its length backpatched
+  // around a nested subdocument.
+  template<typename Writer_type>
+  bool encode(Writer_type& writer, int i, std::size_t size) {
+    auto document = start_document(writer);
+    document.encode_int32("i", i);
+    auto&& nested = document.start_subdocument("nested");
+    nested.encode_utf8_string("padding", std::string(size, 'a' + i % 26));
+    nested.finish();
+    document.finish();
+    return document.ok();
+  }
+
+  std::vector<byte_t> expected_documents(int count) {
+    std::vector<byte_t> result;
+    for (int i = 0; i != count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      encode(writer, i, 100 + (i * 37) % 3000);
+      result.insert(result.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    return result;
+  }
+
+  TEST_F(MappedFileWriter, WritesDocumentsAcrossExtents) {
+    mapped_file_writer_options options;
+    options.extent = 4096;
+
+    {
+      mapped_file_writer writer(path_.c_str(), options);
+      ASSERT_TRUE(writer.ok());
+      for (int i = 0; i != 200; ++i)
+        ASSERT_TRUE(encode(writer, i, 100 + (i * 37) % 3000));
+      EXPECT_TRUE(writer.sync());
+      EXPECT_TRUE(writer.close());
+    }
+
+    std::vector<byte_t> const expected = expected_documents(200);
+    mapped_file file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+    ASSERT_EQ(expected.size(), file.size());
+    EXPECT_EQ(0, std::memcmp(expected.data(), file.data(), file.size()));
+
+    std::size_t documents = 0;
+    for (auto document : file.documents()) {
+      (void)document;
+      ++documents;
+    }
+    EXPECT_EQ(200u, documents);
+  }
+
+  TEST_F(MappedFileWriter, DestructorTruncatesToWhatWasWritten) {
+    std::size_t written;
+    {
+      mapped_file_writer writer(path_.c_str());
+      ASSERT_TRUE(encode(writer, 1, 10));
+      written = writer.valid();
+    }
+    mapped_file file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+    EXPECT_EQ(written, file.size());
+  }
+
+  TEST_F(MappedFileWriter, FailsPastTheReservation) {
+    mapped_file_writer_options options;
+    options.extent = 4096;
+    options.reservation = 8192;
+
+    mapped_file_writer writer(path_.c_str(), options);
+    ASSERT_TRUE(encode(writer, 1, 3000));
+    EXPECT_FALSE(encode(writer, 2, 6000));
+    EXPECT_FALSE(writer.ok());
+    EXPECT_EQ(EFBIG, writer.error());
+
+    // Once failed, it stays failed, even with room to spare.
+    EXPECT_FALSE(writer.reserve(1));
+  }
+
+  TEST_F(MappedFileWriter, CloseDropsADocumentLeftUnfinished) {
+    mapped_file_writer_options options;
+    options.extent = 4096;
+    options.reservation = 8192;
+
+    {
+      mapped_file_writer writer(path_.c_str(), options);
+      ASSERT_TRUE(encode(writer, 1, 3000));
+      std::size_t const finished = writer.valid();
+      EXPECT_FALSE(encode(writer, 2, 6000));
+      EXPECT_LT(finished, writer.valid());
+      EXPECT_FALSE(writer.close());
+    }
+
+    buffer_type expected;
+    auto expected_writer = make_array_writer(expected);
+    encode(expected_writer, 1, 3000);
+    mapped_file file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+    ASSERT_EQ(expected_writer.valid(), file.size());
+    EXPECT_EQ(0, std::memcmp(expected.data(), file.data(), file.size()));
+  }
+
+  TEST_F(MappedFileWriter, DurableCloseKeepsWhatWasWritten) {
+    mapped_file_writer_options options;
+    options.durable = true;
+
+    std::size_t written;
+    {
+      mapped_file_writer writer(path_.c_str(), options);
+      ASSERT_TRUE(encode(writer, 1, 10));
+      written = writer.valid();
+      EXPECT_TRUE(writer.close());
+    }
+    mapped_file file(path_.c_str());
+    ASSERT_TRUE(file.ok());
+    EXPECT_EQ(written, file.size());
+  }
+
+  TEST_F(MappedFileWriter, FailsAfterClose) {
+    mapped_file_writer writer(path_.c_str());
+    ASSERT_TRUE(encode(writer, 1, 10));
+    ASSERT_TRUE(writer.close());
+    EXPECT_FALSE(writer.reserve(1));
+  }
+
+  TEST_F(MappedFileWriter, ReportsOpenFailures) {
+    mapped_file_writer writer("/nonexistent/directory/file");
+    EXPECT_FALSE(writer.ok());
+    EXPECT_EQ(ENOENT, writer.error());
+    EXPECT_FALSE(writer.reserve(1));
+  }
+
+} // namespace
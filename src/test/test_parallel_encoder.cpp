@@ -0,0 +1,236 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <bassoon/arena_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file.hpp>
+#include <bassoon/parallel_encoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  struct record {
+    std::int64_t id;
+    std::string name;
+    double score;
+  };
+
+  std::vector<record> make_records(int count) {
+    std::vector<record> result;
+    for (int i = 0; i != count; ++i)
+      result.push_back(record{ i, std::string(i % 97, 'a' + i % 26), i * 0.5 });
+    return result;
+  }
+
+  void encode_record(arena_writer& writer, record const& record) {
+    auto document = start_document(writer);
+    document.encode_int64("id", record.id);
+    document.encode_utf8_string("name", record.name);
+    document.encode_floating_point("score", record.score);
+    document.finish();
+  }
+
+  std::vector<byte_t> encode_serially(std::vector<record> const& records) {
+    arena_writer writer;
+    for (auto const& record : records)
+      encode_record(writer, record);
+    return std::vector<byte_t>(writer.data(), writer.data() + writer.valid());
+  }
+
+  std::vector<std::size_t> segment_sizes(parallel_encoder const& encoder) {
+    std::vector<std::size_t> result;
+    for (auto const& segment : encoder.segments())
+      result.push_back(segment.iov_len);
+    return result;
+  }
+
+  TEST(ArenaWriter, GrowsWithoutMoving) {
+    arena_writer_options options;
+    options.extent = 4096;
+    arena_writer writer(options);
+    ASSERT_TRUE(writer.ok());
+
+    byte_t const* const data = writer.data();
+    std::vector<record> const records = make_records(1000);
+    for (auto const& record : records)
+      encode_record(writer, record);
+    EXPECT_TRUE(writer.ok());
+    EXPECT_EQ(data, writer.data());
+    EXPECT_LT(4096u, writer.valid());
+
+    writer.clear();
+    EXPECT_EQ(0u, writer.valid());
+  }
+
+  TEST(ArenaWriter, FailsPastItsReservation) {
+    arena_writer_options options;
+    options.extent = 4096;
+    options.reservation = 8192;
+    arena_writer writer(options);
+    EXPECT_TRUE(writer.reserve(8192));
+    EXPECT_FALSE(writer.reserve(8193));
+    EXPECT_EQ(ENOMEM, writer.error());
+
+    writer.clear();
+    EXPECT_TRUE(writer.ok());
+  }
+
+  TEST(ParallelEncoder, MatchesSerialEncoding) {
+    std::vector<record> const records = make_records(100000);
+    std::vector<byte_t> const expected = encode_serially(records);
+
+    for (std::size_t threads : { 1, 2, 3, 8 }) {
+      parallel_encoder_options options;
+      options.threads = threads;
+      options.min_grain = 100;
+      parallel_encoder encoder(options);
+      ASSERT_TRUE(encoder.encode(records.begin(), records.end(), encode_record));
+      EXPECT_EQ(expected.size(), encoder.size());
+
+      std::vector<byte_t> output;
+      encoder.concatenate(output);
+      EXPECT_EQ(expected, output) << threads << " threads";
+    }
+  }
+
+  TEST(ParallelEncoder, EncodesBatchAfterBatch) {
+    parallel_encoder_options options;
+    options.threads = 4;
+    options.min_grain = 10;
+    parallel_encoder encoder(options);
+
+    for (int count : { 5000, 0, 37, 20000, 1 }) {
+      std::vector<record> const records = make_records(count);
+      ASSERT_TRUE(encoder.encode(records.begin(), records.end(), encode_record));
+
+      std::vector<byte_t> output;
+      encoder.concatenate(output);
+      EXPECT_EQ(encode_serially(records), output) << count << " records";
+    }
+  }
+
+  TEST(ParallelEncoder, DeterministicSegmentsDoNotDependOnThreads) {
+    std::vector<record> const records = make_records(10000);
+    std::vector<std::size_t> first;
+    for (std::size_t threads : { 1, 3, 8 }) {
+      parallel_encoder_options options;
+      options.threads = threads;
+      options.min_grain = 256;
+      options.deterministic = true;
+      parallel_encoder encoder(options);
+      ASSERT_TRUE(encoder.encode(records.begin(), records.end(), encode_record));
+
+      // One segment for each run of 'min_grain' records.
+      EXPECT_EQ((records.size() + 255) / 256, encoder.segments().size());
+      if (first.empty())
+        first = segment_sizes(encoder);
+      else
+        EXPECT_EQ(first, segment_sizes(encoder)) << threads << " threads";
+    }
+  }
+
+  TEST(ParallelEncoder, SmallBatchesStayOnTheCallingThread) {
+    parallel_encoder_options options;
+    options.threads = 4;
+    options.min_grain = 1000;
+    parallel_encoder encoder(options);
+
+    std::vector<record> const records = make_records(1000);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    ASSERT_TRUE(encoder.encode(records.begin(), records.end(), [&](arena_writer& writer, record const& record) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+      }
+      encode_record(writer, record);
+    }));
+    EXPECT_EQ(std::set<std::thread::id>{ std::this_thread::get_id() }, threads);
+    EXPECT_EQ(1u, encoder.segments().size());
+  }
+
+  TEST(ParallelEncoder, SegmentsCanBeWrittenWithWritev) {
+    std::vector<record> const records = make_records(20000);
+    parallel_encoder_options options;
+    options.threads = 4;
+    options.min_grain = 500;
+    options.deterministic = true;
+    parallel_encoder encoder(options);
+    ASSERT_TRUE(encoder.encode(records.begin(), records.end(), encode_record));
+
+    char path[] = "/tmp/bassoon-test-XXXXXX";
+    int const fd = ::mkstemp(path);
+    ASSERT_NE(-1, fd);
+    std::vector<iovec> const& segments = encoder.segments();
+    EXPECT_EQ(ssize_t(encoder.size()), ::writev(fd, segments.data(), segments.size()));
+    ::close(fd);
+
+    mapped_file file(path);
+    ASSERT_TRUE(file.ok());
+    byte_t const* const data = static_cast<byte_t const*>(file.data());
+    EXPECT_EQ(encode_serially(records), std::vector<byte_t>(data, data + file.size()));
+    ::unlink(path);
+  }
+
+  TEST(ParallelEncoder, ReportsArenasThatRunOutOfRoom) {
+    // Each record on a thread of its own, and each larger than an
+    // arena can hold.
+    std::vector<record> const records = { record{ 1, std::string(10000, 'a'), 1.0 },
+                                          record{ 2, std::string(10000, 'b'), 2.0 } };
+    parallel_encoder_options options;
+    options.threads = 2;
+    options.min_grain = 1;
+    options.arena.extent = 4096;
+    options.arena.reservation = 8192;
+    parallel_encoder encoder(options);
+    EXPECT_FALSE(encoder.encode(records.begin(), records.end(), encode_record));
+    EXPECT_EQ(ENOMEM, encoder.error());
+    EXPECT_TRUE(encoder.segments().empty());
+  }
+
+  TEST(ParallelEncoder, StopsEveryThreadOnceAnArenaFails) {
+    // The first record is larger than an arena can hold. The other
+    // thread only starts on its records once that has failed.
+    std::vector<record> records = make_records(200);
+    records[0].name = std::string(10000, 'a');
+    parallel_encoder_options options;
+    options.threads = 2;
+    options.min_grain = 1;
+    options.deterministic = true;
+    options.arena.extent = 4096;
+    options.arena.reservation = 8192;
+    parallel_encoder encoder(options);
+
+    std::atomic<bool> failed(false);
+    std::atomic<int> encoded(0);
+    EXPECT_FALSE(encoder.encode(records.begin(), records.end(), [&](arena_writer& writer, record const& record) {
+      if (record.id != 0) {
+        while (!failed.load())
+          std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      encode_record(writer, record);
+      ++encoded;
+      if (!writer.ok())
+        failed.store(true);
+    }));
+    EXPECT_EQ(ENOMEM, encoder.error());
+
+    // Otherwise, the other thread would go on to encode every record
+    // but the first.
+    EXPECT_GT(10, encoded.load());
+  }
+
+}  // namespace
@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/shm_ring.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 8192>;
+
+  // A document of about 'size' bytes, with its length backpatched
+  // around a nested subdocument.
+  template<typename Writer_type>
+  bool encode(Writer_type& writer, int i, std::size_t size) {
+    auto document = start_document(writer);
+    document.encode_int32("i", i);
+    auto&& nested = document.start_subdocument("nested");
+    nested.encode_utf8_string("padding", std::string(size, 'a' + i % 26));
+    nested.finish();
+    document.finish();
+    return document.ok();
+  }
+
+  std::size_t document_size(int i) {
+    return 100 + (i * 37) % 3000;
+  }
+
+  std::vector<byte_t> expected_document(int i) {
+    buffer_type buffer;
+    auto writer = make_array_writer(buffer);
+    encode(writer, i, document_size(i));
+    return std::vector<byte_t>(buffer.begin(), buffer.begin() + writer.valid());
+  }
+
+  std::vector<byte_t> bytes(document_cdata document) {
+    byte_t const* const data = static_cast<byte_t const*>(document.data);
+    return std::vector<byte_t>(data, data + document.size);
+  }
+
+  // Reads documents until the ring closes, and returns how many of
+  // them were the ones expected, in order.
+  int read_all(shm_ring_reader& reader) {
+    for (int i = 0;; ++i) {
+      document_cdata const document = reader.next();
+      if (!document.data || bytes(document) != expected_document(i))
+        return i;
+    }
+  }
+
+  TEST(ShmRing, ReadersSeeEveryDocument) {
+    shm_ring_writer writer;
+    ASSERT_TRUE(writer.ok());
+    shm_ring_reader first(writer.fd());
+    shm_ring_reader second(writer.fd());
+    ASSERT_TRUE(first.ok());
+    ASSERT_TRUE(second.ok());
+
+    EXPECT_EQ(nullptr, first.try_next().data);
+    for (int i = 0; i != 10; ++i)
+      ASSERT_TRUE(encode(writer, i, document_size(i)));
+
+    for (int i = 0; i != 10; ++i) {
+      EXPECT_EQ(expected_document(i), bytes(first.try_next()));
+      EXPECT_EQ(expected_document(i), bytes(second.next()));
+    }
+    EXPECT_EQ(nullptr, first.try_next().data);
+
+    writer.close();
+    EXPECT_EQ(nullptr, second.next().data);
+    EXPECT_TRUE(second.ok());
+    EXPECT_FALSE(writer.reserve(1));
+    EXPECT_EQ(EPIPE, writer.error());
+  }
+
+  TEST(ShmRing, ReaderStartsAtWhatIsPublishedNext) {
+    shm_ring_writer writer;
+    ASSERT_TRUE(encode(writer, 0, document_size(0)));
+    shm_ring_reader reader(writer.fd());
+    ASSERT_TRUE(encode(writer, 1, document_size(1)));
+    EXPECT_EQ(expected_document(1), bytes(reader.next()));
+  }
+
+  TEST(ShmRing, ProducerWaitsForTheSlowestReader) {
+    shm_ring_options options;
+    options.capacity = 16 << 10;
+    shm_ring_writer writer(options);
+    shm_ring_reader reader(writer.fd());
+
+    int const count = 2000;
+    std::thread producer([&]() {
+      for (int i = 0; i != count; ++i) {
+        if (!encode(writer, i, document_size(i)))
+          break;
+      }
+      writer.close();
+    });
+
+    EXPECT_EQ(count, read_all(reader));
+    producer.join();
+    EXPECT_TRUE(writer.ok());
+    EXPECT_GT(writer.published(), 100 * options.capacity);
+  }
+
+  TEST(ShmRing, ReaderInAnotherProcess) {
+    shm_ring_options options;
+    options.capacity = 16 << 10;
+    shm_ring_writer writer(options);
+
+    // The child attaches before the parent writes, and tells it so.
+    int ready[2];
+    ASSERT_EQ(0, ::pipe(ready));
+    int const count = 1000;
+    pid_t const child = ::fork();
+    ASSERT_NE(-1, child);
+    if (child == 0) {
+      shm_ring_reader reader(writer.fd());
+      char const byte = 0;
+      if (::write(ready[1], &byte, 1) != 1)
+        ::_exit(2);
+      ::_exit(reader.ok() && read_all(reader) == count ? 0 : 1);
+    }
+
+    char byte;
+    ASSERT_EQ(1, ::read(ready[0], &byte, 1));
+    for (int i = 0; i != count; ++i)
+      ASSERT_TRUE(encode(writer, i, document_size(i)));
+    writer.close();
+
+    int status;
+    ASSERT_EQ(child, ::waitpid(child, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    ::close(ready[0]);
+    ::close(ready[1]);
+  }
+
+  TEST(ShmRing, ProducerDropsAReaderThatDied) {
+    shm_ring_options options;
+    options.capacity = 16 << 10;
+    shm_ring_writer writer(options);
+
+    pid_t const child = ::fork();
+    ASSERT_NE(-1, child);
+    if (child == 0) {
+      shm_ring_reader reader(writer.fd());
+      ::_exit(reader.ok() ? 0 : 1);
+    }
+    int status;
+    ASSERT_EQ(child, ::waitpid(child, &status, 0));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    // The child never detached; without dropping it, this would wait
+    // forever.
+    for (int i = 0; i != 100; ++i)
+      ASSERT_TRUE(encode(writer, i, document_size(i)));
+  }
+
+  TEST(ShmRing, ReaderTakesOverTheSlotOfOneThatDied) {
+    shm_ring_options options;
+    options.capacity = 16 << 10;
+    shm_ring_writer writer(options);
+
+    // Every slot goes to a reader that never detaches.
+    pid_t const child = ::fork();
+    ASSERT_NE(-1, child);
+    if (child == 0) {
+      std::vector<std::unique_ptr<shm_ring_reader>> readers;
+      for (std::size_t i = 0; i != k_max_shm_ring_readers; ++i) {
+        readers.emplace_back(new shm_ring_reader(writer.fd()));
+        if (!readers.back()->ok())
+          ::_exit(1);
+      }
+      shm_ring_reader extra(writer.fd());
+      ::_exit(extra.error() == EBUSY ? 0 : 2);
+    }
+    int status;
+    ASSERT_EQ(child, ::waitpid(child, &status, 0));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    // The producer never waited on them, so only the new reader can
+    // tell that they are gone.
+    {
+      shm_ring_reader reader(writer.fd());
+      ASSERT_TRUE(reader.ok()) << reader.error();
+      ASSERT_TRUE(encode(writer, 0, document_size(0)));
+      EXPECT_EQ(expected_document(0), bytes(reader.next()));
+    }
+
+    // The producer drops the rest once they hold it up.
+    for (int i = 1; i != 100; ++i)
+      ASSERT_TRUE(encode(writer, i, document_size(i)));
+  }
+
+  TEST(ShmRing, ReaderOpensANamedRing) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "/bassoon-test-%d", static_cast<int>(::getpid()));
+    shm_ring_options options;
+    options.name = name;
+
+    shm_ring_writer writer(options);
+    ASSERT_TRUE(writer.ok());
+    shm_ring_reader reader(name);
+    ASSERT_TRUE(reader.ok());
+    ASSERT_TRUE(encode(writer, 0, document_size(0)));
+    EXPECT_EQ(expected_document(0), bytes(reader.next()));
+  }
+
+  TEST(ShmRing, FailsADocumentLargerThanTheRing) {
+    shm_ring_options options;
+    options.capacity = 4096;
+    shm_ring_writer writer(options);
+    shm_ring_reader reader(writer.fd());
+
+    ASSERT_TRUE(encode(writer, 0, document_size(0)));
+    EXPECT_FALSE(encode(writer, 1, 6000));
+    EXPECT_EQ(EMSGSIZE, writer.error());
+
+    // The reader sees the first document, and none of the second.
+    EXPECT_EQ(expected_document(0), bytes(reader.next()));
+    EXPECT_EQ(nullptr, reader.try_next().data);
+  }
+
+  TEST(ShmRing, ReportsAttachFailures) {
+    shm_ring_reader missing("/bassoon-test-missing");
+    EXPECT_EQ(ENOENT, missing.error());
+    EXPECT_EQ(nullptr, missing.next().data);
+
+    // Not a ring.
+    int pipe_ends[2];
+    ASSERT_EQ(0, ::pipe(pipe_ends));
+    shm_ring_reader not_a_ring(pipe_ends[0]);
+    EXPECT_EQ(EINVAL, not_a_ring.error());
+    ::close(pipe_ends[0]);
+    ::close(pipe_ends[1]);
+  }
+
+} // namespace
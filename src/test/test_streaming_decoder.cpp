@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/streaming_decoder.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  // Records every event as a line of text so that runs can be compared.
+  struct recording_handler : null_decoder_handler {
+
+    handler_result record(std::string const& event, cstring_cdata name) {
+      events.push_back(event + " " + name.data);
+      return handler_result::proceed;
+    }
+
+    template<typename T>
+    handler_result record(std::string const& event, cstring_cdata name, T const& value) {
+      std::ostringstream stream;
+      stream << event << " " << name.data << " " << value;
+      events.push_back(stream.str());
+      return handler_result::proceed;
+    }
+
+    handler_result on_start_document() {
+      events.push_back("start");
+      return handler_result::proceed;
+    }
+
+    handler_result on_start_subdocument(cstring_cdata name) {
+      return record("subdocument", name);
+    }
+
+    handler_result on_start_subarray(cstring_cdata name) {
+      return record("subarray", name);
+    }
+
+    handler_result on_finish() {
+      events.push_back("finish");
+      return handler_result::proceed;
+    }
+
+    handler_result on_floating_point(cstring_cdata name, double_t value) {
+      return record("double", name, value);
+    }
+
+    handler_result on_utf8_string(cstring_cdata name, string_cdata value) {
+      return record("string", name, value.data);
+    }
+
+    handler_result on_binary(cstring_cdata name, binary_subtypes subtype, binary_cdata data) {
+      return record("binary", name, std::string(static_cast<char const*>(data.data), data.size));
+    }
+
+    handler_result on_object_id(cstring_cdata name, object_id_cdata id) {
+      return record("oid", name, std::string(reinterpret_cast<char const*>(id.data), id.size));
+    }
+
+    handler_result on_boolean(cstring_cdata name, bool value) {
+      return record("bool", name, value);
+    }
+
+    handler_result on_utc_datetime(cstring_cdata name, std::int64_t value) {
+      return record("datetime", name, value);
+    }
+
+    handler_result on_null(cstring_cdata name) {
+      return record("null", name);
+    }
+
+    handler_result on_regex(cstring_cdata name, cstring_cdata regex, cstring_cdata options) {
+      return record("regex", name, std::string(regex.data) + "/" + options.data);
+    }
+
+    handler_result on_javascript(cstring_cdata name, string_cdata code) {
+      return record("javascript", name, code.data);
+    }
+
+    handler_result on_symbol(cstring_cdata name, string_cdata symbol) {
+      return record("symbol", name, symbol.data);
+    }
+
+    handler_result on_int32(cstring_cdata name, std::int32_t value) {
+      return record("int32", name, value);
+    }
+
+    handler_result on_timestamp(cstring_cdata name, std::int64_t value) {
+      return record("timestamp", name, value);
+    }
+
+    handler_result on_int64(cstring_cdata name, std::int64_t value) {
+      return record("int64", name, value);
+    }
+
+    handler_result on_min_key(cstring_cdata name) {
+      return record("min", name);
+    }
+
+    handler_result on_max_key(cstring_cdata name) {
+      return record("max", name);
+    }
+
+    std::vector<std::string> events;
+  };
+
+  class StreamingDecoderTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() override {
+      const byte_t oid[k_object_id_length] = { 'o', 'b', 'j', 'e', 'c', 't', '-', 'i', 'd', '-', '1', '2' };
+      const char payload[] = { 'b', 'i', 'n' };
+
+      auto writer = make_array_writer(buffer_);
+      auto document = start_document(writer);
+      document.encode_floating_point("pi", 3.25);
+      document.encode_utf8_string("a string with some length", "and a value that is longer still");
+      auto nested = document.start_subdocument("nested");
+      nested.encode_int32("i", 42);
+      nested.encode_null("nothing");
+      auto array = nested.start_subarray("array");
+      array.encode_int64("0", 1LL << 40);
+      array.encode_boolean("1", true);
+      array.finish();
+      nested.finish();
+      document.encode_binary("bin", binary_subtypes::generic, binary_cdata(payload, sizeof(payload)));
+      document.encode_object_id("_id", object_id_cdata(&oid[0]));
+      document.encode_utc_datetime("when", 1234567890123LL);
+      document.encode_regex("re", "^ab+c$", "im");
+      document.encode_javascript("js", "function() {}");
+      document.encode_symbol("sym", "symbol");
+      document.encode_timestamp("ts", 77);
+      document.encode_min_key("lo");
+      document.encode_max_key("hi");
+      document.finish();
+      ASSERT_TRUE(document.ok());
+      size_ = writer.valid();
+
+      streaming_decoder<recording_handler> decoder(expected_);
+      EXPECT_EQ(size_, decoder.feed(buffer_.data(), size_));
+      EXPECT_TRUE(decoder.ok());
+      EXPECT_TRUE(decoder.idle());
+    }
+
+    std::array<byte_t, 512> buffer_;
+    std::size_t size_;
+    recording_handler expected_;
+  };
+
+  TEST_F(StreamingDecoderTest, DeliversEventsInDocumentOrder) {
+    const std::vector<std::string> expected = {
+      "start",
+      "double pi 3.25",
+      "string a string with some length and a value that is longer still",
+      "subdocument nested",
+      "int32 i 42",
+      "null nothing",
+      "subarray array",
+      "int64 0 1099511627776",
+      "bool 1 1",
+      "finish",
+      "finish",
+      "binary bin bin",
+      "oid _id object-id-12",
+      "datetime when 1234567890123",
+      "regex re ^ab+c$/im",
+      "javascript js function() {}",
+      "symbol sym symbol",
+      "timestamp ts 77",
+      "min lo",
+      "max hi",
+      "finish",
+    };
+    EXPECT_EQ(expected, expected_.events);
+  }
+
+  // Feeding the document in chunks of any fixed size yields the same events.
+  TEST_F(StreamingDecoderTest, FixedChunkSizes) {
+    for (std::size_t chunk = 1; chunk <= size_; ++chunk) {
+      recording_handler handler;
+      streaming_decoder<recording_handler> decoder(handler);
+      for (std::size_t offset = 0; offset < size_; offset += chunk) {
+        std::size_t const count = std::min(chunk, size_ - offset);
+        EXPECT_EQ(count, decoder.feed(&buffer_[offset], count));
+      }
+      EXPECT_TRUE(decoder.ok());
+      EXPECT_TRUE(decoder.idle());
+      EXPECT_EQ(expected_.events, handler.events) << "chunk size " << chunk;
+    }
+  }
+
+  // Split the document in two at every offset, scribbling over the first
+  // chunk before feeding the second, to check that the decoder never
+  // refers back to memory from an earlier chunk.
+  TEST_F(StreamingDecoderTest, EverySplitPoint) {
+    for (std::size_t split = 0; split <= size_; ++split) {
+      recording_handler handler;
+      streaming_decoder<recording_handler> decoder(handler);
+
+      std::vector<byte_t> first(buffer_.begin(), buffer_.begin() + split);
+      EXPECT_EQ(split, decoder.feed(first.data(), first.size()));
+      std::fill(first.begin(), first.end(), 0xcd);
+
+      std::vector<byte_t> second(buffer_.begin() + split, buffer_.begin() + size_);
+      EXPECT_EQ(second.size(), decoder.feed(second.data(), second.size()));
+
+      EXPECT_TRUE(decoder.ok());
+      EXPECT_EQ(expected_.events, handler.events) << "split at " << split;
+    }
+  }
+
+  TEST_F(StreamingDecoderTest, BackToBackDocuments) {
+    std::vector<byte_t> stream;
+    for (int i = 0; i != 3; ++i)
+      stream.insert(stream.end(), buffer_.begin(), buffer_.begin() + size_);
+
+    recording_handler handler;
+    streaming_decoder<recording_handler> decoder(handler);
+    for (std::size_t offset = 0; offset < stream.size(); offset += 7)
+      decoder.feed(&stream[offset], std::min<std::size_t>(7, stream.size() - offset));
+
+    EXPECT_TRUE(decoder.ok());
+    EXPECT_TRUE(decoder.idle());
+    EXPECT_EQ(3 * expected_.events.size(), handler.events.size());
+  }
+
+  TEST_F(StreamingDecoderTest, HandlerCanStop) {
+    struct stopping_handler : null_decoder_handler {
+      handler_result on_int32(cstring_cdata name, std::int32_t value) {
+        return handler_result::stop;
+      }
+      handler_result on_null(cstring_cdata name) {
+        ADD_FAILURE() << "event delivered after stop";
+        return handler_result::proceed;
+      }
+    } handler;
+
+    streaming_decoder<stopping_handler> decoder(handler);
+    EXPECT_GT(size_, decoder.feed(buffer_.data(), size_));
+    EXPECT_EQ(streaming_decoder_status::stopped, decoder.status());
+
+    decoder.reset();
+    EXPECT_TRUE(decoder.ok());
+    EXPECT_TRUE(decoder.idle());
+  }
+
+  TEST_F(StreamingDecoderTest, RejectsMalformedInput) {
+    // An element that overruns its enclosing document.
+    buffer_[0] = 12;
+    null_decoder_handler handler;
+    streaming_decoder<null_decoder_handler> decoder(handler);
+    decoder.feed(buffer_.data(), size_);
+    EXPECT_EQ(streaming_decoder_status::invalid, decoder.status());
+
+    // A length prefix too short to hold a document.
+    const byte_t too_short[] = { 0x04, 0x00, 0x00, 0x00 };
+    decoder.reset();
+    decoder.feed(too_short, sizeof(too_short));
+    EXPECT_EQ(streaming_decoder_status::invalid, decoder.status());
+
+    // An unknown element type.
+    const byte_t unknown_type[] = { 0x08, 0x00, 0x00, 0x00, 0x42, 'x', 0x00, 0x00 };
+    decoder.reset();
+    decoder.feed(unknown_type, sizeof(unknown_type));
+    EXPECT_EQ(streaming_decoder_status::invalid, decoder.status());
+  }
+
+} // namespace
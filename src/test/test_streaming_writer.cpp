@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/mapped_file.hpp>
+#include <bassoon/streaming_writer.hpp>
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  using buffer_type = std::array<byte_t, 8192>;
+
+  class StreamingWriter : public ::testing::Test {
+  protected:
+    void SetUp() override {
+      char path[] = "/tmp/bassoon-test-XXXXXX";
+      fd_ = ::mkstemp(path);
+      ASSERT_NE(-1, fd_);
+      path_ = path;
+    }
+
+    void TearDown() override {
+      ::close(fd_);
+      ::unlink(path_.c_str());
+    }
+
+    std::size_t file_size() const {
+      struct stat status;
+      return ::fstat(fd_, &status) == 0 ? status.st_size : 0;
+    }
+
+    std::vector<byte_t> contents() const {
+      mapped_file file(path_.c_str());
+      if (!file.ok())
+        return std::vector<byte_t>();
+      byte_t const* const data = static_cast<byte_t const*>(file.data());
+      return std::vector<byte_t>(data, data + file.size());
+    }
+
+    int fd_;
+    std::string path_;
+  };
+
+  // A document of about 'size' bytes, with its length backpatched
+  // around a nested subdocument.
+  template<typename Writer_type>
+  bool encode(Writer_type& writer, int i, std::size_t size) {
+    auto document = start_document(writer);
+    document.encode_int32("i", i);
+    auto&& nested = document.start_subdocument("nested");
+    nested.encode_utf8_string("padding", std::string(size, 'a' + i % 26));
+    nested.finish();
+    document.finish();
+    return document.ok();
+  }
+
+  std::size_t document_size(int i) {
+    return 100 + (i * 37) % 3000;
+  }
+
+  std::vector<byte_t> expected_documents(int count) {
+    std::vector<byte_t> result;
+    for (int i = 0; i != count; ++i) {
+      buffer_type buffer;
+      auto writer = make_array_writer(buffer);
+      encode(writer, i, document_size(i));
+      result.insert(result.end(), buffer.begin(), buffer.begin() + writer.valid());
+    }
+    return result;
+  }
+
+  TEST_F(StreamingWriter, StreamsManyTimesItsCapacity) {
+    streaming_writer_options options;
+    options.capacity = 16 << 10;
+    options.flush_bytes = 4 << 10;
+
+    std::vector<byte_t> const expected = expected_documents(500);
+    ASSERT_GT(expected.size(), 32 * options.capacity);
+
+    {
+      streaming_writer writer(fd_, options);
+      ASSERT_TRUE(writer.ok());
+      for (int i = 0; i != 500; ++i)
+        ASSERT_TRUE(encode(writer, i, document_size(i)));
+      EXPECT_TRUE(writer.flush());
+      EXPECT_EQ(expected.size(), writer.written());
+    }
+
+    EXPECT_EQ(expected, contents());
+  }
+
+  TEST_F(StreamingWriter, WritesOutEachDocumentWhenFlushBytesIsZero) {
+    streaming_writer_options options;
+    options.capacity = 16 << 10;
+    options.flush_bytes = 0;
+
+    streaming_writer writer(fd_, options);
+    std::size_t previous = 0;
+    for (int i = 0; i != 20; ++i) {
+      ASSERT_TRUE(encode(writer, i, document_size(i)));
+      EXPECT_LT(previous, file_size());
+      EXPECT_EQ(writer.written(), file_size());
+      previous = file_size();
+    }
+  }
+
+  TEST_F(StreamingWriter, DestructorWritesOutFinishedDocuments) {
+    {
+      streaming_writer writer(fd_);
+      for (int i = 0; i != 10; ++i)
+        ASSERT_TRUE(encode(writer, i, document_size(i)));
+      EXPECT_EQ(0u, file_size());
+    }
+    EXPECT_EQ(expected_documents(10), contents());
+  }
+
+  TEST_F(StreamingWriter, FailsADocumentLargerThanTheRing) {
+    streaming_writer_options options;
+    options.capacity = 4096;
+
+    {
+      streaming_writer writer(fd_, options);
+      ASSERT_TRUE(encode(writer, 0, document_size(0)));
+      EXPECT_FALSE(encode(writer, 1, 6000));
+      EXPECT_FALSE(writer.ok());
+      EXPECT_EQ(EMSGSIZE, writer.error());
+
+      // Once failed, it stays failed, even with room to spare.
+      EXPECT_FALSE(writer.reserve(1));
+    }
+
+    // The document before it is still written out, and none of the
+    // one that failed.
+    EXPECT_EQ(expected_documents(1), contents());
+  }
+
+  TEST_F(StreamingWriter, ReportsWriteFailures) {
+    int const read_only = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_NE(-1, read_only);
+
+    streaming_writer_options options;
+    options.flush_bytes = 0;
+    {
+      streaming_writer writer(read_only, options);
+      EXPECT_FALSE(encode(writer, 0, document_size(0)));
+      EXPECT_EQ(EBADF, writer.error());
+      EXPECT_FALSE(writer.flush());
+    }
+    ::close(read_only);
+  }
+
+} // namespace
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <bassoon/array_writer.hpp>
+#include <bassoon/encoder.hpp>
+#include <bassoon/struct_decoder.hpp>
+
+namespace {
+
+  struct location {
+    double lat;
+    double lon;
+  };
+
+  struct reading {
+    std::int64_t ts;
+    double value;
+    std::string host;
+    bool up;
+    std::int32_t count;
+    std::vector<std::int32_t> samples;
+    location where;
+  };
+
+  // Names that share a size, and a first byte, and names that the
+  // decoder does not switch on: the empty one and long ones.
+  struct names {
+    std::int32_t ab;
+    std::int32_t ac;
+    std::int32_t bc;
+    std::int32_t empty;
+    std::int32_t long_name;
+    std::int32_t longer_name;
+  };
+
+} // namespace
+
+namespace bassoon {
+  namespace bson {
+
+    template<>
+    struct struct_schema<location> {
+      BASSOON_STRUCT_FIELD(location, lat);
+      BASSOON_STRUCT_FIELD(location, lon);
+      using fields = field_list<lat_field, lon_field>;
+    };
+
+    template<>
+    struct struct_schema<reading> {
+      BASSOON_STRUCT_FIELD(reading, ts);
+      BASSOON_STRUCT_FIELD(reading, value);
+      BASSOON_STRUCT_FIELD(reading, host);
+      BASSOON_STRUCT_FIELD(reading, up);
+      BASSOON_STRUCT_FIELD_NAMED(reading, count, "n");
+      BASSOON_STRUCT_FIELD(reading, samples);
+      BASSOON_STRUCT_FIELD(reading, where);
+      using fields = field_list<ts_field, value_field, host_field, up_field,
+                                count_field, samples_field, where_field>;
+    };
+
+    template<>
+    struct struct_schema<names> {
+      BASSOON_STRUCT_FIELD(names, ab);
+      BASSOON_STRUCT_FIELD(names, ac);
+      BASSOON_STRUCT_FIELD(names, bc);
+      BASSOON_STRUCT_FIELD_NAMED(names, empty, "");
+      BASSOON_STRUCT_FIELD_NAMED(names, long_name, "a_name_well_over_thirty_two_bytes_long");
+      BASSOON_STRUCT_FIELD_NAMED(names, longer_name, "a_name_well_over_thirty_two_bytes_longer");
+      using fields = field_list<ab_field, ac_field, bc_field, empty_field, long_name_field, longer_name_field>;
+    };
+
+  } // namespace bson
+} // namespace bassoon
+
+namespace {
+
+  using namespace bassoon::bson;
+
+  class StructDecoderTest : public ::testing::Test {
+  protected:
+    reading decoded() {
+      reading result = reading();
+      result_ = decode_struct(buffer_.data(), result);
+      return result;
+    }
+
+    std::array<byte_t, 512> buffer_;
+    struct_decode_result result_;
+  };
+
+  TEST_F(StructDecoderTest, DecodesAllFields) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_utc_datetime("ts", 1400000000000LL);
+    document.encode_floating_point("value", 42.5);
+    document.encode_utf8_string("host", "alpha");
+    document.encode_boolean("up", true);
+    document.encode_int32("n", 7);
+    auto samples = document.start_subarray("samples");
+    samples.encode_int32("0", 3);
+    samples.encode_int32("1", 1);
+    samples.encode_int32("2", 4);
+    samples.finish();
+    auto where = document.start_subdocument("where");
+    where.encode_floating_point("lat", 52.5);
+    where.encode_floating_point("lon", 13.25);
+    where.finish();
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    reading const r = decoded();
+    EXPECT_TRUE(result_.ok());
+    EXPECT_EQ(0x7fU, result_.decoded);
+    EXPECT_EQ(0U, result_.unknown);
+
+    EXPECT_EQ(1400000000000LL, r.ts);
+    EXPECT_EQ(42.5, r.value);
+    EXPECT_EQ("alpha", r.host);
+    EXPECT_TRUE(r.up);
+    EXPECT_EQ(7, r.count);
+    EXPECT_EQ((std::vector<std::int32_t>{ 3, 1, 4 }), r.samples);
+    EXPECT_EQ(52.5, r.where.lat);
+    EXPECT_EQ(13.25, r.where.lon);
+  }
+
+  TEST_F(StructDecoderTest, SkipsUnknownFields) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_utf8_string("comment", "ignore me");
+    auto extra = document.start_subdocument("extra");
+    extra.encode_int32("ts", 99);
+    extra.finish();
+    document.encode_int64("ts", 5);
+    // Same length as "ts", different bytes.
+    document.encode_int64("tz", 6);
+    // Names that share a prefix with a field.
+    document.encode_int32("upx", 1);
+    document.encode_int32("u", 1);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    reading const r = decoded();
+    EXPECT_TRUE(result_.ok());
+    EXPECT_EQ(0x1U, result_.decoded);
+    EXPECT_EQ(5U, result_.unknown);
+    EXPECT_EQ(5, r.ts);
+  }
+
+  TEST_F(StructDecoderTest, WidensNumbers) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_int32("ts", 12);
+    document.encode_int64("value", 1LL << 40);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    reading const r = decoded();
+    EXPECT_TRUE(result_.ok());
+    EXPECT_EQ(12, r.ts);
+    EXPECT_EQ(static_cast<double>(1LL << 40), r.value);
+  }
+
+  TEST_F(StructDecoderTest, ReportsMismatches) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_utf8_string("ts", "yesterday");
+    document.encode_int64("n", 7);
+    document.encode_boolean("up", true);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    reading const r = decoded();
+    EXPECT_FALSE(result_.ok());
+    EXPECT_FALSE(result_.malformed);
+    EXPECT_EQ(0x1U | 0x10U, result_.mismatched);
+    EXPECT_EQ(0x8U, result_.decoded);
+    EXPECT_EQ(0, r.ts);
+    EXPECT_EQ(0, r.count);
+    EXPECT_TRUE(r.up);
+  }
+
+  TEST_F(StructDecoderTest, LeavesPartlyMismatchedFieldsAlone) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    auto samples = document.start_subarray("samples");
+    samples.encode_int32("0", 3);
+    samples.encode_utf8_string("1", "four");
+    samples.finish();
+    auto where = document.start_subdocument("where");
+    where.encode_floating_point("lat", 52.5);
+    where.encode_boolean("lon", true);
+    where.finish();
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    reading r = reading();
+    r.samples = { 1, 2 };
+    r.where.lat = 1.5;
+    r.where.lon = 2.5;
+    result_ = decode_struct(buffer_.data(), r);
+    EXPECT_EQ(0x20U | 0x40U, result_.mismatched);
+    EXPECT_EQ((std::vector<std::int32_t>{ 1, 2 }), r.samples);
+    EXPECT_EQ(1.5, r.where.lat);
+    EXPECT_EQ(2.5, r.where.lon);
+  }
+
+  TEST_F(StructDecoderTest, FirstOccurrenceWins) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_int32("n", 1);
+    document.encode_int32("n", 2);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    EXPECT_EQ(1, decoded().count);
+    EXPECT_TRUE(result_.ok());
+  }
+
+  TEST_F(StructDecoderTest, StopsAtMalformedElement) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_int32("n", 3);
+    document.encode_utf8_string("host", "alpha");
+    document.encode_boolean("up", true);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    // Make the string length of 'host' overrun the document.
+    buffer_[4 + 7 + 6] = 0x7f;
+
+    reading const r = decoded();
+    EXPECT_TRUE(result_.malformed);
+    EXPECT_FALSE(result_.ok());
+    EXPECT_EQ(3, r.count);
+    EXPECT_FALSE(r.up);
+  }
+
+  TEST_F(StructDecoderTest, MatchesNamesOfEverySize) {
+    auto writer = make_array_writer(buffer_);
+    auto document = start_document(writer);
+    document.encode_int32("a_name_well_over_thirty_two_bytes_longer", 6);
+    document.encode_int32("ac", 2);
+    document.encode_int32("", 4);
+    document.encode_int32("bc", 3);
+    document.encode_int32("ab", 1);
+    document.encode_int32("a_name_well_over_thirty_two_bytes_long", 5);
+    document.encode_int32("ad", 0);
+    document.encode_int32("a_name_well_over_thirty_two_bytes_lon", 0);
+    document.finish();
+    ASSERT_TRUE(document.ok());
+
+    names result = names();
+    struct_decode_result const decoded = decode_struct(buffer_.data(), result);
+    EXPECT_TRUE(decoded.ok());
+    EXPECT_EQ(0x3fu, decoded.decoded);
+    EXPECT_EQ(2u, decoded.unknown);
+    EXPECT_EQ(1, result.ab);
+    EXPECT_EQ(2, result.ac);
+    EXPECT_EQ(3, result.bc);
+    EXPECT_EQ(4, result.empty);
+    EXPECT_EQ(5, result.long_name);
+    EXPECT_EQ(6, result.longer_name);
+  }
+
+} // namespace